@@ -0,0 +1,164 @@
+// Scene-Cooker: bakes the models, materials and textures a scene description lists into one scene pack, and its
+// instances into a placement file. The renderer maps both at startup instead of parsing sources.
+//
+// Usage: Scene-Cooker [scene description] [output pack] [output placements]
+// Defaults to assets/forest.scene, assets/forest.pack and assets/forest.placements. Textures go through the same
+// cache as the runtime, so only the ones that changed are cooked again.
+
+#include "obj_loader.hpp"
+#include "scene_description.hpp"
+#include "scene_pack.hpp"
+#include "scene_placement.hpp"
+#include "texture_cooker.hpp"
+#include "thread_pool.hpp"
+#include "vertex.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	bool cookScene(const std::string& scenePath, const std::string& packPath, const std::string& placementPath)
+	{
+		const auto start{ std::chrono::steady_clock::now() };
+
+		SceneDescription scene{};
+		if (!readSceneDescription(scenePath, scene))
+		{
+			return false;
+		}
+
+		ScenePackContents contents{};
+
+		// Each texture is cooked once however many meshes use it, in the order first seen
+		std::vector<SceneDescription::Texture> textures{};
+		std::unordered_map<std::string, std::uint32_t> textureIndices{};
+		const auto findTexture{ [&](const std::string& path, TextureUsage usage)
+		{
+			const auto [entry, added] { textureIndices.emplace(path, static_cast<std::uint32_t>(textures.size())) };
+			if (added)
+			{
+				textures.push_back({ path, usage });
+			}
+			return entry->second;
+		} };
+
+		for (const std::string& model : scene.objects)
+		{
+			if (!std::filesystem::exists(model))
+			{
+				std::cerr << "missing model: " << model << '\n';
+				return false;
+			}
+
+			PackObject object
+			{
+				.path{ contents.addString(model) },
+				.firstMesh{ static_cast<std::uint32_t>(contents.meshes.size()) },
+				.firstVertex{ static_cast<std::uint32_t>(contents.vertices.size()) },
+			};
+
+			// Indices come back pointing into the whole vertex list, which is the pack's vertex section
+			const std::filesystem::path directory{ std::filesystem::path{ model }.parent_path() };
+			for (ObjMesh& mesh : loadObj(model.c_str(), contents.vertices))
+			{
+				contents.meshes.push_back(
+				{
+					.material{ mesh.material },
+					.texture{ mesh.diffusePath.empty() ? noPackTexture : findTexture((directory / mesh.diffusePath).generic_string(), TextureUsage::Auto) },
+					.firstIndex{ static_cast<std::uint32_t>(contents.indices.size()) },
+					.indexCount{ static_cast<std::uint32_t>(mesh.indices.size()) },
+					.diffusePath{ contents.addString(mesh.diffusePath) },
+				});
+				contents.indices.insert(contents.indices.end(), mesh.indices.begin(), mesh.indices.end());
+			}
+
+			object.meshCount = static_cast<std::uint32_t>(contents.meshes.size()) - object.firstMesh;
+			object.vertexCount = static_cast<std::uint32_t>(contents.vertices.size()) - object.firstVertex;
+			contents.objects.push_back(object);
+		}
+
+		for (const SceneDescription::Texture& texture : scene.textures)
+		{
+			findTexture(texture.path, texture.usage);
+		}
+
+		// The pack is for desktop GPUs, which all have BC support
+		std::vector<CookedImage> cooked(textures.size());
+		{
+			ThreadPool pool{};
+			for (std::size_t i{ 0 }; i < textures.size(); ++i)
+			{
+				pool.submit([&cooked, &textures, i]
+				{
+					cooked[i] = loadCookedImage(textures[i].path, TextureCookSettings{ .usage{ textures[i].usage } });
+				});
+			}
+		}
+
+		for (std::size_t i{ 0 }; i < textures.size(); ++i)
+		{
+			if (cooked[i].empty())
+			{
+				std::cerr << "failed to cook texture: " << textures[i].path << '\n';
+				return false;
+			}
+			contents.addTexture(textures[i].path, cooked[i]);
+		}
+
+		if (!writeScenePack(packPath, contents))
+		{
+			std::cerr << "failed to write scene pack: " << packPath << '\n';
+			return false;
+		}
+
+		std::vector<PlacementSource> placements{};
+		placements.reserve(scene.instances.size());
+		for (const SceneDescription::Instance& instance : scene.instances)
+		{
+			placements.push_back(
+			{
+				.object{ instance.object },
+				.isStatic{ instance.isStatic },
+				.position{ instance.position },
+				.rotation{ instance.orientation() },
+				.scale{ instance.scale },
+			});
+		}
+		if (!writePlacementFile(placementPath, scene.objects, scene.skybox, scene.cellSize, placements))
+		{
+			std::cerr << "failed to write placement file: " << placementPath << '\n';
+			return false;
+		}
+
+		const double seconds{ std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count() };
+		std::cout << "Scene pack " << packPath << " (version " << scenePackVersion << ")\n"
+			<< "  objects:   " << contents.objects.size() << ", " << contents.meshes.size() << " meshes\n"
+			<< "  vertices:  " << contents.vertices.size() << ", indices: " << contents.indices.size() << '\n'
+			<< "  textures:  " << contents.textures.size() << ", " << contents.textureData.size() / (1024.0 * 1024.0) << " MiB\n"
+			<< "  size:      " << std::filesystem::file_size(packPath) / (1024.0 * 1024.0) << " MiB\n"
+			<< "Placement file " << placementPath << " (version " << placementFileVersion << ")\n"
+			<< "  instances: " << placements.size() << ", " << std::filesystem::file_size(placementPath) / 1024.0 << " KiB\n"
+			<< "Cooked in " << seconds << " s\n";
+
+		return true;
+	}
+
+}
+
+int main(int argc, char** argv)
+{
+	const std::string scenePath{ argc > 1 ? argv[1] : "assets/forest.scene" };
+	const std::string packPath{ argc > 2 ? argv[2] : "assets/forest.pack" };
+	const std::string placementPath{ argc > 3 ? argv[3] : "assets/forest.placements" };
+
+	return Graphics::cookScene(scenePath, packPath, placementPath) ? 0 : 1;
+}
\ No newline at end of file
@@ -4,8 +4,9 @@ layout (location = 0) in vec3 inPos;
 
 layout (push_constant) uniform constants
 {
-	mat4 model;
-	uint texIndex;
+	mat4 transform;
+	uint textureIndex;
+	uint instanceSource;
 } pushConstants;
 
 layout (set = 0, binding = 0) uniform CameraBuffer
@@ -14,7 +15,18 @@ layout (set = 0, binding = 0) uniform CameraBuffer
 	mat4 light;
 } cameraData;
 
+layout (set = 0, binding = 1) readonly buffer InstanceBuffer
+{
+	mat4 transforms[];
+} instanceData;
+
+layout (set = 1, binding = 2) readonly buffer ScatterInstanceBuffer
+{
+	mat4 transforms[];
+} scatterData;
+
 void main()
 {
-	gl_Position = cameraData.light * pushConstants.model * vec4(inPos, 1.0f);
+	mat4 model = pushConstants.instanceSource == 0 ? instanceData.transforms[gl_InstanceIndex] : scatterData.transforms[gl_InstanceIndex];
+	gl_Position = cameraData.light * model * vec4(inPos, 1.0f);
 }
\ No newline at end of file
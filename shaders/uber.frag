@@ -2,10 +2,22 @@
 
 #extension GL_EXT_nonuniform_qualifier : require
 
+// Built a second time with HALF_PRECISION defined, as uber_half.frag.spv, for devices with shaderFloat16. Lighting,
+// shadow filtering and color math then run in 16 bits. Texture coordinates and depths stay 32 bit.
+#ifdef HALF_PRECISION
+#extension GL_EXT_shader_explicit_arithmetic_types_float16 : require
+#define hfloat float16_t
+#define hvec3 f16vec3
+#else
+#define hfloat float
+#define hvec3 vec3
+#endif
+
 layout (location = 0) in vec3 inNorm;
 layout (location = 1) in vec3 inColor;
 layout (location = 2) in vec2 inTex;
 layout (location = 3) in vec4 inLightPos;
+layout (location = 4) flat in uint inLayer;
 
 layout (location = 0) out vec4 outColor;
 
@@ -17,56 +29,159 @@ layout (push_constant) uniform constants
 
 layout (set = 1, binding = 1) uniform sampler2D textures[];
 
-float shadowCalc(vec4 pos)
+// Set per pipeline, so every branch on them is resolved when the pipeline is compiled. Must match MaterialClass,
+// TextureKind and uberFragmentConstants().
+const uint materialGeneric = 0;
+const uint materialUntextured = 1;
+const uint materialTexturedOpaque = 2;
+const uint materialAlphaTested = 3;
+
+// Any picks the kind from the texture index per draw
+const uint textureAny = 0;
+const uint textureRegular = 1;
+const uint textureVirtual = 2;
+const uint textureArray = 3;
+
+layout (constant_id = 0) const uint materialClass = materialGeneric;
+layout (constant_id = 1) const int pcfRadius = 1; // Of the square of shadow map texels averaged
+layout (constant_id = 2) const float alphaCutoff = 0.2f;
+layout (constant_id = 3) const uint shadowMapIndex = 1000;
+layout (constant_id = 4) const uint textureKind = textureAny;
+layout (constant_id = 5) const uint noTexture = 1001;
+
+// Virtual textures follow the regular texture indices. Must match VirtualTextureCache.
+const uint firstVirtualTexture = 1002;
+const float pageSize = 128.0f;
+const float pageBorder = 4.0f;
+const float cachePages = 16.0f;
+const uint maxPageRequests = 8192;
+
+layout (set = 1, binding = 3) uniform sampler2D pageCache;
+layout (set = 1, binding = 4) uniform usampler2D pageTables[16];
+
+// Small textures packed together, numbered after the virtual textures. The layer comes from the vertices,
+// so meshes with different textures in one array share a draw. Must match TexturePacker.
+const uint firstTextureArray = 1018;
+
+layout (set = 1, binding = 5) uniform sampler2DArray textureArrays[64];
+
+// Per texture slot, the finest level any reporting fragment wanted, relative to the largest resident
+// level and biased by 16. Read back by the texture streamer. Then the virtual texture pages sampled,
+// as texture << 28 | level << 24 | y << 12 | x, read back by the virtual texture cache.
+layout (set = 0, binding = 2) buffer FeedbackBuffer
+{
+	uint levels[1000];
+	uint pageRequestCount;
+	uint pageRequests[];
+} feedback;
+
+hfloat shadowCalc(vec4 pos)
 {
 	vec3 projCoords = pos.xyz / pos.w;
 
 	projCoords.xy = projCoords.xy * 0.5f + 0.5f;
 
-	float closestDepth = texture(textures[1000], projCoords.xy).r;
 	float currentDepth = projCoords.z;
 
 	const float bias = 0.005f;
 
-	float shadow = 0.0f;
-	vec2 texelSize = 1.0f / textureSize(textures[1000], 0);
-	for (int x = -1; x <= 1; ++x)
+	hfloat shadow = hfloat(0.0f);
+	vec2 texelSize = 1.0f / textureSize(textures[shadowMapIndex], 0);
+	for (int x = -pcfRadius; x <= pcfRadius; ++x)
 	{
-		for (int y = -1; y <= 1; ++y)
+		for (int y = -pcfRadius; y <= pcfRadius; ++y)
 		{
-			float pfcDepth = texture(textures[1000], projCoords.xy + vec2(x, y) * texelSize).r;
-			shadow += currentDepth - bias > pfcDepth ? 1.0f : 0.0f;
+			float pfcDepth = texture(textures[shadowMapIndex], projCoords.xy + vec2(x, y) * texelSize).r;
+			shadow += currentDepth - bias > pfcDepth ? hfloat(1.0f) : hfloat(0.0f);
 		}
 	}
-	shadow /= 9.0f;
+	shadow /= hfloat((2 * pcfRadius + 1) * (2 * pcfRadius + 1));
 
 	return shadow;
 }
 
+vec4 sampleVirtual(uint index, vec2 uv)
+{
+	int pages = textureSize(pageTables[index], 0).x;
+	int levels = textureQueryLevels(pageTables[index]);
+
+	// The level the hardware would pick for a texture of the full virtual size
+	vec2 texel = uv * float(pages) * pageSize;
+	vec2 dx = dFdx(texel);
+	vec2 dy = dFdy(texel);
+	float lod = 0.5f * log2(max(dot(dx, dx), dot(dy, dy)));
+	int level = clamp(int(floor(lod)), 0, levels - 1);
+
+	// Pages are cut with wrapping borders, so the texture repeats
+	vec2 wrapped = fract(uv);
+	ivec2 page = min(ivec2(wrapped * float(pages >> level)), ivec2((pages >> level) - 1));
+
+	// The entry points at the finest resident page covering this one, which may be coarser than wanted
+	uvec4 entry = texelFetch(pageTables[index], page, level);
+	vec2 inPage = fract(wrapped * float(pages >> entry.z));
+	vec2 physical = (vec2(entry.xy) * (pageSize + 2.0f * pageBorder) + pageBorder + inPage * pageSize)
+		/ (cachePages * (pageSize + 2.0f * pageBorder));
+	vec4 color = textureLod(pageCache, physical, 0.0f);
+
+	// Every request takes an atomic on one counter, so fewer fragments report than for regular textures
+	uvec2 pixel = uvec2(gl_FragCoord.xy);
+	if ((pixel.x & 15u) == 0u && (pixel.y & 15u) == 0u)
+	{
+		uint request = atomicAdd(feedback.pageRequestCount, 1u);
+		if (request < maxPageRequests)
+		{
+			feedback.pageRequests[request] = (index << 28) | (uint(level) << 24) | (uint(page.y) << 12) | uint(page.x);
+		}
+	}
+
+	return color;
+}
+
 void main()
 {
-	if (pushConstants.textureIndex == 1001)
+	bool anyTexture = textureKind == textureAny && materialClass != materialUntextured;
+	if (materialClass == materialUntextured || (anyTexture && pushConstants.textureIndex == noTexture))
 	{
 		// There is no texture
 		outColor = vec4(inColor, 1.0f);
 	}
+	else if (textureKind == textureArray || (anyTexture && pushConstants.textureIndex >= firstTextureArray))
+	{
+		outColor = texture(textureArrays[pushConstants.textureIndex - firstTextureArray], vec3(inTex, float(inLayer)));
+	}
+	else if (textureKind == textureVirtual || (anyTexture && pushConstants.textureIndex >= firstVirtualTexture))
+	{
+		outColor = sampleVirtual(pushConstants.textureIndex - firstVirtualTexture, inTex);
+	}
 	else
 	{
 		outColor = texture(textures[pushConstants.textureIndex], inTex);
+
+		// Queried outside the branch below, which would leave the derivatives undefined
+		float lod = textureQueryLod(textures[pushConstants.textureIndex], inTex).y;
+
+		// One fragment in 64 reports, which is plenty to find the finest level a texture needs
+		uvec2 pixel = uvec2(gl_FragCoord.xy);
+		if ((pixel.x & 7u) == 0u && (pixel.y & 7u) == 0u)
+		{
+			uint level = uint(clamp(floor(lod) + 16.0f, 0.0f, 31.0f));
+			atomicMin(feedback.levels[pushConstants.textureIndex], level);
+		}
 	}
 
-	if (outColor.a <= 0.2f)
+	// Only textures with transparent texels can cut out, the other variants are left without a discard
+	if ((materialClass == materialGeneric || materialClass == materialAlphaTested) && outColor.a <= alphaCutoff)
 	{
 		discard;
 	}
 
-	const float ambient = 0.1f;
+	const hfloat ambient = hfloat(0.1f);
 
-	const vec3 lightDir = normalize(vec3(2.0f, 1.0f, -3.0f));
-	float diffuse = max(dot(inNorm, lightDir), 0.0f);
-	vec3 diffuseColor = vec3(0.98f, 0.56f, 0.38f) * diffuse;
+	hvec3 lightDir = hvec3(normalize(vec3(2.0f, 1.0f, -3.0f)));
+	hfloat diffuse = max(dot(hvec3(inNorm), lightDir), hfloat(0.0f));
+	hvec3 diffuseColor = hvec3(0.98f, 0.56f, 0.38f) * diffuse;
 
-	float shadow = max(1.0 - shadowCalc(inLightPos), 0.4f);
+	hfloat shadow = max(hfloat(1.0f) - shadowCalc(inLightPos), hfloat(0.4f));
 
-	outColor = vec4(outColor.rgb * (ambient + diffuseColor) * shadow, outColor.a);
+	outColor = vec4(vec3(hvec3(outColor.rgb) * (ambient + diffuseColor) * shadow), outColor.a);
 }
\ No newline at end of file
@@ -4,16 +4,19 @@ layout (location = 0) in vec3 inPos;
 layout (location = 1) in vec3 inNorm;
 layout (location = 2) in vec3 inColor;
 layout (location = 3) in vec2 inTex;
+layout (location = 4) in uint inLayer;
 
 layout (location = 0) out vec3 outNorm;
 layout (location = 1) out vec3 outColor;
 layout (location = 2) out vec2 outTex;
 layout (location = 3) out vec4 fragPosLightSpace;
+layout (location = 4) flat out uint outLayer;
 
 layout (push_constant) uniform constants
 {
 	mat4 transform;
 	uint textureIndex;
+	uint instanceSource;
 } pushConstants;
 
 layout (set = 0, binding = 0) uniform CameraBuffer
@@ -22,15 +25,28 @@ layout (set = 0, binding = 0) uniform CameraBuffer
 	mat4 lightSpaceMatrix;
 } cameraData;
 
+layout (set = 0, binding = 1) readonly buffer InstanceBuffer
+{
+	mat4 transforms[];
+} instanceData;
+
+layout (set = 1, binding = 2) readonly buffer ScatterInstanceBuffer
+{
+	mat4 transforms[];
+} scatterData;
+
 void main()
 {
-	mat4 finalMatrix = cameraData.viewProj * pushConstants.transform;
+	mat4 model = pushConstants.instanceSource == 0 ? instanceData.transforms[gl_InstanceIndex] : scatterData.transforms[gl_InstanceIndex];
+
+	mat4 finalMatrix = cameraData.viewProj * model;
 	gl_Position = finalMatrix * vec4(inPos, 1.0f);
 
-	mat3 transform = inverse(transpose(mat3(pushConstants.transform)));
+	mat3 transform = inverse(transpose(mat3(model)));
 	outNorm = normalize(inNorm * transform);
 	outColor = inColor;
 	outTex = inTex;
+	outLayer = inLayer;
 
-	fragPosLightSpace = cameraData.lightSpaceMatrix * pushConstants.transform * vec4(inPos, 1.0f);
+	fragPosLightSpace = cameraData.lightSpaceMatrix * model * vec4(inPos, 1.0f);
 }
\ No newline at end of file
@@ -0,0 +1,116 @@
+#include "asset_loader.hpp"
+
+#include "task.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include <algorithm>
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	AssetLoader::AssetLoader(UploadManager& uploader, std::size_t threadCount)
+		: m_shared{ std::make_unique<Shared>() },
+		  m_pool{ std::make_unique<ThreadPool>(threadCount) },
+		  m_uploader{ &uploader }
+	{
+		m_shared->pool = m_pool.get();
+	}
+
+	AssetLoader::AssetLoader(AssetLoader&& a) noexcept
+	{
+		move(std::move(a));
+	}
+
+	AssetLoader& AssetLoader::operator=(AssetLoader&& a) noexcept
+	{
+		destroy();
+		move(std::move(a));
+		return *this;
+	}
+
+	AssetLoader::~AssetLoader()
+	{
+		destroy();
+	}
+
+	void AssetLoader::start(Task<> task)
+	{
+		task.handle().resume();
+		m_tasks.push_back(std::move(task));
+	}
+
+	void AssetLoader::poll()
+	{
+		if (!m_shared)
+		{
+			return;
+		}
+
+		std::deque<std::coroutine_handle<>> ready{};
+		{
+			std::lock_guard lock{ m_shared->mutex };
+			ready.swap(m_shared->mainThread);
+
+			auto& uploads{ m_shared->uploads };
+			for (auto upload{ uploads.begin() }; upload != uploads.end();)
+			{
+				if (m_uploader->isComplete(upload->first))
+				{
+					ready.push_back(upload->second);
+					upload = uploads.erase(upload);
+				}
+				else
+				{
+					++upload;
+				}
+			}
+		}
+
+		// Resumed without the lock, since they may queue themselves again
+		for (std::coroutine_handle<> handle : ready)
+		{
+			handle.resume();
+		}
+
+		for (auto task{ m_tasks.begin() }; task != m_tasks.end();)
+		{
+			if (task->done())
+			{
+				Task<> finished{ std::move(*task) };
+				task = m_tasks.erase(task);
+				finished.result();
+			}
+			else
+			{
+				++task;
+			}
+		}
+	}
+
+	void AssetLoader::move(AssetLoader&& a)
+	{
+		m_tasks = std::move(a.m_tasks);
+		m_shared = std::move(a.m_shared);
+		m_pool = std::move(a.m_pool);
+		m_uploader = a.m_uploader;
+	}
+
+	void AssetLoader::destroy()
+	{
+		// Whatever a worker is running continues to its next suspension before the pool is joined,
+		// and only then are the suspended coroutines destroyed
+		m_pool.reset();
+		m_tasks.clear();
+		m_shared.reset();
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,145 @@
+#pragma once
+
+#include "task.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Runs asset loading coroutines alongside the frame loop. A coroutine moves itself between threads by what it awaits:
+	// background() for parsing and decoding on a worker, mainThread() for anything touching the uploader or what the
+	// renderer reads, and uploaded() to wait for an upload batch without blocking. Main thread continuations only run
+	// from poll(), between frames, so a coroutine can change what the next frame draws without any locking.
+	class AssetLoader
+	{
+	private:
+		struct Shared
+		{
+			std::mutex                                                     mutex{};
+			std::deque<std::coroutine_handle<>>                            mainThread{};
+			std::vector<std::pair<std::uint64_t, std::coroutine_handle<>>> uploads{};
+
+			// Stays reachable while the pool is being joined, so a coroutine running on it can still queue itself there
+			ThreadPool* pool{};
+		};
+
+	public:
+		struct BackgroundAwaiter
+		{
+			ThreadPool* pool{};
+
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				pool->submit([handle] { handle.resume(); });
+			}
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		struct MainThreadAwaiter
+		{
+			Shared* shared{};
+
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				std::lock_guard lock{ shared->mutex };
+				shared->mainThread.push_back(handle);
+			}
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		struct UploadAwaiter
+		{
+			Shared*       shared{};
+			std::uint64_t upload{};
+
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+			void await_suspend(std::coroutine_handle<> handle)
+			{
+				std::lock_guard lock{ shared->mutex };
+				shared->uploads.emplace_back(upload, handle);
+			}
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		AssetLoader() = default;
+
+		// The uploader must outlive the loader
+		explicit AssetLoader(UploadManager& uploader, std::size_t threadCount = 1);
+
+		AssetLoader(const AssetLoader&) = delete;
+		AssetLoader& operator=(const AssetLoader&) = delete;
+
+		AssetLoader(AssetLoader&& a) noexcept;
+		AssetLoader& operator=(AssetLoader&& a) noexcept;
+
+		~AssetLoader();
+
+		// Runs the task up to its first suspension, then keeps it until it finishes, which must be on the main thread.
+		// poll() rethrows what escapes it.
+		void start(Task<> task);
+
+		// Call once per frame on the main thread. Resumes the coroutines waiting for it, and the ones waiting for uploads that have completed.
+		void poll();
+
+		// Whether every started task has finished
+		bool idle() const
+		{
+			return m_tasks.empty();
+		}
+
+		BackgroundAwaiter background() const
+		{
+			return { m_shared->pool };
+		}
+		MainThreadAwaiter mainThread() const
+		{
+			return { m_shared.get() };
+		}
+		// Continues on the main thread once the upload batch ending in the value has completed
+		UploadAwaiter uploaded(std::uint64_t upload) const
+		{
+			return { m_shared.get(), upload };
+		}
+
+	private:
+		std::vector<Task<>> m_tasks{};
+
+		// Continuations queued on the pool push into the shared state, so it outlives the pool
+		std::unique_ptr<Shared>     m_shared{};
+		std::unique_ptr<ThreadPool> m_pool{};
+
+		// Not owned by the class
+		UploadManager* m_uploader{};
+
+		void move(AssetLoader&& a);
+		void destroy();
+	};
+
+}
\ No newline at end of file
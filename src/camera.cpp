@@ -48,4 +48,44 @@ namespace Graphics
 		m_up = glm::cross(m_front, m_right);
 	}
 
+	Frustum extractFrustum(const glm::mat4& viewProj)
+	{
+		const glm::mat4 m{ glm::transpose(viewProj) };
+
+		Frustum frustum
+		{
+			.planes
+			{
+				m[3] + m[0],
+				m[3] - m[0],
+				m[3] + m[1],
+				m[3] - m[1],
+				m[3] + m[2],
+				m[3] - m[2],
+			},
+		};
+
+		for (auto& plane : frustum.planes)
+		{
+			plane /= glm::length(glm::vec3{ plane });
+		}
+
+		return frustum;
+	}
+
+	bool intersects(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax)
+	{
+		for (const auto& plane : frustum.planes)
+		{
+			// The corner furthest along the plane's normal
+			const glm::vec3 corner{ glm::mix(boundsMin, boundsMax, glm::greaterThan(glm::vec3{ plane }, glm::vec3{ 0.0f })) };
+			if (glm::dot(glm::vec3{ plane }, corner) + plane.w < 0.0f)
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
 }
\ No newline at end of file
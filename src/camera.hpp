@@ -5,6 +5,17 @@
 namespace Graphics
 {
 
+	// Planes point inwards, xyz is the normal and w the distance
+	struct Frustum
+	{
+		glm::vec4 planes[6]{};
+	};
+
+	Frustum extractFrustum(const glm::mat4& viewProj);
+
+	// Conservative: may report boxes just outside a corner of the frustum as visible
+	bool intersects(const Frustum& frustum, const glm::vec3& boundsMin, const glm::vec3& boundsMax);
+
 	class Camera
 	{
 	public:
@@ -0,0 +1,340 @@
+#include "cluster_culler.hpp"
+
+#include "alloc.hpp"
+#include "camera.hpp"
+#include "depth_pyramid.hpp"
+#include "frame.hpp"
+#include "pipeline.hpp"
+#include "static_batch.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <utility>
+
+namespace Graphics
+{
+
+	// Must match the CullData block in cluster_cull.comp
+	struct ClusterCullData
+	{
+		glm::vec4     frustums[12]{};        // The camera's planes, then the light's
+		glm::vec4     cameraPosition{};
+		glm::mat4     pyramidView{ 1.0f };
+		glm::vec4     pyramidProjection{};   // The x and y scales, then the two terms mapping view depth to depth
+		glm::vec2     pyramidSize{};
+		std::uint32_t pyramidLevels{};
+		std::uint32_t occlusion{};
+	};
+
+	// Must match the push constant block in cluster_cull.comp
+	struct ClusterCullPushConstants
+	{
+		std::uint32_t clusterCount{};
+		std::uint32_t chunkCount{};
+		std::uint32_t identityInstance{};
+	};
+
+	constexpr std::uint32_t clusterCullGroupSize{ 64 };
+	constexpr std::uint32_t clusterViewCount{ 2 };
+
+	VkDescriptorSetLayout ClusterCuller::m_setLayout{};
+	VkPipelineLayout      ClusterCuller::m_pipelineLayout{};
+	VkPipeline            ClusterCuller::m_pipeline{};
+
+	void ClusterCuller::init(VkDevice device)
+	{
+		VkDescriptorSetLayoutBinding bindings[5]
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 4, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		};
+		VkDescriptorSetLayoutCreateInfo setLayoutCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO },
+			.bindingCount{ 5 },
+			.pBindings{ bindings },
+		};
+		vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &m_setLayout);
+
+		m_pipelineLayout = createPipelineLayout(device, 1, &m_setLayout, sizeof(ClusterCullPushConstants), VK_SHADER_STAGE_COMPUTE_BIT);
+		m_pipeline = createComputePipeline(device, "shaders/cluster_cull.comp.spv", m_pipelineLayout);
+	}
+
+	void ClusterCuller::cleanup(VkDevice device)
+	{
+		vkDestroyPipeline(device, m_pipeline, nullptr);
+		vkDestroyPipelineLayout(device, m_pipelineLayout, nullptr);
+		vkDestroyDescriptorSetLayout(device, m_setLayout, nullptr);
+	}
+
+	ClusterCuller::ClusterCuller(VkDevice device, VmaAllocator allocator)
+		: m_device{ device },
+		  m_allocator{ allocator }
+	{
+		VkBufferCreateInfo cullDataCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ sizeof(ClusterCullData) },
+			.usage{ VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT },
+		};
+		VmaAllocationCreateInfo cullDataAllocCI
+		{
+			.flags{ VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT },
+		};
+		VmaAllocationInfo allocInfo{};
+		vmaCreateBuffer(allocator, &cullDataCI, &cullDataAllocCI, &m_cullData.buffer, &m_cullData.alloc, &allocInfo);
+		m_cullDataMapped = allocInfo.pMappedData;
+
+		VkDescriptorPoolSize sizes[3]
+		{
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1 },
+		};
+		VkDescriptorPoolCreateInfo poolCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO },
+			.maxSets{ 1 },
+			.poolSizeCount{ 3 },
+			.pPoolSizes{ sizes },
+		};
+		vkCreateDescriptorPool(device, &poolCI, nullptr, &m_descriptorPool);
+
+		VkDescriptorSetAllocateInfo setAllocInfo
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO },
+			.descriptorPool{ m_descriptorPool },
+			.descriptorSetCount{ 1 },
+			.pSetLayouts{ &m_setLayout },
+		};
+		vkAllocateDescriptorSets(device, &setAllocInfo, &m_descriptorSet);
+	}
+
+	ClusterCuller::ClusterCuller(ClusterCuller&& c) noexcept
+	{
+		move(std::move(c));
+	}
+
+	ClusterCuller& ClusterCuller::operator=(ClusterCuller&& c) noexcept
+	{
+		destroy();
+		move(std::move(c));
+		return *this;
+	}
+
+	ClusterCuller::~ClusterCuller()
+	{
+		destroy();
+	}
+
+	void ClusterCuller::cull(VkCommandBuffer commandBuffer, const StaticBatch& batch, const glm::mat4& cameraView, const glm::mat4& cameraProj,
+		const glm::mat4& lightViewProj, const DepthPyramid& depthPyramid, std::uint32_t identityInstance)
+	{
+		const std::uint32_t chunkCount{ static_cast<std::uint32_t>(batch.chunks().size()) };
+
+		reserve(batch.clusterCount(), chunkCount);
+		if (m_boundClusters != batch.clusterBuffer())
+		{
+			writeDescriptors(batch, depthPyramid);
+		}
+
+		m_frustums[static_cast<std::uint32_t>(ClusterView::Camera)] = extractFrustum(cameraProj * cameraView);
+		m_frustums[static_cast<std::uint32_t>(ClusterView::Light)]  = extractFrustum(lightViewProj);
+
+		// The pyramid holds the previous frame, so clusters are tested where that frame's camera saw them
+		const glm::mat4& pyramidProj{ depthPyramid.cameraProj() };
+		ClusterCullData cullData
+		{
+			.cameraPosition{ glm::inverse(cameraView)[3] },
+			.pyramidView{ depthPyramid.cameraView() },
+			.pyramidProjection{ pyramidProj[0][0], pyramidProj[1][1], pyramidProj[2][2], pyramidProj[3][2] },
+			.pyramidSize{ depthPyramid.extent().width, depthPyramid.extent().height },
+			.pyramidLevels{ depthPyramid.levelCount() },
+			.occlusion{ depthPyramid.built() ? 1u : 0u },
+		};
+		for (std::uint32_t view{ 0 }; view < clusterViewCount; ++view)
+		{
+			std::copy(std::begin(m_frustums[view].planes), std::end(m_frustums[view].planes), cullData.frustums + view * 6);
+		}
+		std::memcpy(m_cullDataMapped, &cullData, sizeof(ClusterCullData));
+		vmaFlushAllocation(m_allocator, m_cullData.alloc, 0, VK_WHOLE_SIZE);
+
+		vkCmdFillBuffer(commandBuffer, m_counts.buffer, 0, clusterViewCount * chunkCount * sizeof(std::uint32_t), 0);
+
+		VkMemoryBarrier clearBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_descriptorSet, 0, nullptr);
+
+		ClusterCullPushConstants pushConstants
+		{
+			.clusterCount{ batch.clusterCount() },
+			.chunkCount{ chunkCount },
+			.identityInstance{ identityInstance },
+		};
+		vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ClusterCullPushConstants), &pushConstants);
+		vkCmdDispatch(commandBuffer, (batch.clusterCount() + clusterCullGroupSize - 1) / clusterCullGroupSize, 1, 1);
+
+		VkMemoryBarrier drawBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_INDIRECT_COMMAND_READ_BIT },
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT, 0,
+			1, &drawBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void ClusterCuller::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const StaticBatch& batch, ClusterView view, bool opaque) const
+	{
+		const auto& chunks{ batch.chunks() };
+		const std::uint32_t viewIndex{ static_cast<std::uint32_t>(view) };
+
+		std::uint32_t boundTexture{ std::numeric_limits<std::uint32_t>::max() };
+		for (std::size_t c{ 0 }; c < chunks.size(); ++c)
+		{
+			const StaticBatchChunk& chunk{ chunks[c] };
+			if (chunk.opaque != opaque || !intersects(m_frustums[viewIndex], chunk.boundsMin, chunk.boundsMax))
+			{
+				continue;
+			}
+
+			if (chunk.textureIndex != boundTexture)
+			{
+				PushConstants pushConstants{ .textureIndex{ chunk.textureIndex } };
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants), &pushConstants);
+				boundTexture = chunk.textureIndex;
+			}
+
+			const VkDeviceSize commandOffset{ (static_cast<VkDeviceSize>(viewIndex) * batch.clusterCount() + chunk.firstCluster) * sizeof(VkDrawIndexedIndirectCommand) };
+			const VkDeviceSize countOffset{ (viewIndex * chunks.size() + c) * sizeof(std::uint32_t) };
+
+			vkCmdDrawIndexedIndirectCount(commandBuffer, m_commands.buffer, commandOffset, m_counts.buffer, countOffset,
+				chunk.clusterCount, sizeof(VkDrawIndexedIndirectCommand));
+		}
+	}
+
+	void ClusterCuller::reserve(std::uint32_t clusterCount, std::uint32_t chunkCount)
+	{
+		if (clusterCount <= m_clusterCapacity && chunkCount <= m_chunkCapacity)
+		{
+			return;
+		}
+
+		// Only called once the frame's previous draws have completed
+		if (m_commands.buffer != VK_NULL_HANDLE)
+		{
+			vmaDestroyBuffer(m_allocator, m_commands.buffer, m_commands.alloc);
+			vmaDestroyBuffer(m_allocator, m_counts.buffer, m_counts.alloc);
+		}
+
+		m_clusterCapacity = std::max(clusterCount, m_clusterCapacity);
+		m_chunkCapacity   = std::max(chunkCount, m_chunkCapacity);
+
+		VkBufferCreateInfo commandsCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ clusterViewCount * m_clusterCapacity * sizeof(VkDrawIndexedIndirectCommand) },
+			.usage{ VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		};
+		VkBufferCreateInfo countsCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ clusterViewCount * m_chunkCapacity * sizeof(std::uint32_t) },
+			.usage{ VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		};
+		VmaAllocationCreateInfo allocCI
+		{
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+		};
+		vmaCreateBuffer(m_allocator, &commandsCI, &allocCI, &m_commands.buffer, &m_commands.alloc, nullptr);
+		vmaCreateBuffer(m_allocator, &countsCI, &allocCI, &m_counts.buffer, &m_counts.alloc, nullptr);
+
+		m_boundClusters = VK_NULL_HANDLE;
+	}
+
+	void ClusterCuller::writeDescriptors(const StaticBatch& batch, const DepthPyramid& depthPyramid)
+	{
+		VkDescriptorBufferInfo bufferInfos[4]
+		{
+			{ m_cullData.buffer, 0, VK_WHOLE_SIZE },
+			{ batch.clusterBuffer(), 0, VK_WHOLE_SIZE },
+			{ m_commands.buffer, 0, VK_WHOLE_SIZE },
+			{ m_counts.buffer, 0, VK_WHOLE_SIZE },
+		};
+		VkDescriptorImageInfo pyramidInfo{ depthPyramid.sampler(), depthPyramid.imageView(), VK_IMAGE_LAYOUT_GENERAL };
+
+		VkWriteDescriptorSet writes[5]{};
+		for (std::uint32_t i{ 0 }; i < 5; ++i)
+		{
+			writes[i] =
+			{
+				.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+				.dstSet{ m_descriptorSet },
+				.dstBinding{ i },
+				.descriptorCount{ 1 },
+				.descriptorType{ i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER : i < 4 ? VK_DESCRIPTOR_TYPE_STORAGE_BUFFER : VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+				.pImageInfo{ i < 4 ? nullptr : &pyramidInfo },
+				.pBufferInfo{ i < 4 ? &bufferInfos[i] : nullptr },
+			};
+		}
+		vkUpdateDescriptorSets(m_device, 5, writes, 0, nullptr);
+
+		m_boundClusters = batch.clusterBuffer();
+	}
+
+	void ClusterCuller::move(ClusterCuller&& c)
+	{
+		m_cullData = c.m_cullData;
+		m_cullDataMapped = c.m_cullDataMapped;
+
+		m_commands = c.m_commands;
+		m_counts = c.m_counts;
+		m_clusterCapacity = c.m_clusterCapacity;
+		m_chunkCapacity = c.m_chunkCapacity;
+
+		m_descriptorPool = c.m_descriptorPool;
+		m_descriptorSet = c.m_descriptorSet;
+		m_boundClusters = c.m_boundClusters;
+
+		std::copy(std::begin(c.m_frustums), std::end(c.m_frustums), m_frustums);
+
+		m_device = c.m_device;
+		c.m_device = VK_NULL_HANDLE;
+		m_allocator = c.m_allocator;
+	}
+
+	void ClusterCuller::destroy()
+	{
+		if (m_device != VK_NULL_HANDLE)
+		{
+			vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+
+			vmaDestroyBuffer(m_allocator, m_counts.buffer, m_counts.alloc);
+			vmaDestroyBuffer(m_allocator, m_commands.buffer, m_commands.alloc);
+			vmaDestroyBuffer(m_allocator, m_cullData.buffer, m_cullData.alloc);
+		}
+	}
+
+}
\ No newline at end of file
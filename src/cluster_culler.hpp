@@ -0,0 +1,86 @@
+#pragma once
+
+#include "alloc.hpp"
+#include "camera.hpp"
+#include "depth_pyramid.hpp"
+#include "static_batch.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+
+namespace Graphics
+{
+
+	// What a culling pass prepares the static batch's draws for
+	enum class ClusterView : std::uint32_t
+	{
+		Camera,
+		Light,
+	};
+
+	// Culls the static batch cluster by cluster in a compute pass ahead of rendering, and draws what is left with
+	// one indirect count draw per chunk, so hidden triangles never reach the vertex shader. For the camera, clusters
+	// are tested against the frustum, their normal cone and the depth pyramid of the previous frame; for the light only
+	// against its frustum, since back facing and hidden clusters still cast shadows.
+	// Each frame in flight has its own, as the draws are rewritten every frame.
+	class ClusterCuller
+	{
+	public:
+		static void init(VkDevice device);
+		static void cleanup(VkDevice device);
+
+		ClusterCuller() = default;
+		ClusterCuller(VkDevice device, VmaAllocator allocator);
+
+		ClusterCuller(const ClusterCuller&) = delete;
+		ClusterCuller& operator=(const ClusterCuller&) = delete;
+
+		ClusterCuller(ClusterCuller&& c) noexcept;
+		ClusterCuller& operator=(ClusterCuller&& c) noexcept;
+
+		~ClusterCuller();
+
+		// Records the culling pass outside of rendering, once the draws of the last time it ran have completed.
+		// identityInstance must hold an identity transform.
+		void cull(VkCommandBuffer commandBuffer, const StaticBatch& batch, const glm::mat4& cameraView, const glm::mat4& cameraProj,
+			const glm::mat4& lightViewProj, const DepthPyramid& depthPyramid, std::uint32_t identityInstance);
+
+		// Draws the clusters the last cull left for the view, with the geometry arena's index buffer bound
+		void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const StaticBatch& batch, ClusterView view, bool opaque) const;
+
+	private:
+		static VkDescriptorSetLayout m_setLayout;
+		static VkPipelineLayout      m_pipelineLayout;
+		static VkPipeline            m_pipeline;
+
+		Buffer m_cullData{};
+		void*  m_cullDataMapped{};
+
+		// Per view, the draws of every chunk's clusters and how many of them are left
+		Buffer        m_commands{};
+		Buffer        m_counts{};
+		std::uint32_t m_clusterCapacity{};
+		std::uint32_t m_chunkCapacity{};
+
+		VkDescriptorPool m_descriptorPool{};
+		VkDescriptorSet  m_descriptorSet{};
+		VkBuffer         m_boundClusters{};
+
+		// Chunks entirely outside these are not even drawn
+		Frustum m_frustums[2]{};
+
+		// Not owned by the class
+		VkDevice     m_device{};
+		VmaAllocator m_allocator{};
+
+		void reserve(std::uint32_t clusterCount, std::uint32_t chunkCount);
+		void writeDescriptors(const StaticBatch& batch, const DepthPyramid& depthPyramid);
+
+		void move(ClusterCuller&& c);
+		void destroy();
+	};
+
+}
\ No newline at end of file
@@ -0,0 +1,299 @@
+#include "depth_pyramid.hpp"
+
+#include "alloc.hpp"
+#include "pipeline.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Must match the push constant block in depth_pyramid.comp
+	struct DepthPyramidPushConstants
+	{
+		glm::uvec2    size{};
+		glm::uvec2    sourceSize{};
+		std::uint32_t level{};
+		std::uint32_t samples{};
+	};
+
+	constexpr std::uint32_t depthPyramidGroupSize{ 8 };
+
+	DepthPyramid::DepthPyramid(VkDevice device, VmaAllocator allocator, VkImageView depthImageView, VkExtent2D depthExtent, VkSampleCountFlagBits samples)
+		: m_depthExtent{ depthExtent },
+		  m_depthSamples{ static_cast<std::uint32_t>(samples) },
+		  m_device{ device },
+		  m_allocator{ allocator }
+	{
+		m_extent     = { std::bit_floor(depthExtent.width), std::bit_floor(depthExtent.height) };
+		m_levelCount = static_cast<std::uint32_t>(std::bit_width(std::max(m_extent.width, m_extent.height)));
+
+		VkImageCreateInfo imageCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO },
+			.imageType{ VK_IMAGE_TYPE_2D },
+			.format{ VK_FORMAT_R32_SFLOAT },
+			.extent{ m_extent.width, m_extent.height, 1 },
+			.mipLevels{ m_levelCount },
+			.arrayLayers{ 1 },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.tiling{ VK_IMAGE_TILING_OPTIMAL },
+			.usage{ VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+		};
+		VmaAllocationCreateInfo allocCI
+		{
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+		};
+		vmaCreateImage(allocator, &imageCI, &allocCI, &m_image.image, &m_image.alloc, nullptr);
+
+		VkImageViewCreateInfo viewCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO },
+			.image{ m_image.image },
+			.viewType{ VK_IMAGE_VIEW_TYPE_2D },
+			.format{ VK_FORMAT_R32_SFLOAT },
+			.subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, m_levelCount, 0, 1 },
+		};
+		vkCreateImageView(device, &viewCI, nullptr, &m_view);
+
+		m_levelViews.resize(m_levelCount);
+		for (std::uint32_t level{ 0 }; level < m_levelCount; ++level)
+		{
+			viewCI.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 };
+			vkCreateImageView(device, &viewCI, nullptr, &m_levelViews[level]);
+		}
+
+		// Both the attachment and the pyramid are only read with texelFetch
+		VkSamplerCreateInfo samplerCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO },
+			.magFilter{ VK_FILTER_NEAREST },
+			.minFilter{ VK_FILTER_NEAREST },
+			.mipmapMode{ VK_SAMPLER_MIPMAP_MODE_NEAREST },
+			.addressModeU{ VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			.addressModeV{ VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			.addressModeW{ VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			.maxLod{ VK_LOD_CLAMP_NONE },
+		};
+		vkCreateSampler(device, &samplerCI, nullptr, &m_sampler);
+
+		VkDescriptorSetLayoutBinding bindings[3]
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		};
+		VkDescriptorSetLayoutCreateInfo setLayoutCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO },
+			.bindingCount{ 3 },
+			.pBindings{ bindings },
+		};
+		vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &m_setLayout);
+
+		VkDescriptorPoolSize poolSizes[2]
+		{
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, m_levelCount },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 2 * m_levelCount },
+		};
+		VkDescriptorPoolCreateInfo poolCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO },
+			.maxSets{ m_levelCount },
+			.poolSizeCount{ 2 },
+			.pPoolSizes{ poolSizes },
+		};
+		vkCreateDescriptorPool(device, &poolCI, nullptr, &m_descriptorPool);
+
+		std::vector<VkDescriptorSetLayout> setLayouts(m_levelCount, m_setLayout);
+		VkDescriptorSetAllocateInfo setAI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO },
+			.descriptorPool{ m_descriptorPool },
+			.descriptorSetCount{ m_levelCount },
+			.pSetLayouts{ setLayouts.data() },
+		};
+		m_levelSets.resize(m_levelCount);
+		vkAllocateDescriptorSets(device, &setAI, m_levelSets.data());
+
+		// Level 0 reads the attachment, so its source binding just repeats its destination
+		for (std::uint32_t level{ 0 }; level < m_levelCount; ++level)
+		{
+			VkDescriptorImageInfo imageInfos[3]
+			{
+				{ m_sampler, depthImageView, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+				{ VK_NULL_HANDLE, m_levelViews[level == 0 ? 0 : level - 1], VK_IMAGE_LAYOUT_GENERAL },
+				{ VK_NULL_HANDLE, m_levelViews[level], VK_IMAGE_LAYOUT_GENERAL },
+			};
+			VkWriteDescriptorSet writes[3]{};
+			for (std::uint32_t i{ 0 }; i < 3; ++i)
+			{
+				writes[i] =
+				{
+					.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+					.dstSet{ m_levelSets[level] },
+					.dstBinding{ i },
+					.descriptorCount{ 1 },
+					.descriptorType{ bindings[i].descriptorType },
+					.pImageInfo{ &imageInfos[i] },
+				};
+			}
+			vkUpdateDescriptorSets(device, 3, writes, 0, nullptr);
+		}
+
+		m_pipelineLayout = createPipelineLayout(device, 1, &m_setLayout, sizeof(DepthPyramidPushConstants), VK_SHADER_STAGE_COMPUTE_BIT);
+		m_pipeline = createComputePipeline(device, "shaders/depth_pyramid.comp.spv", m_pipelineLayout);
+	}
+
+	DepthPyramid::DepthPyramid(DepthPyramid&& p) noexcept
+	{
+		move(std::move(p));
+	}
+
+	DepthPyramid& DepthPyramid::operator=(DepthPyramid&& p) noexcept
+	{
+		destroy();
+		move(std::move(p));
+		return *this;
+	}
+
+	DepthPyramid::~DepthPyramid()
+	{
+		destroy();
+	}
+
+	void DepthPyramid::build(VkCommandBuffer commandBuffer, VkImage depthImage, const glm::mat4& cameraView, const glm::mat4& cameraProj)
+	{
+		// The previous build was last read by cull passes, which only need to have finished before it is overwritten
+		VkImageMemoryBarrier beginBarriers[2]
+		{
+			{
+				.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+				.srcAccessMask{ VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT },
+				.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT },
+				.oldLayout{ VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL },
+				.newLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+				.image{ depthImage },
+				.subresourceRange{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 },
+			},
+			{
+				.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+				.srcAccessMask{ 0 },
+				.dstAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+				.oldLayout{ m_built ? VK_IMAGE_LAYOUT_GENERAL : VK_IMAGE_LAYOUT_UNDEFINED },
+				.newLayout{ VK_IMAGE_LAYOUT_GENERAL },
+				.image{ m_image.image },
+				.subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, m_levelCount, 0, 1 },
+			},
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 0, nullptr, 0, nullptr, 2, beginBarriers);
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipeline);
+
+		// Each level waits for the one above it, and the last one for nothing but the next frame's cull passes
+		VkMemoryBarrier levelBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT },
+		};
+
+		glm::uvec2 sourceSize{ m_depthExtent.width, m_depthExtent.height };
+		for (std::uint32_t level{ 0 }; level < m_levelCount; ++level)
+		{
+			const glm::uvec2 size{ glm::max(glm::uvec2{ m_extent.width, m_extent.height } >> level, glm::uvec2{ 1 }) };
+
+			DepthPyramidPushConstants pushConstants
+			{
+				.size{ size },
+				.sourceSize{ sourceSize },
+				.level{ level },
+				.samples{ m_depthSamples },
+			};
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &m_levelSets[level], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthPyramidPushConstants), &pushConstants);
+			vkCmdDispatch(commandBuffer, (size.x + depthPyramidGroupSize - 1) / depthPyramidGroupSize, (size.y + depthPyramidGroupSize - 1) / depthPyramidGroupSize, 1);
+
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+			sourceSize = size;
+		}
+
+		// Ready to be cleared by the next frame's render pass
+		VkImageMemoryBarrier endBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+			.srcAccessMask{ 0 },
+			.dstAccessMask{ VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT },
+			.oldLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			.newLayout{ VK_IMAGE_LAYOUT_DEPTH_ATTACHMENT_OPTIMAL },
+			.image{ depthImage },
+			.subresourceRange{ VK_IMAGE_ASPECT_DEPTH_BIT, 0, 1, 0, 1 },
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &endBarrier);
+
+		m_built      = true;
+		m_cameraView = cameraView;
+		m_cameraProj = cameraProj;
+	}
+
+	void DepthPyramid::move(DepthPyramid&& p)
+	{
+		m_image = p.m_image;
+		m_view = p.m_view;
+		m_levelViews = std::move(p.m_levelViews);
+		m_sampler = p.m_sampler;
+		m_extent = p.m_extent;
+		m_levelCount = p.m_levelCount;
+
+		m_depthExtent = p.m_depthExtent;
+		m_depthSamples = p.m_depthSamples;
+
+		m_setLayout = p.m_setLayout;
+		m_descriptorPool = p.m_descriptorPool;
+		m_levelSets = std::move(p.m_levelSets);
+		m_pipelineLayout = p.m_pipelineLayout;
+		m_pipeline = p.m_pipeline;
+
+		m_built = p.m_built;
+		m_cameraView = p.m_cameraView;
+		m_cameraProj = p.m_cameraProj;
+
+		m_device = p.m_device;
+		p.m_device = VK_NULL_HANDLE;
+		m_allocator = p.m_allocator;
+	}
+
+	void DepthPyramid::destroy()
+	{
+		if (m_device != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(m_device, m_pipeline, nullptr);
+			vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+			vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
+			vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+
+			vkDestroySampler(m_device, m_sampler, nullptr);
+			for (VkImageView view : m_levelViews)
+			{
+				vkDestroyImageView(m_device, view, nullptr);
+			}
+			vkDestroyImageView(m_device, m_view, nullptr);
+			vmaDestroyImage(m_allocator, m_image.image, m_image.alloc);
+		}
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "alloc.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics
+{
+
+	// The farthest depth under every texel of a frame's depth attachment, at every level of a power of two mip chain,
+	// for occlusion culling the next frame against. Level 0 is the largest power of two that fits in the attachment,
+	// so each of its texels covers one to two pixels along each axis and keeps the farthest of all their samples.
+	class DepthPyramid
+	{
+	public:
+		DepthPyramid() = default;
+
+		// The depth attachment must have been created with sampled usage
+		DepthPyramid(VkDevice device, VmaAllocator allocator, VkImageView depthImageView, VkExtent2D depthExtent, VkSampleCountFlagBits samples);
+
+		DepthPyramid(const DepthPyramid&) = delete;
+		DepthPyramid& operator=(const DepthPyramid&) = delete;
+
+		DepthPyramid(DepthPyramid&& p) noexcept;
+		DepthPyramid& operator=(DepthPyramid&& p) noexcept;
+
+		~DepthPyramid();
+
+		// Records the reduction of the depth attachment, which has to be in DEPTH_ATTACHMENT_OPTIMAL and is left there.
+		// cameraView and cameraProj are what the depth was rendered with, and what passes recorded afterwards project with.
+		void build(VkCommandBuffer commandBuffer, VkImage depthImage, const glm::mat4& cameraView, const glm::mat4& cameraProj);
+
+		// Nothing can be culled against the pyramid before its first build
+		bool built() const
+		{
+			return m_built;
+		}
+
+		// Every level stays in GENERAL
+		VkImageView imageView() const
+		{
+			return m_view;
+		}
+		VkSampler sampler() const
+		{
+			return m_sampler;
+		}
+		VkExtent2D extent() const
+		{
+			return m_extent;
+		}
+		std::uint32_t levelCount() const
+		{
+			return m_levelCount;
+		}
+
+		const glm::mat4& cameraView() const
+		{
+			return m_cameraView;
+		}
+		const glm::mat4& cameraProj() const
+		{
+			return m_cameraProj;
+		}
+
+	private:
+		Image                    m_image{};
+		VkImageView              m_view{};
+		std::vector<VkImageView> m_levelViews{};
+		VkSampler                m_sampler{};
+		VkExtent2D               m_extent{};
+		std::uint32_t            m_levelCount{};
+
+		VkExtent2D    m_depthExtent{};
+		std::uint32_t m_depthSamples{};
+
+		VkDescriptorSetLayout        m_setLayout{};
+		VkDescriptorPool             m_descriptorPool{};
+		std::vector<VkDescriptorSet> m_levelSets{};
+		VkPipelineLayout             m_pipelineLayout{};
+		VkPipeline                   m_pipeline{};
+
+		bool      m_built{};
+		glm::mat4 m_cameraView{ 1.0f };
+		glm::mat4 m_cameraProj{ 1.0f };
+
+		// Not owned by the class
+		VkDevice     m_device{};
+		VmaAllocator m_allocator{};
+
+		void move(DepthPyramid&& p);
+		void destroy();
+	};
+
+}
\ No newline at end of file
@@ -1,9 +1,15 @@
 #include "descriptor.hpp"
 
 #include "mesh.hpp"
+#include "texture_cache.hpp"
+#include "texture_packer.hpp"
+#include "virtual_texture.hpp"
 
 #include "volk/volk.h"
 
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <vector>
 
 namespace Graphics
@@ -14,7 +20,7 @@ namespace Graphics
 		VkDescriptorPoolSize poolSizes[]
 		{
 			{ VK_DESCRIPTOR_TYPE_SAMPLER, 1000 },
-			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1001 },
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1001 + 1 + VirtualTextureCache::maxTextures + TexturePacker::maxArrays },
 			{ VK_DESCRIPTOR_TYPE_SAMPLED_IMAGE, 1000 },
 			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1000 },
 			{ VK_DESCRIPTOR_TYPE_UNIFORM_TEXEL_BUFFER, 1000 },
@@ -29,6 +35,7 @@ namespace Graphics
 		VkDescriptorPoolCreateInfo poolCI
 		{
 			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO },
+			.flags{ VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT },
 			.maxSets{ 1 },
 			.poolSizeCount{ 11 },
 			.pPoolSizes{ poolSizes },
@@ -51,20 +58,25 @@ namespace Graphics
 			.stageFlags{ VK_SHADER_STAGE_FRAGMENT_BIT },
 		};
 		*/
-		VkDescriptorBindingFlags bindingFlags[2]
+		// The texture streamer swaps textures in while frames in flight still sample the table
+		VkDescriptorBindingFlags bindingFlags[6]
 		{
 			0,
-			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT 
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT,
+			VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT
 		};
 
 		VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCI
 		{ 
 			.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO,
-			.bindingCount{ 2 },
+			.bindingCount{ 6 },
 			.pBindingFlags{ bindingFlags },
 		};
 
-		VkDescriptorSetLayoutBinding bindings[2]
+		VkDescriptorSetLayoutBinding bindings[6]
 		{
 			{
 				.binding{ 0 },
@@ -79,6 +91,38 @@ namespace Graphics
 			.descriptorCount{ 1001 },
 			.stageFlags{ VK_SHADER_STAGE_FRAGMENT_BIT },
 			},
+
+			// Instances generated on the GPU by the scatter stage
+			{
+				.binding{ 2 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_VERTEX_BIT },
+			},
+
+			// Physical page cache shared by the virtual textures
+			{
+				.binding{ 3 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_FRAGMENT_BIT },
+			},
+
+			// Page table of each virtual texture
+			{
+				.binding{ 4 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+				.descriptorCount{ VirtualTextureCache::maxTextures },
+				.stageFlags{ VK_SHADER_STAGE_FRAGMENT_BIT },
+			},
+
+			// Texture arrays small textures are packed into
+			{
+				.binding{ 5 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+				.descriptorCount{ TexturePacker::maxArrays },
+				.stageFlags{ VK_SHADER_STAGE_FRAGMENT_BIT },
+			},
 		};
 		/*
 		VkDescriptorSetLayoutBinding binding
@@ -93,7 +137,8 @@ namespace Graphics
 		{
 			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO },
 			.pNext{ &bindingFlagsCI },
-			.bindingCount{ 2 },
+			.flags{ VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT },
+			.bindingCount{ 6 },
 			.pBindings{ bindings },
 		};
 
@@ -119,28 +164,49 @@ namespace Graphics
 		return set;
 	}
 
-	void writeTextureSamplers(VkDevice device, VkDescriptorSet descriptorSet, const std::vector<Texture>& textures)
+	void writeTextureSamplers(VkDevice device, VkDescriptorSet descriptorSet, const TextureCache& textures)
+	{
+		std::vector<std::uint32_t> slots(textures.textures().size());
+		for (std::uint32_t i{ 0 }; i < slots.size(); ++i)
+		{
+			slots[i] = i;
+		}
+		writeTextureSamplers(device, descriptorSet, textures, slots);
+	}
+
+	void writeTextureSamplers(VkDevice device, VkDescriptorSet descriptorSet, const TextureCache& textures, std::span<const std::uint32_t> slots)
 	{
-		std::vector<VkDescriptorImageInfo> imageInfos(textures.size());
-		std::vector<VkWriteDescriptorSet> writes(textures.size());
-		for (int i{ 0 }; i < textures.size(); ++i)
+		const auto& loaded{ textures.textures() };
+
+		// Reserved up front so the writes can point into it
+		std::vector<VkDescriptorImageInfo> imageInfos{};
+		imageInfos.reserve(slots.size());
+		std::vector<VkWriteDescriptorSet> writes{};
+		writes.reserve(slots.size());
+		for (std::uint32_t slot : slots)
 		{
-			imageInfos[i] =
+			// Free slots are left unwritten, the binding is partially bound
+			if (!loaded[slot])
 			{
-				.sampler{ textures[i].vkSampler() },
-				.imageView{ textures[i].vkImageView() },
+				continue;
+			}
+
+			imageInfos.push_back(
+			{
+				.sampler{ loaded[slot]->vkSampler() },
+				.imageView{ loaded[slot]->vkImageView() },
 				.imageLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
-			};
-			writes[i] =
+			});
+			writes.push_back(
 			{
 				.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
 				.dstSet{ descriptorSet },
 				.dstBinding{ 1 },
-				.dstArrayElement{ static_cast<std::uint32_t>(i) },
+				.dstArrayElement{ slot },
 				.descriptorCount{ 1 },
 				.descriptorType{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
-				.pImageInfo{ &imageInfos[i] },
-			};
+				.pImageInfo{ &imageInfos.back() },
+			});
 		}
 		vkUpdateDescriptorSets(device, writes.size(), writes.data(), 0, nullptr);
 	}
@@ -165,4 +231,102 @@ namespace Graphics
 		};
 		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
 	}
+
+	void writeScatterInstanceBuffer(VkDevice device, VkDescriptorSet descriptorSet, VkBuffer instanceBuffer)
+	{
+		VkDescriptorBufferInfo bufferInfo
+		{
+			.buffer{ instanceBuffer },
+			.offset{ 0 },
+			.range{ VK_WHOLE_SIZE },
+		};
+		VkWriteDescriptorSet write
+		{
+			.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+			.dstSet{ descriptorSet },
+			.dstBinding{ 2 },
+			.descriptorCount{ 1 },
+			.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+			.pBufferInfo{ &bufferInfo },
+		};
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
+
+	void writeVirtualTextures(VkDevice device, VkDescriptorSet descriptorSet, const VirtualTextureCache& virtualTextures)
+	{
+		if (virtualTextures.size() == 0)
+		{
+			return;
+		}
+
+		std::vector<VkDescriptorImageInfo> imageInfos{};
+		imageInfos.reserve(1 + virtualTextures.size());
+		imageInfos.push_back(
+		{
+			.sampler{ virtualTextures.pageCacheSampler() },
+			.imageView{ virtualTextures.pageCacheView() },
+			.imageLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		});
+		for (std::uint32_t i{ 0 }; i < virtualTextures.size(); ++i)
+		{
+			imageInfos.push_back(
+			{
+				.sampler{ virtualTextures.pageTableSampler() },
+				.imageView{ virtualTextures.pageTableView(i) },
+				.imageLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			});
+		}
+
+		VkWriteDescriptorSet writes[2]
+		{
+			{
+				.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+				.dstSet{ descriptorSet },
+				.dstBinding{ 3 },
+				.descriptorCount{ 1 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+				.pImageInfo{ &imageInfos[0] },
+			},
+			{
+				.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+				.dstSet{ descriptorSet },
+				.dstBinding{ 4 },
+				.descriptorCount{ virtualTextures.size() },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+				.pImageInfo{ &imageInfos[1] },
+			},
+		};
+		vkUpdateDescriptorSets(device, 2, writes, 0, nullptr);
+	}
+
+	void writeTextureArrays(VkDevice device, VkDescriptorSet descriptorSet, const TexturePacker& packedTextures)
+	{
+		if (packedTextures.size() == 0)
+		{
+			return;
+		}
+
+		std::vector<VkDescriptorImageInfo> imageInfos{};
+		imageInfos.reserve(packedTextures.size());
+		for (std::uint32_t i{ 0 }; i < packedTextures.size(); ++i)
+		{
+			imageInfos.push_back(
+			{
+				.sampler{ packedTextures.sampler() },
+				.imageView{ packedTextures.arrayView(i) },
+				.imageLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			});
+		}
+
+		VkWriteDescriptorSet write
+		{
+			.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+			.dstSet{ descriptorSet },
+			.dstBinding{ 5 },
+			.descriptorCount{ packedTextures.size() },
+			.descriptorType{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER },
+			.pImageInfo{ imageInfos.data() },
+		};
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+	}
 }
\ No newline at end of file
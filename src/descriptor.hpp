@@ -1,9 +1,14 @@
 #pragma once
 
 #include "mesh.hpp"
+#include "texture_cache.hpp"
+#include "texture_packer.hpp"
+#include "virtual_texture.hpp"
 
 #include "volk/volk.h"
 
+#include <cstdint>
+#include <span>
 #include <vector>
 
 namespace Graphics
@@ -15,8 +20,16 @@ namespace Graphics
 
 	VkDescriptorSet allocateDescriptorSet(VkDevice device, VkDescriptorPool descriptorPool, VkDescriptorSetLayout descriptorSetLayout);
 
-	void writeTextureSamplers(VkDevice device, VkDescriptorSet descriptorSet, const std::vector<Texture>& textures);
+	void writeTextureSamplers(VkDevice device, VkDescriptorSet descriptorSet, const TextureCache& textures);
+	// Only the given slots. The texture table is update after bind, so this is fine while frames in flight use it.
+	void writeTextureSamplers(VkDevice device, VkDescriptorSet descriptorSet, const TextureCache& textures, std::span<const std::uint32_t> slots);
 
 	void writeSkyboxSampler(VkDevice device, VkDescriptorSet descriptorSet, VkImageView skyboxView, VkSampler skyboxSampler);
 
+	void writeScatterInstanceBuffer(VkDevice device, VkDescriptorSet descriptorSet, VkBuffer instanceBuffer);
+
+	void writeVirtualTextures(VkDevice device, VkDescriptorSet descriptorSet, const VirtualTextureCache& virtualTextures);
+
+	void writeTextureArrays(VkDevice device, VkDescriptorSet descriptorSet, const TexturePacker& packedTextures);
+
 }
\ No newline at end of file
@@ -8,7 +8,24 @@
 namespace Graphics
 {
 
-	VkDevice createDevice(VkPhysicalDevice physicalDevice, std::uint32_t graphicsQueueFamily, VkQueue& graphicsQueue)
+	bool supportsShaderFloat16(VkPhysicalDevice physicalDevice)
+	{
+		VkPhysicalDeviceVulkan12Features vulkan12Features
+		{
+			.sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES },
+		};
+		VkPhysicalDeviceFeatures2 features
+		{
+			.sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2 },
+			.pNext{ &vulkan12Features },
+		};
+		vkGetPhysicalDeviceFeatures2(physicalDevice, &features);
+
+		return vulkan12Features.shaderFloat16 == VK_TRUE;
+	}
+
+	VkDevice createDevice(VkPhysicalDevice physicalDevice, std::uint32_t graphicsQueueFamily, VkQueue& graphicsQueue,
+		std::uint32_t transferQueueFamily, VkQueue& transferQueue)
 	{ 
 		VkPhysicalDeviceVulkan13Features vulkan13Features
 		{
@@ -19,19 +36,47 @@ namespace Graphics
 		{
 			.sType{ VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES },
 			.pNext{ &vulkan13Features },
+			.drawIndirectCount{ VK_TRUE }, // The static batch draws the clusters left by culling on the GPU
+			.shaderFloat16{ supportsShaderFloat16(physicalDevice) }, // uber_half.frag.spv shades in 16 bit floats
 			.descriptorIndexing{ VK_TRUE },
+			.descriptorBindingSampledImageUpdateAfterBind{ VK_TRUE }, // The texture streamer swaps textures between frames
 			.descriptorBindingPartiallyBound{ VK_TRUE },
 			.runtimeDescriptorArray{ VK_TRUE },
+			.timelineSemaphore{ VK_TRUE },
+		};
+
+		VkPhysicalDeviceFeatures supportedFeatures{};
+		vkGetPhysicalDeviceFeatures(physicalDevice, &supportedFeatures);
+
+		// Scattered instances are drawn with one multi-draw-indirect call per mesh.
+		// Cooked textures are block compressed wherever BC formats are available.
+		// uber.frag writes texture streaming feedback.
+		VkPhysicalDeviceFeatures features
+		{
+			.multiDrawIndirect{ VK_TRUE },
+			.drawIndirectFirstInstance{ VK_TRUE },
+			.textureCompressionBC{ supportedFeatures.textureCompressionBC },
+			.fragmentStoresAndAtomics{ VK_TRUE },
 		};
 
 		constexpr float graphicsQueuePriority{ 1.0f };
 
-		VkDeviceQueueCreateInfo graphicsQueueCI
+		constexpr float transferQueuePriority{ 0.5f };
+
+		VkDeviceQueueCreateInfo queueCIs[2]
 		{
-			.sType{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO },
-			.queueFamilyIndex{ graphicsQueueFamily },
-			.queueCount{ 1 },
-			.pQueuePriorities{ &graphicsQueuePriority }
+			{
+				.sType{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO },
+				.queueFamilyIndex{ graphicsQueueFamily },
+				.queueCount{ 1 },
+				.pQueuePriorities{ &graphicsQueuePriority }
+			},
+			{
+				.sType{ VK_STRUCTURE_TYPE_DEVICE_QUEUE_CREATE_INFO },
+				.queueFamilyIndex{ transferQueueFamily },
+				.queueCount{ 1 },
+				.pQueuePriorities{ &transferQueuePriority }
+			},
 		};
 
 		std::vector<const char*> extensions{};
@@ -42,10 +87,11 @@ namespace Graphics
 		{
 			.sType{ VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO },
 			.pNext{ &vulkan12Features },
-			.queueCreateInfoCount{ 1 },
-			.pQueueCreateInfos{ &graphicsQueueCI },
+			.queueCreateInfoCount{ transferQueueFamily != graphicsQueueFamily ? 2u : 1u },
+			.pQueueCreateInfos{ queueCIs },
 			.enabledExtensionCount{ static_cast<std::uint32_t>(extensions.size()) },
 			.ppEnabledExtensionNames{ extensions.data() },
+			.pEnabledFeatures{ &features },
 		};
 
 		VkDevice device{};
@@ -54,6 +100,7 @@ namespace Graphics
 		volkLoadDevice(device);
 
 		vkGetDeviceQueue(device, graphicsQueueFamily, 0, &graphicsQueue);
+		vkGetDeviceQueue(device, transferQueueFamily, 0, &transferQueue);
 
 		return device;
 	}
@@ -7,6 +7,11 @@
 namespace Graphics
 {
 
-	VkDevice createDevice(VkPhysicalDevice physicalDevice, std::uint32_t graphicsQueueFamily, VkQueue& graphicsQueue);
+	// Whether shaders can do arithmetic on 16 bit floats. createDevice enables it where it is.
+	bool supportsShaderFloat16(VkPhysicalDevice physicalDevice);
+
+	// transferQueueFamily may equal graphicsQueueFamily, in which case both queues are the same
+	VkDevice createDevice(VkPhysicalDevice physicalDevice, std::uint32_t graphicsQueueFamily, VkQueue& graphicsQueue,
+		std::uint32_t transferQueueFamily, VkQueue& transferQueue);
 
 }
\ No newline at end of file
@@ -1,16 +1,29 @@
 #include "frame.hpp"
 
 #include "alloc.hpp"
+#include "cluster_culler.hpp"
 #include "cmd_buffer.hpp"
+#include "depth_pyramid.hpp"
+#include "hlod.hpp"
 #include "sync.hpp"
 #include "swapchain.hpp"
 #include "mesh.hpp"
+#include "scatter.hpp"
+#include "static_batch.hpp"
 #include "attachment.hpp"
+#include "texture_cache.hpp"
+#include "texture_packer.hpp"
+#include "virtual_texture.hpp"
 
 #include "volk/volk.h"
 #include "VMA/vk_mem_alloc.h"
 #include "glm/glm.hpp"
 
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
 #include <cstdint>
 #include <cstring>
 #include <utility>
@@ -22,31 +35,84 @@ namespace Graphics
 	struct QueuedMesh
 	{
 		const RenderObject::Mesh& mesh{};
-		const glm::mat4& transform{};
+		const InstanceBatch& batch{};
 	};
 
+	namespace
+	{
+		UberVariant meshUberVariant(const RenderObject::Mesh& mesh)
+		{
+			if (mesh.textureIndex == TextureCache::noTexture)
+			{
+				return { MaterialClass::Untextured, TextureKind::Any };
+			}
+			const TextureKind textures{ mesh.textureIndex >= TexturePacker::firstIndex ? TextureKind::Array
+				: mesh.textureIndex >= VirtualTextureCache::firstIndex ? TextureKind::Virtual : TextureKind::Regular };
+			// Virtual textures aren't checked for transparent texels when loaded, so they keep the cutout test
+			const bool opaque{ mesh.opaque && textures != TextureKind::Virtual };
+			return { opaque ? MaterialClass::TexturedOpaque : MaterialClass::AlphaTested, textures };
+		}
+	}
+
+	// Initial size of each frame's instance buffer, in instances. It grows on demand.
+	constexpr std::uint32_t initialInstanceCapacity{ 1024 };
+
+	std::array<std::uint32_t, 6> uberFragmentConstants(UberVariant variant, const UberShaderSettings& settings)
+	{
+		return
+		{
+			static_cast<std::uint32_t>(variant.material),
+			settings.pcfKernelSize / 2,
+			std::bit_cast<std::uint32_t>(settings.alphaCutoff),
+			TextureCache::maxTextures, // The shadow map's slot
+			static_cast<std::uint32_t>(variant.textures),
+			TextureCache::noTexture,
+		};
+	}
+
 	VkDescriptorSetLayout Frame::m_descriptorSetLayout{};
 
 	void Frame::init(VkDevice device)
 	{
-		VkDescriptorSetLayoutBinding setLayoutBinding
+		VkDescriptorSetLayoutBinding setLayoutBindings[3]
 		{
-			.binding{ 0 },
-			.descriptorType{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER },
-			.descriptorCount{ 1 },
-			.stageFlags{ VK_SHADER_STAGE_VERTEX_BIT },
+			{
+				.binding{ 0 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_VERTEX_BIT },
+			},
+
+			{
+				.binding{ 1 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_VERTEX_BIT },
+			},
+
+			// Texture streaming feedback
+			{
+				.binding{ 2 },
+				.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+				.descriptorCount{ 1 },
+				.stageFlags{ VK_SHADER_STAGE_FRAGMENT_BIT },
+			},
 		};
 		VkDescriptorSetLayoutCreateInfo setLayoutCI
 		{
 			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO },
-			.bindingCount{ 1 },
-			.pBindings{ &setLayoutBinding },
+			.bindingCount{ 3 },
+			.pBindings{ setLayoutBindings },
 		};
 		vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &m_descriptorSetLayout);
+
+		ClusterCuller::init(device);
 	}
 
 	void Frame::cleanup(VkDevice device)
 	{
+		ClusterCuller::cleanup(device);
+
 		vkDestroyDescriptorSetLayout(device, m_descriptorSetLayout, nullptr);
 	}
 
@@ -77,17 +143,17 @@ namespace Graphics
 		vmaCreateBuffer(allocator, &bufferCI, &allocCI, &m_cameraUBO.buffer, &m_cameraUBO.alloc, &allocInfo);
 		cameraUBOData = allocInfo.pMappedData;
 
-		VkDescriptorPoolSize size
+		VkDescriptorPoolSize sizes[2]
 		{
-			.type{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER },
-			.descriptorCount{ 1 },
+			{ VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 2 },
 		};
 		VkDescriptorPoolCreateInfo poolCI
 		{
 			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO },
 			.maxSets{ 1 },
-			.poolSizeCount{ 1 },
-			.pPoolSizes{ &size },
+			.poolSizeCount{ 2 },
+			.pPoolSizes{ sizes },
 		};
 		vkCreateDescriptorPool(device, &poolCI, nullptr, &m_descriptorPool);
 
@@ -116,6 +182,36 @@ namespace Graphics
 			.pBufferInfo{ &descriptorBufferInfo },
 		};
 		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+		// Read on the CPU once the frame's fence has signaled. The levels per texture slot are followed
+		// by the virtual texture page requests.
+		VkBufferCreateInfo feedbackCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ (VirtualTextureCache::feedbackOffset + 1 + VirtualTextureCache::maxFeedbackRequests) * sizeof(std::uint32_t) },
+			.usage{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		};
+		VmaAllocationCreateInfo feedbackAllocCI
+		{
+			.flags{ VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT },
+			.usage{ VMA_MEMORY_USAGE_AUTO },
+		};
+		vmaCreateBuffer(allocator, &feedbackCI, &feedbackAllocCI, &m_feedbackBuffer.buffer, &m_feedbackBuffer.alloc, &allocInfo);
+		m_feedbackData = allocInfo.pMappedData;
+
+		// Nothing has been sampled before the first frame
+		std::memset(m_feedbackData, 0xFF, feedbackCI.size);
+		static_cast<std::uint32_t*>(m_feedbackData)[VirtualTextureCache::feedbackOffset] = 0;
+		vmaFlushAllocation(allocator, m_feedbackBuffer.alloc, 0, VK_WHOLE_SIZE);
+
+		descriptorBufferInfo.buffer = m_feedbackBuffer.buffer;
+		write.dstBinding = 2;
+		write.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+		vkUpdateDescriptorSets(device, 1, &write, 0, nullptr);
+
+		reserveInstances(initialInstanceCapacity);
+
+		m_clusterCuller = ClusterCuller{ device, allocator };
 	}
 
 	Frame::Frame(Frame&& f) noexcept
@@ -143,6 +239,12 @@ namespace Graphics
 		vkResetFences(m_device, 1, &m_renderFence);
 	}
 
+	const std::uint32_t* Frame::textureFeedback()
+	{
+		vmaInvalidateAllocation(m_allocator, m_feedbackBuffer.alloc, 0, VK_WHOLE_SIZE);
+		return static_cast<const std::uint32_t*>(m_feedbackData);
+	}
+
 	void Frame::execute(const RenderInfo& renderInfo)
 	{
 		std::uint32_t swapchainImageIndex{ acquireNextSwapchainImage(m_device, renderInfo.swapchain, m_presentSemaphore) };
@@ -154,13 +256,42 @@ namespace Graphics
 		};
 		std::memcpy(cameraUBOData, &ubo, sizeof(CameraUBOData));
 
+		writeInstances(renderInfo);
+
 		vkResetCommandPool(m_device, m_cmdPool, 0);
 		beginCommandBuffer(m_cmdBuffer, true);
 
+		clearTextureFeedback();
+
+		// The static batch's hidden clusters are dropped before either pass draws it
+		if (!renderInfo.staticBatch.chunks().empty())
+		{
+			m_clusterCuller.cull(m_cmdBuffer, renderInfo.staticBatch, renderInfo.cameraView, renderInfo.cameraProj,
+				renderInfo.lightProj * renderInfo.lightView, renderInfo.depthPyramid, m_identityInstance);
+		}
+
 		shadowpass(renderInfo);
 
 		renderpass(renderInfo, swapchainImageIndex);
 
+		if (renderInfo.captureBuffer != VK_NULL_HANDLE)
+		{
+			capture(renderInfo, swapchainImageIndex);
+		}
+
+		// For the next frame to cull against
+		renderInfo.depthPyramid.build(m_cmdBuffer, renderInfo.depthImage.image, renderInfo.cameraView, renderInfo.cameraProj);
+
+		// Make the feedback visible to the host once the fence signals
+		VkMemoryBarrier feedbackBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_HOST_READ_BIT },
+		};
+		vkCmdPipelineBarrier(m_cmdBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_HOST_BIT, 0,
+			1, &feedbackBarrier, 0, nullptr, 0, nullptr);
+
 		vkEndCommandBuffer(m_cmdBuffer);
 
 		queueSubmit(renderInfo.queue, m_cmdBuffer, m_presentSemaphore, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, m_renderSemaphore, m_renderFence);
@@ -168,6 +299,166 @@ namespace Graphics
 		swapchainQueuePresent(renderInfo.queue, renderInfo.swapchain, m_renderSemaphore, swapchainImageIndex);
 	}
 
+	void Frame::clearTextureFeedback()
+	{
+		vkCmdFillBuffer(m_cmdBuffer, m_feedbackBuffer.buffer, 0, VK_WHOLE_SIZE, ~0u);
+		vkCmdFillBuffer(m_cmdBuffer, m_feedbackBuffer.buffer, VirtualTextureCache::feedbackOffset * sizeof(std::uint32_t), sizeof(std::uint32_t), 0);
+
+		VkMemoryBarrier clearBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+		};
+		vkCmdPipelineBarrier(m_cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0,
+			1, &clearBarrier, 0, nullptr, 0, nullptr);
+	}
+
+	void Frame::reserveInstances(std::uint32_t count)
+	{
+		if (count <= m_instanceCapacity)
+		{
+			return;
+		}
+
+		// Only called after waitFrame(), so the GPU is no longer reading the old buffer
+		if (m_instanceBuffer.buffer != VK_NULL_HANDLE)
+		{
+			vmaDestroyBuffer(m_allocator, m_instanceBuffer.buffer, m_instanceBuffer.alloc);
+		}
+
+		m_instanceCapacity = std::max(count, m_instanceCapacity * 2);
+
+		VkBufferCreateInfo bufferCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ m_instanceCapacity * sizeof(glm::mat4) },
+			.usage{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		};
+		VmaAllocationCreateInfo allocCI
+		{
+			.flags{ VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT },
+		};
+		VmaAllocationInfo allocInfo{};
+		vmaCreateBuffer(m_allocator, &bufferCI, &allocCI, &m_instanceBuffer.buffer, &m_instanceBuffer.alloc, &allocInfo);
+		m_instanceData = allocInfo.pMappedData;
+
+		VkDescriptorBufferInfo descriptorBufferInfo
+		{
+			.buffer{ m_instanceBuffer.buffer },
+			.offset{ 0 },
+			.range{ VK_WHOLE_SIZE },
+		};
+		VkWriteDescriptorSet write
+		{
+			.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+			.dstSet{ m_descriptorSet },
+			.dstBinding{ 1 },
+			.descriptorCount{ 1 },
+			.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+			.pBufferInfo{ &descriptorBufferInfo },
+		};
+		vkUpdateDescriptorSets(m_device, 1, &write, 0, nullptr);
+	}
+
+	void Frame::writeInstances(const RenderInfo& renderInfo)
+	{
+		// Distant clusters of instances are replaced by their HLOD proxy, static instances are drawn by the static batch.
+		// Streamed instances are only there while their tile is near the camera, so they are always drawn, and the
+		// proxies of the other tiles stand in for theirs.
+		const glm::vec3 cameraPosition{ glm::inverse(renderInfo.cameraView)[3] };
+		const float projectionScale{ std::abs(renderInfo.cameraProj[1][1]) * renderInfo.windowExtent.height * 0.5f };
+
+		m_proxies.clear();
+		m_hiddenInstances.assign(renderInfo.renderObjectInstances.size(), 0);
+		renderInfo.hlod.select(cameraPosition, projectionScale, renderInfo.loadedTiles, m_proxies, m_hiddenInstances);
+
+		// While the scene is still loading there is no static batch yet, and static instances are drawn one by one
+		const bool batched{ !renderInfo.staticBatch.chunks().empty() };
+		for (std::size_t i{ 0 }; i < renderInfo.renderObjectInstances.size(); ++i)
+		{
+			if (batched && renderInfo.renderObjectInstances[i].isStatic)
+			{
+				m_hiddenInstances[i] = 1;
+			}
+		}
+
+		// Counting sort of the instances by render object, so that every render object's
+		// transforms are contiguous and each mesh can be drawn with a single instanced call
+		std::vector<std::uint32_t> counts(renderInfo.renderObjects.size() + 1, 0u);
+		for (std::size_t i{ 0 }; i < renderInfo.renderObjectInstances.size(); ++i)
+		{
+			if (!m_hiddenInstances[i])
+			{
+				++counts[renderInfo.renderObjectInstances[i].renderObject + 1];
+			}
+		}
+		for (const auto& instance : renderInfo.streamedInstances)
+		{
+			++counts[instance.renderObject + 1];
+		}
+		for (std::size_t i{ 1 }; i < counts.size(); ++i)
+		{
+			counts[i] += counts[i - 1];
+		}
+
+		const std::uint32_t instanceCount{ counts.back() };
+		reserveInstances(instanceCount + 1);
+
+		m_instanceBatches.clear();
+		for (std::size_t i{ 0 }; i + 1 < counts.size(); ++i)
+		{
+			if (counts[i + 1] > counts[i])
+			{
+				m_instanceBatches.push_back({
+					.renderObject{ static_cast<int>(i) },
+					.firstInstance{ counts[i] },
+					.instanceCount{ counts[i + 1] - counts[i] },
+					});
+			}
+		}
+
+		glm::mat4* transforms{ static_cast<glm::mat4*>(m_instanceData) };
+		for (std::size_t i{ 0 }; i < renderInfo.renderObjectInstances.size(); ++i)
+		{
+			if (!m_hiddenInstances[i])
+			{
+				const auto& instance{ renderInfo.renderObjectInstances[i] };
+				transforms[counts[instance.renderObject]++] = instance.transform;
+			}
+		}
+		for (const auto& instance : renderInfo.streamedInstances)
+		{
+			transforms[counts[instance.renderObject]++] = instance.transform;
+		}
+
+		// Proxies and static chunks are already in world space
+		m_identityInstance = instanceCount;
+		transforms[m_identityInstance] = glm::mat4{ 1.0f };
+
+		vmaFlushAllocation(m_allocator, m_instanceBuffer.alloc, 0, (instanceCount + 1) * sizeof(glm::mat4));
+	}
+
+	void Frame::drawProxies(const RenderInfo& renderInfo)
+	{
+		if (m_proxies.empty())
+		{
+			return;
+		}
+
+		// Proxy materials are baked into vertex colors
+		PushConstants pushConstants{ .textureIndex{ TextureCache::noTexture } };
+		vkCmdPushConstants(m_cmdBuffer, renderInfo.pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants), &pushConstants);
+
+		for (std::uint32_t proxy : m_proxies)
+		{
+			const HLODCluster& cluster{ renderInfo.hlod.clusters()[proxy] };
+			vkCmdDrawIndexed(m_cmdBuffer, cluster.indexCount, 1, cluster.firstIndex, 0, m_identityInstance);
+		}
+	}
+
 	void Frame::shadowpass(const RenderInfo& renderInfo)
 	{
 		correctDepthAttachmentImageLayout(renderInfo.shadowImage.image, m_cmdBuffer);
@@ -198,35 +489,10 @@ namespace Graphics
 
 		vkCmdBeginRendering(m_cmdBuffer, &renderingInfo);
 
-		vkCmdBindPipeline(m_cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderInfo.shadowPipeline);
-
-		VkDescriptorSet descriptorSets[2]
-		{
-			m_descriptorSet,
-			renderInfo.descriptorSet
-		};
-		vkCmdBindDescriptorSets(m_cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderInfo.pipelineLayout, 0, 2, descriptorSets, 0, nullptr);
-
-		constexpr VkDeviceSize offset{ 0 };
-		vkCmdBindVertexBuffers(m_cmdBuffer, 0, 1, &renderInfo.vertexBuffer.buffer, &offset);
-
-		for (const auto& instance : renderInfo.renderObjectInstances)
+		// Until the asset loader publishes the scene, the pass only clears
+		if (!renderInfo.renderObjects.empty())
 		{
-			for (const auto& mesh : renderInfo.renderObjects[instance.renderObject].meshes)
-			{
-				if (mesh.draw)
-				{
-					if (mesh.opaque)
-					{
-						PushConstants pushConstants{ instance.transform };
-						vkCmdPushConstants(m_cmdBuffer, renderInfo.pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants),
-							&pushConstants);
-
-						vkCmdBindIndexBuffer(m_cmdBuffer, mesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-						vkCmdDrawIndexed(m_cmdBuffer, mesh.indexCount, 1, 0, 0, 0);
-					}
-				}
-			}
+			drawShadowCasters(renderInfo);
 		}
 
 		vkCmdEndRendering(m_cmdBuffer);
@@ -290,6 +556,59 @@ namespace Graphics
 
 		vkCmdBeginRendering(m_cmdBuffer, &renderingInfo);
 
+		if (!renderInfo.renderObjects.empty())
+		{
+			drawScene(renderInfo);
+		}
+
+		vkCmdEndRendering(m_cmdBuffer);
+
+		prepareImageForPresentation(m_cmdBuffer, renderInfo.swapchainImages[swapchainImageIndex]);
+	}
+
+	void Frame::drawShadowCasters(const RenderInfo& renderInfo)
+	{
+		vkCmdBindPipeline(m_cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderInfo.shadowPipeline);
+
+		VkDescriptorSet descriptorSets[2]
+		{
+			m_descriptorSet,
+			renderInfo.descriptorSet
+		};
+		vkCmdBindDescriptorSets(m_cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderInfo.pipelineLayout, 0, 2, descriptorSets, 0, nullptr);
+
+		constexpr VkDeviceSize offset{ 0 };
+		vkCmdBindVertexBuffers(m_cmdBuffer, 0, 1, &renderInfo.vertexBuffer.buffer, &offset);
+
+		// Every mesh's indices live in the geometry arena, so this is the only index buffer bind of the pass
+		vkCmdBindIndexBuffer(m_cmdBuffer, renderInfo.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
+		PushConstants pushConstants{};
+		vkCmdPushConstants(m_cmdBuffer, renderInfo.pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants), &pushConstants);
+
+		for (const auto& batch : m_instanceBatches)
+		{
+			for (const auto& mesh : renderInfo.renderObjects[batch.renderObject].meshes)
+			{
+				if (mesh.draw)
+				{
+					if (mesh.opaque)
+					{
+						vkCmdDrawIndexed(m_cmdBuffer, mesh.indexCount, batch.instanceCount, mesh.firstIndex, 0, batch.firstInstance);
+					}
+				}
+			}
+		}
+
+		drawProxies(renderInfo);
+
+		m_clusterCuller.draw(m_cmdBuffer, renderInfo.pipelineLayout, renderInfo.staticBatch, ClusterView::Light, true);
+
+		renderInfo.scatter.draw(m_cmdBuffer, renderInfo.pipelineLayout, renderInfo.renderObjects, true);
+	}
+
+	void Frame::drawScene(const RenderInfo& renderInfo)
+	{
 		VkDescriptorSet descriptorSets[2]
 		{
 			m_descriptorSet,
@@ -300,57 +619,134 @@ namespace Graphics
 		constexpr VkDeviceSize offset{ 0 };
 		vkCmdBindVertexBuffers(m_cmdBuffer, 0, 1, &renderInfo.vertexBuffer.buffer, &offset);
 
+		// Every mesh's indices live in the geometry arena, so this is the only index buffer bind of the pass
+		vkCmdBindIndexBuffer(m_cmdBuffer, renderInfo.indexBuffer, 0, VK_INDEX_TYPE_UINT32);
+
 		vkCmdBindPipeline(m_cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderInfo.skyboxPipeline);
 
 		glm::mat4 view{ glm::mat3{ renderInfo.cameraView } };
 		PushConstants pushConstant{ { renderInfo.cameraProj * view }, 0 };
 		vkCmdPushConstants(m_cmdBuffer, renderInfo.pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants), &pushConstant);
 
-		vkCmdBindIndexBuffer(m_cmdBuffer, renderInfo.renderObjects[renderInfo.skyboxRenderObjectIndex].meshes[0].indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-		vkCmdDrawIndexed(m_cmdBuffer, renderInfo.renderObjects[renderInfo.skyboxRenderObjectIndex].meshes[0].indexCount, 1, 0, 0, 0);
+		const auto& skyboxMesh{ renderInfo.renderObjects[renderInfo.skyboxRenderObjectIndex].meshes[0] };
+		vkCmdDrawIndexed(m_cmdBuffer, skyboxMesh.indexCount, 1, skyboxMesh.firstIndex, 0, 0);
 
-		vkCmdBindPipeline(m_cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, renderInfo.pipeline);
+		// Variants still compiling fall back to the generic pipeline, so neighbours often share one
+		VkPipeline boundPipeline{ VK_NULL_HANDLE };
+		const auto bindMaterial{ [&](UberVariant variant)
+		{
+			VkPipeline pipeline{ renderInfo.pipelines[uberVariantIndex(variant)] };
+			if (pipeline != boundPipeline)
+			{
+				vkCmdBindPipeline(m_cmdBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipeline);
+				boundPipeline = pipeline;
+			}
+		} };
 
 		// Meshes with transparency should be drawn last
 		std::vector<QueuedMesh> meshQueue{};
 
-		for (const auto& instance : renderInfo.renderObjectInstances)
+		for (const auto& batch : m_instanceBatches)
 		{
-			for (const auto& mesh : renderInfo.renderObjects[instance.renderObject].meshes)
+			for (const auto& mesh : renderInfo.renderObjects[batch.renderObject].meshes)
 			{
 				if (mesh.draw)
 				{
 					if (mesh.opaque)
 					{
-						PushConstants pushConstants{ instance.transform, mesh.textureIndex };
+						bindMaterial(meshUberVariant(mesh));
+
+						PushConstants pushConstants{ .textureIndex{ mesh.textureIndex } };
 						vkCmdPushConstants(m_cmdBuffer, renderInfo.pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants), &pushConstants);
 
-						vkCmdBindIndexBuffer(m_cmdBuffer, mesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-						vkCmdDrawIndexed(m_cmdBuffer, mesh.indexCount, 1, 0, 0, 0);
+						vkCmdDrawIndexed(m_cmdBuffer, mesh.indexCount, batch.instanceCount, mesh.firstIndex, 0, batch.firstInstance);
 					}
 					else
 					{
 						meshQueue.push_back({
 							.mesh{ mesh },
-							.transform{ instance.transform },
+							.batch{ batch },
 							});
 					}
 				}
 			}
 		}
+
+		bindMaterial({ MaterialClass::Untextured, TextureKind::Any });
+		drawProxies(renderInfo);
+
+		// Chunks and scattered meshes of every kind share their draws
+		bindMaterial({ MaterialClass::Generic, TextureKind::Any });
+		m_clusterCuller.draw(m_cmdBuffer, renderInfo.pipelineLayout, renderInfo.staticBatch, ClusterView::Camera, true);
+
+		renderInfo.scatter.draw(m_cmdBuffer, renderInfo.pipelineLayout, renderInfo.renderObjects, true);
 		
 		for (const auto& queuedMesh : meshQueue)
 		{
-			PushConstants pushConstants{ queuedMesh.transform, queuedMesh.mesh.textureIndex };
+			bindMaterial(meshUberVariant(queuedMesh.mesh));
+
+			PushConstants pushConstants{ .textureIndex{ queuedMesh.mesh.textureIndex } };
 			vkCmdPushConstants(m_cmdBuffer, renderInfo.pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants), &pushConstants);
 
-			vkCmdBindIndexBuffer(m_cmdBuffer, queuedMesh.mesh.indexBuffer.buffer, 0, VK_INDEX_TYPE_UINT32);
-			vkCmdDrawIndexed(m_cmdBuffer, queuedMesh.mesh.indexCount, 1, 0, 0, 0);
+			vkCmdDrawIndexed(m_cmdBuffer, queuedMesh.mesh.indexCount, queuedMesh.batch.instanceCount, queuedMesh.mesh.firstIndex, 0, queuedMesh.batch.firstInstance);
 		}
-		
-		vkCmdEndRendering(m_cmdBuffer);
 
-		prepareImageForPresentation(m_cmdBuffer, renderInfo.swapchainImages[swapchainImageIndex]);
+		bindMaterial({ MaterialClass::Generic, TextureKind::Any });
+		m_clusterCuller.draw(m_cmdBuffer, renderInfo.pipelineLayout, renderInfo.staticBatch, ClusterView::Camera, false);
+
+		renderInfo.scatter.draw(m_cmdBuffer, renderInfo.pipelineLayout, renderInfo.renderObjects, false);
+	}
+
+	void Frame::capture(const RenderInfo& renderInfo, std::uint32_t swapchainImageIndex)
+	{
+		VkImageMemoryBarrier imageBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_TRANSFER_READ_BIT },
+			.oldLayout{ VK_IMAGE_LAYOUT_PRESENT_SRC_KHR },
+			.newLayout{ VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL },
+			.image{ renderInfo.swapchainImages[swapchainImageIndex] },
+			.subresourceRange
+			{
+				.aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT },
+				.baseMipLevel{ 0 },
+				.levelCount{ 1 },
+				.baseArrayLayer{ 0 },
+				.layerCount{ 1 },
+			},
+		};
+		vkCmdPipelineBarrier(m_cmdBuffer, VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT, 0,
+			0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		VkBufferImageCopy region
+		{
+			.bufferOffset{ 0 },
+			.imageSubresource
+			{
+				.aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT },
+				.mipLevel{ 0 },
+				.baseArrayLayer{ 0 },
+				.layerCount{ 1 },
+			},
+			.imageExtent{ renderInfo.windowExtent.width, renderInfo.windowExtent.height, 1 },
+		};
+		vkCmdCopyImageToBuffer(m_cmdBuffer, imageBarrier.image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, renderInfo.captureBuffer, 1, &region);
+
+		// Back for presentation, and the copy made visible to the host once the fence signals
+		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_NONE;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+		VkMemoryBarrier copyBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_HOST_READ_BIT },
+		};
+		vkCmdPipelineBarrier(m_cmdBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_HOST_BIT | VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT, 0,
+			1, &copyBarrier, 0, nullptr, 1, &imageBarrier);
 	}
 
 	void Frame::destroyObjects()
@@ -359,6 +755,8 @@ namespace Graphics
 		{
 			vkDestroyDescriptorPool(m_device, m_descriptorPool, nullptr);
 
+			vmaDestroyBuffer(m_allocator, m_feedbackBuffer.buffer, m_feedbackBuffer.alloc);
+			vmaDestroyBuffer(m_allocator, m_instanceBuffer.buffer, m_instanceBuffer.alloc);
 			vmaDestroyBuffer(m_allocator, m_cameraUBO.buffer, m_cameraUBO.alloc);
 
 			vkDestroyFence(m_device, m_renderFence, nullptr);
@@ -385,6 +783,20 @@ namespace Graphics
 		m_cameraUBO = f.m_cameraUBO;
 		cameraUBOData = f.cameraUBOData;
 
+		m_instanceBuffer = f.m_instanceBuffer;
+		m_instanceData = f.m_instanceData;
+		m_instanceCapacity = f.m_instanceCapacity;
+		m_instanceBatches = std::move(f.m_instanceBatches);
+
+		m_feedbackBuffer = f.m_feedbackBuffer;
+		m_feedbackData = f.m_feedbackData;
+
+		m_proxies = std::move(f.m_proxies);
+		m_hiddenInstances = std::move(f.m_hiddenInstances);
+		m_identityInstance = f.m_identityInstance;
+
+		m_clusterCuller = std::move(f.m_clusterCuller);
+
 		m_descriptorPool = f.m_descriptorPool;
 		m_descriptorSet = f.m_descriptorSet;
 	}
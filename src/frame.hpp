@@ -1,12 +1,19 @@
 #pragma once
 
 #include "alloc.hpp"
+#include "cluster_culler.hpp"
+#include "depth_pyramid.hpp"
+#include "hlod.hpp"
 #include "mesh.hpp"
+#include "scatter.hpp"
+#include "static_batch.hpp"
 
 #include "volk/volk.h"
 #include "VMA/vk_mem_alloc.h"
 #include "glm/glm.hpp"
 
+#include <array>
+#include <cstddef>
 #include <cstdint>
 #include <vector>
 
@@ -23,14 +30,80 @@ namespace Graphics
 	{
 		glm::mat4 vertexTransform{};
 		std::uint32_t textureIndex{};
+		std::uint32_t instanceSource{}; // 0 reads the frame's instance buffer, 1 the scattered instances
 	};
 
+	// The specializations of uber.frag. Each one only has the instructions for one kind of mesh, Generic decides
+	// per draw and can draw any of them. Must match uber.frag.
+	enum class MaterialClass : std::uint32_t
+	{
+		Generic,
+		Untextured,
+		TexturedOpaque,
+		AlphaTested,
+	};
+	inline constexpr std::size_t materialClassCount{ 4 };
+
+	// The kind of texture a specialization of uber.frag samples. Any decides per draw from the texture index, as
+	// Generic needs. Must match uber.frag.
+	enum class TextureKind : std::uint32_t
+	{
+		Any,
+		Regular,
+		Virtual,
+		Array,
+	};
+	inline constexpr std::size_t textureKindCount{ 4 };
+
+	struct UberVariant
+	{
+		MaterialClass material{};
+		TextureKind   textures{};
+	};
+
+	// Every variant meshes are drawn with. Virtual textures always keep the cutout test, and the other combinations
+	// are never drawn, so their slots hold the generic pipeline.
+	inline constexpr UberVariant uberVariants[]
+	{
+		{ MaterialClass::Generic, TextureKind::Any },
+		{ MaterialClass::Untextured, TextureKind::Any },
+		{ MaterialClass::TexturedOpaque, TextureKind::Regular },
+		{ MaterialClass::TexturedOpaque, TextureKind::Array },
+		{ MaterialClass::AlphaTested, TextureKind::Regular },
+		{ MaterialClass::AlphaTested, TextureKind::Virtual },
+		{ MaterialClass::AlphaTested, TextureKind::Array },
+	};
+	inline constexpr std::size_t uberVariantCount{ materialClassCount * textureKindCount };
+
+	// Slot of a variant in the arrays of uber pipelines
+	constexpr std::size_t uberVariantIndex(UberVariant variant)
+	{
+		return static_cast<std::size_t>(variant.material) * textureKindCount + static_cast<std::size_t>(variant.textures);
+	}
+
+	struct UberShaderSettings
+	{
+		std::uint32_t pcfKernelSize{ 3 };   // Shadow map texels averaged on a side, odd
+		float         alphaCutoff{ 0.2f }; // Cutout texels at or below this alpha are discarded
+	};
+
+	// The values of uber.frag's specialization constants in constant_id order
+	std::array<std::uint32_t, 6> uberFragmentConstants(UberVariant variant, const UberShaderSettings& settings);
+
 	struct ShadowPassPushConstants
 	{
 		glm::mat4 vertexTransform{};
 		glm::mat4 lightTransform{};
 	};
 
+	// A run of instances of one render object, laid out contiguously in the instance buffer
+	struct InstanceBatch
+	{
+		int           renderObject{};
+		std::uint32_t firstInstance{};
+		std::uint32_t instanceCount{};
+	};
+
 	struct RenderInfo
 	{
 		VkQueue queue{};
@@ -43,23 +116,31 @@ namespace Graphics
 		VkImageView colorImageView{};
 		const Image& depthImage{};
 		VkImageView depthImageView{};
+		DepthPyramid& depthPyramid; // Of the previous frame until this one rebuilds it
 		const Image& shadowImage{};
 		VkImageView shadowImageView{};
 		bool firstFrame{};
-		VkPipeline pipeline{};
+		std::array<VkPipeline, uberVariantCount> pipelines{}; // uber, indexed by uberVariantIndex()
 		VkPipeline shadowPipeline{};
 		VkPipeline skyboxPipeline{};
 		VkPipelineLayout pipelineLayout{};
 		VkPipelineLayout shadowPipelineLayout{};
 		const Buffer& vertexBuffer{};
+		VkBuffer indexBuffer{};
 		const std::vector<RenderObject>& renderObjects{};
 		const std::vector<RenderObjectInstance>& renderObjectInstances{};
+		const std::vector<RenderObjectInstance>& streamedInstances{};
+		const std::vector<std::uint8_t>& loadedTiles{};
+		const Scatter& scatter{};
+		const HLOD& hlod{};
+		const StaticBatch& staticBatch{};
 		VkDescriptorSet descriptorSet{};
 		const glm::mat4& cameraView{};
 		const glm::mat4& cameraProj{};
 		const glm::mat4& lightView{};
 		const glm::mat4& lightProj{};
 		int skyboxRenderObjectIndex{};
+		VkBuffer captureBuffer{}; // If set, the presented image is also copied here, tightly packed
 	};
 
 	class Frame
@@ -81,6 +162,10 @@ namespace Graphics
 		void waitFrame();
 		void execute(const RenderInfo& renderInfo);
 
+		// What uber.frag reported about each texture slot and the virtual texture pages it wanted the last time
+		// this frame ran. Only valid after waitFrame().
+		const std::uint32_t* textureFeedback();
+
 		void* cameraUBOData{};
 
 		static VkDescriptorSetLayout getDescriptorSetLayout()
@@ -98,6 +183,21 @@ namespace Graphics
 
 		Buffer m_cameraUBO{};
 
+		Buffer        m_instanceBuffer{};
+		void*         m_instanceData{};
+		std::uint32_t m_instanceCapacity{};
+
+		std::vector<InstanceBatch> m_instanceBatches{};
+
+		Buffer m_feedbackBuffer{};
+		void*  m_feedbackData{};
+
+		std::vector<std::uint32_t> m_proxies{};
+		std::vector<std::uint8_t>  m_hiddenInstances{};
+		std::uint32_t              m_identityInstance{}; // Instance buffer slot holding the identity transform proxies and static chunks are drawn with
+
+		ClusterCuller m_clusterCuller{};
+
 		VkDescriptorPool      m_descriptorPool{};
 		static VkDescriptorSetLayout m_descriptorSetLayout;
 		VkDescriptorSet       m_descriptorSet{};
@@ -106,8 +206,16 @@ namespace Graphics
 		VkDevice m_device{};
 		VmaAllocator m_allocator{};
 
+		void reserveInstances(std::uint32_t count);
+		void writeInstances(const RenderInfo& renderInfo);
+		void drawProxies(const RenderInfo& renderInfo);
+		void clearTextureFeedback();
+
 		void shadowpass(const RenderInfo& renderInfo);
 		void renderpass(const RenderInfo& renderInfo, std::uint32_t swapchainImageIndex);
+		void capture(const RenderInfo& renderInfo, std::uint32_t swapchainImageIndex);
+		void drawShadowCasters(const RenderInfo& renderInfo);
+		void drawScene(const RenderInfo& renderInfo);
 
 		void destroyObjects();
 		void move(Frame&& f);
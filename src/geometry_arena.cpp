@@ -0,0 +1,189 @@
+#include "geometry_arena.hpp"
+
+#include "alloc.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	GeometryArena::GeometryArena(std::uint32_t indexCapacity, UploadManager& uploader, VmaAllocator allocator)
+		: m_indexCapacity{ indexCapacity },
+		  m_uploader{ &uploader },
+		  m_allocator{ allocator }
+	{
+		m_indexBuffer = createBuffer(indexCapacity);
+		m_freeRanges.push_back({ .first{ 0 }, .count{ indexCapacity } });
+	}
+
+	GeometryArena::GeometryArena(GeometryArena&& g) noexcept
+	{
+		move(std::move(g));
+	}
+
+	GeometryArena& GeometryArena::operator=(GeometryArena&& g) noexcept
+	{
+		destroy();
+		move(std::move(g));
+		return *this;
+	}
+
+	GeometryArena::~GeometryArena()
+	{
+		destroy();
+	}
+
+	GeometryRange GeometryArena::allocateIndices(const std::vector<std::uint32_t>& indices)
+	{
+		const IndexWrite write{ beginIndices(static_cast<std::uint32_t>(indices.size())) };
+		std::copy(indices.begin(), indices.end(), write.indices);
+		endIndices(write);
+
+		return write.range;
+	}
+
+	IndexWrite GeometryArena::beginIndices(std::uint32_t count)
+	{
+		if (count == 0)
+		{
+			return {};
+		}
+
+		auto fits = [count](const GeometryRange& r) { return r.count >= count; };
+
+		// Out of space: move everything into a buffer twice the size, the new tail becomes free space
+		Buffer oldBuffer{};
+		std::uint32_t oldCapacity{ m_indexCapacity };
+		if (std::find_if(m_freeRanges.begin(), m_freeRanges.end(), fits) == m_freeRanges.end())
+		{
+			const std::uint32_t newCapacity{ std::max(m_indexCapacity * 2, m_indexCapacity + count) };
+
+			oldBuffer = m_indexBuffer;
+			m_indexBuffer = createBuffer(newCapacity);
+			m_indexCapacity = newCapacity;
+			free({ .first{ oldCapacity }, .count{ newCapacity - oldCapacity } });
+		}
+
+		auto freeRange{ std::find_if(m_freeRanges.begin(), m_freeRanges.end(), fits) };
+		const GeometryRange range{ .first{ freeRange->first }, .count{ count } };
+		freeRange->first += count;
+		freeRange->count -= count;
+		if (freeRange->count == 0)
+		{
+			m_freeRanges.erase(freeRange);
+		}
+
+		if (oldBuffer.buffer != VK_NULL_HANDLE)
+		{
+			VkCommandBuffer commandBuffer{ m_uploader->transferCommands() };
+
+			// Earlier uploads into the old buffer may still be in flight on the same queue
+			VkMemoryBarrier barrier
+			{
+				.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+				.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+				.dstAccessMask{ VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT },
+			};
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			VkBufferCopy oldRegion{ .size{ oldCapacity * sizeof(std::uint32_t) } };
+			vkCmdCopyBuffer(commandBuffer, oldBuffer.buffer, m_indexBuffer.buffer, 1, &oldRegion);
+
+			// The new range may start in the old buffer's free tail
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 1, &barrier, 0, nullptr, 0, nullptr);
+
+			m_uploader->destroyAfterUpload(oldBuffer);
+
+			// A direct write could land in the old buffer's free tail before the copy above runs
+			m_uploader->wait(m_uploader->flush());
+		}
+
+		const BufferWrite write{ m_uploader->beginBufferWrite(m_indexBuffer, range.first * sizeof(std::uint32_t), count * sizeof(std::uint32_t)) };
+
+		return { range, static_cast<std::uint32_t*>(write.data), write };
+	}
+
+	void GeometryArena::endIndices(const IndexWrite& write)
+	{
+		if (write.range.count != 0)
+		{
+			m_uploader->endBufferWrite(write.write);
+		}
+	}
+
+	void GeometryArena::free(GeometryRange range)
+	{
+		if (range.count == 0)
+		{
+			return;
+		}
+
+		auto next{ std::lower_bound(m_freeRanges.begin(), m_freeRanges.end(), range.first,
+			[](const GeometryRange& r, std::uint32_t first) { return r.first < first; }) };
+
+		// Merge with the neighbours it touches
+		if (next != m_freeRanges.end() && range.first + range.count == next->first)
+		{
+			range.count += next->count;
+			next = m_freeRanges.erase(next);
+		}
+		if (next != m_freeRanges.begin())
+		{
+			auto previous{ std::prev(next) };
+			if (previous->first + previous->count == range.first)
+			{
+				previous->count += range.count;
+				return;
+			}
+		}
+
+		m_freeRanges.insert(next, range);
+	}
+
+	bool GeometryArena::fits(std::uint32_t count) const
+	{
+		return std::any_of(m_freeRanges.begin(), m_freeRanges.end(), [count](const GeometryRange& r) { return r.count >= count; });
+	}
+
+	Buffer GeometryArena::createBuffer(std::uint32_t indexCapacity) const
+	{
+		VkBufferCreateInfo bufferCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ indexCapacity * sizeof(std::uint32_t) },
+			.usage{ VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_SRC_BIT }
+		};
+
+		return m_uploader->createBuffer(bufferCI);
+	}
+
+	void GeometryArena::move(GeometryArena&& g)
+	{
+		m_indexBuffer = g.m_indexBuffer;
+		m_indexCapacity = g.m_indexCapacity;
+		m_freeRanges = std::move(g.m_freeRanges);
+
+		m_uploader = g.m_uploader;
+		m_allocator = g.m_allocator;
+		g.m_allocator = {};
+	}
+
+	void GeometryArena::destroy()
+	{
+		if (m_allocator != VmaAllocator{})
+		{
+			vmaDestroyBuffer(m_allocator, m_indexBuffer.buffer, m_indexBuffer.alloc);
+		}
+	}
+
+}
\ No newline at end of file
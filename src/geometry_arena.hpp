@@ -0,0 +1,86 @@
+#pragma once
+
+#include "alloc.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics
+{
+
+	// A span of indices suballocated from the arena
+	struct GeometryRange
+	{
+		std::uint32_t first{};
+		std::uint32_t count{};
+	};
+
+	// Indices being written into a freshly allocated range
+	struct IndexWrite
+	{
+		GeometryRange  range{};
+		std::uint32_t* indices{};
+		BufferWrite    write{};
+	};
+
+	// One device-local index buffer shared by every mesh, so draws never rebind it.
+	// Space is handed out first-fit from a free-list that coalesces on release.
+	class GeometryArena
+	{
+	public:
+		GeometryArena() = default;
+
+		// The uploader must outlive the arena
+		GeometryArena(std::uint32_t indexCapacity, UploadManager& uploader, VmaAllocator allocator);
+
+		GeometryArena(const GeometryArena&) = delete;
+		GeometryArena& operator=(const GeometryArena&) = delete;
+
+		GeometryArena(GeometryArena&& g) noexcept;
+		GeometryArena& operator=(GeometryArena&& g) noexcept;
+
+		~GeometryArena();
+
+		// Queues an upload of the indices into free space. The buffer is reallocated at twice the size
+		// when nothing fits, so indexBuffer() must be queried again after loading, and the arena must
+		// not grow while frames using the old buffer are in flight.
+		GeometryRange allocateIndices(const std::vector<std::uint32_t>& indices);
+
+		// Same, but the caller fills write.indices itself, which writes straight into the index buffer
+		// when its memory is host visible. The write follows the rules of UploadManager::beginBufferWrite.
+		IndexWrite beginIndices(std::uint32_t count);
+		void endIndices(const IndexWrite& write);
+
+		void free(GeometryRange range);
+
+		// Whether count indices can be allocated without growing the buffer, which is the only way
+		// to allocate while frames are in flight
+		bool fits(std::uint32_t count) const;
+
+		VkBuffer indexBuffer() const
+		{
+			return m_indexBuffer.buffer;
+		}
+
+	private:
+		Buffer        m_indexBuffer{};
+		std::uint32_t m_indexCapacity{};
+
+		// Sorted by first, never adjacent
+		std::vector<GeometryRange> m_freeRanges{};
+
+		// Not owned by the class
+		UploadManager* m_uploader{};
+		VmaAllocator   m_allocator{};
+
+		Buffer createBuffer(std::uint32_t indexCapacity) const;
+
+		void move(GeometryArena&& g);
+		void destroy();
+	};
+
+}
\ No newline at end of file
@@ -0,0 +1,307 @@
+#include "hlod.hpp"
+
+#include "alloc.hpp"
+#include "image.hpp"
+#include "mesh.hpp"
+#include "texture_cache.hpp"
+#include "texture_packer.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Accumulates every source vertex that falls into one simplification cell
+	struct ProxyCell
+	{
+		glm::vec3     pos{};
+		glm::vec3     norm{};
+		glm::vec3     color{};
+		std::uint32_t count{};
+	};
+
+	namespace
+	{
+		// Merges the instances into a single proxy, whose vertices are appended to vertices and whose cluster is appended
+		// to the build. Returns false if they draw nothing.
+		bool addCluster(HLODBuild& build, const HLODSettings& settings, const std::vector<RenderObject>& renderObjects,
+			const std::vector<RenderObjectInstance>& instances, const std::vector<std::uint32_t>& clusterInstances,
+			std::span<const glm::vec4> textureColors, const TexturePacker& packedTextures, std::vector<Vertex>& vertices)
+		{
+			// Materials are baked into the proxies' vertex colors, textured meshes contributing their average texel.
+			// Virtual textures are never whole on the CPU and keep the vertex color.
+			auto decodeColor = [](const glm::vec4& color)
+			{
+				return glm::vec3{ decodeSrgb(color.r), decodeSrgb(color.g), decodeSrgb(color.b) };
+			};
+			auto bakedColor = [&](const RenderObject::Mesh& mesh, const Vertex& vertex)
+			{
+				if (mesh.textureIndex < TextureCache::noTexture)
+				{
+					return decodeColor(textureColors[mesh.textureIndex]);
+				}
+				if (packedTextures.contains(mesh.textureIndex))
+				{
+					return decodeColor(packedTextures.averageColor(mesh.textureIndex, vertex.layer, vertex.tex));
+				}
+				return vertex.color;
+			};
+
+			glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+			glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+
+			for (std::uint32_t i : clusterInstances)
+			{
+				for (const auto& mesh : renderObjects[instances[i].renderObject].meshes)
+				{
+					if (mesh.draw)
+					{
+						for (std::uint32_t index : mesh.indices)
+						{
+							const glm::vec3 position{ instances[i].transform * glm::vec4{ vertices[index].pos, 1.0f } };
+							boundsMin = glm::min(boundsMin, position);
+							boundsMax = glm::max(boundsMax, position);
+						}
+					}
+				}
+			}
+
+			if (boundsMin.x > boundsMax.x)
+			{
+				return false;
+			}
+
+			const glm::vec3 extent{ boundsMax - boundsMin };
+			const float cellSize{ std::max({ extent.x, extent.y, extent.z }) / settings.proxyResolution };
+
+			std::unordered_map<glm::ivec3, std::uint32_t> cellIds{};
+			std::vector<ProxyCell> proxyCells{};
+			std::vector<std::uint32_t> clusterIndices{};
+
+			for (std::uint32_t i : clusterInstances)
+			{
+				const glm::mat4& transform{ instances[i].transform };
+				const glm::mat3 normalTransform{ glm::inverse(glm::transpose(glm::mat3{ transform })) };
+
+				for (const auto& mesh : renderObjects[instances[i].renderObject].meshes)
+				{
+					if (!mesh.draw)
+					{
+						continue;
+					}
+
+					for (std::size_t t{ 0 }; t + 2 < mesh.indices.size(); t += 3)
+					{
+						std::uint32_t ids[3]{};
+						for (std::size_t c{ 0 }; c < 3; ++c)
+						{
+							const Vertex& vertex{ vertices[mesh.indices[t + c]] };
+							const glm::vec3 position{ transform * glm::vec4{ vertex.pos, 1.0f } };
+
+							const glm::ivec3 key{ glm::floor((position - boundsMin) / cellSize) };
+							auto [it, inserted]{ cellIds.try_emplace(key, static_cast<std::uint32_t>(proxyCells.size())) };
+							if (inserted)
+							{
+								proxyCells.push_back({});
+							}
+
+							ProxyCell& proxyCell{ proxyCells[it->second] };
+							proxyCell.pos   += position;
+							proxyCell.norm  += normalTransform * vertex.norm;
+							proxyCell.color += bakedColor(mesh, vertex);
+							++proxyCell.count;
+
+							ids[c] = it->second;
+						}
+
+						// Triangles that collapse into fewer than three cells vanish from the proxy
+						if (ids[0] != ids[1] && ids[1] != ids[2] && ids[0] != ids[2])
+						{
+							clusterIndices.insert(clusterIndices.end(), ids, ids + 3);
+						}
+					}
+				}
+			}
+
+			const std::uint32_t baseVertex{ static_cast<std::uint32_t>(vertices.size()) };
+			for (const auto& proxyCell : proxyCells)
+			{
+				const float weight{ 1.0f / proxyCell.count };
+				const float normLength{ glm::length(proxyCell.norm) };
+				vertices.push_back({
+					.pos{ proxyCell.pos * weight },
+					.norm{ normLength > 0.0f ? proxyCell.norm / normLength : glm::vec3{ 0.0f } },
+					.color{ proxyCell.color * weight },
+					});
+			}
+
+			build.clusters.push_back({
+				.center{ (boundsMin + boundsMax) * 0.5f },
+				.radius{ glm::length(extent) * 0.5f },
+				.error{ cellSize },
+				.firstIndex{ static_cast<std::uint32_t>(build.indices.size()) },
+				.indexCount{ static_cast<std::uint32_t>(clusterIndices.size()) },
+				});
+
+			for (std::uint32_t index : clusterIndices)
+			{
+				build.indices.push_back(baseVertex + index);
+			}
+
+			return true;
+		}
+	}
+
+	HLODBuild buildHLOD(const HLODSettings& settings, const std::vector<RenderObject>& renderObjects, const std::vector<RenderObjectInstance>& instances,
+		std::span<const glm::vec4> textureColors, const TexturePacker& packedTextures, std::vector<Vertex>& vertices)
+	{
+		HLODBuild build{ .maxScreenError{ settings.maxScreenError } };
+
+		std::unordered_map<glm::ivec2, std::vector<std::uint32_t>> cells{};
+		for (std::uint32_t i{ 0 }; i < instances.size(); ++i)
+		{
+			// Static instances are already merged by the static batcher
+			if (instances[i].isStatic)
+			{
+				continue;
+			}
+
+			const glm::vec3 position{ instances[i].transform[3] };
+			cells[glm::ivec2{ glm::floor(glm::vec2{ position.x, position.z } / settings.clusterSize) }].push_back(i);
+		}
+
+		for (auto& [cell, clusterInstances] : cells)
+		{
+			if (addCluster(build, settings, renderObjects, instances, clusterInstances, textureColors, packedTextures, vertices))
+			{
+				build.clusters.back().instances = std::move(clusterInstances);
+			}
+		}
+
+		return build;
+	}
+
+	HLODBuild buildHLOD(const HLODSettings& settings, const std::vector<RenderObject>& renderObjects, const PlacementFile& placements,
+		const std::vector<RenderObjectInstance>& placedInstances, std::span<const glm::vec4> textureColors, const TexturePacker& packedTextures,
+		std::vector<Vertex>& vertices)
+	{
+		HLODBuild build{ .maxScreenError{ settings.maxScreenError } };
+
+		std::vector<std::uint32_t> cellInstances{};
+		std::uint32_t first{ 0 };
+		for (std::uint32_t cell{ 0 }; cell < placements.cells().size(); ++cell)
+		{
+			const std::uint32_t count{ placements.cells()[cell].placementCount };
+
+			// The static ones are already merged by the static batcher
+			cellInstances.clear();
+			for (std::uint32_t i{ first }; i < first + count; ++i)
+			{
+				if (!placedInstances[i].isStatic)
+				{
+					cellInstances.push_back(i);
+				}
+			}
+			first += count;
+
+			if (addCluster(build, settings, renderObjects, placedInstances, cellInstances, textureColors, packedTextures, vertices))
+			{
+				build.clusters.back().tile = cell;
+			}
+		}
+
+		return build;
+	}
+
+	HLOD::HLOD(HLODBuild&& build, GeometryArena& geometry)
+		: m_clusters{ std::move(build.clusters) },
+		  m_maxScreenError{ build.maxScreenError },
+		  m_geometry{ &geometry }
+	{
+		m_indexRange = geometry.allocateIndices(build.indices);
+		for (auto& cluster : m_clusters)
+		{
+			cluster.firstIndex += m_indexRange.first;
+		}
+	}
+
+	HLOD::HLOD(HLOD&& h) noexcept
+	{
+		move(std::move(h));
+	}
+
+	HLOD& HLOD::operator=(HLOD&& h) noexcept
+	{
+		destroy();
+		move(std::move(h));
+		return *this;
+	}
+
+	HLOD::~HLOD()
+	{
+		destroy();
+	}
+
+	void HLOD::select(const glm::vec3& cameraPosition, float projectionScale, std::span<const std::uint8_t> loadedTiles,
+		std::vector<std::uint32_t>& proxies, std::vector<std::uint8_t>& hiddenInstances) const
+	{
+		for (std::uint32_t c{ 0 }; c < m_clusters.size(); ++c)
+		{
+			const HLODCluster& cluster{ m_clusters[c] };
+
+			// A tile's proxy covers for it until its instances are streamed in, however close it is
+			if (cluster.tile != noHLODTile)
+			{
+				if (cluster.tile >= loadedTiles.size() || !loadedTiles[cluster.tile])
+				{
+					proxies.push_back(c);
+				}
+				continue;
+			}
+
+			const float distance{ glm::distance(cameraPosition, cluster.center) - cluster.radius };
+			if (distance <= 0.0f || cluster.error * projectionScale / distance >= m_maxScreenError)
+			{
+				continue;
+			}
+
+			proxies.push_back(c);
+			for (std::uint32_t instance : cluster.instances)
+			{
+				hiddenInstances[instance] = 1;
+			}
+		}
+	}
+
+	void HLOD::move(HLOD&& h)
+	{
+		m_clusters = std::move(h.m_clusters);
+		m_maxScreenError = h.m_maxScreenError;
+
+		m_indexRange = h.m_indexRange;
+
+		m_geometry = h.m_geometry;
+		h.m_geometry = {};
+	}
+
+	void HLOD::destroy()
+	{
+		if (m_geometry != nullptr)
+		{
+			m_geometry->free(m_indexRange);
+		}
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,100 @@
+#pragma once
+
+#include "alloc.hpp"
+#include "geometry_arena.hpp"
+#include "mesh.hpp"
+#include "scene_placement.hpp"
+#include "texture_packer.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct HLODSettings
+	{
+		float         clusterSize{ 400.0f };   // Width of the grid cells instances are clustered by, unless they come from a placement file
+		std::uint32_t proxyResolution{ 64 };   // Simplification cells along the longest side of a cluster
+		float         maxScreenError{ 1.5f };  // Pixels of error a proxy may show before its instances are drawn instead
+	};
+
+	constexpr std::uint32_t noHLODTile{ ~0u };
+
+	// A group of instances that can be replaced by a single merged, simplified proxy mesh
+	struct HLODCluster
+	{
+		glm::vec3                  center{};
+		float                      radius{};
+		float                      error{};      // World space deviation of the proxy from the source geometry
+		std::uint32_t              firstIndex{};
+		std::uint32_t              indexCount{};
+		std::vector<std::uint32_t> instances{};  // Empty for a tile's cluster, whose instances are streamed
+		std::uint32_t              tile{ noHLODTile }; // Placement cell whose dynamic placements the proxy stands in for
+	};
+
+	// The CPU side of an HLOD, built on any thread and uploaded by HLOD's constructor
+	struct HLODBuild
+	{
+		std::vector<HLODCluster>   clusters{}; // Their first index counts from the start of indices
+		std::vector<std::uint32_t> indices{};
+		float                      maxScreenError{};
+	};
+
+	// Needs the meshes' CPU index lists (see RenderObject's keepIndices) and must run before the vertex buffer is
+	// created, since the proxies' vertices are appended to vertices. Textured meshes bake in textureColors[slot],
+	// the average color of the texture in that slot of the bindless table.
+	HLODBuild buildHLOD(const HLODSettings& settings, const std::vector<RenderObject>& renderObjects, const std::vector<RenderObjectInstance>& instances,
+		std::span<const glm::vec4> textureColors, const TexturePacker& packedTextures, std::vector<Vertex>& vertices);
+	// The same for a streamed world, with one cluster per cell of the placement file holding the cell's dynamic placements.
+	// placedInstances holds every placement, decoded cell after cell.
+	HLODBuild buildHLOD(const HLODSettings& settings, const std::vector<RenderObject>& renderObjects, const PlacementFile& placements,
+		const std::vector<RenderObjectInstance>& placedInstances, std::span<const glm::vec4> textureColors, const TexturePacker& packedTextures,
+		std::vector<Vertex>& vertices);
+
+	class HLOD
+	{
+	public:
+		HLOD() = default;
+
+		// Uploads the proxies' indices
+		HLOD(HLODBuild&& build, GeometryArena& geometry);
+
+		HLOD(const HLOD&) = delete;
+		HLOD& operator=(const HLOD&) = delete;
+
+		HLOD(HLOD&& h) noexcept;
+		HLOD& operator=(HLOD&& h) noexcept;
+
+		~HLOD();
+
+		// Appends the clusters whose proxy error projects to less than maxScreenError pixels,
+		// and flags every instance they cover in hiddenInstances. A tile's cluster is appended
+		// instead whenever its flag in loadedTiles is clear or missing.
+		void select(const glm::vec3& cameraPosition, float projectionScale, std::span<const std::uint8_t> loadedTiles,
+			std::vector<std::uint32_t>& proxies, std::vector<std::uint8_t>& hiddenInstances) const;
+
+		const std::vector<HLODCluster>& clusters() const
+		{
+			return m_clusters;
+		}
+
+	private:
+		std::vector<HLODCluster> m_clusters{};
+		float                    m_maxScreenError{};
+
+		GeometryRange m_indexRange{};
+
+		// Not owned by the class
+		GeometryArena* m_geometry{};
+
+		void move(HLOD&& h);
+		void destroy();
+	};
+
+}
\ No newline at end of file
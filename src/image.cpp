@@ -0,0 +1,73 @@
+#include "image.hpp"
+
+#define STB_IMAGE_IMPLEMENTATION
+#include "stb/stb_image.h"
+
+#include "glm/glm.hpp"
+
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <iostream>
+
+namespace Graphics
+{
+
+	void ImageDeleter::operator()(unsigned char* pixels) const
+	{
+		stbi_image_free(pixels);
+	}
+
+	DecodedImage decodeImage(const char* path, bool computeAverageColor)
+	{
+		DecodedImage image{};
+
+		int channels{};
+		image.pixels.reset(stbi_load(path, &image.width, &image.height, &channels, STBI_rgb_alpha));
+		if (!image.pixels)
+		{
+			std::cerr << "failed to load texture at path: " << path << '\n';
+			return image;
+		}
+
+		// Texels are averaged in linear space, since averaging the sRGB values darkens mid-tones
+		if (computeAverageColor)
+		{
+			const stbi_uc* data{ image.pixels.get() };
+
+			std::array<double, 256> linear{};
+			for (std::size_t i{ 0 }; i < linear.size(); ++i)
+			{
+				linear[i] = decodeSrgb(i / 255.0f);
+			}
+
+			glm::dvec3 colorSum{ 0.0 };
+			double alphaSum{ 0.0 };
+			for (std::size_t i{ 0 }; i < static_cast<std::size_t>(image.width) * image.height; ++i)
+			{
+				const double alpha{ data[i * 4 + 3] / 255.0 };
+				colorSum += glm::dvec3{ linear[data[i * 4 + 0]], linear[data[i * 4 + 1]], linear[data[i * 4 + 2]] } * alpha;
+				alphaSum += alpha;
+			}
+			if (alphaSum > 0.0)
+			{
+				const glm::vec3 mean{ colorSum / alphaSum };
+				image.averageColor = glm::vec4{ encodeSrgb(mean.r), encodeSrgb(mean.g), encodeSrgb(mean.b),
+					alphaSum / (static_cast<double>(image.width) * image.height) };
+			}
+		}
+
+		return image;
+	}
+
+	float decodeSrgb(float value)
+	{
+		return value <= 0.04045f ? value / 12.92f : std::pow((value + 0.055f) / 1.055f, 2.4f);
+	}
+
+	float encodeSrgb(float value)
+	{
+		return value <= 0.0031308f ? value * 12.92f : 1.055f * std::pow(value, 1.0f / 2.4f) - 0.055f;
+	}
+
+}
\ No newline at end of file
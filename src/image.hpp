@@ -0,0 +1,31 @@
+#pragma once
+
+#include "glm/glm.hpp"
+
+#include <memory>
+
+namespace Graphics
+{
+
+	struct ImageDeleter
+	{
+		void operator()(unsigned char* pixels) const;
+	};
+
+	// RGBA8 pixels decoded on the CPU, ready to upload
+	struct DecodedImage
+	{
+		std::unique_ptr<unsigned char, ImageDeleter> pixels{};
+		int                                          width{};
+		int                                          height{};
+		glm::vec4                                    averageColor{}; // Alpha weighted mean of the linear colors, sRGB encoded
+	};
+
+	// Safe to call from any thread
+	DecodedImage decodeImage(const char* path, bool computeAverageColor = true);
+
+	// Convert one channel in [0, 1] between sRGB encoding and linear
+	float decodeSrgb(float value);
+	float encodeSrgb(float value);
+
+}
\ No newline at end of file
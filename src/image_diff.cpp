@@ -0,0 +1,56 @@
+#include "image_diff.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <limits>
+#include <span>
+
+namespace Graphics
+{
+
+	ImageDiff diffImages(std::span<const std::uint8_t> a, std::span<const std::uint8_t> b, const ImageDiffTolerance& tolerance)
+	{
+		constexpr std::size_t channels{ 4 };
+		constexpr std::size_t colorChannels{ 3 };
+
+		const std::size_t pixelCount{ std::min(a.size(), b.size()) / channels };
+
+		ImageDiff diff{};
+		std::uint64_t errorSum{ 0 };
+		std::uint64_t squaredErrorSum{ 0 };
+		std::size_t changedPixels{ 0 };
+		for (std::size_t p{ 0 }; p < pixelCount; ++p)
+		{
+			std::uint32_t pixelError{ 0 };
+			for (std::size_t c{ 0 }; c < colorChannels; ++c)
+			{
+				const std::uint32_t error{ static_cast<std::uint32_t>(std::abs(a[p * channels + c] - b[p * channels + c])) };
+				errorSum += error;
+				squaredErrorSum += error * error;
+				pixelError = std::max(pixelError, error);
+			}
+			diff.maxError = std::max(diff.maxError, pixelError);
+			if (pixelError > tolerance.changedThreshold)
+			{
+				++changedPixels;
+			}
+		}
+
+		if (pixelCount == 0)
+		{
+			diff.psnr = std::numeric_limits<double>::infinity();
+			return diff;
+		}
+
+		const double samples{ static_cast<double>(pixelCount * colorChannels) };
+		const double meanSquaredError{ squaredErrorSum / samples };
+		diff.meanError = errorSum / samples;
+		diff.psnr = meanSquaredError > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / meanSquaredError) : std::numeric_limits<double>::infinity();
+		diff.changedFraction = changedPixels / static_cast<double>(pixelCount);
+		return diff;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+
+namespace Graphics
+{
+
+	struct ImageDiffTolerance
+	{
+		double        minPsnr{ 40.0 };             // dB over the color channels
+		std::uint32_t changedThreshold{ 8 };       // A pixel counts as changed once a channel differs by more than this
+		double        maxChangedFraction{ 0.005 }; // Of the pixels
+	};
+
+	struct ImageDiff
+	{
+		std::uint32_t maxError{};        // Largest difference of any channel
+		double        meanError{};       // Per channel
+		double        psnr{};            // Infinite for identical images
+		double        changedFraction{};
+
+		bool within(const ImageDiffTolerance& tolerance) const
+		{
+			return psnr >= tolerance.minPsnr && changedFraction <= tolerance.maxChangedFraction;
+		}
+	};
+
+	// Compares two images of the same size with four 8 bit channels per pixel, of which the fourth is ignored.
+	// Changed pixels are counted by the tolerance's threshold.
+	ImageDiff diffImages(std::span<const std::uint8_t> a, std::span<const std::uint8_t> b, const ImageDiffTolerance& tolerance = {});
+
+}
\ No newline at end of file
@@ -85,4 +85,25 @@ namespace Graphics
 		return 0;
 	}
 
+	std::uint32_t getTransferQueueFamily(VkPhysicalDevice physicalDevice, std::uint32_t graphicsQueueFamily)
+	{
+		std::uint32_t queueFamilyPropertyCount{};
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, nullptr);
+
+		std::vector<VkQueueFamilyProperties> queueFamilyProperties(queueFamilyPropertyCount);
+		vkGetPhysicalDeviceQueueFamilyProperties(physicalDevice, &queueFamilyPropertyCount, queueFamilyProperties.data());
+
+		// Transfer-only families are backed by the copy engines, which run alongside rendering
+		for (std::uint32_t i{ 0 }; i < queueFamilyProperties.size(); ++i)
+		{
+			const VkQueueFlags flags{ queueFamilyProperties[i].queueFlags };
+			if ((flags & VK_QUEUE_TRANSFER_BIT) && !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT)))
+			{
+				return i;
+			}
+		}
+
+		return graphicsQueueFamily;
+	}
+
 }
\ No newline at end of file
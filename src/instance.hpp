@@ -13,4 +13,7 @@ namespace Graphics
 
 	std::uint32_t getGraphicsQueueFamily(VkPhysicalDevice physicalDevice);
 
+	// Returns a transfer-only family if the device has one, otherwise graphicsQueueFamily
+	std::uint32_t getTransferQueueFamily(VkPhysicalDevice physicalDevice, std::uint32_t graphicsQueueFamily);
+
 }
\ No newline at end of file
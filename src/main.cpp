@@ -5,17 +5,40 @@
 
 #include "attachment.hpp"
 
-#include "cmd_buffer.hpp"
-#include "sync.hpp"
+#include "depth_pyramid.hpp"
 
 #include "frame.hpp"
 
+#include "asset_loader.hpp"
+#include "task.hpp"
+
 #include "descriptor.hpp"
 
+#include "geometry_arena.hpp"
+#include "image_diff.hpp"
+#include "memory_usage.hpp"
 #include "mesh.hpp"
+#include "obj_pipeline.hpp"
+#include "scene_description.hpp"
+#include "scene_pack.hpp"
+#include "scene_placement.hpp"
+#include "upload.hpp"
+#include "mip_generator.hpp"
 #include "texture.hpp"
+#include "texture_cache.hpp"
+#include "texture_cooker.hpp"
+#include "texture_packer.hpp"
+#include "texture_streamer.hpp"
+#include "virtual_texture.hpp"
+#include "scatter.hpp"
+#include "hlod.hpp"
+#include "static_batch.hpp"
+#include "thread_pool.hpp"
+#include "world_streamer.hpp"
 
 #include "pipeline.hpp"
+#include "pipeline_cache.hpp"
+#include "pipeline_registry.hpp"
 
 #include "camera.hpp"
 
@@ -25,11 +48,25 @@
 #include "glm/glm.hpp"
 #include "glm/gtc/matrix_transform.hpp"
 
+#include <algorithm>
+#include <array>
+#include <chrono>
 #include <cstdint>   // For std::memcpy
+#include <cstdlib>
 #include <cstring>   // For std::uint32_t
 #include <exception>
+#include <filesystem>
 #include <iostream>
+#include <iterator>
+#include <limits>
+#include <optional>
 #include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 
 namespace Graphics
@@ -45,8 +82,16 @@ namespace Graphics
 
 		std::uint32_t graphicsQueueFamily{};
 		VkQueue       graphicsQueue{};
+		std::uint32_t transferQueueFamily{};
+		VkQueue       transferQueue{};
 		VkDevice      device{};
+		bool          shaderFloat16{};
 		VmaAllocator  allocator{};
+		PipelineCache pipelineCache{};
+
+		UploadManager uploader{};
+		MipGenerator  mipGenerator{};
+		AssetLoader   loader{};
 
 		VkSurfaceKHR             surface{};
 		VkFormat                 swapchainImageFormat{};
@@ -58,18 +103,15 @@ namespace Graphics
 		Image       colorAttachmentImage{};
 		VkImageView colorAttachmentImageView{};
 
-		Image       depthAttachmentImage{};
-		VkImageView depthAttachmentImageView{};
+		Image        depthAttachmentImage{};
+		VkImageView  depthAttachmentImageView{};
+		DepthPyramid depthPyramid{};
 
 		VkExtent2D  shadowMapExtent{};
 		Image       shadowMap{};
 		VkImageView shadowMapView{};
 		VkSampler   shadowMapSampler{};
 
-		VkCommandPool   GPCmdPool{};
-		VkCommandBuffer GPCmdBuffer{};
-		VkFence         GPFence{};
-
 		std::vector<Frame> framesInFlight{};
 
 		VkDescriptorPool      globalDescriptorPool{};
@@ -77,23 +119,66 @@ namespace Graphics
 		VkDescriptorSet       globalDescriptorSet{};
 
 		VkPipelineLayout uberPipelineLayout{};
-		VkPipeline       uberPipeline{};
-		VkPipeline       shadowpassPipeline{};
-		VkPipeline       skyboxPipeline{};
-
+		PipelineRegistry pipelines{};
+		std::array<PipelineId, uberVariantCount> uberPipelines{};     // Indexed by uberVariantIndex()
+		std::array<PipelineId, uberVariantCount> halfUberPipelines{}; // The same shading in 16 bit floats, if requested
+		PipelineId       shadowpassPipeline{ noPipeline };
+		PipelineId       skyboxPipeline{ noPipeline };
+
+		ScenePack                 pack{};
+		PlacementFile             placements{};
+		GeometryArena             geometry{};
 		std::vector<RenderObject> renderObjects{};
+		int                       skyboxRenderObject{};
 		Buffer                    vertexBuffer{};
 
-		std::vector<Texture> textures{};
+		TextureCache        textures{};
+		TextureStreamer     textureStreamer{};
+		VirtualTextureCache virtualTextures{};
+		TexturePacker       texturePacker{};
 
 		Image       skybox{};
 		VkImageView skyboxView{};
 		VkSampler   skyboxSampler{};
 		
 		std::vector<RenderObjectInstance> renderObjectInstances{};
+
+		Scatter     scatter{};
+		HLOD        hlod{};
+		StaticBatch staticBatch{};
+
+		WorldStreamer worldStreamer{};
+	};
+
+	struct RunSettings
+	{
+		UberShaderSettings shaders{};
+		bool               halfPrecision{ false }; // Shade in 16 bit floats where the device supports them
+
+		// Once the scene has loaded and streaming has settled, one frame is drawn at each precision and the two are
+		// compared before quitting
+		bool               checkHalfPrecision{ false };
+		std::uint32_t      checkSettleFrames{ 120 };
+		ImageDiffTolerance halfPrecisionTolerance{};
 	};
 
-	void init(Instance& instance, VkExtent2D windowExtent, const char* windowTitle)
+	// Outcome of the half precision check, which is also the process exit code
+	enum class CheckResult
+	{
+		passed  = 0, // Within tolerance, or no check was asked for
+		failed  = 1,
+		skipped = 2, // The device can't shade in 16 bit floats
+	};
+
+	struct LoadSettings
+	{
+		// Bounds what loading holds at once, for machines that can't fit all of it: models are parsed one at a time and
+		// only a few decoded textures wait for upload. Loading takes longer.
+		bool        lowMemory{ false };
+		std::size_t maxDecodedTextures{ 4 }; // Decoding or waiting for upload, in low memory mode
+	};
+
+	void init(Instance& instance, VkExtent2D windowExtent, const char* windowTitle, const RunSettings& settings)
 	{
 		if (!glfwInit())
 		{
@@ -118,8 +203,18 @@ namespace Graphics
 		instance.physicalDevice = getPhysicalDevice(instance.instance);
 
 		instance.graphicsQueueFamily = getGraphicsQueueFamily(instance.physicalDevice);
-		instance.device              = createDevice(instance.physicalDevice, instance.graphicsQueueFamily, instance.graphicsQueue);
+		instance.transferQueueFamily = getTransferQueueFamily(instance.physicalDevice, instance.graphicsQueueFamily);
+		instance.device              = createDevice(instance.physicalDevice, instance.graphicsQueueFamily, instance.graphicsQueue,
+		                                   instance.transferQueueFamily, instance.transferQueue);
+		instance.shaderFloat16       = supportsShaderFloat16(instance.physicalDevice);
 		instance.allocator           = createAllocator(instance.instance, instance.physicalDevice, instance.device);
+		instance.pipelineCache       = PipelineCache{ instance.physicalDevice, instance.device, "cache/pipelines.bin" };
+		usePipelineCache(&instance.pipelineCache);
+		instance.uploader            = UploadManager{ instance.device, instance.allocator, instance.transferQueueFamily, instance.transferQueue,
+		                                   instance.graphicsQueueFamily, instance.graphicsQueue };
+		instance.mipGenerator        = MipGenerator{ instance.device, instance.allocator };
+		instance.uploader.setMipGenerator(&instance.mipGenerator);
+		instance.loader              = AssetLoader{ instance.uploader };
 
 		glfwCreateWindowSurface(instance.instance, instance.window, nullptr, &instance.surface);
 		instance.swapchainImageFormat = VK_FORMAT_B8G8R8A8_SRGB;
@@ -131,8 +226,12 @@ namespace Graphics
 		instance.colorAttachmentImage     = createColorAttachmentImage(instance.allocator, instance.swapchainImageFormat, instance.windowExtent, instance.sampleCount);
 		instance.colorAttachmentImageView = createColorAttachmentImageView(instance.device, instance.colorAttachmentImage.image, instance.swapchainImageFormat);
 
-		instance.depthAttachmentImage     = createDepthAttachmentImage(instance.allocator, instance.windowExtent, instance.sampleCount);
+		// Sampled to build the depth pyramid the static batch is occlusion culled with
+		instance.depthAttachmentImage     = createDepthAttachmentImage(instance.allocator, instance.windowExtent, instance.sampleCount,
+		                                        VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT | VK_IMAGE_USAGE_SAMPLED_BIT);
 		instance.depthAttachmentImageView = createDepthAttachmentImageView(instance.device, instance.depthAttachmentImage.image);
+		instance.depthPyramid             = DepthPyramid{ instance.device, instance.allocator, instance.depthAttachmentImageView,
+		                                        instance.windowExtent, instance.sampleCount };
 
 		instance.shadowMapExtent  = { 2048, 2048 };
 		instance.shadowMap        = createDepthAttachmentImage(instance.allocator, instance.shadowMapExtent,
@@ -140,10 +239,6 @@ namespace Graphics
 		instance.shadowMapView    = createDepthAttachmentImageView(instance.device, instance.shadowMap.image);
 		instance.shadowMapSampler = createShadowMapSampler(instance.device);
 
-		instance.GPCmdPool   = createCommandPool(instance.device, instance.graphicsQueueFamily, true);
-		instance.GPCmdBuffer = allocateCommandBuffer(instance.device, instance.GPCmdPool);
-		instance.GPFence     = createFence(instance.device, false);
-
 		Frame::init(instance.device);
 		instance.framesInFlight.reserve(2);
 		instance.framesInFlight.push_back({ instance.device, instance.allocator, instance.graphicsQueueFamily });
@@ -161,7 +256,9 @@ namespace Graphics
 			instance.globalDescriptorSetLayout
 		};
 		instance.uberPipelineLayout = createPipelineLayout(instance.device, 2, setLayouts);
+		instance.pipelines          = PipelineRegistry{ instance.device };
 
+		const auto genericConstants{ uberFragmentConstants(uberVariants[0], settings.shaders) };
 		GraphicsPipelineCreateInfo uberPipelineCI
 		{
 			.device{ instance.device },
@@ -170,11 +267,13 @@ namespace Graphics
 			.depthFormat{ VK_FORMAT_D32_SFLOAT },
 			.pVertexShaderPath{ "shaders/uber.vert.spv" },
 			.pFragmentShaderPath{ "shaders/uber.frag.spv" },
+			.fragmentConstants{ genericConstants },
 			.viewportExtent{ instance.windowExtent },
 			.sampleCount{ instance.sampleCount },
 			.pipelineLayout{ instance.uberPipelineLayout },
 		};
-		instance.uberPipeline = createGraphicsPipeline(uberPipelineCI);
+		const PipelineId genericPipeline{ instance.pipelines.request(uberPipelineCI) };
+		instance.uberPipelines.fill(genericPipeline);
 
 		GraphicsPipelineCreateInfo shadowpassPipelineCI
 		{
@@ -187,7 +286,7 @@ namespace Graphics
 			.sampleCount{ VK_SAMPLE_COUNT_1_BIT },
 			.pipelineLayout{ instance.uberPipelineLayout },
 		};
-		instance.shadowpassPipeline = createGraphicsPipeline(shadowpassPipelineCI);
+		instance.shadowpassPipeline = instance.pipelines.request(shadowpassPipelineCI);
 
 		GraphicsPipelineCreateInfo skyboxPipelineCI
 		{
@@ -202,44 +301,85 @@ namespace Graphics
 			.pipelineLayout{ instance.uberPipelineLayout },
 			.depthTestEnable{ false },
 		};
-		instance.skyboxPipeline = createGraphicsPipeline(skyboxPipelineCI);
+		instance.skyboxPipeline = instance.pipelines.request(skyboxPipelineCI);
+
+		// These are what every variant falls back to, so the first frame needs them. They compile side by side.
+		instance.pipelines.future(genericPipeline).get();
+		instance.pipelines.future(instance.shadowpassPipeline).get();
+		instance.pipelines.future(instance.skyboxPipeline).get();
+
+		// The specialized variants are drawn with as they come in
+		for (const UberVariant& variant : std::span{ uberVariants }.subspan(1))
+		{
+			const auto constants{ uberFragmentConstants(variant, settings.shaders) };
+			GraphicsPipelineCreateInfo variantCI{ uberPipelineCI };
+			variantCI.fragmentConstants = constants;
+			instance.uberPipelines[uberVariantIndex(variant)] = instance.pipelines.request(variantCI, genericPipeline);
+		}
+
+		if ((settings.halfPrecision || settings.checkHalfPrecision) && !instance.shaderFloat16)
+		{
+			std::cerr << "the device has no 16 bit float arithmetic in shaders, shading stays 32 bit\n";
+		}
+		else if (settings.halfPrecision || settings.checkHalfPrecision)
+		{
+			// Each falls back to its 32 bit counterpart until it has compiled
+			GraphicsPipelineCreateInfo halfCI{ uberPipelineCI };
+			halfCI.pFragmentShaderPath = "shaders/uber_half.frag.spv";
+			instance.halfUberPipelines.fill(instance.pipelines.request(halfCI, genericPipeline));
+			for (const UberVariant& variant : std::span{ uberVariants }.subspan(1))
+			{
+				const auto constants{ uberFragmentConstants(variant, settings.shaders) };
+				halfCI.fragmentConstants = constants;
+				const std::size_t v{ uberVariantIndex(variant) };
+				instance.halfUberPipelines[v] = instance.pipelines.request(halfCI, instance.uberPipelines[v]);
+			}
+		}
 	}
 
-	void loadRenderObjects(Instance& instance)
+	// Runs on the asset loader alongside the frame loop. Frames show only the clear color until the models, placements and
+	// skybox are published, then draw the models untextured until the textures, HLOD proxies and static batch follow.
+	// Parsing and decoding happen on the loader's worker; everything touching the uploader, or anything frames read,
+	// on the main thread between frames.
+	Task<> loadScene(Instance& instance, LoadSettings settings)
 	{
-		std::vector<Vertex> vertices{};
+		AssetLoader& loader{ instance.loader };
+		MemoryTracker memory{};
+		const auto start{ std::chrono::steady_clock::now() };
+		const auto secondsSinceStart{ [start] { return std::chrono::duration<float>{ std::chrono::steady_clock::now() - start }.count(); } };
 
-		instance.renderObjects.reserve(4);
-		instance.renderObjects.push_back({ "assets/forest.obj", vertices,instance.device, instance.allocator, instance.graphicsQueue, instance.GPCmdBuffer, instance.GPFence });
-		instance.renderObjects.push_back({ "assets/skybox/obj.obj", vertices, instance.device, instance.allocator, instance.graphicsQueue, instance.GPCmdBuffer, instance.GPFence });
+		std::vector<Vertex> vertices{};
 
-		instance.renderObjects[0].meshes[1].opaque = false;
-		instance.renderObjects[0].meshes[2].opaque = false;
-		instance.renderObjects[0].meshes[4].opaque = false;
+		VkPhysicalDeviceFeatures features{};
+		vkGetPhysicalDeviceFeatures(instance.physicalDevice, &features);
+		const TextureCookSettings cookSettings{ .compress{ features.textureCompressionBC == VK_TRUE } };
+		const TextureCookSettings skyboxCookSettings{ .usage{ TextureUsage::Color }, .compress{ cookSettings.compress } };
 
-		instance.vertexBuffer = createVertexBuffer(vertices, instance.device, instance.allocator, instance.graphicsQueue, instance.GPCmdBuffer, instance.GPFence);
+		co_await loader.background();
 
-		for (auto& renderObject : instance.renderObjects)
+		// Scene-Cooker bakes the models and textures into one pack that is mapped rather than parsed, so startup is bound by reading it.
+		// Its textures are block compressed, so without BC support the sources are loaded instead. It stays mapped for the world streamer.
+		instance.pack = cookSettings.compress ? ScenePack{ "assets/forest.pack" } : ScenePack{};
+		const ScenePack& pack{ instance.pack };
+		std::unordered_map<std::string_view, std::uint32_t> packTextures{};
+		for (std::uint32_t i{ 0 }; i < pack.textures().size(); ++i)
 		{
-			for (auto& mesh : renderObject.meshes)
-			{
-				if (!mesh.diffusePath.empty())
-				{
-					mesh.textureIndex = instance.textures.size();
-					std::string path{ "assets/" + mesh.diffusePath };
-					instance.textures.push_back({ path.c_str(), instance.device, instance.allocator, instance.graphicsQueue, instance.GPCmdBuffer, instance.GPFence });
-				}
-				else
-				{
-					// Texture ID 1001 means no texture
-					mesh.textureIndex = 1001;
-				}
-			}
+			packTextures.emplace(pack.string(pack.textures()[i].path), i);
 		}
+		// Copying a texture out of the pack is all the work left, which still goes on the pool to overlap the reads
+		const auto loadTexture{ [&pack, &packTextures](const std::string& path, const TextureCookSettings& settings)
+		{
+			const auto packed{ packTextures.find(path) };
+			return packed != packTextures.end() ? pack.texture(packed->second) : loadCookedImage(path, settings);
+		} };
 
-		writeTextureSamplers(instance.device, instance.globalDescriptorSet, instance.textures);
+		// Textures are cooked, or read back from the cache, on the pool while the models are still being parsed.
+		// Everything the tasks use is declared first so the pool has joined before it goes away.
+		CompletionQueue<CookedImage> cooked{};
+		CompletionQueue<CookedImage> skyboxCooked{};
+		ThreadPool pool{};
 
-		const char* paths[6]
+		const char* skyboxPaths[6]
 		{
 			"assets/skybox/px.png",
 			"assets/skybox/nx.png",
@@ -248,20 +388,534 @@ namespace Graphics
 			"assets/skybox/pz.png",
 			"assets/skybox/nz.png",
 		};
-		instance.skybox = loadSkybox(paths, instance.device, instance.allocator, instance.graphicsQueue, instance.GPCmdBuffer, instance.GPFence);
-		instance.skyboxView = createSkyboxView(instance.device, instance.skybox.image);
+		for (std::size_t i{ 0 }; i < 6; ++i)
+		{
+			pool.submit([&skyboxCooked, &skyboxCookSettings, &loadTexture, path = skyboxPaths[i], i] { skyboxCooked.push(i, loadTexture(path, skyboxCookSettings)); });
+		}
+
+		// The scene's composition comes from the cooked placement file, or else from the description it is cooked from
+		instance.placements = PlacementFile{ "assets/forest.placements" };
+		const PlacementFile& placements{ instance.placements };
+		SceneDescription description{};
+		std::vector<std::string> objectPaths{};
+		std::uint32_t skyboxObject{ noPlacementObject };
+		if (!placements.empty())
+		{
+			for (const PlacementObject& object : placements.objects())
+			{
+				objectPaths.emplace_back(placements.string(object.path));
+			}
+			skyboxObject = placements.skyboxObject();
+		}
+		else if (readSceneDescription("assets/forest.scene", description))
+		{
+			std::cout << "no placement file, reading the scene description. Run Scene-Cooker for faster startup\n";
+			objectPaths = description.objects;
+			skyboxObject = description.skybox;
+		}
+		if (skyboxObject == noPlacementObject)
+		{
+			throw std::exception{ "the scene has no skybox" };
+		}
+
+		// Models scattered over the terrain on the GPU. Layers whose model is missing are skipped.
+		struct ScatterModel
+		{
+			const char*  path{};
+			ScatterLayer layer{};
+		};
+		const ScatterModel scatterModels[]
+		{
+			{ "assets/scatter/tree.obj",  { .spacing{ 12.0f }, .densityScale{ 1.0f }, .minScale{ 0.8f }, .maxScale{ 1.3f }, .seed{ 1 } } },
+			{ "assets/scatter/shrub.obj", { .spacing{ 4.0f },  .densityScale{ 0.6f }, .minScale{ 0.6f }, .maxScale{ 1.2f }, .seed{ 2 } } },
+			{ "assets/scatter/rock.obj",  { .spacing{ 8.0f },  .densityScale{ 0.3f }, .minScale{ 0.5f }, .maxScale{ 2.0f }, .seed{ 3 } } },
+		};
+
+		// Scatter models come after the scene's, so the layers know their render object before anything is loaded
+		std::vector<ScatterLayer> scatterLayers{};
+		std::vector<std::string> scatterPaths{};
+		for (const auto& model : scatterModels)
+		{
+			if (std::filesystem::exists(model.path))
+			{
+				scatterLayers.push_back(model.layer);
+				scatterLayers.back().renderObject = static_cast<int>(objectPaths.size() + scatterPaths.size());
+				scatterPaths.emplace_back(model.path);
+			}
+		}
+
+		// Models the scene pack has are copied out of it. The others go through the OBJ pipeline, which parses, welds and
+		// optimizes them on threads of its own while the rest of the scene loads, and hands them over to be uploaded between frames.
+		std::unordered_map<std::string_view, std::uint32_t> packObjects{};
+		for (std::uint32_t i{ 0 }; i < pack.objects().size(); ++i)
+		{
+			packObjects.emplace(pack.string(pack.objects()[i].path), i);
+		}
+		std::vector<std::uint32_t> renderObjectPackObjects{};
+		std::vector<std::string> sourcePaths{};
+		for (const std::string& path : objectPaths)
+		{
+			const auto packed{ packObjects.find(path) };
+			renderObjectPackObjects.push_back(packed != packObjects.end() ? packed->second : noPackObject);
+			if (packed == packObjects.end())
+			{
+				sourcePaths.push_back(path);
+			}
+		}
+		sourcePaths.insert(sourcePaths.end(), scatterPaths.begin(), scatterPaths.end());
+		const ObjPipelineSettings pipelineSettings{ settings.lowMemory ? ObjPipelineSettings{ .queueCapacity{ 2 }, .maxModelsInFlight{ 1 } } : ObjPipelineSettings{} };
+		ObjPipeline objPipeline{ pipelineSettings, std::move(sourcePaths) };
+
+		// Only the upload is left for the main thread
+		struct ParsedObject
+		{
+			std::vector<ObjMesh> meshes{};
+			std::uint32_t        firstVertex{};
+			std::uint32_t        vertexCount{};
+			bool                 pipelined{}; // Comes out of the OBJ pipeline instead
+		};
+		std::vector<ParsedObject> parsedObjects{};
+		vertices.reserve(pack.vertices().size());
+		for (const std::uint32_t packObject : renderObjectPackObjects)
+		{
+			ParsedObject& object{ parsedObjects.emplace_back() };
+			if (packObject == noPackObject)
+			{
+				object.pipelined = true;
+				continue;
+			}
+
+			object.firstVertex = static_cast<std::uint32_t>(vertices.size());
+			object.meshes = pack.object(packObject, vertices);
+			object.vertexCount = static_cast<std::uint32_t>(vertices.size()) - object.firstVertex;
+		}
+		parsedObjects.resize(parsedObjects.size() + scatterPaths.size(), ParsedObject{ .pipelined{ true } });
+
+		// Placements decode straight into an instance array, cell by cell. Only the static ones are kept as instances, to
+		// be baked by the static batch; the world streamer brings in the dynamic ones around the camera. The static batch
+		// still sees every placement, so a render object the streamer also draws keeps its original vertices.
+		std::vector<RenderObjectInstance> renderObjectInstances{};
+		std::vector<RenderObjectInstance> placedInstances{};
+		if (!placements.empty())
+		{
+			placedInstances.resize(placements.placements().size());
+			RenderObjectInstance* next{ placedInstances.data() };
+			for (std::uint32_t cell{ 0 }; cell < placements.cells().size(); ++cell)
+			{
+				placements.decodeCell(cell, next);
+				next += placements.cells()[cell].placementCount;
+			}
+			std::ranges::copy_if(placedInstances, std::back_inserter(renderObjectInstances),
+				[](const RenderObjectInstance& placement) { return placement.isStatic; });
+		}
+		else
+		{
+			for (const SceneDescription::Instance& placement : description.instances)
+			{
+				renderObjectInstances.push_back(
+				{
+					.renderObject{ static_cast<int>(placement.object) },
+					.transform{ placementTransform(placement.position, placement.orientation(), placement.scale) },
+					.isStatic{ placement.isStatic },
+				});
+			}
+		}
+
+		memory.sample("pack objects and placements");
+
+		co_await loader.mainThread();
+
+		instance.textures = TextureCache{ instance.uploader, instance.device, instance.allocator };
+		instance.textureStreamer = TextureStreamer{ TextureStreamingSettings{}, instance.textures, instance.uploader,
+			instance.device, instance.allocator, instance.globalDescriptorSet };
+		instance.virtualTextures = VirtualTextureCache{ VirtualTextureSettings{}, instance.uploader, instance.textures.samplers(),
+			instance.device, instance.allocator };
+		instance.texturePacker = TexturePacker{ TexturePackingSettings{}, instance.textures.samplers(), instance.device, instance.allocator };
+
+		// Textures are decoded on the pool as soon as their meshes are known. In low memory mode they wait until the
+		// textures are being uploaded, and only a few go out at a time, the next as one is uploaded.
+		struct TextureLoad
+		{
+			std::uint32_t handle{};
+			std::string   path{};
+		};
+		std::vector<TextureLoad> textureLoads{};
+		std::size_t texturesSubmitted{ 0 };
+		std::size_t texturesDecoded{ 0 };
+		const std::size_t maxDecodedTextures{ settings.lowMemory ? settings.maxDecodedTextures : std::numeric_limits<std::size_t>::max() };
+		const auto submitTextureLoads{ [&]
+		{
+			for (; texturesSubmitted < textureLoads.size() && texturesSubmitted - texturesDecoded < maxDecodedTextures; ++texturesSubmitted)
+			{
+				pool.submit([&cooked, &cookSettings, &loadTexture, load = textureLoads[texturesSubmitted]]
+				{
+					cooked.push(load.handle, loadTexture(load.path, cookSettings));
+				});
+			}
+		} };
+
+		// Meshes are drawn untextured until every texture is loaded. Until then meshTextures holds each mesh's texture cache
+		// handle, or the final index of its virtual texture.
+		std::vector<std::vector<std::uint32_t>> meshTextures{};
+		const auto queueTextures{ [&](const RenderObject& renderObject)
+		{
+			std::vector<std::uint32_t>& textures{ meshTextures.emplace_back() };
+			for (const auto& mesh : renderObject.meshes)
+			{
+				if (mesh.diffusePath.empty())
+				{
+					textures.push_back(TextureCache::noTexture);
+					continue;
+				}
+
+				// Textures too large to keep resident are paged in through the virtual texture cache instead
+				const std::uint32_t virtualTexture{ instance.virtualTextures.add("assets/" + mesh.diffusePath) };
+				if (virtualTexture != TextureCache::noTexture)
+				{
+					textures.push_back(virtualTexture);
+					continue;
+				}
+
+				const TextureCache::Request request{ instance.textures.request("assets/" + mesh.diffusePath) };
+				textures.push_back(request.handle);
+				if (request.load)
+				{
+					textureLoads.push_back({ .handle{ request.handle }, .path{ "assets/" + mesh.diffusePath } });
+				}
+			}
+		} };
+
+		// Room for 4M indices to start with, the arena grows if the scene needs more
+		instance.geometry = GeometryArena{ 1u << 22, instance.uploader, instance.allocator };
+
+		std::vector<RenderObject> renderObjects{};
+		renderObjects.reserve(parsedObjects.size());
+		const auto addRenderObject{ [&](std::vector<ObjMesh> meshes, std::uint32_t firstVertex, std::uint32_t vertexCount)
+		{
+			renderObjects.push_back({ std::move(meshes), firstVertex, vertexCount, instance.geometry, true });
+			queueTextures(renderObjects.back());
+			for (auto& mesh : renderObjects.back().meshes)
+			{
+				mesh.textureIndex = TextureCache::noTexture;
+			}
+			if (!settings.lowMemory)
+			{
+				submitTextureLoads();
+			}
+		} };
+		for (ParsedObject& object : parsedObjects)
+		{
+			if (!object.pipelined)
+			{
+				addRenderObject(std::move(object.meshes), object.firstVertex, object.vertexCount);
+				continue;
+			}
+
+			// Whatever the pipeline has finished goes up this frame, otherwise a frame goes by
+			while (!objPipeline.uploadNext(vertices, [&](ObjPipeline::Model& model) { addRenderObject(std::move(model.meshes), model.firstVertex, model.vertexCount); }))
+			{
+				co_await loader.mainThread();
+			}
+		}
+		parsedObjects = {};
+		memory.sample("models");
+
+		// The vertex list stays, since packing textures into atlases still moves UVs and the proxies and static batch add to it
+		vmaDestroyBuffer(instance.allocator, instance.vertexBuffer.buffer, instance.vertexBuffer.alloc);
+		instance.vertexBuffer = createVertexBuffer(std::span<const Vertex>{ vertices }, instance.uploader);
+
+		co_await loader.background();
+
+		CookedImage skyboxFaces[6]{};
+		for (int i{ 0 }; i < 6; ++i)
+		{
+			auto [face, image] { skyboxCooked.pop() };
+			skyboxFaces[face] = std::move(image);
+		}
+
+		co_await loader.mainThread();
+
+		instance.skybox = loadSkybox(skyboxFaces, instance.uploader, instance.allocator);
+		instance.skyboxView = createSkyboxView(instance.device, instance.skybox.image, skyboxFaces[0].format,
+			static_cast<std::uint32_t>(skyboxFaces[0].levels.size()));
 		instance.skyboxSampler = createSkyboxSampler(instance.device);
+		for (CookedImage& face : skyboxFaces)
+		{
+			face = {};
+		}
+
+		co_await loader.uploaded(instance.uploader.flush());
+
+		// Frames in flight have the global descriptor set bound, so it is only written with the queue idle
+		vkQueueWaitIdle(instance.graphicsQueue);
 		writeSkyboxSampler(instance.device, instance.globalDescriptorSet, instance.skyboxView, instance.skyboxSampler);
+		instance.renderObjects = std::move(renderObjects);
+		instance.renderObjectInstances = std::move(renderObjectInstances);
+		instance.skyboxRenderObject = static_cast<int>(skyboxObject);
+		std::cout << "scene visible after " << secondsSinceStart() << " s\n";
+		memory.sample("skybox");
+
+		co_await loader.background();
+
+		// Atlased textures can't repeat, so only the ones whose meshes all keep their UVs inside the texture qualify.
+		// Frames only read the meshes in the meantime, and nothing else writes them until this coroutine is back on the main thread.
+		std::unordered_map<std::uint32_t, bool> atlasable{};
+		for (std::size_t r{ 0 }; r < instance.renderObjects.size(); ++r)
+		{
+			const auto& meshes{ instance.renderObjects[r].meshes };
+			for (std::size_t m{ 0 }; m < meshes.size(); ++m)
+			{
+				if (meshTextures[r][m] >= TextureCache::noTexture)
+				{
+					continue;
+				}
+
+				const bool inside{ std::all_of(meshes[m].indices.begin(), meshes[m].indices.end(), [&](std::uint32_t index)
+				{
+					return glm::all(glm::greaterThanEqual(vertices[index].tex, glm::vec2{ 0.0f })) &&
+						glm::all(glm::lessThanEqual(vertices[index].tex, glm::vec2{ 1.0f }));
+				}) };
+				const auto [entry, added] { atlasable.emplace(meshTextures[r][m], inside) };
+				entry->second = entry->second && inside;
+			}
+		}
+
+		co_await loader.mainThread();
+
+		// Small textures wait to be packed together, of the rest only the small levels go up now and the streamer brings
+		// in the others once the textures are seen
+		const auto addTexture{ [&](std::uint32_t handle, const CookedImage& image)
+		{
+			const std::uint32_t firstLevel{ instance.textureStreamer.baseLevel(image, instance.textures.source(handle)) };
+			instance.textures.add(handle, image, firstLevel);
+		} };
+		// Meshes whose texture isn't fully opaque are drawn as cutouts, which is also what decided their cooked format
+		std::unordered_set<std::uint32_t> cutoutTextures{};
+
+		// Textures go up as their decodes finish, whatever has finished each frame
+		submitTextureLoads();
+		while (texturesDecoded < textureLoads.size())
+		{
+			while (std::optional<std::pair<std::size_t, CookedImage>> decoded{ cooked.tryPop() })
+			{
+				++texturesDecoded;
+				const std::uint32_t handle{ static_cast<std::uint32_t>(decoded->first) };
+				CookedImage& image{ decoded->second };
+				if (!image.empty() && image.averageColor.a < 1.0f)
+				{
+					cutoutTextures.insert(handle);
+				}
+				if (instance.texturePacker.packable(image))
+				{
+					instance.texturePacker.add(handle, std::move(image), atlasable[handle]);
+					continue;
+				}
+				addTexture(handle, image);
+			}
+
+			submitTextureLoads();
+			if (texturesDecoded < textureLoads.size())
+			{
+				co_await loader.mainThread();
+			}
+		}
+		textureLoads = {};
+		for (const auto& [handle, image] : instance.texturePacker.pack(instance.uploader))
+		{
+			addTexture(handle, image);
+		}
+
+		co_await loader.background();
+
+		// Packing moves the UVs of the meshes it takes into their atlas. The meshes keep their old textures until the
+		// vertex buffer holding the new UVs has landed, and only read the vertex list in the meantime.
+		bool repacked{ false };
+		for (std::size_t r{ 0 }; r < instance.renderObjects.size(); ++r)
+		{
+			const auto& meshes{ instance.renderObjects[r].meshes };
+			for (std::size_t m{ 0 }; m < meshes.size(); ++m)
+			{
+				if (meshTextures[r][m] >= TextureCache::noTexture)
+				{
+					continue;
+				}
+				if (const PackedTexture* packed{ instance.texturePacker.find(meshTextures[r][m]) })
+				{
+					applyPacking(*packed, meshes[m], vertices);
+					repacked = true;
+				}
+			}
+		}
+
+		co_await loader.mainThread();
+
+		Buffer packedVertexBuffer{};
+		if (repacked)
+		{
+			packedVertexBuffer = createVertexBuffer(std::span<const Vertex>{ vertices }, instance.uploader);
+		}
+
+		// The scene has no dedicated density or height map yet, so the terrain texture stands in for both.
+		// The instances are generated with the textures' uploads and drawn from when the meshes get their textures.
+		ScatterSettings scatterSettings
+		{
+			.densityMapPath{ "assets/terrain.jpg" },
+			.heightMapPath{ "assets/terrain.jpg" },
+		};
+		Scatter scatter{ scatterSettings, scatterLayers, instance.renderObjects,
+			instance.uploader, instance.textures.samplers(), instance.device, instance.allocator };
+
+		co_await loader.uploaded(instance.uploader.flush());
+		memory.sample("textures and scatter");
+
+		// The meshes' textures, the vertex buffer and the descriptors change together, with no frame in flight
+		vkQueueWaitIdle(instance.graphicsQueue);
+
+		if (repacked)
+		{
+			vmaDestroyBuffer(instance.allocator, instance.vertexBuffer.buffer, instance.vertexBuffer.alloc);
+			instance.vertexBuffer = packedVertexBuffer;
+		}
+
+		for (std::size_t r{ 0 }; r < instance.renderObjects.size(); ++r)
+		{
+			auto& meshes{ instance.renderObjects[r].meshes };
+			for (std::size_t m{ 0 }; m < meshes.size(); ++m)
+			{
+				RenderObject::Mesh& mesh{ meshes[m] };
+				mesh.textureIndex = meshTextures[r][m];
+
+				// Virtual textures already have their final index, numbered after noTexture
+				if (mesh.textureIndex >= TextureCache::noTexture)
+				{
+					continue;
+				}
+
+				mesh.opaque = !cutoutTextures.contains(mesh.textureIndex);
+
+				if (const PackedTexture* packed{ instance.texturePacker.find(mesh.textureIndex) })
+				{
+					mesh.textureIndex = packed->textureIndex;
+				}
+				else
+				{
+					mesh.textureIndex = instance.textures.slot(mesh.textureIndex);
+				}
+			}
+		}
+
+		writeTextureSamplers(instance.device, instance.globalDescriptorSet, instance.textures);
+		writeVirtualTextures(instance.device, instance.globalDescriptorSet, instance.virtualTextures);
+		writeTextureArrays(instance.device, instance.globalDescriptorSet, instance.texturePacker);
+		instance.scatter = std::move(scatter);
+		if (!instance.scatter.empty())
+		{
+			writeScatterInstanceBuffer(instance.device, instance.globalDescriptorSet, instance.scatter.instanceBuffer());
+		}
+
+		// The streamer swaps textures on this thread, so the proxies bake their colors from a copy
+		std::vector<glm::vec4> textureColors(instance.textures.textures().size());
+		for (std::size_t slot{ 0 }; slot < textureColors.size(); ++slot)
+		{
+			if (instance.textures.textures()[slot])
+			{
+				textureColors[slot] = instance.textures.textures()[slot]->averageColor();
+			}
+		}
+
+		co_await loader.background();
+
+		// Proxy and static batch vertices are added to the shared vertex list, so this has to happen before it is uploaded.
+		// Proxies stand in for dynamic instances: far clusters of them, or with cooked placements, every tile not streamed in.
+		// Frames only read the meshes and instances in the meantime.
+		HLODBuild hlodBuild{ placements.empty()
+			? buildHLOD(HLODSettings{}, instance.renderObjects, instance.renderObjectInstances, textureColors, instance.texturePacker, vertices)
+			: buildHLOD(HLODSettings{}, instance.renderObjects, placements, placedInstances, textureColors, instance.texturePacker, vertices) };
+		StaticBatchBuild staticBatchBuild{ buildStaticBatch(StaticBatchSettings{}, instance.renderObjects,
+			placedInstances.empty() ? instance.renderObjectInstances : placedInstances, vertices) };
+
+		co_await loader.mainThread();
+
+		HLOD hlod{ std::move(hlodBuild), instance.geometry };
+		StaticBatch staticBatch{ std::move(staticBatchBuild), instance.geometry, instance.uploader, instance.allocator };
+		const Buffer vertexBuffer{ createVertexBuffer(vertices, instance.uploader) };
+
+		co_await loader.uploaded(instance.uploader.flush());
+		memory.sample("proxies and static batch");
+
+		// Frames in flight bind the vertex buffer, and draw models whose indices the world streamer frees
+		vkQueueWaitIdle(instance.graphicsQueue);
+
+		vmaDestroyBuffer(instance.allocator, instance.vertexBuffer.buffer, instance.vertexBuffer.alloc);
+		instance.vertexBuffer = vertexBuffer;
+		instance.hlod = std::move(hlod);
+		instance.staticBatch = std::move(staticBatch);
+		placedInstances = {};
+		for (auto& renderObject : instance.renderObjects)
+		{
+			for (auto& mesh : renderObject.meshes)
+			{
+				mesh.indices = {};
+			}
+		}
+
+		if (!placements.empty())
+		{
+			instance.worldStreamer = WorldStreamer{ WorldStreamingSettings{}, placements, pack, renderObjectPackObjects,
+				instance.renderObjects, instance.geometry, instance.uploader };
+		}
 
-		instance.renderObjectInstances.push_back({ .renderObject{ 0 } });
-		instance.renderObjectInstances[0].transform = glm::scale(instance.renderObjectInstances[0].transform, glm::vec3{ 100.0f });
-		instance.renderObjectInstances[0].transform = glm::translate(instance.renderObjectInstances[0].transform, glm::vec3{ 0.0f, 0.0f, 0.0f });
+		std::cout << "scene loaded after " << secondsSinceStart() << " s\n";
+		instance.uploader.printStatistics();
+		instance.textures.printStatistics();
+		instance.texturePacker.printStatistics();
+		instance.textureStreamer.printStatistics();
+		instance.worldStreamer.printStatistics();
+		instance.staticBatch.printStatistics();
+		objPipeline.printStatistics();
+		instance.pipelines.printStatistics();
+		instance.pipelineCache.printStatistics();
+		memory.sample("world streaming");
+		memory.printStatistics();
 	}
 
-	void run(Instance& instance)
+	CheckResult run(Instance& instance, const RunSettings& settings)
 	{
 		Camera camera{ {0.0f, -3.0f, -10.0f }, { 0.0f, -90.0f } };
 
+		const bool halfPrecision{ settings.halfPrecision && instance.shaderFloat16 };
+		const bool checking{ settings.checkHalfPrecision && instance.shaderFloat16 };
+		if (settings.checkHalfPrecision && !checking)
+		{
+			std::cout << "half precision check skipped\n";
+			return CheckResult::skipped;
+		}
+
+		// Both precisions are copied out of the swapchain image they were presented from
+		const VkDeviceSize captureSize{ static_cast<VkDeviceSize>(instance.windowExtent.width) * instance.windowExtent.height * 4 };
+		Buffer captureBuffer{};
+		const std::uint8_t* captureData{};
+		if (checking)
+		{
+			VkBufferCreateInfo captureCI
+			{
+				.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+				.size{ captureSize },
+				.usage{ VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+			};
+			VmaAllocationCreateInfo captureAllocCI
+			{
+				.flags{ VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_RANDOM_BIT },
+				.usage{ VMA_MEMORY_USAGE_AUTO },
+			};
+			VmaAllocationInfo allocInfo{};
+			vmaCreateBuffer(instance.allocator, &captureCI, &captureAllocCI, &captureBuffer.buffer, &captureBuffer.alloc, &allocInfo);
+			captureData = static_cast<const std::uint8_t*>(allocInfo.pMappedData);
+		}
+		std::vector<std::uint8_t> fullPrecisionImage{};
+		std::uint32_t settledFrames{ 0 };
+		bool withinTolerance{ true };
+
 		int frameNumber{ 0 };
 		bool firstFrame{ true };
 
@@ -272,6 +926,9 @@ namespace Graphics
 
 		while (!glfwWindowShouldClose(instance.window))
 		{
+			// Whatever the loader publishes is picked up by this frame's render info
+			instance.loader.poll();
+
 			float current{ static_cast<float>(glfwGetTime()) };
 			deltaTime = current - lastFrame;
 			lastFrame = current;
@@ -300,6 +957,24 @@ namespace Graphics
 
 			CameraUBOData ubo{ .viewProj{ proj * camera.getViewMatrix() }, .lightTransform{ lightProj * lightView } };
 
+			// The full precision frame is captured first, the half precision one right after it
+			bool capturing{ false };
+			bool halfPrecisionFrame{ halfPrecision };
+			if (checking && instance.loader.idle() && ++settledFrames > settings.checkSettleFrames)
+			{
+				instance.pipelines.waitIdle();
+				capturing = true;
+				halfPrecisionFrame = !fullPrecisionImage.empty();
+			}
+
+			// Variants still compiling resolve to the generic pipeline
+			const auto& uberPipelineIds{ halfPrecisionFrame ? instance.halfUberPipelines : instance.uberPipelines };
+			std::array<VkPipeline, uberVariantCount> uberPipelines{};
+			for (std::size_t v{ 0 }; v < uberVariantCount; ++v)
+			{
+				uberPipelines[v] = instance.pipelines.get(uberPipelineIds[v]);
+			}
+
 			RenderInfo renderInfo
 			{
 				.queue{ instance.graphicsQueue },
@@ -312,28 +987,67 @@ namespace Graphics
 				.colorImageView{ instance.colorAttachmentImageView },
 				.depthImage{ instance.depthAttachmentImage },
 				.depthImageView{ instance.depthAttachmentImageView },
+				.depthPyramid{ instance.depthPyramid },
 				.shadowImage{ instance.shadowMap },
 				.shadowImageView{ instance.shadowMapView },
 				.firstFrame{ firstFrame },
-				.pipeline{ instance.uberPipeline },
-				.shadowPipeline{ instance.shadowpassPipeline },
-				.skyboxPipeline{ instance.skyboxPipeline },
+				.pipelines{ uberPipelines },
+				.shadowPipeline{ instance.pipelines.get(instance.shadowpassPipeline) },
+				.skyboxPipeline{ instance.pipelines.get(instance.skyboxPipeline) },
 				.pipelineLayout{ instance.uberPipelineLayout },
 				.vertexBuffer{ instance.vertexBuffer },
+				.indexBuffer{ instance.geometry.indexBuffer() },
 				.renderObjects{ instance.renderObjects },
 				.renderObjectInstances{ instance.renderObjectInstances },
+				.streamedInstances{ instance.worldStreamer.instances() },
+				.loadedTiles{ instance.worldStreamer.loadedTiles() },
+				.scatter{ instance.scatter },
+				.hlod{ instance.hlod },
+				.staticBatch{ instance.staticBatch },
 				.descriptorSet{ instance.globalDescriptorSet },
 				.cameraView{ camera.getViewMatrix() },
 				.cameraProj{ proj },
 				.lightView{ lightView },
 				.lightProj{ lightProj },
-				.skyboxRenderObjectIndex{ 1 },
+				.skyboxRenderObjectIndex{ instance.skyboxRenderObject },
+				.captureBuffer{ capturing ? captureBuffer.buffer : VK_NULL_HANDLE },
 			};
 
 			instance.framesInFlight[frameNumber].waitFrame();
 
+			// Nothing is streamed in between the two captures, so they only differ by precision
+			if (!capturing)
+			{
+				const std::uint32_t* feedback{ instance.framesInFlight[frameNumber].textureFeedback() };
+				instance.textureStreamer.update(feedback);
+				instance.virtualTextures.update(feedback);
+				instance.worldStreamer.update(camera.position());
+			}
+
 			instance.framesInFlight[frameNumber].execute(renderInfo);
 
+			if (capturing)
+			{
+				vkQueueWaitIdle(instance.graphicsQueue);
+				vmaInvalidateAllocation(instance.allocator, captureBuffer.alloc, 0, VK_WHOLE_SIZE);
+				const std::span<const std::uint8_t> image{ captureData, static_cast<std::size_t>(captureSize) };
+
+				if (fullPrecisionImage.empty())
+				{
+					fullPrecisionImage.assign(image.begin(), image.end());
+				}
+				else
+				{
+					const ImageDiff diff{ diffImages(fullPrecisionImage, image, settings.halfPrecisionTolerance) };
+					withinTolerance = diff.within(settings.halfPrecisionTolerance);
+
+					std::cout << "half precision shading " << (withinTolerance ? "within" : "outside") << " tolerance: PSNR "
+						<< diff.psnr << " dB, max error " << diff.maxError << ", mean error " << diff.meanError << ", "
+						<< diff.changedFraction * 100.0 << "% of pixels changed\n";
+					glfwSetWindowShouldClose(instance.window, GLFW_TRUE);
+				}
+			}
+
 			glfwPollEvents();
 
 			frameNumber = ++frameNumber % 2;
@@ -341,27 +1055,56 @@ namespace Graphics
 
 			//glfwSetWindowShouldClose(instance.window, GLFW_TRUE);
 		}
+
+		if (checking)
+		{
+			vkDeviceWaitIdle(instance.device);
+			vmaDestroyBuffer(instance.allocator, captureBuffer.buffer, captureBuffer.alloc);
+		}
+
+		return withinTolerance ? CheckResult::passed : CheckResult::failed;
 	}
 
 	void cleanup(Instance& instance)
 	{
 		vkDeviceWaitIdle(instance.device);
 
-		vkDestroyPipeline(instance.device, instance.skyboxPipeline, nullptr);
-		vkDestroyPipeline(instance.device, instance.shadowpassPipeline, nullptr);
-		vkDestroyPipeline(instance.device, instance.uberPipeline, nullptr);
+		// A scene still loading is abandoned, whatever it created so far is in the instance and destroyed below
+		instance.loader = {};
+
+		// Joins the compile workers first, so the cache holds everything they compiled
+		instance.pipelines = {};
+
+		// Written before anything else is torn down so a failure further down doesn't lose this run's compiles
+		instance.pipelineCache.save();
+
 		vkDestroyPipelineLayout(instance.device, instance.uberPipelineLayout, nullptr);
 
 		vmaDestroyBuffer(instance.allocator, instance.vertexBuffer.buffer, instance.vertexBuffer.alloc);
 
 		instance.renderObjectInstances.clear();
+		instance.scatter = {};
+		instance.hlod = {};
+		instance.staticBatch = {};
+		instance.worldStreamer.printStatistics();
+		instance.worldStreamer = {};
 
 		vkDestroySampler(instance.device, instance.skyboxSampler, nullptr);
 		vkDestroyImageView(instance.device, instance.skyboxView, nullptr);
 		vmaDestroyImage(instance.allocator, instance.skybox.image, instance.skybox.alloc);
 
-		instance.textures.clear();
+		instance.textureStreamer.printStatistics();
+		instance.textureStreamer = {};
+		instance.virtualTextures.printStatistics();
+		instance.virtualTextures = {};
+		instance.texturePacker = {};
+		instance.textures = {};
 		instance.renderObjects.clear();
+		instance.geometry = {};
+		instance.placements = {};
+		instance.pack = {};
+		instance.uploader = {};
+		instance.mipGenerator = {};
 
 		vkDestroyDescriptorSetLayout(instance.device, instance.globalDescriptorSetLayout, nullptr);
 		vkDestroyDescriptorPool(instance.device, instance.globalDescriptorPool, nullptr);
@@ -369,13 +1112,11 @@ namespace Graphics
 		instance.framesInFlight.clear();
 		Frame::cleanup(instance.device);
 
-		vkDestroyFence(instance.device, instance.GPFence, nullptr);
-		vkDestroyCommandPool(instance.device, instance.GPCmdPool, nullptr);
-
 		vkDestroySampler(instance.device, instance.shadowMapSampler, nullptr);
 		vkDestroyImageView(instance.device, instance.shadowMapView, nullptr);
 		vmaDestroyImage(instance.allocator, instance.shadowMap.image, instance.shadowMap.alloc);
 
+		instance.depthPyramid = {};
 		vkDestroyImageView(instance.device, instance.depthAttachmentImageView, nullptr);
 		vmaDestroyImage(instance.allocator, instance.depthAttachmentImage.image, instance.depthAttachmentImage.alloc);
 
@@ -388,6 +1129,8 @@ namespace Graphics
 		}
 		vkDestroySwapchainKHR(instance.device, instance.swapchain, nullptr);
 		vkDestroySurfaceKHR(instance.instance, instance.surface, nullptr);
+		usePipelineCache(nullptr);
+		instance.pipelineCache = {};
 		vmaDestroyAllocator(instance.allocator);
 		vkDestroyDevice(instance.device, nullptr);
 		vkDestroyInstance(instance.instance, nullptr);
@@ -399,16 +1142,39 @@ namespace Graphics
 
 }
 
-int main()
+int main(int argc, char** argv)
 {
+	Graphics::LoadSettings loadSettings{};
+	Graphics::RunSettings runSettings{};
+	for (int i{ 1 }; i < argc; ++i)
+	{
+		if (std::string_view{ argv[i] } == "--low-memory")
+		{
+			loadSettings.lowMemory = true;
+		}
+		else if (std::string_view{ argv[i] } == "--pcf" && i + 1 < argc)
+		{
+			// Rounded up to odd so the kernel stays centered
+			runSettings.shaders.pcfKernelSize = static_cast<std::uint32_t>(std::max(std::atoi(argv[++i]), 1)) | 1u;
+		}
+		else if (std::string_view{ argv[i] } == "--half-precision")
+		{
+			runSettings.halfPrecision = true;
+		}
+		else if (std::string_view{ argv[i] } == "--check-half-precision")
+		{
+			runSettings.checkHalfPrecision = true;
+		}
+	}
+
 	Graphics::Instance graphicsInstance{};
 
-	Graphics::init(graphicsInstance, VkExtent2D{ 1600, 900 }, "Vulkan Forest Scene");
-	Graphics::loadRenderObjects(graphicsInstance);
+	Graphics::init(graphicsInstance, VkExtent2D{ 1600, 900 }, "Vulkan Forest Scene", runSettings);
+	graphicsInstance.loader.start(Graphics::loadScene(graphicsInstance, loadSettings));
 
-	Graphics::run(graphicsInstance);
+	const Graphics::CheckResult checkResult{ Graphics::run(graphicsInstance, runSettings) };
 
 	Graphics::cleanup(graphicsInstance);
 
-	return 0;
+	return static_cast<int>(checkResult);
 }
\ No newline at end of file
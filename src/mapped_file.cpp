@@ -0,0 +1,148 @@
+#include "mapped_file.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <cstddef>
+#include <utility>
+
+namespace Graphics
+{
+
+#ifdef _WIN32
+	MappedFile::MappedFile(const char* path)
+	{
+		HANDLE file{ CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr) };
+		if (file == INVALID_HANDLE_VALUE)
+		{
+			return;
+		}
+		m_file = file;
+
+		LARGE_INTEGER size{};
+		if (!GetFileSizeEx(file, &size) || size.QuadPart == 0)
+		{
+			destroy();
+			return;
+		}
+
+		m_mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+		if (m_mapping == nullptr)
+		{
+			destroy();
+			return;
+		}
+
+		m_data = static_cast<const std::byte*>(MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0));
+		if (m_data == nullptr)
+		{
+			destroy();
+			return;
+		}
+		m_size = static_cast<std::size_t>(size.QuadPart);
+	}
+
+	void MappedFile::destroy()
+	{
+		if (m_data != nullptr)
+		{
+			UnmapViewOfFile(m_data);
+		}
+		if (m_mapping != nullptr)
+		{
+			CloseHandle(m_mapping);
+		}
+		if (m_file != nullptr)
+		{
+			CloseHandle(m_file);
+		}
+		m_data = nullptr;
+		m_size = 0;
+		m_mapping = nullptr;
+		m_file = nullptr;
+	}
+#else
+	MappedFile::MappedFile(const char* path)
+	{
+		m_file = open(path, O_RDONLY);
+		if (m_file < 0)
+		{
+			return;
+		}
+
+		struct stat status{};
+		if (fstat(m_file, &status) != 0 || status.st_size == 0)
+		{
+			destroy();
+			return;
+		}
+
+		void* data{ mmap(nullptr, static_cast<std::size_t>(status.st_size), PROT_READ, MAP_PRIVATE, m_file, 0) };
+		if (data == MAP_FAILED)
+		{
+			destroy();
+			return;
+		}
+		m_data = static_cast<const std::byte*>(data);
+		m_size = static_cast<std::size_t>(status.st_size);
+	}
+
+	void MappedFile::destroy()
+	{
+		if (m_data != nullptr)
+		{
+			munmap(const_cast<std::byte*>(m_data), m_size);
+		}
+		if (m_file >= 0)
+		{
+			close(m_file);
+		}
+		m_data = nullptr;
+		m_size = 0;
+		m_file = -1;
+	}
+#endif
+
+	MappedFile::MappedFile(MappedFile&& f) noexcept
+	{
+		move(std::move(f));
+	}
+
+	MappedFile& MappedFile::operator=(MappedFile&& f) noexcept
+	{
+		destroy();
+		move(std::move(f));
+		return *this;
+	}
+
+	MappedFile::~MappedFile()
+	{
+		destroy();
+	}
+
+	void MappedFile::move(MappedFile&& f)
+	{
+		m_data    = f.m_data;
+		m_size    = f.m_size;
+		m_file    = f.m_file;
+#ifdef _WIN32
+		m_mapping = f.m_mapping;
+
+		f.m_file    = nullptr;
+		f.m_mapping = nullptr;
+#else
+		f.m_file = -1;
+#endif
+		f.m_data = nullptr;
+		f.m_size = 0;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <cstddef>
+
+namespace Graphics
+{
+
+	// A read only view of a whole file. Pages are brought in by the OS as they are touched,
+	// so nothing is read up front.
+	class MappedFile
+	{
+	public:
+		MappedFile() = default;
+		// Empty if the file is missing or can't be mapped
+		explicit MappedFile(const char* path);
+
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		MappedFile(MappedFile&& f) noexcept;
+		MappedFile& operator=(MappedFile&& f) noexcept;
+
+		~MappedFile();
+
+		// Page aligned
+		const std::byte* data() const
+		{
+			return m_data;
+		}
+		std::size_t size() const
+		{
+			return m_size;
+		}
+		bool empty() const
+		{
+			return m_data == nullptr;
+		}
+
+	private:
+		const std::byte* m_data{};
+		std::size_t      m_size{};
+#ifdef _WIN32
+		void* m_file{};
+		void* m_mapping{};
+#else
+		int m_file{ -1 };
+#endif
+
+		void move(MappedFile&& f);
+		void destroy();
+	};
+
+}
\ No newline at end of file
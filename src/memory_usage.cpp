@@ -0,0 +1,119 @@
+#include "memory_usage.hpp"
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#include <unistd.h>
+#endif
+
+#include <algorithm>
+#include <cstddef>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+
+namespace Graphics
+{
+
+#ifdef _WIN32
+	std::size_t residentBytes()
+	{
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return 0;
+		}
+		return counters.WorkingSetSize;
+	}
+
+	std::size_t peakResidentBytes()
+	{
+		PROCESS_MEMORY_COUNTERS counters{};
+		if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+		{
+			return 0;
+		}
+		return counters.PeakWorkingSetSize;
+	}
+#else
+	std::size_t residentBytes()
+	{
+		// The second field is the resident set, in pages
+		std::ifstream statm{ "/proc/self/statm" };
+		std::size_t size{ 0 };
+		std::size_t resident{ 0 };
+		if (!(statm >> size >> resident))
+		{
+			return 0;
+		}
+		return resident * static_cast<std::size_t>(sysconf(_SC_PAGESIZE));
+	}
+
+	std::size_t peakResidentBytes()
+	{
+		rusage usage{};
+		if (getrusage(RUSAGE_SELF, &usage) != 0)
+		{
+			return 0;
+		}
+#ifdef __APPLE__
+		return static_cast<std::size_t>(usage.ru_maxrss);
+#else
+		return static_cast<std::size_t>(usage.ru_maxrss) * 1024;
+#endif
+	}
+#endif
+
+	MemoryTracker::MemoryTracker()
+		: m_startResident{ residentBytes() },
+		  m_startPeak{ peakResidentBytes() }
+	{
+	}
+
+	void MemoryTracker::sample(std::string stage)
+	{
+		m_samples.push_back({ .stage{ std::move(stage) }, .resident{ residentBytes() }, .peak{ peakResidentBytes() } });
+	}
+
+	void MemoryTracker::printStatistics() const
+	{
+		constexpr double mebibyte{ 1024.0 * 1024.0 };
+
+		std::size_t width{ 0 };
+		for (const Sample& sample : m_samples)
+		{
+			width = std::max(width, sample.stage.size());
+		}
+
+		std::cout << "memory: " << m_startResident / mebibyte << " MiB resident at the start";
+		if (!m_samples.empty())
+		{
+			std::cout << ", peak " << m_samples.back().peak / mebibyte << " MiB";
+		}
+		std::cout << '\n';
+
+		std::size_t resident{ m_startResident };
+		std::size_t peak{ m_startPeak };
+		for (const Sample& sample : m_samples)
+		{
+			const double change{ (static_cast<double>(sample.resident) - static_cast<double>(resident)) / mebibyte };
+			std::cout << "  " << std::left << std::setw(static_cast<int>(width)) << sample.stage << std::right
+				<< ' ' << sample.resident / mebibyte << " MiB resident (" << std::showpos << change << std::noshowpos << ')';
+			if (sample.peak > peak)
+			{
+				std::cout << ", peak rose to " << sample.peak / mebibyte << " MiB";
+			}
+			std::cout << '\n';
+
+			resident = sample.resident;
+			peak = sample.peak;
+		}
+	}
+
+}
\ No newline at end of file
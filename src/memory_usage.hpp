@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Bytes of the process's memory currently in RAM, and the most there has ever been. 0 where the platform doesn't say.
+	std::size_t residentBytes();
+	std::size_t peakResidentBytes();
+
+	// Samples the resident set as a long job like loading passes through its stages, for a breakdown of where the memory went.
+	// The peak only tells the highest point so far, so a stage is blamed for it when the peak rose while it ran.
+	class MemoryTracker
+	{
+	public:
+		MemoryTracker();
+
+		// Call as a stage ends
+		void sample(std::string stage);
+
+		void printStatistics() const;
+
+	private:
+		struct Sample
+		{
+			std::string stage{};
+			std::size_t resident{};
+			std::size_t peak{};
+		};
+
+		std::size_t         m_startResident{};
+		std::size_t         m_startPeak{};
+		std::vector<Sample> m_samples{};
+	};
+
+}
\ No newline at end of file
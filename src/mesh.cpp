@@ -1,195 +1,85 @@
 #include "mesh.hpp"
 
 #include "alloc.hpp"
-#include "cmd_buffer.hpp"
-#include "sync.hpp"
-
-#define TINYOBJLOADER_IMPLEMENTATION
-#include "TinyObj/tiny_obj_loader.h"
-
-#include "stb/stb_image.h"
+#include "mip_generator.hpp"
+#include "obj_loader.hpp"
+#include "scene_pack.hpp"
+#include "texture_cooker.hpp"
+#include "upload.hpp"
 
 #include <algorithm>
 #include <cmath>
 #include <cstdint>
 #include <cstring>
-#include <iostream>
+#include <span>
 #include <string>
-#include <string_view>
-#include <unordered_map>
 #include <utility>
 #include <vector>
 
 namespace Graphics
 {
 
-	Buffer createVertexBuffer(std::vector<Vertex>& vertices, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence)
+	Buffer createVertexBuffer(std::vector<Vertex>& vertices, UploadManager& uploader)
 	{
-		const VkDeviceSize vertexBufferSize{ vertices.size() * sizeof(Vertex) };
-
-		VkBufferCreateInfo stagingBufferCI
-		{
-			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
-			.size{ vertexBufferSize },
-			.usage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
-		};
-
-		VmaAllocationCreateInfo stagingAllocCI
-		{
-			.flags{ VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
-			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_HOST },
-			.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT },
-		};
-
-		Buffer stagingBuffer{};
-		vmaCreateBuffer(allocator, &stagingBufferCI, &stagingAllocCI, &stagingBuffer.buffer, &stagingBuffer.alloc, nullptr);
-
-		void* data{};
-		vmaMapMemory(allocator, stagingBuffer.alloc, &data);
-		std::memcpy(data, vertices.data(), vertexBufferSize);
-		vmaUnmapMemory(allocator, stagingBuffer.alloc);
+		const Buffer buffer{ createVertexBuffer(std::span<const Vertex>{ vertices }, uploader) };
 
 		vertices.clear();
 		vertices.shrink_to_fit();
 
-		VkBufferCreateInfo bufferCI
-		{
-			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
-			.size{ vertexBufferSize },
-			.usage{ VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT }
-		};
-
-		VmaAllocationCreateInfo allocCI
-		{
-			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
-			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }
-		};
-
-		Buffer buffer{};
-		vmaCreateBuffer(allocator, &bufferCI, &allocCI, &buffer.buffer, &buffer.alloc, nullptr);
-
-		vkResetCommandBuffer(commandBuffer, 0);
-		beginCommandBuffer(commandBuffer, true);
-
-		VkBufferCopy region{ .size{ vertexBufferSize } };
-		vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, buffer.buffer, 1, &region);
-
-		vkEndCommandBuffer(commandBuffer);
-
-		queueSubmit(queue, commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, fence);
-
-		vkWaitForFences(device, 1, &fence, VK_TRUE, secondsToNanoseconds(600));
-		vkResetFences(device, 1, &fence);
-
-		vmaDestroyBuffer(allocator, stagingBuffer.buffer, stagingBuffer.alloc);
-
 		return buffer;
 	}
 
-	Buffer createIndexBuffer(std::vector<std::uint32_t>& indices, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence)
+	Buffer createVertexBuffer(std::span<const Vertex> vertices, UploadManager& uploader)
 	{
-		const VkDeviceSize indexBufferSize{ indices.size() * sizeof(std::uint32_t) };
-
-		VkBufferCreateInfo stagingBufferCI
-		{
-			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
-			.size{ indexBufferSize },
-			.usage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
-		};
-
-		VmaAllocationCreateInfo stagingAllocCI
-		{
-			.flags{ VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
-			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_HOST },
-			.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT },
-		};
-
-		Buffer stagingBuffer{};
-		vmaCreateBuffer(allocator, &stagingBufferCI, &stagingAllocCI, &stagingBuffer.buffer, &stagingBuffer.alloc, nullptr);
-
-		void* data{};
-		vmaMapMemory(allocator, stagingBuffer.alloc, &data);
-		std::memcpy(data, indices.data(), indexBufferSize);
-		vmaUnmapMemory(allocator, stagingBuffer.alloc);
-
-		indices.clear();
-		indices.shrink_to_fit();
+		const VkDeviceSize vertexBufferSize{ vertices.size_bytes() };
 
 		VkBufferCreateInfo bufferCI
 		{
 			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
-			.size{ indexBufferSize },
-			.usage{ VK_BUFFER_USAGE_INDEX_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT }
-		};
-
-		VmaAllocationCreateInfo allocCI
-		{
-			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
-			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT }
+			.size{ vertexBufferSize },
+			.usage{ VK_BUFFER_USAGE_VERTEX_BUFFER_BIT }
 		};
+		Buffer buffer{ uploader.createBuffer(bufferCI) };
 
-		Buffer buffer{};
-		vmaCreateBuffer(allocator, &bufferCI, &allocCI, &buffer.buffer, &buffer.alloc, nullptr);
-
-		vkResetCommandBuffer(commandBuffer, 0);
-		beginCommandBuffer(commandBuffer, true);
-
-		VkBufferCopy region{ .size{ indexBufferSize } };
-		vkCmdCopyBuffer(commandBuffer, stagingBuffer.buffer, buffer.buffer, 1, &region);
-
-		vkEndCommandBuffer(commandBuffer);
-
-		queueSubmit(queue, commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, fence);
-
-		vkWaitForFences(device, 1, &fence, VK_TRUE, secondsToNanoseconds(600));
-		vkResetFences(device, 1, &fence);
-
-		vmaDestroyBuffer(allocator, stagingBuffer.buffer, stagingBuffer.alloc);
+		const BufferWrite write{ uploader.beginBufferWrite(buffer, 0, vertexBufferSize) };
+		std::memcpy(write.data, vertices.data(), vertexBufferSize);
+		uploader.endBufferWrite(write);
 
 		return buffer;
 	}
 
-	Image loadImage(const char* path, std::uint32_t& mipLevels, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence)
+	Image loadImage(const char* path, std::uint32_t& mipLevels, UploadManager& uploader, VmaAllocator allocator,
+		VkFormat imageFormat, glm::vec4* averageColor)
 	{
-		int width{};
-		int height{};
-		int channels{};
-		stbi_uc* data{ stbi_load(path, &width, &height, &channels, STBI_rgb_alpha) };
-		if (!data)
+		const DecodedImage image{ decodeImage(path, averageColor != nullptr) };
+		if (averageColor)
 		{
-			std::cerr << "failed to load texture at path: " << path << '\n';
+			*averageColor = image.averageColor;
 		}
 
-		mipLevels = std::floor(std::log2(std::max(width, height))) + 1u;
+		return uploadImage(image, mipLevels, uploader, allocator, imageFormat);
+	}
 
-		VkDeviceSize imageSize   { static_cast<VkDeviceSize>(width * height * 4) };
-		VkFormat     imageFormat { VK_FORMAT_R8G8B8A8_SRGB };
+	Image uploadImage(const DecodedImage& decoded, std::uint32_t& mipLevels, UploadManager& uploader, VmaAllocator allocator, VkFormat imageFormat,
+		bool preserveAlphaCoverage)
+	{
+		const int width{ decoded.width };
+		const int height{ decoded.height };
 
-		VkBufferCreateInfo stagingBufferCI
-		{
-			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
-			.size{ imageSize },
-			.usage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
-		};
-		VmaAllocationCreateInfo stagingAllocCI
-		{
-			.flags{ VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
-			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_HOST },
-			.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT },
-		};
-		Buffer stagingBuffer{};
-		vmaCreateBuffer(allocator, &stagingBufferCI, &stagingAllocCI, &stagingBuffer.buffer, &stagingBuffer.alloc, nullptr);
+		mipLevels = std::floor(std::log2(std::max(width, height))) + 1u;
+
+		VkDeviceSize imageSize{ static_cast<VkDeviceSize>(width * height * 4) };
 
-		void* mappedData{};
-		vmaMapMemory(allocator, stagingBuffer.alloc, &mappedData);
-		std::memcpy(mappedData, data, imageSize);
-		vmaUnmapMemory(allocator, stagingBuffer.alloc);
+		const StagingRegion staging{ uploader.allocateStaging(imageSize) };
+		std::memcpy(staging.data, decoded.pixels.get(), imageSize);
 
-		stbi_image_free(data);
+		MipGenerator* mipGenerator{ uploader.mipGenerator() };
+		const bool computeMips{ mipGenerator && mipLevels > 1 && MipGenerator::supports(imageFormat, mipLevels) };
 
 		VkImageCreateInfo imageCI
 		{
 			.sType{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO },
+			.flags{ computeMips ? MipGenerator::imageFlags(imageFormat) : 0u },
 			.imageType{ VK_IMAGE_TYPE_2D },
 			.format{ imageFormat },
 			.extent{ .width{ static_cast<std::uint32_t>(width) }, .height{ static_cast<std::uint32_t>(height) }, .depth{ 1u } },
@@ -200,6 +90,10 @@ namespace Graphics
 			.usage{ VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_SAMPLED_BIT },
 			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
 		};
+		if (computeMips)
+		{
+			imageCI.usage |= MipGenerator::imageUsage();
+		}
 		VmaAllocationCreateInfo allocCI
 		{
 			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
@@ -208,8 +102,7 @@ namespace Graphics
 		Image image{};
 		vmaCreateImage(allocator, &imageCI, &allocCI, &image.image, &image.alloc, nullptr);
 
-		vkResetCommandBuffer(commandBuffer, 0);
-		beginCommandBuffer(commandBuffer, true);
+		VkCommandBuffer commandBuffer{ uploader.transferCommands() };
 
 		VkImageSubresourceRange subresourceRange
 		{
@@ -235,11 +128,30 @@ namespace Graphics
 
 		VkBufferImageCopy copy
 		{
-			.bufferOffset{ 0 },
+			.bufferOffset{ staging.offset },
 			.imageSubresource{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 0, 1 },
 			.imageExtent{ .width{ static_cast<std::uint32_t>(width) }, .height{ static_cast<std::uint32_t>(height) }, .depth{ 1u } },
 		};
-		vkCmdCopyBufferToImage(commandBuffer, stagingBuffer.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+		vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &copy);
+
+		// Blits and the mip generator need the graphics queue
+		uploader.transferImageOwnership(image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+		if (computeMips)
+		{
+			mipGenerator->enqueue(
+			{
+				.image{ image.image },
+				.format{ imageFormat },
+				.extent{ static_cast<std::uint32_t>(width), static_cast<std::uint32_t>(height) },
+				.mipLevels{ mipLevels },
+				.preserveAlphaCoverage{ preserveAlphaCoverage },
+			});
+			return image;
+		}
+
+		// Without the generator, blit each level from the one above
+		commandBuffer = uploader.graphicsCommands();
 
 		VkImageMemoryBarrier imageBarrier2
 		{
@@ -316,128 +228,211 @@ namespace Graphics
 		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
 			0, 0, nullptr, 0, nullptr, 1, &imageBarrier2);
 
-		vkEndCommandBuffer(commandBuffer);
-		queueSubmit(queue, commandBuffer, VK_NULL_HANDLE, 0, VK_NULL_HANDLE, fence);
+		return image;
+	}
+
+	Image uploadCookedImage(const CookedImage* layers, std::uint32_t layerCount, UploadManager& uploader, VmaAllocator allocator,
+		VkImageCreateFlags flags, std::uint32_t firstLevel)
+	{
+		const CookedImage& first{ layers[0] };
+		const std::uint32_t mipLevels{ static_cast<std::uint32_t>(first.levels.size()) - firstLevel };
+
+		// Offsets stay 16 byte aligned, which covers every block size
+		std::size_t stagingSize{ 0 };
+		for (std::uint32_t layer{ 0 }; layer < layerCount; ++layer)
+		{
+			for (std::uint32_t mip{ 0 }; mip < mipLevels; ++mip)
+			{
+				stagingSize = (stagingSize + 15) / 16 * 16 + layers[layer].levels[firstLevel + mip].size;
+			}
+		}
+		const StagingRegion staging{ uploader.allocateStaging(stagingSize) };
+
+		VkImageCreateInfo imageCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO },
+			.flags{ flags },
+			.imageType{ VK_IMAGE_TYPE_2D },
+			.format{ first.format },
+			.extent{ .width{ first.levels[firstLevel].width }, .height{ first.levels[firstLevel].height }, .depth{ 1u } },
+			.mipLevels{ mipLevels },
+			.arrayLayers{ layerCount },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.tiling{ VK_IMAGE_TILING_OPTIMAL },
+			.usage{ VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+		};
+		VmaAllocationCreateInfo allocCI
+		{
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+		};
+		Image image{};
+		vmaCreateImage(allocator, &imageCI, &allocCI, &image.image, &image.alloc, nullptr);
+
+		VkCommandBuffer commandBuffer{ uploader.transferCommands() };
 
-		vkWaitForFences(device, 1, &fence, VK_TRUE, secondsToNanoseconds(60));
-		vkResetFences(device, 1, &fence);
+		const VkImageSubresourceRange subresourceRange
+		{
+			.aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT },
+			.baseMipLevel{ 0 },
+			.levelCount{ mipLevels },
+			.baseArrayLayer{ 0 },
+			.layerCount{ layerCount },
+		};
 
-		vmaDestroyBuffer(allocator, stagingBuffer.buffer, stagingBuffer.alloc);
+		VkImageMemoryBarrier imageBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_NONE },
+			.dstAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.oldLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+			.newLayout{ VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+			.image{ image.image },
+			.subresourceRange{ subresourceRange },
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+
+		std::vector<VkBufferImageCopy> copies{};
+		copies.reserve(static_cast<std::size_t>(layerCount) * mipLevels);
+		std::size_t offset{ 0 };
+		for (std::uint32_t layer{ 0 }; layer < layerCount; ++layer)
+		{
+			for (std::uint32_t mip{ 0 }; mip < mipLevels; ++mip)
+			{
+				const CookedLevel& level{ layers[layer].levels[firstLevel + mip] };
+
+				offset = (offset + 15) / 16 * 16;
+				std::memcpy(static_cast<char*>(staging.data) + offset, layers[layer].data.data() + level.offset, level.size);
+
+				copies.push_back(
+				{
+					.bufferOffset{ staging.offset + offset },
+					.imageSubresource{ VK_IMAGE_ASPECT_COLOR_BIT, mip, layer, 1 },
+					.imageExtent{ .width{ level.width }, .height{ level.height }, .depth{ 1u } },
+				});
+				offset += level.size;
+			}
+		}
+		vkCmdCopyBufferToImage(commandBuffer, staging.buffer, image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+			static_cast<std::uint32_t>(copies.size()), copies.data());
+
+		uploader.transferImageOwnership(image.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, subresourceRange);
+
+		imageBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+		imageBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		imageBarrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+		imageBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		vkCmdPipelineBarrier(uploader.graphicsCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
 
 		return image;
 	}
 
-	RenderObject::RenderObject(const char* path, std::vector<Vertex>& vertices, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence)
-		: m_allocator{ allocator }
+	RenderObject::RenderObject(const char* path, std::vector<Vertex>& vertices, GeometryArena& geometry, bool keepIndices)
+		: m_geometry{ &geometry }
 	{
-		tinyobj::ObjReaderConfig readerConfig{};
-		readerConfig.vertex_color = true;
-		readerConfig.triangulate = true;
+		firstVertex = static_cast<std::uint32_t>(vertices.size());
+		addMeshes(loadObj(path, vertices));
+		vertexCount = static_cast<std::uint32_t>(vertices.size()) - firstVertex;
 
-		tinyobj::ObjReader reader{};
-		reader.ParseFromFile(static_cast<std::string>(path), readerConfig);
+		uploadIndices(keepIndices);
+	}
 
-		if (!reader.Error().empty())
+	RenderObject::RenderObject(const ScenePack& pack, std::uint32_t object, std::vector<Vertex>& vertices, GeometryArena& geometry,
+		bool keepIndices)
+		: m_geometry{ &geometry }
+	{
+		firstVertex = static_cast<std::uint32_t>(vertices.size());
+		addMeshes(pack.object(object, vertices));
+		vertexCount = static_cast<std::uint32_t>(vertices.size()) - firstVertex;
+
+		uploadIndices(keepIndices);
+	}
+
+	RenderObject::RenderObject(std::vector<ObjMesh> objMeshes, std::uint32_t firstVertex, std::uint32_t vertexCount, GeometryArena& geometry,
+		bool keepIndices)
+		: firstVertex{ firstVertex },
+		  vertexCount{ vertexCount },
+		  m_geometry{ &geometry }
+	{
+		addMeshes(std::move(objMeshes));
+		uploadIndices(keepIndices);
+	}
+
+	void RenderObject::addMeshes(std::vector<ObjMesh> objMeshes)
+	{
+		meshes.reserve(objMeshes.size());
+		for (ObjMesh& mesh : objMeshes)
 		{
-			std::cerr << "error: tinyobj: " << reader.Error() << '\n';
+			meshes.push_back(Mesh{
+				.material{ mesh.material },
+				.indices{ std::move(mesh.indices) },
+				.diffusePath{ std::move(mesh.diffusePath) },
+				});
 		}
+	}
 
-		if (!reader.Warning().empty())
+	void RenderObject::uploadIndices(bool keepIndices)
+	{
+		std::uint32_t indexCount{ 0 };
+		for (auto& m : meshes)
 		{
-			std::cerr << "warning: tinyobj: " << reader.Warning() << '\n';
+			indexCount += static_cast<std::uint32_t>(m.indices.size());
 		}
 
-		auto& attrib{ reader.GetAttrib() };
-		auto& shapes{ reader.GetShapes() };
-		auto& materials{ reader.GetMaterials() };
+		// All meshes go into the arena as one range, written straight into place
+		const IndexWrite write{ m_geometry->beginIndices(indexCount) };
+		m_indexRange = write.range;
 
-		for (std::size_t s{ 0 }; s < shapes.size(); ++s)
+		std::uint32_t firstIndex{ m_indexRange.first };
+		for (auto& m : meshes)
 		{
-			std::size_t indexOffset{ 0 };
-			for (std::size_t f{ 0 }; f < shapes[s].mesh.num_face_vertices.size(); ++f)
-			{
-				std::size_t fv{ shapes[s].mesh.num_face_vertices[f] };
+			m.firstIndex = firstIndex;
+			m.indexCount = m.indices.size();
+			std::copy(m.indices.begin(), m.indices.end(), write.indices + (firstIndex - m_indexRange.first));
+			firstIndex += m.indexCount;
 
-				for (std::size_t v{ 0 }; v < fv; ++v)
-				{
-					tinyobj::index_t index{ shapes[s].mesh.indices[indexOffset + v] };
-
-					Vertex newVertex{};
-					newVertex.pos.x = attrib.vertices[3 * index.vertex_index + 0];
-					newVertex.pos.y = -attrib.vertices[3 * index.vertex_index + 1];
-					newVertex.pos.z = -(attrib.vertices[3 * index.vertex_index + 2]);
-
-					if (index.normal_index >= 0)
-					{
-						newVertex.norm.x = attrib.normals[3 * index.normal_index + 0];
-						newVertex.norm.y = attrib.normals[3 * index.normal_index + 1];
-						newVertex.norm.z = attrib.normals[3 * index.normal_index + 2];
-					}
-
-					if (index.texcoord_index >= 0)
-					{
-						newVertex.tex.x = attrib.texcoords[2 * index.texcoord_index + 0];
-						newVertex.tex.y = 1 - (attrib.texcoords[2 * index.texcoord_index + 1]);
-					}
-
-					newVertex.color.r = attrib.colors[3 * index.vertex_index + 0];
-					newVertex.color.g = attrib.colors[3 * index.vertex_index + 1];
-					newVertex.color.b = attrib.colors[3 * index.vertex_index + 2];
-
-					int material{ shapes[s].mesh.material_ids[f] };
-
-					if (material != -1)
-					{
-						newVertex.color.r = materials[material].diffuse[0];
-						newVertex.color.g = materials[material].diffuse[1];
-						newVertex.color.b = materials[material].diffuse[2];
-					}
-
-					std::vector<Mesh>::iterator result{};
-					if (meshes.size() != 0)
-					{
-						result = std::find_if(meshes.begin(), meshes.end(),
-							[=](const Mesh& m) {
-								return material == m.material;
-							});
-					}
-					else
-					{
-						result = meshes.end();
-					}
-
-					if (result == meshes.end() || meshes.size() == 0)
-					{
-						meshes.push_back(Mesh{
-							.material{ material },
-							.diffusePath{ material == -1 ? "" : materials[material].diffuse_texname },
-							});
-						meshes.back().map[newVertex] = static_cast<std::uint32_t>(vertices.size());
-						meshes.back().indices.push_back(static_cast<std::uint32_t>(vertices.size()));
-						vertices.push_back(newVertex);
-					}
-					else
-					{
-						if (result->map.count(newVertex) == 0)
-						{
-							result->map[newVertex] = static_cast<std::uint32_t>(vertices.size());
-							vertices.push_back(newVertex);
-						}
-						result->indices.push_back(result->map[newVertex]);
-					}
-				}
-
-				indexOffset += fv;
+			if (!keepIndices)
+			{
+				m.indices = {};
 			}
 		}
 
+		m_geometry->endIndices(write);
+	}
+
+	void RenderObject::releaseIndices()
+	{
+		m_geometry->free(m_indexRange);
+		m_indexRange = {};
+	}
+
+	void RenderObject::restoreIndices(const std::uint32_t* indices)
+	{
+		const IndexWrite write{ m_geometry->beginIndices(indexCount()) };
+		m_indexRange = write.range;
+
+		std::uint32_t firstIndex{ m_indexRange.first };
 		for (auto& m : meshes)
 		{
-			m.indexCount = m.indices.size();
-			m.indexBuffer = createIndexBuffer(m.indices, device, allocator, queue, commandBuffer, fence);
-			// Standard doesn't seem to have a way of freeing memory used by unordered_map without destruction. smh
-			m.map = {};
+			m.firstIndex = firstIndex;
+			firstIndex += m.indexCount;
 		}
+		std::copy(indices, indices + m_indexRange.count, write.indices);
+
+		m_geometry->endIndices(write);
+	}
+
+	std::uint32_t RenderObject::indexCount() const
+	{
+		std::uint32_t count{ 0 };
+		for (const auto& m : meshes)
+		{
+			count += m.indexCount;
+		}
+		return count;
 	}
 
 	RenderObject::RenderObject(RenderObject&& r) noexcept
@@ -460,34 +455,56 @@ namespace Graphics
 	void RenderObject::move(RenderObject&& r)
 	{
 		meshes = std::move(r.meshes);
+		firstVertex = r.firstVertex;
+		vertexCount = r.vertexCount;
+		m_indexRange = r.m_indexRange;
 
-		m_allocator = r.m_allocator;
-		r.m_allocator = {};
+		m_geometry = r.m_geometry;
+		r.m_geometry = {};
 	}
 
 	void RenderObject::destroy()
 	{
-		if (m_allocator != VmaAllocator{})
+		if (m_geometry != nullptr)
 		{
-			for (auto& m : meshes)
-			{
-				vmaDestroyBuffer(m_allocator, m.indexBuffer.buffer, m.indexBuffer.alloc);
-			}
+			m_geometry->free(m_indexRange);
 		}
 	}
 
-	Texture::Texture(const char* path, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence)
-		: m_device{ device },
+	Texture::Texture(const char* path, UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator, VkFormat format)
+		: Texture{ decodeImage(path), uploader, samplers, device, allocator, format }
+	{
+	}
+
+	Texture::Texture(const DecodedImage& image, UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator,
+		VkFormat format, bool preserveAlphaCoverage)
+		: m_averageColor{ image.averageColor },
+		  m_device{ device },
+		  m_allocator{ allocator }
+	{
+		m_image = uploadImage(image, m_mipLevels, uploader, allocator, format, preserveAlphaCoverage);
+		createView(format, samplers);
+	}
+
+	Texture::Texture(const CookedImage& image, UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator,
+		std::uint32_t firstLevel)
+		: m_mipLevels{ static_cast<std::uint32_t>(image.levels.size()) - firstLevel },
+		  m_averageColor{ image.averageColor },
+		  m_device{ device },
 		  m_allocator{ allocator }
 	{
-		m_image = loadImage(path, m_mipLevels, device, allocator, queue, commandBuffer, fence);
+		m_image = uploadCookedImage(&image, 1, uploader, allocator, 0, firstLevel);
+		createView(image.format, samplers);
+	}
 
+	void Texture::createView(VkFormat format, SamplerCache& samplers)
+	{
 		VkImageViewCreateInfo imageViewCI
 		{
 			.sType{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO },
 			.image{ m_image.image },
 			.viewType{ VK_IMAGE_VIEW_TYPE_2D },
-			.format{ VK_FORMAT_R8G8B8A8_SRGB },
+			.format{ format },
 			.subresourceRange
 			{
 				.aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT },
@@ -497,7 +514,7 @@ namespace Graphics
 				.layerCount{ 1 },
 			}
 		};
-		vkCreateImageView(device, &imageViewCI, nullptr, &m_imageView);
+		vkCreateImageView(m_device, &imageViewCI, nullptr, &m_imageView);
 
 		VkSamplerCreateInfo samplerCI
 		{
@@ -508,10 +525,10 @@ namespace Graphics
 			.addressModeU{ VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT },
 			.addressModeV{ VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT },
 			.minLod{ 0.0f },
-			.maxLod{ static_cast<float>(m_mipLevels) },
-
+			// The view already limits the mip count, so every texture can share this sampler
+			.maxLod{ VK_LOD_CLAMP_NONE },
 		};
-		vkCreateSampler(device, &samplerCI, nullptr, &m_sampler);
+		m_sampler = samplers.get(samplerCI);
 	}
 
 	Texture::Texture(Texture&& t)
@@ -533,6 +550,9 @@ namespace Graphics
 
 	void Texture::move(Texture&& t)
 	{
+		m_mipLevels    = t.m_mipLevels;
+		m_averageColor = t.m_averageColor;
+
 		m_image     = t.m_image;
 		m_imageView = t.m_imageView;
 		m_sampler   = t.m_sampler;
@@ -547,7 +567,6 @@ namespace Graphics
 	{
 		if (m_device != VK_NULL_HANDLE)
 		{
-			vkDestroySampler(m_device, m_sampler, nullptr);
 			vkDestroyImageView(m_device, m_imageView, nullptr);
 			vmaDestroyImage(m_allocator, m_image.image, m_image.alloc);
 		}
@@ -1,17 +1,23 @@
 #pragma once
 
 #include "alloc.hpp"
+#include "geometry_arena.hpp"
+#include "image.hpp"
+#include "obj_loader.hpp"
+#include "sampler_cache.hpp"
+#include "upload.hpp"
+#include "vertex.hpp"
 
 #include "volk/volk.h"
 #include "VMA/vk_mem_alloc.h"
 
 #include "glm/glm.hpp"
-#define GLM_ENABLE_EXPERIMENTAL
-#include "glm/gtx/hash.hpp"
 
 #include <cstddef>
 #include <cstdint>
 #include <functional>
+#include <memory>
+#include <span>
 #include <string>
 #include <string_view>
 #include <unordered_map>
@@ -20,56 +26,34 @@
 namespace Graphics
 {
 
-	struct Vertex
-	{
-		glm::vec3 pos{};
-		glm::vec3 norm{};
-		glm::vec3 color{};
-		glm::vec2 tex{};
+	// Releases the vertex list once it has been written
+	Buffer createVertexBuffer(std::vector<Vertex>& vertices, UploadManager& uploader);
+	// Leaves the vertices alone, for a list that is still being built on
+	Buffer createVertexBuffer(std::span<const Vertex> vertices, UploadManager& uploader);
 
-		bool operator==(const Vertex& v) const
-		{
-			return pos == v.pos && norm == v.norm && color == v.color && tex == v.tex;
-		}
-	};
-
-}
-
-template<>
-struct std::hash<Graphics::Vertex>
-{
-	size_t operator()(const Graphics::Vertex& v) const noexcept
-	{
-		size_t h1{ hash<glm::vec3>{}(v.pos) };
-		size_t h2{ hash<glm::vec3>{}(v.norm) };
-		size_t h3{ hash<glm::vec3>{}(v.color) };
-		size_t h4{ hash<glm::vec2>{}(v.tex) };
-
-		constexpr std::uint64_t multiplier{ 6364136223846793005 };
-		constexpr std::uint64_t increment{ 1442695040888963407 };
-
-		size_t finalHash{ h1 };
-		finalHash = finalHash ^ (h2 * multiplier + increment);
-		finalHash = finalHash ^ (h3 * multiplier + increment);
-		finalHash = finalHash ^ (h4 * multiplier + increment);
-
-		return finalHash;
-	}
-};
-
-namespace Graphics
-{
+	// The image is usable once the uploader's current batch has completed. Mips are built by the uploader's
+	// mip generator when it has one, otherwise by blits. Coverage preservation needs the generator.
+	Image uploadImage(const DecodedImage& image, std::uint32_t& mipLevels, UploadManager& uploader, VmaAllocator allocator,
+		VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB, bool preserveAlphaCoverage = false);
 
-	Buffer createVertexBuffer(std::vector<Vertex>& vertices, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence);
+	// Decodes and uploads on the calling thread
+	// averageColor, if given, receives the alpha weighted mean of the image's linear colors, sRGB encoded
+	Image loadImage(const char* path, std::uint32_t& mipLevels, UploadManager& uploader, VmaAllocator allocator,
+		VkFormat imageFormat = VK_FORMAT_R8G8B8A8_SRGB, glm::vec4* averageColor = nullptr);
 
-	Buffer createIndexBuffer(std::vector<std::uint32_t>& indices, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence);
+	struct CookedImage;
+	class ScenePack;
 
-	Image loadImage(const char* path, std::uint32_t& mipLevels, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence);
+	// Copies the levels from firstLevel down of the cooked images into one image, one array layer per image. All of them
+	// must have the same format, size and level count. The image is usable once the uploader's current batch has completed.
+	Image uploadCookedImage(const CookedImage* layers, std::uint32_t layerCount, UploadManager& uploader, VmaAllocator allocator,
+		VkImageCreateFlags flags = 0, std::uint32_t firstLevel = 0);
 
 	struct RenderObjectInstance
 	{
 		int       renderObject{};
 		glm::mat4 transform{ 1.0f };
+		bool      isStatic{ false }; // Static instances are baked into world space by the static batcher
 	};
 
 	class RenderObject
@@ -77,19 +61,26 @@ namespace Graphics
 	public:
 		struct Mesh
 		{
-			int                                       material{};
-			std::vector<std::uint32_t>                indices{};
-			std::string                               diffusePath{};
-			Buffer                                    indexBuffer{};
-			std::uint32_t                             indexCount{};
-			std::uint32_t                             textureIndex{};
-			bool                                      draw{ true };
-			std::unordered_map<Vertex, std::uint32_t> map{};
-			bool                                      opaque{ true };
+			int                        material{};
+			std::vector<std::uint32_t> indices{};
+			std::string                diffusePath{};
+			std::uint32_t              firstIndex{}; // Into the geometry arena's index buffer
+			std::uint32_t              indexCount{};
+			std::uint32_t              textureIndex{};
+			bool                       draw{ true };
+			bool                       opaque{ true };
 		};
 
-		RenderObject(const char* path, std::vector<Vertex>& vertices, VkDevice device, 
-			VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence);
+		// keepIndices leaves each mesh's CPU index list alive after upload, for build steps such as HLOD.
+		// The geometry arena must outlive the render object.
+		RenderObject(const char* path, std::vector<Vertex>& vertices, GeometryArena& geometry, bool keepIndices = false);
+		// Copies the object's vertices and indices out of a cooked scene pack, no parsing involved
+		RenderObject(const ScenePack& pack, std::uint32_t object, std::vector<Vertex>& vertices, GeometryArena& geometry,
+			bool keepIndices = false);
+		// Takes meshes read earlier by loadObj or ScenePack::object, whose vertices went into the shared list from firstVertex on.
+		// All that is left is the upload, so this is the part that belongs on the thread owning the uploader.
+		RenderObject(std::vector<ObjMesh> objMeshes, std::uint32_t firstVertex, std::uint32_t vertexCount, GeometryArena& geometry,
+			bool keepIndices = false);
 
 		RenderObject(const RenderObject&) = delete;
 		RenderObject& operator=(const RenderObject&) = delete;
@@ -99,10 +90,34 @@ namespace Graphics
 
 		~RenderObject();
 
+		// Frees the object's index range. The meshes keep their index counts, so the indices can be
+		// brought back with restoreIndices. Nothing may draw the object in between.
+		void releaseIndices();
+		// indices holds every mesh's indices back to back, in mesh order, indexCount() in total.
+		// The arena must have room for them unless no frames are in flight.
+		void restoreIndices(const std::uint32_t* indices);
+
+		bool indicesResident() const
+		{
+			return m_indexRange.count != 0;
+		}
+		std::uint32_t indexCount() const;
+
 		std::vector<Mesh> meshes{};
+
+		// The object's range in the shared vertex list
+		std::uint32_t firstVertex{};
+		std::uint32_t vertexCount{};
 	private:
+		GeometryRange m_indexRange{};
+
 		// Not owned by the class
-		VmaAllocator m_allocator{};
+		GeometryArena* m_geometry{};
+
+		void addMeshes(std::vector<ObjMesh> objMeshes);
+
+		// Writes every mesh's indices into the arena as one range
+		void uploadIndices(bool keepIndices);
 
 		void move(RenderObject&& r);
 		void destroy();
@@ -111,7 +126,15 @@ namespace Graphics
 	class Texture
 	{
 	public:
-		Texture(const char* path, VkDevice device, VmaAllocator allocator, VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence);
+		// Data maps (density, height, normals) should pass a UNORM format so they are not linearized on sampling
+		Texture(const char* path, UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator,
+			VkFormat format = VK_FORMAT_R8G8B8A8_SRGB);
+		// Cutout textures should pass preserveAlphaCoverage so their mips don't thin out
+		Texture(const DecodedImage& image, UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator,
+			VkFormat format = VK_FORMAT_R8G8B8A8_SRGB, bool preserveAlphaCoverage = false);
+		// Mips come from the cooked image instead of being generated on the GPU. Levels above firstLevel are left out.
+		Texture(const CookedImage& image, UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator,
+			std::uint32_t firstLevel = 0);
 
 		Texture(const Texture&) = delete;
 		Texture& operator=(const Texture&) = delete;
@@ -129,17 +152,24 @@ namespace Graphics
 		{
 			return m_sampler;
 		}
+		const glm::vec4& averageColor() const
+		{
+			return m_averageColor;
+		}
 
 	private:
 		std::uint32_t m_mipLevels{};
+		glm::vec4     m_averageColor{};
 		Image         m_image{};
 		VkImageView   m_imageView{};
-		VkSampler     m_sampler{};
 
 		// Not owned by class
+		VkSampler    m_sampler{};
 		VkDevice     m_device{};
 		VmaAllocator m_allocator{};
 
+		void createView(VkFormat format, SamplerCache& samplers);
+
 		void move(Texture&& t);
 		void destroy();
 	};
@@ -0,0 +1,145 @@
+#include "meshlet.hpp"
+
+#include "vertex.hpp"
+
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <span>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Below this the normals spread too far for the cone to ever be back facing
+	constexpr float minConeCos{ 0.1f };
+
+	static Meshlet finishMeshlet(std::span<const std::uint32_t> indices, std::span<const Vertex> vertices, std::uint32_t firstIndex, std::uint32_t indexCount,
+		const MeshletSettings& settings)
+	{
+		Meshlet meshlet
+		{
+			.firstIndex{ firstIndex },
+			.indexCount{ indexCount },
+		};
+
+		glm::vec3 boundsMin{ std::numeric_limits<float>::max() };
+		glm::vec3 boundsMax{ std::numeric_limits<float>::lowest() };
+		for (std::uint32_t i{ firstIndex }; i < firstIndex + indexCount; ++i)
+		{
+			boundsMin = glm::min(boundsMin, vertices[indices[i]].pos);
+			boundsMax = glm::max(boundsMax, vertices[indices[i]].pos);
+		}
+
+		meshlet.center = (boundsMin + boundsMax) * 0.5f;
+		for (std::uint32_t i{ firstIndex }; i < firstIndex + indexCount; ++i)
+		{
+			meshlet.radius = std::max(meshlet.radius, glm::length(vertices[indices[i]].pos - meshlet.center));
+		}
+
+		if (!settings.coneCulling)
+		{
+			return meshlet;
+		}
+
+		// Each triangle's geometric normal, turned to the side its vertex normals agree on
+		std::vector<glm::vec3> normals{};
+		normals.reserve(indexCount / 3);
+		for (std::uint32_t t{ firstIndex }; t + 2 < firstIndex + indexCount; t += 3)
+		{
+			const Vertex& a{ vertices[indices[t + 0]] };
+			const Vertex& b{ vertices[indices[t + 1]] };
+			const Vertex& c{ vertices[indices[t + 2]] };
+
+			glm::vec3 normal{ glm::cross(b.pos - a.pos, c.pos - a.pos) };
+			const float length{ glm::length(normal) };
+			if (length == 0.0f)
+			{
+				continue;
+			}
+			normal /= length;
+
+			if (glm::dot(normal, a.norm + b.norm + c.norm) < 0.0f)
+			{
+				normal = -normal;
+			}
+			normals.push_back(normal);
+		}
+
+		glm::vec3 axis{ 0.0f };
+		for (const auto& normal : normals)
+		{
+			axis += normal;
+		}
+		const float axisLength{ glm::length(axis) };
+		if (normals.empty() || axisLength == 0.0f)
+		{
+			return meshlet;
+		}
+		axis /= axisLength;
+
+		float coneCos{ 1.0f };
+		for (const auto& normal : normals)
+		{
+			coneCos = std::min(coneCos, glm::dot(normal, axis));
+		}
+
+		if (coneCos >= minConeCos)
+		{
+			meshlet.coneAxis = axis;
+			meshlet.coneCos  = coneCos;
+		}
+
+		return meshlet;
+	}
+
+	std::vector<Meshlet> buildMeshlets(std::span<const std::uint32_t> indices, std::span<const Vertex> vertices, const MeshletSettings& settings)
+	{
+		std::vector<Meshlet> meshlets{};
+		meshlets.reserve(indices.size() / 3 / settings.maxTriangles + 1);
+
+		std::vector<std::uint32_t> meshletVertices{};
+		meshletVertices.reserve(settings.maxVertices);
+
+		std::uint32_t firstIndex{ 0 };
+		const std::uint32_t indexCount{ static_cast<std::uint32_t>(indices.size() - indices.size() % 3) };
+		for (std::uint32_t t{ 0 }; t < indexCount; t += 3)
+		{
+			std::uint32_t newVertices{ 0 };
+			for (std::uint32_t i{ t }; i < t + 3; ++i)
+			{
+				const bool seen{ std::find(meshletVertices.begin(), meshletVertices.end(), indices[i]) != meshletVertices.end() ||
+					std::find(indices.begin() + t, indices.begin() + i, indices[i]) != indices.begin() + i };
+				newVertices += seen ? 0 : 1;
+			}
+
+			const std::uint32_t triangleCount{ (t - firstIndex) / 3 };
+			if (triangleCount == settings.maxTriangles || meshletVertices.size() + newVertices > settings.maxVertices)
+			{
+				meshlets.push_back(finishMeshlet(indices, vertices, firstIndex, t - firstIndex, settings));
+				meshletVertices.clear();
+				firstIndex = t;
+			}
+
+			for (std::uint32_t i{ t }; i < t + 3; ++i)
+			{
+				if (std::find(meshletVertices.begin(), meshletVertices.end(), indices[i]) == meshletVertices.end())
+				{
+					meshletVertices.push_back(indices[i]);
+				}
+			}
+		}
+
+		if (indexCount > firstIndex)
+		{
+			meshlets.push_back(finishMeshlet(indices, vertices, firstIndex, indexCount - firstIndex, settings));
+		}
+
+		return meshlets;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,39 @@
+#pragma once
+
+#include "vertex.hpp"
+
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct MeshletSettings
+	{
+		// Small enough that the bounds cull tightly, large enough that a cluster is still worth a draw
+		std::uint32_t maxVertices{ 64 };
+		std::uint32_t maxTriangles{ 124 };
+		// Off for double sided geometry, which has no back faces to cull
+		bool          coneCulling{ true };
+	};
+
+	// A run of triangles of an index list, culled as a whole
+	struct Meshlet
+	{
+		glm::vec3     center{};
+		float         radius{};
+		glm::vec3     coneAxis{};     // Average facing of the triangles
+		float         coneCos{};      // Cosine of the widest angle between a triangle's facing and the axis, 0 if the meshlet is never back facing
+		std::uint32_t firstIndex{};   // Into the index list the meshlets were built from
+		std::uint32_t indexCount{};
+	};
+
+	// Splits the triangles into meshlets in the order they come, starting a new one whenever the next triangle would
+	// exceed a limit. Run it on indices already optimized for the vertex cache, which keeps neighbouring triangles together.
+	// Triangles face the side their vertex normals point to, whatever their winding.
+	std::vector<Meshlet> buildMeshlets(std::span<const std::uint32_t> indices, std::span<const Vertex> vertices, const MeshletSettings& settings);
+
+}
\ No newline at end of file
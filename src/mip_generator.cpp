@@ -0,0 +1,343 @@
+#include "mip_generator.hpp"
+
+#include "alloc.hpp"
+#include "pipeline.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Must match the push constant block in mipgen.comp and mipcoverage.comp
+	struct MipPushConstants
+	{
+		glm::uvec2    size{};
+		std::uint32_t levelCount{};
+		std::uint32_t workGroupCount{};
+		std::uint32_t srgb{};
+		float         alphaCutoff{};
+	};
+
+	// Must match the State block in the shaders: the workgroup counter, the covered texel count of
+	// level 0 and a 64 bin alpha histogram for every other level. Rounded up to any storage buffer
+	// offset alignment a device can require.
+	constexpr VkDeviceSize mipStateSize{ 4096 };
+	static_assert(sizeof(std::uint32_t) * (2 + (MipGenerator::maxMipLevels - 1) * 64) <= mipStateSize);
+
+	constexpr std::uint32_t mipTileSize{ 64 };
+	constexpr std::uint32_t mipCoverageGroupSize{ 8 };
+
+	MipGenerator::MipGenerator(VkDevice device, VmaAllocator allocator)
+		: m_device{ device },
+		  m_allocator{ allocator }
+	{
+		VkDescriptorSetLayoutBinding bindings[3]
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxMipLevels - 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		};
+		VkDescriptorSetLayoutCreateInfo setLayoutCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO },
+			.bindingCount{ 3 },
+			.pBindings{ bindings },
+		};
+		vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &m_setLayout);
+
+		m_pipelineLayout = createPipelineLayout(device, 1, &m_setLayout, sizeof(MipPushConstants), VK_SHADER_STAGE_COMPUTE_BIT);
+		m_downsamplePipeline = createComputePipeline(device, "shaders/mipgen.comp.spv", m_pipelineLayout);
+		m_coveragePipeline = createComputePipeline(device, "shaders/mipcoverage.comp.spv", m_pipelineLayout);
+	}
+
+	MipGenerator::MipGenerator(MipGenerator&& m) noexcept
+	{
+		move(std::move(m));
+	}
+
+	MipGenerator& MipGenerator::operator=(MipGenerator&& m) noexcept
+	{
+		destroy();
+		move(std::move(m));
+		return *this;
+	}
+
+	MipGenerator::~MipGenerator()
+	{
+		destroy();
+	}
+
+	VkImageCreateFlags MipGenerator::imageFlags(VkFormat format)
+	{
+		// sRGB formats can't be storage images, so the levels are written through UNORM views
+		return format == VK_FORMAT_R8G8B8A8_SRGB ? VK_IMAGE_CREATE_MUTABLE_FORMAT_BIT | VK_IMAGE_CREATE_EXTENDED_USAGE_BIT : 0;
+	}
+
+	VkImageUsageFlags MipGenerator::imageUsage()
+	{
+		return VK_IMAGE_USAGE_STORAGE_BIT;
+	}
+
+	bool MipGenerator::supports(VkFormat format, std::uint32_t mipLevels)
+	{
+		return (format == VK_FORMAT_R8G8B8A8_SRGB || format == VK_FORMAT_R8G8B8A8_UNORM) && mipLevels <= maxMipLevels;
+	}
+
+	void MipGenerator::enqueue(const MipRequest& request)
+	{
+		m_requests.push_back(request);
+	}
+
+	void MipGenerator::record(VkCommandBuffer commandBuffer, UploadManager& uploader)
+	{
+		const std::uint32_t requestCount{ static_cast<std::uint32_t>(m_requests.size()) };
+
+		// Everything below only lives as long as this batch
+		VkBufferCreateInfo stateCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ mipStateSize * requestCount },
+			.usage{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		};
+		VmaAllocationCreateInfo stateAllocCI
+		{
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+		};
+		Buffer state{};
+		vmaCreateBuffer(m_allocator, &stateCI, &stateAllocCI, &state.buffer, &state.alloc, nullptr);
+		uploader.destroyAfterUpload(state);
+
+		VkDescriptorPoolSize poolSizes[2]
+		{
+			{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE, maxMipLevels * requestCount },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, requestCount },
+		};
+		VkDescriptorPoolCreateInfo poolCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO },
+			.maxSets{ requestCount },
+			.poolSizeCount{ 2 },
+			.pPoolSizes{ poolSizes },
+		};
+		VkDescriptorPool pool{};
+		vkCreateDescriptorPool(m_device, &poolCI, nullptr, &pool);
+
+		std::vector<VkDescriptorSetLayout> setLayouts(requestCount, m_setLayout);
+		VkDescriptorSetAllocateInfo setAI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO },
+			.descriptorPool{ pool },
+			.descriptorSetCount{ requestCount },
+			.pSetLayouts{ setLayouts.data() },
+		};
+		std::vector<VkDescriptorSet> sets(requestCount);
+		vkAllocateDescriptorSets(m_device, &setAI, sets.data());
+
+		std::vector<VkImageView> views{};
+		views.reserve(static_cast<std::size_t>(requestCount) * maxMipLevels);
+
+		std::vector<VkImageMemoryBarrier> beginBarriers{};
+		std::vector<VkImageMemoryBarrier> endBarriers{};
+		for (std::uint32_t r{ 0 }; r < requestCount; ++r)
+		{
+			const MipRequest& request{ m_requests[r] };
+
+			// One view per level, unused array elements repeat the last one
+			VkDescriptorImageInfo imageInfos[maxMipLevels]{};
+			for (std::uint32_t level{ 0 }; level < maxMipLevels; ++level)
+			{
+				if (level < request.mipLevels)
+				{
+					VkImageViewCreateInfo viewCI
+					{
+						.sType{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO },
+						.image{ request.image },
+						.viewType{ VK_IMAGE_VIEW_TYPE_2D },
+						.format{ VK_FORMAT_R8G8B8A8_UNORM },
+						.subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1 },
+					};
+					VkImageView view{};
+					vkCreateImageView(m_device, &viewCI, nullptr, &view);
+					views.push_back(view);
+				}
+				imageInfos[level] = { .imageView{ views.back() }, .imageLayout{ VK_IMAGE_LAYOUT_GENERAL } };
+			}
+
+			VkDescriptorBufferInfo stateInfo{ state.buffer, mipStateSize * r, mipStateSize };
+
+			VkWriteDescriptorSet writes[3]
+			{
+				{
+					.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+					.dstSet{ sets[r] },
+					.dstBinding{ 0 },
+					.descriptorCount{ 1 },
+					.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE },
+					.pImageInfo{ &imageInfos[0] },
+				},
+				{
+					.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+					.dstSet{ sets[r] },
+					.dstBinding{ 1 },
+					.descriptorCount{ maxMipLevels - 1 },
+					.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_IMAGE },
+					.pImageInfo{ &imageInfos[1] },
+				},
+				{
+					.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+					.dstSet{ sets[r] },
+					.dstBinding{ 2 },
+					.descriptorCount{ 1 },
+					.descriptorType{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER },
+					.pBufferInfo{ &stateInfo },
+				},
+			};
+			vkUpdateDescriptorSets(m_device, 3, writes, 0, nullptr);
+
+			VkImageMemoryBarrier barrier
+			{
+				.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+				.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+				.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT },
+				.oldLayout{ VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+				.newLayout{ VK_IMAGE_LAYOUT_GENERAL },
+				.srcQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+				.dstQueueFamilyIndex{ VK_QUEUE_FAMILY_IGNORED },
+				.image{ request.image },
+				.subresourceRange{ VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1 },
+			};
+			beginBarriers.push_back(barrier);
+
+			barrier.srcAccessMask = VK_ACCESS_NONE;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 1, request.mipLevels - 1, 0, 1 };
+			beginBarriers.push_back(barrier);
+
+			barrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_GENERAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+			barrier.subresourceRange = { VK_IMAGE_ASPECT_COLOR_BIT, 0, request.mipLevels, 0, 1 };
+			endBarriers.push_back(barrier);
+		}
+
+		uploader.destroyAfterUpload([device = m_device, pool, views = std::move(views)]
+		{
+			for (VkImageView view : views)
+			{
+				vkDestroyImageView(device, view, nullptr);
+			}
+			vkDestroyDescriptorPool(device, pool, nullptr);
+		});
+
+		// The workgroup counters and histograms start at zero
+		vkCmdFillBuffer(commandBuffer, state.buffer, 0, VK_WHOLE_SIZE, 0);
+
+		VkMemoryBarrier clearBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			1, &clearBarrier, 0, nullptr, static_cast<std::uint32_t>(beginBarriers.size()), beginBarriers.data());
+
+		// No barriers between images, so their dispatches can overlap
+		auto pushConstants = [](const MipRequest& request)
+		{
+			const glm::uvec2 size{ request.extent.width, request.extent.height };
+			const glm::uvec2 tiles{ (size + mipTileSize - 1u) / mipTileSize };
+			return MipPushConstants
+			{
+				.size{ size },
+				.levelCount{ request.mipLevels - 1 },
+				.workGroupCount{ tiles.x * tiles.y },
+				.srgb{ request.format == VK_FORMAT_R8G8B8A8_SRGB },
+				.alphaCutoff{ request.preserveAlphaCoverage ? request.alphaCutoff : -1.0f },
+			};
+		};
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_downsamplePipeline);
+		for (std::uint32_t r{ 0 }; r < requestCount; ++r)
+		{
+			const MipPushConstants constants{ pushConstants(m_requests[r]) };
+			vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &sets[r], 0, nullptr);
+			vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+			vkCmdDispatch(commandBuffer, constants.workGroupCount, 1, 1);
+		}
+
+		const bool anyCoverage{ std::any_of(m_requests.begin(), m_requests.end(), [](const MipRequest& r) { return r.preserveAlphaCoverage; }) };
+		if (anyCoverage)
+		{
+			VkMemoryBarrier downsampleBarrier
+			{
+				.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+				.srcAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+				.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+			};
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+				1, &downsampleBarrier, 0, nullptr, 0, nullptr);
+
+			vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_coveragePipeline);
+			for (std::uint32_t r{ 0 }; r < requestCount; ++r)
+			{
+				const MipRequest& request{ m_requests[r] };
+				if (!request.preserveAlphaCoverage || request.mipLevels < 2)
+				{
+					continue;
+				}
+
+				// Sized for level 1, smaller levels leave the extra invocations idle
+				const MipPushConstants constants{ pushConstants(request) };
+				const glm::uvec2 level1{ glm::max(constants.size / 2u, glm::uvec2{ 1 }) };
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, m_pipelineLayout, 0, 1, &sets[r], 0, nullptr);
+				vkCmdPushConstants(commandBuffer, m_pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(constants), &constants);
+				vkCmdDispatch(commandBuffer, (level1.x + mipCoverageGroupSize - 1) / mipCoverageGroupSize,
+					(level1.y + mipCoverageGroupSize - 1) / mipCoverageGroupSize, constants.levelCount);
+			}
+		}
+
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+			VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+			0, nullptr, 0, nullptr, static_cast<std::uint32_t>(endBarriers.size()), endBarriers.data());
+
+		m_requests.clear();
+	}
+
+	void MipGenerator::move(MipGenerator&& m)
+	{
+		m_setLayout = m.m_setLayout;
+		m_pipelineLayout = m.m_pipelineLayout;
+		m_downsamplePipeline = m.m_downsamplePipeline;
+		m_coveragePipeline = m.m_coveragePipeline;
+
+		m_requests = std::move(m.m_requests);
+
+		m_device = m.m_device;
+		m_allocator = m.m_allocator;
+
+		m.m_device = VK_NULL_HANDLE;
+	}
+
+	void MipGenerator::destroy()
+	{
+		if (m_device != VK_NULL_HANDLE)
+		{
+			vkDestroyPipeline(m_device, m_coveragePipeline, nullptr);
+			vkDestroyPipeline(m_device, m_downsamplePipeline, nullptr);
+			vkDestroyPipelineLayout(m_device, m_pipelineLayout, nullptr);
+			vkDestroyDescriptorSetLayout(m_device, m_setLayout, nullptr);
+		}
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,84 @@
+#pragma once
+
+#include "alloc.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics
+{
+
+	class UploadManager;
+
+	// An RGBA8 image whose mip chain is built from level 0 on the GPU
+	struct MipRequest
+	{
+		VkImage       image{};
+		VkFormat      format{ VK_FORMAT_R8G8B8A8_SRGB }; // R8G8B8A8 UNORM or SRGB
+		VkExtent2D    extent{};
+		std::uint32_t mipLevels{};
+		bool          preserveAlphaCoverage{ false };
+		float         alphaCutoff{ 0.2f }; // Matches the discard in uber.frag
+	};
+
+	// Builds whole mip chains with a single compute dispatch per image, in the style of a single pass
+	// downsampler: each workgroup reduces a 64x64 tile through six levels in shared memory, and the last
+	// workgroup to finish reduces the rest. Filtering happens in linear space and is weighted by alpha.
+	// With preserveAlphaCoverage, a second dispatch rescales the alpha of every level so the same share
+	// of texels passes the alpha test as in level 0, which keeps cutout foliage from thinning out.
+	class MipGenerator
+	{
+	public:
+		// Level 0 plus the twelve levels one dispatch can produce, so up to 4096x4096
+		static constexpr std::uint32_t maxMipLevels{ 13 };
+
+		MipGenerator() = default;
+		MipGenerator(VkDevice device, VmaAllocator allocator);
+
+		MipGenerator(const MipGenerator&) = delete;
+		MipGenerator& operator=(const MipGenerator&) = delete;
+
+		MipGenerator(MipGenerator&& m) noexcept;
+		MipGenerator& operator=(MipGenerator&& m) noexcept;
+
+		~MipGenerator();
+
+		// Images created with these can be passed to enqueue
+		static VkImageCreateFlags imageFlags(VkFormat format);
+		static VkImageUsageFlags imageUsage();
+
+		static bool supports(VkFormat format, std::uint32_t mipLevels);
+
+		// Level 0 must already be written in TRANSFER_DST_OPTIMAL and owned by the graphics queue.
+		// Every level ends up in SHADER_READ_ONLY_OPTIMAL.
+		void enqueue(const MipRequest& request);
+
+		bool pending() const
+		{
+			return !m_requests.empty();
+		}
+
+		// Records every queued request as one batch. The per-batch resources are released through
+		// the uploader once the commands have run.
+		void record(VkCommandBuffer commandBuffer, UploadManager& uploader);
+
+	private:
+		VkDescriptorSetLayout m_setLayout{};
+		VkPipelineLayout      m_pipelineLayout{};
+		VkPipeline            m_downsamplePipeline{};
+		VkPipeline            m_coveragePipeline{};
+
+		std::vector<MipRequest> m_requests{};
+
+		// Not owned by the class
+		VkDevice     m_device{};
+		VmaAllocator m_allocator{};
+
+		void move(MipGenerator&& m);
+		void destroy();
+	};
+
+}
\ No newline at end of file
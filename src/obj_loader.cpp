@@ -0,0 +1,360 @@
+#include "obj_loader.hpp"
+
+#include "vertex.hpp"
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include "TinyObj/tiny_obj_loader.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct ObjFile
+	{
+		tinyobj::ObjReader reader{};
+	};
+
+	namespace
+	{
+		// Vertices the optimizer assumes stay in the post-transform cache. Smaller than most GPUs keep, which only
+		// costs a little of the gain on the bigger ones, while a guess too large loses most of it.
+		constexpr std::uint32_t cacheSize{ 16 };
+	}
+
+	std::vector<ObjMesh> loadObj(const char* path, std::vector<Vertex>& vertices)
+	{
+		const std::shared_ptr<const ObjFile> file{ parseObj(path) };
+
+		ObjWelder welder{ file };
+		vertices.reserve(vertices.size() + vertexEstimate(*file));
+		std::vector<ObjMesh> meshes{};
+		for (std::size_t s{ 0 }; s < shapeCount(*file); ++s)
+		{
+			appendMeshes(meshes, welder.weld(s, vertices));
+		}
+
+		for (ObjMesh& mesh : meshes)
+		{
+			optimizeVertexCache(mesh.indices);
+		}
+
+		return meshes;
+	}
+
+	std::shared_ptr<const ObjFile> parseObj(const char* path)
+	{
+		tinyobj::ObjReaderConfig readerConfig{};
+		readerConfig.vertex_color = true;
+		readerConfig.triangulate = true;
+
+		const std::shared_ptr<ObjFile> file{ std::make_shared<ObjFile>() };
+		file->reader.ParseFromFile(static_cast<std::string>(path), readerConfig);
+
+		if (!file->reader.Error().empty())
+		{
+			std::cerr << "error: tinyobj: " << file->reader.Error() << '\n';
+		}
+
+		if (!file->reader.Warning().empty())
+		{
+			std::cerr << "warning: tinyobj: " << file->reader.Warning() << '\n';
+		}
+
+		return file;
+	}
+
+	std::size_t shapeCount(const ObjFile& file)
+	{
+		return file.reader.GetShapes().size();
+	}
+
+	std::size_t vertexEstimate(const ObjFile& file)
+	{
+		return file.reader.GetAttrib().vertices.size() / 3;
+	}
+
+	ObjWelder::ObjWelder(std::shared_ptr<const ObjFile> file)
+		: m_file{ std::move(file) }
+	{
+	}
+
+	std::vector<ObjMesh> ObjWelder::weld(std::size_t shape, std::vector<Vertex>& vertices)
+	{
+		auto& attrib{ m_file->reader.GetAttrib() };
+		auto& mesh{ m_file->reader.GetShapes()[shape].mesh };
+		auto& materials{ m_file->reader.GetMaterials() };
+
+		// Counting each material's corners first lets every index list be allocated once
+		std::vector<ObjMesh> meshes{};
+		std::vector<std::size_t> corners{};
+		for (std::size_t f{ 0 }; f < mesh.num_face_vertices.size(); ++f)
+		{
+			const int material{ mesh.material_ids[f] };
+			const auto result{ std::find_if(meshes.begin(), meshes.end(),
+				[=](const ObjMesh& m) {
+					return material == m.material;
+				}) };
+
+			if (result == meshes.end())
+			{
+				meshes.push_back(ObjMesh{
+					.material{ material },
+					.diffusePath{ material == -1 ? "" : materials[material].diffuse_texname },
+					});
+				corners.push_back(mesh.num_face_vertices[f]);
+			}
+			else
+			{
+				corners[result - meshes.begin()] += mesh.num_face_vertices[f];
+			}
+		}
+		for (std::size_t m{ 0 }; m < meshes.size(); ++m)
+		{
+			meshes[m].indices.reserve(corners[m]);
+		}
+
+		std::size_t indexOffset{ 0 };
+		for (std::size_t f{ 0 }; f < mesh.num_face_vertices.size(); ++f)
+		{
+			std::size_t fv{ mesh.num_face_vertices[f] };
+
+			for (std::size_t v{ 0 }; v < fv; ++v)
+			{
+				tinyobj::index_t index{ mesh.indices[indexOffset + v] };
+
+				Vertex newVertex{};
+				newVertex.pos.x = attrib.vertices[3 * index.vertex_index + 0];
+				newVertex.pos.y = -attrib.vertices[3 * index.vertex_index + 1];
+				newVertex.pos.z = -(attrib.vertices[3 * index.vertex_index + 2]);
+
+				if (index.normal_index >= 0)
+				{
+					newVertex.norm.x = attrib.normals[3 * index.normal_index + 0];
+					newVertex.norm.y = attrib.normals[3 * index.normal_index + 1];
+					newVertex.norm.z = attrib.normals[3 * index.normal_index + 2];
+				}
+
+				if (index.texcoord_index >= 0)
+				{
+					newVertex.tex.x = attrib.texcoords[2 * index.texcoord_index + 0];
+					newVertex.tex.y = 1 - (attrib.texcoords[2 * index.texcoord_index + 1]);
+				}
+
+				newVertex.color.r = attrib.colors[3 * index.vertex_index + 0];
+				newVertex.color.g = attrib.colors[3 * index.vertex_index + 1];
+				newVertex.color.b = attrib.colors[3 * index.vertex_index + 2];
+
+				int material{ mesh.material_ids[f] };
+
+				if (material != -1)
+				{
+					newVertex.color.r = materials[material].diffuse[0];
+					newVertex.color.g = materials[material].diffuse[1];
+					newVertex.color.b = materials[material].diffuse[2];
+				}
+
+				const auto result{ std::find_if(meshes.begin(), meshes.end(),
+					[=](const ObjMesh& m) {
+						return material == m.material;
+					}) };
+
+				auto& map{ m_maps[material] };
+				const auto [entry, added] { map.emplace(newVertex, static_cast<std::uint32_t>(vertices.size())) };
+				if (added)
+				{
+					vertices.push_back(newVertex);
+				}
+				result->indices.push_back(entry->second);
+			}
+
+			indexOffset += fv;
+		}
+
+		return meshes;
+	}
+
+	void appendMeshes(std::vector<ObjMesh>& meshes, std::vector<ObjMesh> shapeMeshes)
+	{
+		for (ObjMesh& shapeMesh : shapeMeshes)
+		{
+			const auto result{ std::find_if(meshes.begin(), meshes.end(),
+				[&](const ObjMesh& m) {
+					return shapeMesh.material == m.material;
+				}) };
+
+			if (result == meshes.end())
+			{
+				meshes.push_back(std::move(shapeMesh));
+			}
+			else
+			{
+				result->indices.insert(result->indices.end(), shapeMesh.indices.begin(), shapeMesh.indices.end());
+			}
+		}
+	}
+
+	void optimizeVertexCache(std::span<std::uint32_t> indices)
+	{
+		const std::size_t triangleCount{ indices.size() / 3 };
+		if (triangleCount < 2 || indices.size() % 3 != 0)
+		{
+			return;
+		}
+
+		// The optimizer keeps state per vertex, so the vertices the indices use are numbered densely first
+		std::vector<std::uint32_t> vertexIds(indices.begin(), indices.end());
+		std::sort(vertexIds.begin(), vertexIds.end());
+		vertexIds.erase(std::unique(vertexIds.begin(), vertexIds.end()), vertexIds.end());
+		const std::uint32_t vertexCount{ static_cast<std::uint32_t>(vertexIds.size()) };
+
+		std::vector<std::uint32_t> local(indices.size());
+		for (std::size_t i{ 0 }; i < indices.size(); ++i)
+		{
+			local[i] = static_cast<std::uint32_t>(std::lower_bound(vertexIds.begin(), vertexIds.end(), indices[i]) - vertexIds.begin());
+		}
+
+		// The triangles using each vertex
+		std::vector<std::uint32_t> offsets(vertexCount + 1, 0);
+		for (const std::uint32_t v : local)
+		{
+			++offsets[v + 1];
+		}
+		for (std::uint32_t v{ 0 }; v < vertexCount; ++v)
+		{
+			offsets[v + 1] += offsets[v];
+		}
+		std::vector<std::uint32_t> adjacency(local.size());
+		std::vector<std::uint32_t> next(offsets.begin(), offsets.end() - 1);
+		for (std::size_t i{ 0 }; i < local.size(); ++i)
+		{
+			adjacency[next[local[i]]++] = static_cast<std::uint32_t>(i / 3);
+		}
+
+		// Triangles left to emit for each vertex, and when it last went into the cache
+		std::vector<std::uint32_t> live(vertexCount);
+		for (std::uint32_t v{ 0 }; v < vertexCount; ++v)
+		{
+			live[v] = offsets[v + 1] - offsets[v];
+		}
+		std::vector<std::uint32_t> cacheTime(vertexCount, 0);
+		std::vector<bool> emitted(triangleCount, false);
+
+		std::vector<std::uint32_t> deadEnd{};
+		std::vector<std::uint32_t> candidates{};
+		std::vector<std::uint32_t> output{};
+		output.reserve(indices.size());
+
+		std::uint32_t time{ cacheSize + 1 };
+		std::uint32_t cursor{ 0 };
+		std::int64_t fan{ 0 };
+		while (fan >= 0)
+		{
+			// Emit every triangle left around the fanning vertex
+			candidates.clear();
+			for (std::uint32_t a{ offsets[fan] }; a < offsets[fan + 1]; ++a)
+			{
+				const std::uint32_t triangle{ adjacency[a] };
+				if (emitted[triangle])
+				{
+					continue;
+				}
+
+				for (std::uint32_t corner{ 0 }; corner < 3; ++corner)
+				{
+					const std::uint32_t v{ local[3 * triangle + corner] };
+					output.push_back(vertexIds[v]);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+					if (time - cacheTime[v] > cacheSize)
+					{
+						cacheTime[v] = time;
+						++time;
+					}
+				}
+				emitted[triangle] = true;
+			}
+
+			// Fan around the vertex that stays in the cache longest without its remaining triangles pushing it out.
+			// Failing that, a vertex that just went in, then the next one in order.
+			fan = -1;
+			std::int64_t bestPriority{ -1 };
+			for (const std::uint32_t v : candidates)
+			{
+				if (live[v] == 0)
+				{
+					continue;
+				}
+
+				std::int64_t priority{ 0 };
+				if (time - cacheTime[v] + 2 * live[v] <= cacheSize)
+				{
+					priority = time - cacheTime[v];
+				}
+				if (priority > bestPriority)
+				{
+					bestPriority = priority;
+					fan = v;
+				}
+			}
+
+			while (fan < 0 && !deadEnd.empty())
+			{
+				const std::uint32_t v{ deadEnd.back() };
+				deadEnd.pop_back();
+				if (live[v] > 0)
+				{
+					fan = v;
+				}
+			}
+
+			for (; fan < 0 && cursor < vertexCount; ++cursor)
+			{
+				if (live[cursor] > 0)
+				{
+					fan = cursor;
+				}
+			}
+		}
+
+		std::copy(output.begin(), output.end(), indices.begin());
+	}
+
+	float averageCacheMissRatio(std::span<const std::uint32_t> indices)
+	{
+		if (indices.size() < 3)
+		{
+			return 0.0f;
+		}
+
+		std::uint32_t cache[cacheSize]{};
+		std::uint32_t cached{ 0 };
+		std::uint32_t oldest{ 0 };
+		std::size_t misses{ 0 };
+		for (const std::uint32_t index : indices)
+		{
+			if (std::find(cache, cache + cached, index) != cache + cached)
+			{
+				continue;
+			}
+
+			++misses;
+			cache[oldest] = index;
+			oldest = (oldest + 1) % cacheSize;
+			cached = std::min(cached + 1, cacheSize);
+		}
+
+		return static_cast<float>(misses) / static_cast<float>(indices.size() / 3);
+	}
+
+}
\ No newline at end of file
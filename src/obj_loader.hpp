@@ -0,0 +1,68 @@
+#pragma once
+
+#include "vertex.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Graphics
+{
+
+	// The faces of one material
+	struct ObjMesh
+	{
+		int                        material{};
+		std::string                diffusePath{}; // Relative to the model's directory
+		std::vector<std::uint32_t> indices{};     // Into the whole vertex list
+	};
+
+	// Appends the model's vertices to vertices, deduplicated within each mesh, with each mesh's triangles reordered
+	// for the vertex cache. Meshes come out in the order their materials are first used. Needs no device, so the
+	// offline cooker shares it with the runtime. The steps below are what it runs one after another, for callers
+	// that want to overlap them.
+	std::vector<ObjMesh> loadObj(const char* path, std::vector<Vertex>& vertices);
+
+	// A parsed model whose faces haven't been turned into vertices yet
+	struct ObjFile;
+
+	// Errors and warnings go to std::cerr, a file that fails to parse comes back without shapes
+	std::shared_ptr<const ObjFile> parseObj(const char* path);
+	std::size_t shapeCount(const ObjFile& file);
+	// The model's distinct positions, which welding seldom turns into fewer vertices, to size the vertex list up front
+	std::size_t vertexEstimate(const ObjFile& file);
+
+	// Turns a parsed model's faces into vertices one shape at a time, in order. Vertices are shared between
+	// the shapes of a mesh, so one welder has to see all of a model's shapes.
+	class ObjWelder
+	{
+	public:
+		explicit ObjWelder(std::shared_ptr<const ObjFile> file);
+
+		// Appends the shape's new vertices to vertices. Returns the shape's faces, one mesh per material it uses,
+		// each index list allocated at its final size.
+		std::vector<ObjMesh> weld(std::size_t shape, std::vector<Vertex>& vertices);
+
+	private:
+		std::shared_ptr<const ObjFile> m_file{};
+
+		// One per material, for deduplicating its vertices
+		std::unordered_map<int, std::unordered_map<Vertex, std::uint32_t>> m_maps{};
+	};
+
+	// Adds a shape's meshes to the model's, merging the ones with the same material
+	void appendMeshes(std::vector<ObjMesh>& meshes, std::vector<ObjMesh> shapeMeshes);
+
+	// Reorders triangles so their vertices are more likely to still be in the post-transform cache (Tipsify).
+	// Vertices aren't moved, only which order the triangles refer to them in.
+	void optimizeVertexCache(std::span<std::uint32_t> indices);
+
+	// Average vertex shader invocations per triangle through a FIFO post-transform cache of the size the optimizer
+	// assumes. 3 is the worst, 0.5 about the best a regular grid gets.
+	float averageCacheMissRatio(std::span<const std::uint32_t> indices);
+
+}
\ No newline at end of file
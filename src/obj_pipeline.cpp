@@ -0,0 +1,288 @@
+#include "obj_pipeline.hpp"
+
+#include "obj_loader.hpp"
+#include "thread_pool.hpp"
+#include "vertex.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	namespace
+	{
+		double seconds(std::chrono::steady_clock::duration duration)
+		{
+			return std::chrono::duration<double>{ duration }.count();
+		}
+	}
+
+	ObjPipeline::ObjPipeline(ObjPipelineSettings settings, std::vector<std::string> paths)
+		: m_settings{ settings },
+		  m_paths{ std::move(paths) },
+		  m_parsed{ settings.queueCapacity },
+		  m_welded{ settings.queueCapacity },
+		  m_optimized{ settings.queueCapacity },
+		  m_start{ Clock::now() },
+		  m_end{ m_start }
+	{
+		m_parseThread = std::thread{ [this] { parse(); } };
+		m_weldThread = std::thread{ [this] { weld(); } };
+		m_optimizeThread = std::thread{ [this] { optimize(); } };
+	}
+
+	ObjPipeline::~ObjPipeline()
+	{
+		// Closing every queue wakes a stage waiting on either side of it
+		{
+			std::lock_guard lock{ m_modelsMutex };
+			m_stopping = true;
+		}
+		m_modelsCondition.notify_all();
+		m_parsed.close();
+		m_welded.close();
+		m_optimized.close();
+		join();
+	}
+
+	bool ObjPipeline::uploadNext(std::vector<Vertex>& vertices, const std::function<void(Model&)>& upload)
+	{
+		while (std::optional<Shape> shape{ m_optimized.tryPop() })
+		{
+			const Clock::time_point start{ Clock::now() };
+			++m_uploadStatistics.items;
+			appendMeshes(m_uploading, std::move(shape->meshes));
+			if (!shape->last)
+			{
+				m_uploadStatistics.busySeconds += seconds(Clock::now() - start);
+				continue;
+			}
+
+			Model model
+			{
+				.meshes{ std::exchange(m_uploading, {}) },
+				.firstVertex{ static_cast<std::uint32_t>(vertices.size()) },
+				.vertexCount{ static_cast<std::uint32_t>(shape->vertices.size()) },
+			};
+			vertices.insert(vertices.end(), shape->vertices.begin(), shape->vertices.end());
+			for (ObjMesh& mesh : model.meshes)
+			{
+				for (std::uint32_t& index : mesh.indices)
+				{
+					index += model.firstVertex;
+				}
+			}
+			upload(model);
+
+			++m_modelsUploaded;
+			m_end = Clock::now();
+			m_uploadStatistics.busySeconds += seconds(m_end - start);
+			return true;
+		}
+
+		return false;
+	}
+
+	void ObjPipeline::printStatistics()
+	{
+		if (m_paths.empty())
+		{
+			return;
+		}
+
+		join();
+
+		const double total{ seconds(m_end - m_start) };
+		const auto printStage{ [total](const char* name, const StageStatistics& stage, const char* unit) -> std::ostream&
+		{
+			return std::cout << "  " << std::left << std::setw(10) << name << std::right << stage.items << ' ' << unit << " in "
+				<< stage.busySeconds << " s (" << (total > 0.0 ? 100.0 * stage.busySeconds / total : 0.0) << "% busy, "
+				<< (stage.busySeconds > 0.0 ? stage.items / stage.busySeconds : 0.0) << ' ' << unit << "/s)";
+		} };
+		const auto printQueue{ [](const char* name, const BoundedQueue<Shape>::Statistics& queue)
+		{
+			std::cout << "  " << std::left << std::setw(10) << name << std::right
+				<< (queue.pushes > 0 ? static_cast<double>(queue.depthSum) / queue.pushes : 0.0) << " of " << queue.capacity
+				<< " shapes deep on average, " << queue.maxDepth << " at most\n";
+		} };
+
+		const BoundedQueue<Shape>::Statistics parsed{ m_parsed.statistics() };
+		const BoundedQueue<Shape>::Statistics welded{ m_welded.statistics() };
+		const BoundedQueue<Shape>::Statistics optimized{ m_optimized.statistics() };
+
+		std::cout << "obj pipeline: " << m_modelsUploaded << " models in " << total << " s\n";
+		printStage("parse", m_parseStatistics, "models") << ", waited " << parsed.pushWaitSeconds + m_parseWaitSeconds << " s for room\n";
+		printStage("weld", m_weldStatistics, "shapes") << ", waited " << parsed.popWaitSeconds << " s for input, "
+			<< welded.pushWaitSeconds << " s for room\n";
+		printStage("optimize", m_optimizeStatistics, "shapes") << ", waited " << welded.popWaitSeconds << " s for input, "
+			<< optimized.pushWaitSeconds << " s for room\n";
+		printStage("upload", m_uploadStatistics, "shapes") << '\n';
+		printQueue("parsed", parsed);
+		printQueue("welded", welded);
+		printQueue("optimized", optimized);
+
+		if (m_trianglesOptimized > 0)
+		{
+			std::cout << "  vertex cache: " << m_missesBefore / m_trianglesOptimized << " -> " << m_missesAfter / m_trianglesOptimized
+				<< " vertices shaded per triangle\n";
+		}
+
+		// The stage busy the longest is the one the others wait on
+		const std::pair<const char*, double> stages[]
+		{
+			{ "parse", m_parseStatistics.busySeconds },
+			{ "weld", m_weldStatistics.busySeconds },
+			{ "optimize", m_optimizeStatistics.busySeconds },
+			{ "upload", m_uploadStatistics.busySeconds },
+		};
+		std::cout << "  bottleneck: " << std::max_element(std::begin(stages), std::end(stages),
+			[](const auto& a, const auto& b) { return a.second < b.second; })->first << '\n';
+	}
+
+	void ObjPipeline::parse()
+	{
+		for (std::uint32_t m{ 0 }; m < m_paths.size() && !m_stopping; ++m)
+		{
+			{
+				std::unique_lock lock{ m_modelsMutex };
+				if (m_modelsInFlight >= m_settings.maxModelsInFlight && !m_stopping)
+				{
+					const Clock::time_point start{ Clock::now() };
+					m_modelsCondition.wait(lock, [this] { return m_modelsInFlight < m_settings.maxModelsInFlight || m_stopping; });
+					m_parseWaitSeconds += seconds(Clock::now() - start);
+				}
+				if (m_stopping)
+				{
+					return;
+				}
+				++m_modelsInFlight;
+			}
+
+			const Clock::time_point start{ Clock::now() };
+			const std::shared_ptr<const ObjFile> file{ parseObj(m_paths[m].c_str()) };
+			const std::size_t count{ shapeCount(*file) };
+			++m_parseStatistics.items;
+			m_parseStatistics.busySeconds += seconds(Clock::now() - start);
+
+			// A model without shapes still goes through, so it comes out empty rather than not at all
+			for (std::size_t s{ 0 }; s < std::max(count, std::size_t{ 1 }); ++s)
+			{
+				if (!m_parsed.push({ .model{ m }, .shape{ s }, .last{ s + 1 >= count }, .file{ file } }))
+				{
+					return;
+				}
+			}
+		}
+
+		m_parsed.close();
+	}
+
+	void ObjPipeline::weld()
+	{
+		// One welder per model, since a model's shapes share its vertices
+		std::optional<ObjWelder> welder{};
+		std::uint32_t model{ 0 };
+		std::vector<Vertex> vertices{};
+
+		while (std::optional<Shape> shape{ m_parsed.pop() })
+		{
+			if (m_stopping)
+			{
+				return;
+			}
+
+			const Clock::time_point start{ Clock::now() };
+			if (!welder || shape->model != model)
+			{
+				welder.emplace(shape->file);
+				model = shape->model;
+				vertices.reserve(vertexEstimate(*shape->file));
+			}
+			if (shape->shape < shapeCount(*shape->file))
+			{
+				shape->meshes = welder->weld(shape->shape, vertices);
+			}
+			shape->file = {};
+			if (shape->last)
+			{
+				shape->vertices = std::exchange(vertices, {});
+
+				// The parsed model goes with the welder, the shapes still queued no longer reference it
+				welder.reset();
+				{
+					std::lock_guard lock{ m_modelsMutex };
+					--m_modelsInFlight;
+				}
+				m_modelsCondition.notify_one();
+			}
+			++m_weldStatistics.items;
+			m_weldStatistics.busySeconds += seconds(Clock::now() - start);
+
+			if (!m_welded.push(std::move(*shape)))
+			{
+				return;
+			}
+		}
+
+		m_welded.close();
+	}
+
+	void ObjPipeline::optimize()
+	{
+		while (std::optional<Shape> shape{ m_welded.pop() })
+		{
+			if (m_stopping)
+			{
+				return;
+			}
+
+			// Only the reordering counts towards the stage, measuring how well it did is extra
+			for (ObjMesh& mesh : shape->meshes)
+			{
+				const std::size_t triangles{ mesh.indices.size() / 3 };
+				m_missesBefore += averageCacheMissRatio(mesh.indices) * triangles;
+
+				const Clock::time_point start{ Clock::now() };
+				optimizeVertexCache(mesh.indices);
+				m_optimizeStatistics.busySeconds += seconds(Clock::now() - start);
+
+				m_missesAfter += averageCacheMissRatio(mesh.indices) * triangles;
+				m_trianglesOptimized += triangles;
+			}
+			++m_optimizeStatistics.items;
+
+			if (!m_optimized.push(std::move(*shape)))
+			{
+				return;
+			}
+		}
+
+		m_optimized.close();
+	}
+
+	void ObjPipeline::join()
+	{
+		for (std::thread* thread : { &m_parseThread, &m_weldThread, &m_optimizeThread })
+		{
+			if (thread->joinable())
+			{
+				thread->join();
+			}
+		}
+	}
+
+}
\ No newline at end of file
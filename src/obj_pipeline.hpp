@@ -0,0 +1,125 @@
+#pragma once
+
+#include "obj_loader.hpp"
+#include "thread_pool.hpp"
+#include "vertex.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct ObjPipelineSettings
+	{
+		// Shapes each queue holds before the stage feeding it has to wait
+		std::size_t queueCapacity{ 16 };
+		// Parsed models held at once, from parsing until their last shape is welded. A parsed model is the whole
+		// file's attributes, which dwarf the shapes queued, so this is what bounds the pipeline's memory.
+		std::size_t maxModelsInFlight{ 4 };
+	};
+
+	// Loads OBJ models shape by shape through stages on threads of their own: parsing, welding faces into vertices,
+	// and reordering triangles for the vertex cache. The caller uploads what comes out as the last stage, so every
+	// stage works on a different shape at the same time. Models come out in the order they were given.
+	class ObjPipeline
+	{
+	public:
+		// Indices point into the vertex list the model was appended to
+		struct Model
+		{
+			std::vector<ObjMesh> meshes{};
+			std::uint32_t        firstVertex{};
+			std::uint32_t        vertexCount{};
+		};
+
+		ObjPipeline(ObjPipelineSettings settings, std::vector<std::string> paths);
+
+		ObjPipeline(const ObjPipeline&) = delete;
+		ObjPipeline& operator=(const ObjPipeline&) = delete;
+
+		// Stops the stages after the shapes they are on
+		~ObjPipeline();
+
+		// If the next model is through the pipeline, appends its vertices to vertices and runs upload on it on the
+		// calling thread, which is timed as the upload stage. Returns whether there was one.
+		bool uploadNext(std::vector<Vertex>& vertices, const std::function<void(Model&)>& upload);
+
+		// Whether every model has been uploaded
+		bool done() const
+		{
+			return m_modelsUploaded == m_paths.size();
+		}
+
+		// Call once done(). Throughput and how long each stage waited on its neighbours, to find the one holding up the rest.
+		void printStatistics();
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		struct Shape
+		{
+			std::uint32_t                  model{};
+			std::size_t                    shape{};
+			bool                           last{};
+			std::shared_ptr<const ObjFile> file{};
+
+			// From welding on: the shape's faces, indexing the model's own vertices, which come along with its last shape
+			std::vector<ObjMesh> meshes{};
+			std::vector<Vertex>  vertices{};
+		};
+
+		struct StageStatistics
+		{
+			std::size_t items{};
+			double      busySeconds{};
+		};
+
+		ObjPipelineSettings      m_settings{};
+		std::vector<std::string> m_paths{};
+
+		BoundedQueue<Shape> m_parsed;
+		BoundedQueue<Shape> m_welded;
+		BoundedQueue<Shape> m_optimized;
+
+		StageStatistics m_parseStatistics{};
+		StageStatistics m_weldStatistics{};
+		StageStatistics m_optimizeStatistics{};
+		StageStatistics m_uploadStatistics{};
+		double          m_parseWaitSeconds{}; // Parsing held back by maxModelsInFlight
+		double          m_missesBefore{};
+		double          m_missesAfter{};
+		std::size_t     m_trianglesOptimized{};
+
+		// Shapes of the model being uploaded, gathered until its last one
+		std::vector<ObjMesh> m_uploading{};
+		std::size_t          m_modelsUploaded{ 0 };
+
+		std::mutex              m_modelsMutex{};
+		std::condition_variable m_modelsCondition{};
+		std::size_t             m_modelsInFlight{ 0 };
+
+		Clock::time_point m_start{};
+		Clock::time_point m_end{};
+		std::atomic<bool> m_stopping{ false };
+		std::thread       m_parseThread{};
+		std::thread       m_weldThread{};
+		std::thread       m_optimizeThread{};
+
+		void parse();
+		void weld();
+		void optimize();
+
+		void join();
+	};
+
+}
\ No newline at end of file
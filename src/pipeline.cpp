@@ -1,44 +1,57 @@
 #include "pipeline.hpp"
 
 #include "frame.hpp"
+#include "mapped_file.hpp"
 #include "mesh.hpp"
+#include "pipeline_cache.hpp"
 
 #include "volk/volk.h"
 
+#include <chrono>
 #include <cstddef>
 #include <cstdint>
 #include <exception>
-#include <fstream>
+#include <string>
 #include <vector>
 
 namespace Graphics
 {
 
+	namespace
+	{
+		template<typename Create>
+		VkPipeline createCachedPipeline(Create create)
+		{
+			PipelineCache* cache{ getPipelineCache() };
+
+			const auto start{ std::chrono::steady_clock::now() };
+			VkPipeline pipeline{ create(cache ? cache->handle() : VK_NULL_HANDLE) };
+			if (cache)
+			{
+				cache->recordCreation(std::chrono::steady_clock::now() - start);
+			}
+
+			return pipeline;
+		}
+	}
+
 	VkShaderModule createShaderModule(VkDevice device, const char* path)
 	{
-		// Start at end of the file to get code size
-		std::ifstream stream{ path, std::ios::binary | std::ios::ate };
+		// The driver reads the code straight out of the mapping, page alignment covers the uint32_t alignment pCode needs
+		MappedFile file{ path };
 
-		if (!stream.is_open())
+		if (file.empty())
 		{
 			std::string error{ "failed to open SPIR-V file at path: " };
 			error += path;
 			throw std::exception{ error.c_str() };
 		}
 
-		std::size_t codeSize{ static_cast<std::size_t>(stream.tellg()) };
-		std::vector<std::uint32_t> code(codeSize / sizeof(std::uint32_t));
-
-		stream.seekg(0);
-		stream.read(reinterpret_cast<char*>(code.data()), codeSize);
-
-		stream.close();
-
 		VkShaderModuleCreateInfo moduleCI
 		{
 			.sType{ VK_STRUCTURE_TYPE_SHADER_MODULE_CREATE_INFO },
-			.codeSize{ codeSize },
-			.pCode{ code.data() },
+			.codeSize{ file.size() },
+			.pCode{ reinterpret_cast<const std::uint32_t*>(file.data()) },
 		};
 
 		VkShaderModule module{};
@@ -47,13 +60,14 @@ namespace Graphics
 		return module;
 	}
 
-	VkPipelineLayout createPipelineLayout(VkDevice device, std::uint32_t layoutCount, VkDescriptorSetLayout* descriptorSetLayouts)
+	VkPipelineLayout createPipelineLayout(VkDevice device, std::uint32_t layoutCount, VkDescriptorSetLayout* descriptorSetLayouts,
+		std::uint32_t pushConstantSize, VkShaderStageFlags pushConstantStages)
 	{
 		VkPushConstantRange range
 		{
-			.stageFlags{ VK_SHADER_STAGE_ALL_GRAPHICS },
+			.stageFlags{ pushConstantStages },
 			.offset{ 0 },
-			.size{ sizeof(PushConstants) }
+			.size{ pushConstantSize }
 		};
 
 		VkPipelineLayoutCreateInfo layoutCI
@@ -86,6 +100,25 @@ namespace Graphics
 		VkShaderModule vertexShaderModule{ createShaderModule(createInfo.device, createInfo.pVertexShaderPath) };
 		VkShaderModule fragmentShaderModule{ createShaderModule(createInfo.device, createInfo.pFragmentShaderPath) };
 
+		std::vector<VkSpecializationMapEntry> fragmentConstantEntries(createInfo.fragmentConstants.size());
+		for (std::uint32_t i{ 0 }; i < fragmentConstantEntries.size(); ++i)
+		{
+			fragmentConstantEntries[i] =
+			{
+				.constantID{ i },
+				.offset{ i * static_cast<std::uint32_t>(sizeof(std::uint32_t)) },
+				.size{ sizeof(std::uint32_t) },
+			};
+		}
+
+		VkSpecializationInfo fragmentSpecialization
+		{
+			.mapEntryCount{ static_cast<std::uint32_t>(fragmentConstantEntries.size()) },
+			.pMapEntries{ fragmentConstantEntries.data() },
+			.dataSize{ createInfo.fragmentConstants.size_bytes() },
+			.pData{ createInfo.fragmentConstants.data() },
+		};
+
 		VkPipelineShaderStageCreateInfo stages[2]{};
 		stages[0] =
 		{
@@ -100,6 +133,7 @@ namespace Graphics
 			.stage{ VK_SHADER_STAGE_FRAGMENT_BIT },
 			.module{ fragmentShaderModule },
 			.pName{ "main" },
+			.pSpecializationInfo{ createInfo.fragmentConstants.empty() ? nullptr : &fragmentSpecialization },
 		};
 
 		VkVertexInputBindingDescription binding
@@ -109,7 +143,7 @@ namespace Graphics
 			.inputRate{ VK_VERTEX_INPUT_RATE_VERTEX },
 		};
 
-		VkVertexInputAttributeDescription attribs[4]{};
+		VkVertexInputAttributeDescription attribs[5]{};
 		attribs[0] =
 		{
 			.location{ 0 },
@@ -138,13 +172,20 @@ namespace Graphics
 			.format{ VK_FORMAT_R32G32_SFLOAT },
 			.offset{ offsetof(Vertex, Vertex::tex) },
 		};
+		attribs[4] =
+		{
+			.location{ 4 },
+			.binding{ 0 },
+			.format{ VK_FORMAT_R32_UINT },
+			.offset{ offsetof(Vertex, Vertex::layer) },
+		};
 
 		VkPipelineVertexInputStateCreateInfo vertexInputState
 		{
 			.sType{ VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO },
 			.vertexBindingDescriptionCount{ 1 },
 			.pVertexBindingDescriptions{ &binding },
-			.vertexAttributeDescriptionCount{ 4 },
+			.vertexAttributeDescriptionCount{ 5 },
 			.pVertexAttributeDescriptions{ attribs },
 		};
 
@@ -249,8 +290,12 @@ namespace Graphics
 			.layout{ createInfo.pipelineLayout },
 		};
 
-		VkPipeline pipeline{};
-		vkCreateGraphicsPipelines(createInfo.device, VK_NULL_HANDLE, 1, &pipelineCI, nullptr, &pipeline);
+		VkPipeline pipeline{ createCachedPipeline([&](VkPipelineCache cache)
+		{
+			VkPipeline created{};
+			vkCreateGraphicsPipelines(createInfo.device, cache, 1, &pipelineCI, nullptr, &created);
+			return created;
+		}) };
 
 		vkDestroyShaderModule(createInfo.device, vertexShaderModule, nullptr);
 		vkDestroyShaderModule(createInfo.device, fragmentShaderModule, nullptr);
@@ -258,4 +303,33 @@ namespace Graphics
 		return pipeline;
 	}
 
+	VkPipeline createComputePipeline(VkDevice device, const char* shaderPath, VkPipelineLayout pipelineLayout)
+	{
+		VkShaderModule computeShaderModule{ createShaderModule(device, shaderPath) };
+
+		VkComputePipelineCreateInfo pipelineCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO },
+			.stage
+			{
+				.sType{ VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO },
+				.stage{ VK_SHADER_STAGE_COMPUTE_BIT },
+				.module{ computeShaderModule },
+				.pName{ "main" },
+			},
+			.layout{ pipelineLayout },
+		};
+
+		VkPipeline pipeline{ createCachedPipeline([&](VkPipelineCache cache)
+		{
+			VkPipeline created{};
+			vkCreateComputePipelines(device, cache, 1, &pipelineCI, nullptr, &created);
+			return created;
+		}) };
+
+		vkDestroyShaderModule(device, computeShaderModule, nullptr);
+
+		return pipeline;
+	}
+
 }
\ No newline at end of file
@@ -1,8 +1,11 @@
 #pragma once
 
+#include "frame.hpp"
+
 #include "volk/volk.h"
 
 #include <cstdint>
+#include <span>
 
 namespace Graphics
 {
@@ -16,6 +19,9 @@ namespace Graphics
 
 		const char* pVertexShaderPath{};
 		const char* pFragmentShaderPath{};
+		// Specialization constants of the fragment shader, constant_id i takes fragmentConstants[i]. Floats are
+		// passed by their bits.
+		std::span<const std::uint32_t> fragmentConstants{};
 
 		VkExtent2D viewportExtent{};
 
@@ -28,8 +34,11 @@ namespace Graphics
 
 	VkShaderModule createShaderModule(VkDevice device, const char* path);
 
-	VkPipelineLayout createPipelineLayout(VkDevice device, std::uint32_t layoutCount, VkDescriptorSetLayout* descriptorSetLayouts);
+	VkPipelineLayout createPipelineLayout(VkDevice device, std::uint32_t layoutCount, VkDescriptorSetLayout* descriptorSetLayouts,
+		std::uint32_t pushConstantSize = sizeof(PushConstants), VkShaderStageFlags pushConstantStages = VK_SHADER_STAGE_ALL_GRAPHICS);
 
 	VkPipeline createGraphicsPipeline(const GraphicsPipelineCreateInfo& createInfo);
 
+	VkPipeline createComputePipeline(VkDevice device, const char* shaderPath, VkPipelineLayout pipelineLayout);
+
 }
\ No newline at end of file
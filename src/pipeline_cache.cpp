@@ -0,0 +1,228 @@
+#include "pipeline_cache.hpp"
+
+#include "mapped_file.hpp"
+
+#include "volk/volk.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	namespace
+	{
+		// Returns nullptr if the data can be handed to the driver, otherwise why it can't
+		const char* validateCacheHeader(const MappedFile& file, const VkPhysicalDeviceProperties& properties)
+		{
+			VkPipelineCacheHeaderVersionOne header{};
+			if (file.size() < sizeof(header))
+			{
+				return "truncated header";
+			}
+			std::memcpy(&header, file.data(), sizeof(header));
+
+			if (header.headerSize < sizeof(header) || header.headerSize > file.size())
+			{
+				return "bad header size";
+			}
+			if (header.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE)
+			{
+				return "unknown header version";
+			}
+			if (header.vendorID != properties.vendorID || header.deviceID != properties.deviceID)
+			{
+				return "written by another device";
+			}
+			if (std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID, VK_UUID_SIZE) != 0)
+			{
+				return "written by another driver";
+			}
+			return nullptr;
+		}
+
+		PipelineCache* currentCache{};
+	}
+
+	PipelineCache::PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path)
+		: m_path{ path }, m_device{ device }
+	{
+		VkPhysicalDeviceProperties properties{};
+		vkGetPhysicalDeviceProperties(physicalDevice, &properties);
+
+		// Only mapped for the duration of vkCreatePipelineCache, the driver copies what it keeps, and an open
+		// mapping would stop save() from replacing the file on Windows
+		{
+			MappedFile file{ path.c_str() };
+			if (file.empty())
+			{
+				m_rejectReason = "no cache on disk";
+			}
+			else
+			{
+				m_rejectReason = validateCacheHeader(file, properties);
+			}
+
+			if (m_rejectReason == nullptr)
+			{
+				VkPipelineCacheCreateInfo cacheCI
+				{
+					.sType{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO },
+					.initialDataSize{ file.size() },
+					.pInitialData{ file.data() },
+				};
+
+				if (vkCreatePipelineCache(m_device, &cacheCI, nullptr, &m_cache) == VK_SUCCESS)
+				{
+					m_loadedSize = file.size();
+				}
+				else
+				{
+					m_rejectReason = "rejected by the driver";
+					m_cache = VK_NULL_HANDLE;
+				}
+			}
+		}
+
+		if (m_cache == VK_NULL_HANDLE)
+		{
+			VkPipelineCacheCreateInfo cacheCI
+			{
+				.sType{ VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO },
+			};
+			vkCreatePipelineCache(m_device, &cacheCI, nullptr, &m_cache);
+		}
+	}
+
+	PipelineCache::PipelineCache(PipelineCache&& c) noexcept
+	{
+		move(std::move(c));
+	}
+
+	PipelineCache& PipelineCache::operator=(PipelineCache&& c) noexcept
+	{
+		destroy();
+		move(std::move(c));
+		return *this;
+	}
+
+	PipelineCache::~PipelineCache()
+	{
+		destroy();
+	}
+
+	void PipelineCache::recordCreation(std::chrono::steady_clock::duration duration)
+	{
+		m_pipelineCount.fetch_add(1, std::memory_order_relaxed);
+		m_creationTime.fetch_add(duration.count(), std::memory_order_relaxed);
+	}
+
+	bool PipelineCache::save() const
+	{
+		if (m_cache == VK_NULL_HANDLE)
+		{
+			return false;
+		}
+
+		std::size_t size{};
+		vkGetPipelineCacheData(m_device, m_cache, &size, nullptr);
+		std::vector<std::byte> data(size);
+		if (size == 0 || vkGetPipelineCacheData(m_device, m_cache, &size, data.data()) != VK_SUCCESS)
+		{
+			return false;
+		}
+
+		const std::filesystem::path path{ m_path };
+		std::filesystem::path temporaryPath{ path };
+		temporaryPath += ".tmp";
+
+		std::error_code error{};
+		if (path.has_parent_path())
+		{
+			std::filesystem::create_directories(path.parent_path(), error);
+		}
+
+		{
+			std::ofstream stream{ temporaryPath, std::ios::binary | std::ios::trunc };
+			stream.write(reinterpret_cast<const char*>(data.data()), static_cast<std::streamsize>(size));
+			stream.close();
+			if (!stream)
+			{
+				std::cerr << "failed to write pipeline cache to " << temporaryPath.string() << '\n';
+				std::filesystem::remove(temporaryPath, error);
+				return false;
+			}
+		}
+
+		// Replaces the old cache in one step, readers see either the old or the new file
+		std::filesystem::rename(temporaryPath, path, error);
+		if (error)
+		{
+			std::cerr << "failed to replace pipeline cache at " << m_path << ": " << error.message() << '\n';
+			std::filesystem::remove(temporaryPath, error);
+			return false;
+		}
+		return true;
+	}
+
+	void PipelineCache::printStatistics() const
+	{
+		const auto creationTime{ std::chrono::steady_clock::duration{ m_creationTime.load(std::memory_order_relaxed) } };
+
+		std::cout << "pipeline cache: ";
+		if (warm())
+		{
+			std::cout << "warm (" << m_loadedSize / 1024 << " KiB loaded)";
+		}
+		else
+		{
+			std::cout << "cold (" << m_rejectReason << ")";
+		}
+		std::cout << ", " << m_pipelineCount.load(std::memory_order_relaxed) << " pipelines created in "
+			<< std::chrono::duration<float, std::milli>{ creationTime }.count() << " ms\n";
+	}
+
+	void PipelineCache::move(PipelineCache&& c)
+	{
+		m_cache = c.m_cache;
+		c.m_cache = VK_NULL_HANDLE;
+
+		m_path = std::move(c.m_path);
+		m_loadedSize = c.m_loadedSize;
+		m_rejectReason = c.m_rejectReason;
+
+		m_pipelineCount.store(c.m_pipelineCount.load(std::memory_order_relaxed), std::memory_order_relaxed);
+		m_creationTime.store(c.m_creationTime.load(std::memory_order_relaxed), std::memory_order_relaxed);
+
+		m_device = c.m_device;
+	}
+
+	void PipelineCache::destroy()
+	{
+		if (m_cache != VK_NULL_HANDLE)
+		{
+			vkDestroyPipelineCache(m_device, m_cache, nullptr);
+			m_cache = VK_NULL_HANDLE;
+		}
+	}
+
+	void usePipelineCache(PipelineCache* cache)
+	{
+		currentCache = cache;
+	}
+
+	PipelineCache* getPipelineCache()
+	{
+		return currentCache;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "volk/volk.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace Graphics
+{
+
+	// A VkPipelineCache that outlives the process. The previous run's cache is mapped from disk and handed to the
+	// driver only if its header was written by this exact device and driver, and it is written back atomically
+	// (to a temporary file that is then renamed over the old one) so a crash mid write never leaves a torn cache.
+	class PipelineCache
+	{
+	public:
+		PipelineCache() = default;
+		PipelineCache(VkPhysicalDevice physicalDevice, VkDevice device, const std::string& path);
+
+		PipelineCache(const PipelineCache&) = delete;
+		PipelineCache& operator=(const PipelineCache&) = delete;
+
+		PipelineCache(PipelineCache&& c) noexcept;
+		PipelineCache& operator=(PipelineCache&& c) noexcept;
+
+		~PipelineCache();
+
+		VkPipelineCache handle() const
+		{
+			return m_cache;
+		}
+
+		// True if the driver was given a cache from a previous run
+		bool warm() const
+		{
+			return m_loadedSize > 0;
+		}
+
+		// Called by the pipeline creation functions, from any thread
+		void recordCreation(std::chrono::steady_clock::duration duration);
+
+		// Returns false if the cache couldn't be written, the old file is left untouched then
+		bool save() const;
+
+		void printStatistics() const;
+
+	private:
+		VkPipelineCache m_cache{};
+
+		std::string m_path{};
+		std::size_t m_loadedSize{};
+		const char* m_rejectReason{};
+
+		std::atomic<std::uint32_t> m_pipelineCount{};
+		std::atomic<std::int64_t>  m_creationTime{};
+
+		// Not owned by the class
+		VkDevice m_device{};
+
+		void move(PipelineCache&& c);
+		void destroy();
+	};
+
+	// Every pipeline created through pipeline.hpp afterwards goes through the cache, nullptr to stop using it
+	void usePipelineCache(PipelineCache* cache);
+	PipelineCache* getPipelineCache();
+
+}
\ No newline at end of file
@@ -0,0 +1,226 @@
+#include "pipeline_registry.hpp"
+
+#include "pipeline.hpp"
+#include "thread_pool.hpp"
+
+#include "volk/volk.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <future>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <thread>
+#include <utility>
+
+namespace Graphics
+{
+
+	namespace
+	{
+		template<typename T>
+		void hashCombine(std::size_t& seed, const T& value)
+		{
+			seed ^= std::hash<T>{}(value) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
+		}
+	}
+
+	std::size_t PipelineRegistry::KeyHash::operator()(const Key& key) const
+	{
+		std::size_t seed{ 0 };
+		for (VkFormat format : key.colorAttachmentFormats)
+		{
+			hashCombine(seed, static_cast<std::uint32_t>(format));
+		}
+		hashCombine(seed, static_cast<std::uint32_t>(key.depthFormat));
+		hashCombine(seed, key.vertexShaderPath);
+		hashCombine(seed, key.fragmentShaderPath);
+		for (std::uint32_t constant : key.fragmentConstants)
+		{
+			hashCombine(seed, constant);
+		}
+		hashCombine(seed, key.viewportWidth);
+		hashCombine(seed, key.viewportHeight);
+		hashCombine(seed, static_cast<std::uint32_t>(key.sampleCount));
+		hashCombine(seed, key.pipelineLayout);
+		hashCombine(seed, key.depthTestEnable);
+		return seed;
+	}
+
+	PipelineRegistry::PipelineRegistry(VkDevice device, std::size_t threadCount)
+		: m_threadCount{ threadCount == 0 ? std::max(std::thread::hardware_concurrency(), 2u) - 1 : threadCount },
+		  m_pool{ std::make_unique<ThreadPool>(m_threadCount) },
+		  m_device{ device }
+	{
+	}
+
+	PipelineRegistry::PipelineRegistry(PipelineRegistry&& r) noexcept
+	{
+		move(std::move(r));
+	}
+
+	PipelineRegistry& PipelineRegistry::operator=(PipelineRegistry&& r) noexcept
+	{
+		destroy();
+		move(std::move(r));
+		return *this;
+	}
+
+	PipelineRegistry::~PipelineRegistry()
+	{
+		destroy();
+	}
+
+	PipelineId PipelineRegistry::request(const GraphicsPipelineCreateInfo& createInfo, PipelineId fallback)
+	{
+		Key key
+		{
+			.colorAttachmentFormats{ createInfo.pColorAttachmentFormats, createInfo.pColorAttachmentFormats + createInfo.colorAttachmentCount },
+			.depthFormat{ createInfo.depthFormat },
+			.vertexShaderPath{ createInfo.pVertexShaderPath },
+			.fragmentShaderPath{ createInfo.pFragmentShaderPath },
+			.fragmentConstants{ createInfo.fragmentConstants.begin(), createInfo.fragmentConstants.end() },
+			.viewportWidth{ createInfo.viewportExtent.width },
+			.viewportHeight{ createInfo.viewportExtent.height },
+			.sampleCount{ createInfo.sampleCount },
+			.pipelineLayout{ createInfo.pipelineLayout },
+			.depthTestEnable{ createInfo.depthTestEnable },
+		};
+
+		if (auto found{ m_lookup.find(key) }; found != m_lookup.end())
+		{
+			++m_duplicateRequests;
+			return found->second;
+		}
+
+		const PipelineId id{ static_cast<PipelineId>(m_entries.size()) };
+		Entry& entry{ m_entries.emplace_back() };
+		entry.key = key;
+		entry.fallback = fallback;
+		entry.future = entry.promise.get_future().share();
+		m_lookup.emplace(std::move(key), id);
+
+		m_pool->submit([device = m_device, &entry] { compile(device, entry); });
+
+		return id;
+	}
+
+	std::shared_future<VkPipeline> PipelineRegistry::future(PipelineId id) const
+	{
+		return m_entries[id].future;
+	}
+
+	VkPipeline PipelineRegistry::get(PipelineId id) const
+	{
+		for (PipelineId current{ id }; current != noPipeline; current = m_entries[current].fallback)
+		{
+			if (VkPipeline pipeline{ m_entries[current].pipeline.load(std::memory_order_acquire) }; pipeline != VK_NULL_HANDLE)
+			{
+				if (current != id)
+				{
+					++m_fallbackLookups;
+				}
+				return pipeline;
+			}
+		}
+		return VK_NULL_HANDLE;
+	}
+
+	void PipelineRegistry::waitIdle() const
+	{
+		for (const Entry& entry : m_entries)
+		{
+			entry.future.wait();
+		}
+	}
+
+	void PipelineRegistry::printStatistics() const
+	{
+		std::size_t compiled{ 0 };
+		std::chrono::steady_clock::duration compileTime{};
+		for (const Entry& entry : m_entries)
+		{
+			if (entry.future.wait_for(std::chrono::seconds{ 0 }) == std::future_status::ready)
+			{
+				++compiled;
+				compileTime += entry.compileTime;
+			}
+		}
+
+		std::cout << "pipeline registry: " << compiled << " of " << m_entries.size() << " pipelines compiled on "
+			<< m_threadCount << " threads, " << std::chrono::duration<float, std::milli>{ compileTime }.count()
+			<< " ms of compile time, " << m_duplicateRequests << " duplicate requests, "
+			<< m_fallbackLookups << " lookups fell back\n";
+	}
+
+	void PipelineRegistry::compile(VkDevice device, Entry& entry)
+	{
+		const Key& key{ entry.key };
+		GraphicsPipelineCreateInfo createInfo
+		{
+			.device{ device },
+			.colorAttachmentCount{ static_cast<std::uint32_t>(key.colorAttachmentFormats.size()) },
+			.pColorAttachmentFormats{ key.colorAttachmentFormats.data() },
+			.depthFormat{ key.depthFormat },
+			.pVertexShaderPath{ key.vertexShaderPath.c_str() },
+			.pFragmentShaderPath{ key.fragmentShaderPath.c_str() },
+			.fragmentConstants{ key.fragmentConstants },
+			.viewportExtent{ key.viewportWidth, key.viewportHeight },
+			.sampleCount{ key.sampleCount },
+			.pipelineLayout{ key.pipelineLayout },
+			.depthTestEnable{ key.depthTestEnable },
+		};
+
+		const auto start{ std::chrono::steady_clock::now() };
+		try
+		{
+			VkPipeline pipeline{ createGraphicsPipeline(createInfo) };
+			entry.compileTime = std::chrono::steady_clock::now() - start;
+			entry.pipeline.store(pipeline, std::memory_order_release);
+			entry.promise.set_value(pipeline);
+		}
+		catch (...)
+		{
+			entry.compileTime = std::chrono::steady_clock::now() - start;
+			entry.promise.set_exception(std::current_exception());
+		}
+	}
+
+	void PipelineRegistry::move(PipelineRegistry&& r)
+	{
+		// Moving a deque hands over its blocks, so the entries queued workers point at stay where they are
+		m_entries = std::move(r.m_entries);
+		m_lookup = std::move(r.m_lookup);
+
+		m_threadCount = r.m_threadCount;
+		m_duplicateRequests = r.m_duplicateRequests;
+		m_fallbackLookups = r.m_fallbackLookups;
+
+		m_pool = std::move(r.m_pool);
+
+		m_device = r.m_device;
+		r.m_device = VK_NULL_HANDLE;
+	}
+
+	void PipelineRegistry::destroy()
+	{
+		// Joins the workers, so nothing is compiling once the pool is gone
+		m_pool.reset();
+
+		for (const Entry& entry : m_entries)
+		{
+			if (VkPipeline pipeline{ entry.pipeline.load(std::memory_order_acquire) }; pipeline != VK_NULL_HANDLE)
+			{
+				vkDestroyPipeline(m_device, pipeline, nullptr);
+			}
+		}
+		m_entries.clear();
+		m_lookup.clear();
+	}
+
+}
\ No newline at end of file
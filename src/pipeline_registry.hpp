@@ -0,0 +1,116 @@
+#pragma once
+
+#include "pipeline.hpp"
+#include "thread_pool.hpp"
+
+#include "volk/volk.h"
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Stays valid for the lifetime of the registry it came from
+	using PipelineId = std::uint32_t;
+	inline constexpr PipelineId noPipeline{ ~0u };
+
+	// Compiles graphics pipelines on worker threads. Requests with the same create info share one pipeline, so
+	// asking for a variant twice costs a hash lookup. Each request can name a fallback, drawn with until the
+	// variant itself has compiled, so a new variant never stalls a frame; it just looks generic for a few frames.
+	// Requests and lookups come from one thread, only the compiles run on the workers.
+	class PipelineRegistry
+	{
+	public:
+		PipelineRegistry() = default;
+		// The device, and the pipeline layouts of every request, must outlive the registry
+		explicit PipelineRegistry(VkDevice device, std::size_t threadCount = 0);
+
+		PipelineRegistry(const PipelineRegistry&) = delete;
+		PipelineRegistry& operator=(const PipelineRegistry&) = delete;
+
+		PipelineRegistry(PipelineRegistry&& r) noexcept;
+		PipelineRegistry& operator=(PipelineRegistry&& r) noexcept;
+
+		// Finishes the compiles already queued, then destroys every pipeline
+		~PipelineRegistry();
+
+		// The create info is copied, nothing it points to needs to outlive the call. createInfo.device is ignored.
+		PipelineId request(const GraphicsPipelineCreateInfo& createInfo, PipelineId fallback = noPipeline);
+
+		// Ready once the pipeline has compiled, rethrows what the compile threw
+		std::shared_future<VkPipeline> future(PipelineId id) const;
+
+		// The pipeline if it has compiled, otherwise the first ready one along its fallbacks.
+		// VK_NULL_HANDLE if none is, the draw should be skipped then.
+		VkPipeline get(PipelineId id) const;
+
+		// Blocks until every pipeline requested so far has compiled
+		void waitIdle() const;
+
+		void printStatistics() const;
+
+	private:
+		// An owned copy of GraphicsPipelineCreateInfo, compared field by field after the hash matches
+		struct Key
+		{
+			std::vector<VkFormat>      colorAttachmentFormats{};
+			VkFormat                   depthFormat{};
+			std::string                vertexShaderPath{};
+			std::string                fragmentShaderPath{};
+			std::vector<std::uint32_t> fragmentConstants{};
+			std::uint32_t              viewportWidth{};
+			std::uint32_t              viewportHeight{};
+			VkSampleCountFlagBits      sampleCount{};
+			VkPipelineLayout           pipelineLayout{};
+			bool                       depthTestEnable{};
+
+			bool operator==(const Key&) const = default;
+		};
+
+		struct KeyHash
+		{
+			std::size_t operator()(const Key& key) const;
+		};
+
+		struct Entry
+		{
+			Key        key{};
+			PipelineId fallback{ noPipeline };
+
+			std::promise<VkPipeline>       promise{};
+			std::shared_future<VkPipeline> future{};
+			std::atomic<VkPipeline>        pipeline{}; // Set by the worker once compiled
+
+			// Written before the promise is fulfilled, read only after
+			std::chrono::steady_clock::duration compileTime{};
+		};
+
+		// A deque, so workers can hold on to their entry while more are requested
+		std::deque<Entry>                            m_entries{};
+		std::unordered_map<Key, PipelineId, KeyHash> m_lookup{};
+
+		std::size_t         m_threadCount{};
+		std::size_t         m_duplicateRequests{};
+		mutable std::size_t m_fallbackLookups{};
+
+		std::unique_ptr<ThreadPool> m_pool{};
+
+		// Not owned by the class
+		VkDevice m_device{};
+
+		static void compile(VkDevice device, Entry& entry);
+
+		void move(PipelineRegistry&& r);
+		void destroy();
+	};
+
+}
\ No newline at end of file
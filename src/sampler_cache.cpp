@@ -0,0 +1,112 @@
+#include "sampler_cache.hpp"
+
+#include "volk/volk.h"
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <utility>
+
+namespace Graphics
+{
+
+	SamplerCache::SamplerCache(VkDevice device)
+		: m_device{ device }
+	{
+	}
+
+	SamplerCache::SamplerCache(SamplerCache&& s) noexcept
+	{
+		move(std::move(s));
+	}
+
+	SamplerCache& SamplerCache::operator=(SamplerCache&& s) noexcept
+	{
+		destroy();
+		move(std::move(s));
+		return *this;
+	}
+
+	SamplerCache::~SamplerCache()
+	{
+		destroy();
+	}
+
+	VkSampler SamplerCache::get(const VkSamplerCreateInfo& samplerCI)
+	{
+		const Key key
+		{
+			.flags{ samplerCI.flags },
+			.magFilter{ samplerCI.magFilter },
+			.minFilter{ samplerCI.minFilter },
+			.mipmapMode{ samplerCI.mipmapMode },
+			.addressModeU{ samplerCI.addressModeU },
+			.addressModeV{ samplerCI.addressModeV },
+			.addressModeW{ samplerCI.addressModeW },
+			.mipLodBias{ samplerCI.mipLodBias },
+			.anisotropyEnable{ samplerCI.anisotropyEnable },
+			.maxAnisotropy{ samplerCI.maxAnisotropy },
+			.compareEnable{ samplerCI.compareEnable },
+			.compareOp{ samplerCI.compareOp },
+			.minLod{ samplerCI.minLod },
+			.maxLod{ samplerCI.maxLod },
+			.borderColor{ samplerCI.borderColor },
+			.unnormalizedCoordinates{ samplerCI.unnormalizedCoordinates },
+		};
+
+		auto found{ m_samplers.find(key) };
+		if (found != m_samplers.end())
+		{
+			return found->second;
+		}
+
+		VkSampler sampler{};
+		vkCreateSampler(m_device, &samplerCI, nullptr, &sampler);
+		m_samplers.emplace(key, sampler);
+
+		return sampler;
+	}
+
+	std::size_t SamplerCache::KeyHash::operator()(const Key& key) const
+	{
+		const std::uint32_t fields[]
+		{
+			key.flags, static_cast<std::uint32_t>(key.magFilter), static_cast<std::uint32_t>(key.minFilter),
+			static_cast<std::uint32_t>(key.mipmapMode), static_cast<std::uint32_t>(key.addressModeU),
+			static_cast<std::uint32_t>(key.addressModeV), static_cast<std::uint32_t>(key.addressModeW),
+			std::bit_cast<std::uint32_t>(key.mipLodBias), key.anisotropyEnable, std::bit_cast<std::uint32_t>(key.maxAnisotropy),
+			key.compareEnable, static_cast<std::uint32_t>(key.compareOp), std::bit_cast<std::uint32_t>(key.minLod),
+			std::bit_cast<std::uint32_t>(key.maxLod), static_cast<std::uint32_t>(key.borderColor), key.unnormalizedCoordinates,
+		};
+
+		std::size_t hash{ 0 };
+		for (std::uint32_t field : fields)
+		{
+			hash ^= std::hash<std::uint32_t>{}(field) + 0x9e3779b9 + (hash << 6) + (hash >> 2);
+		}
+		return hash;
+	}
+
+	void SamplerCache::move(SamplerCache&& s)
+	{
+		m_samplers = std::move(s.m_samplers);
+		m_device   = s.m_device;
+
+		s.m_samplers.clear();
+		s.m_device = VK_NULL_HANDLE;
+	}
+
+	void SamplerCache::destroy()
+	{
+		if (m_device != VK_NULL_HANDLE)
+		{
+			for (const auto& [key, sampler] : m_samplers)
+			{
+				vkDestroySampler(m_device, sampler, nullptr);
+			}
+		}
+		m_samplers.clear();
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "volk/volk.h"
+
+#include <cstddef>
+#include <unordered_map>
+
+namespace Graphics
+{
+
+	// Hands out one VkSampler per distinct create-info, so identical samplers are only created once
+	class SamplerCache
+	{
+	public:
+		SamplerCache() = default;
+		explicit SamplerCache(VkDevice device);
+
+		SamplerCache(const SamplerCache&) = delete;
+		SamplerCache& operator=(const SamplerCache&) = delete;
+
+		SamplerCache(SamplerCache&& s) noexcept;
+		SamplerCache& operator=(SamplerCache&& s) noexcept;
+
+		~SamplerCache();
+
+		// The sampler stays owned by the cache. pNext chains are not supported.
+		VkSampler get(const VkSamplerCreateInfo& samplerCI);
+
+		std::size_t size() const
+		{
+			return m_samplers.size();
+		}
+
+	private:
+		struct Key
+		{
+			VkSamplerCreateFlags flags{};
+			VkFilter             magFilter{};
+			VkFilter             minFilter{};
+			VkSamplerMipmapMode  mipmapMode{};
+			VkSamplerAddressMode addressModeU{};
+			VkSamplerAddressMode addressModeV{};
+			VkSamplerAddressMode addressModeW{};
+			float                mipLodBias{};
+			VkBool32             anisotropyEnable{};
+			float                maxAnisotropy{};
+			VkBool32             compareEnable{};
+			VkCompareOp          compareOp{};
+			float                minLod{};
+			float                maxLod{};
+			VkBorderColor        borderColor{};
+			VkBool32             unnormalizedCoordinates{};
+
+			bool operator==(const Key&) const = default;
+		};
+
+		struct KeyHash
+		{
+			std::size_t operator()(const Key& key) const;
+		};
+
+		std::unordered_map<Key, VkSampler, KeyHash> m_samplers{};
+
+		// Not owned by the class
+		VkDevice m_device{};
+
+		void move(SamplerCache&& s);
+		void destroy();
+	};
+
+}
\ No newline at end of file
@@ -0,0 +1,364 @@
+#include "scatter.hpp"
+
+#include "alloc.hpp"
+#include "frame.hpp"
+#include "mesh.hpp"
+#include "pipeline.hpp"
+#include "sampler_cache.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Must match the push constant block in scatter.comp
+	struct ScatterPushConstants
+	{
+		glm::vec2     areaMin{};
+		glm::vec2     areaSize{};
+		glm::uvec2    gridSize{};
+		glm::uvec2    regionGrid{};
+		float         cellSize{};
+		float         heightScale{};
+		float         densityScale{};
+		float         minScale{};
+		float         maxScale{};
+		std::uint32_t seed{};
+		std::uint32_t phase{};
+		std::uint32_t firstCommand{};
+		std::uint32_t commandCount{};
+		std::uint32_t instanceBase{};
+		std::uint32_t cellsPerRegion{};
+	};
+
+	// Cells are processed in 3x3 phases so that no two cells running concurrently can see each other's samples
+	constexpr std::uint32_t scatterPhaseCount{ 9 };
+	// Copies the per-region instance counts into every mesh's draw commands
+	constexpr std::uint32_t scatterFinalizePhase{ scatterPhaseCount };
+
+	Scatter::Scatter(const ScatterSettings& settings, const std::vector<ScatterLayer>& layers, const std::vector<RenderObject>& renderObjects,
+		UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator)
+		: m_allocator{ allocator }
+	{
+		if (layers.empty())
+		{
+			return;
+		}
+
+		const glm::vec2 areaSize{ settings.areaMax - settings.areaMin };
+		m_regionCount = settings.regionsPerAxis * settings.regionsPerAxis;
+
+		std::vector<ScatterPushConstants> layerConstants{};
+		layerConstants.reserve(layers.size());
+
+		std::uint32_t instanceCount{ 0 };
+		std::uint32_t commandCount{ 0 };
+		std::uint32_t maxCellCount{ 0 };
+
+		for (const auto& layer : layers)
+		{
+			// A cell this size can hold at most one sample, which bounds the instance count of every region
+			const float cellSize{ layer.spacing / std::sqrt(2.0f) };
+			const glm::uvec2 gridSize{ glm::ceil(areaSize / cellSize) };
+			const glm::uvec2 regionCells{ (gridSize + settings.regionsPerAxis - 1u) / settings.regionsPerAxis };
+
+			layerConstants.push_back({
+				.areaMin{ settings.areaMin },
+				.areaSize{ areaSize },
+				.gridSize{ gridSize },
+				.regionGrid{ glm::uvec2{ settings.regionsPerAxis } },
+				.cellSize{ cellSize },
+				.heightScale{ settings.heightScale },
+				.densityScale{ layer.densityScale },
+				.minScale{ layer.minScale },
+				.maxScale{ layer.maxScale },
+				.seed{ layer.seed },
+				.firstCommand{ commandCount },
+				.commandCount{ static_cast<std::uint32_t>(renderObjects[layer.renderObject].meshes.size()) * m_regionCount },
+				.instanceBase{ instanceCount },
+				.cellsPerRegion{ regionCells.x * regionCells.y },
+				});
+
+			m_layers.push_back({
+				.renderObject{ layer.renderObject },
+				.firstCommand{ commandCount },
+				});
+
+			instanceCount += layerConstants.back().cellsPerRegion * m_regionCount;
+			commandCount  += layerConstants.back().commandCount;
+			maxCellCount   = std::max(maxCellCount, gridSize.x * gridSize.y);
+		}
+
+		VkBufferCreateInfo instanceBufferCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ instanceCount * sizeof(glm::mat4) },
+			.usage{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		};
+		VmaAllocationCreateInfo deviceAllocCI
+		{
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+		};
+		vmaCreateBuffer(allocator, &instanceBufferCI, &deviceAllocCI, &m_instanceBuffer.buffer, &m_instanceBuffer.alloc, nullptr);
+
+		// Written once by the CPU, after which only the instance counts are touched by the GPU
+		VkBufferCreateInfo commandBufferCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ commandCount * sizeof(VkDrawIndexedIndirectCommand) },
+			.usage{ VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		};
+		VmaAllocationCreateInfo mappedAllocCI
+		{
+			.flags{ VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT },
+		};
+		VmaAllocationInfo commandAllocInfo{};
+		vmaCreateBuffer(allocator, &commandBufferCI, &mappedAllocCI, &m_commandBuffer.buffer, &m_commandBuffer.alloc, &commandAllocInfo);
+
+		// Commands are laid out [layer][mesh][region] so each mesh is a single multi-draw
+		VkDrawIndexedIndirectCommand* commands{ static_cast<VkDrawIndexedIndirectCommand*>(commandAllocInfo.pMappedData) };
+		for (std::size_t l{ 0 }; l < layers.size(); ++l)
+		{
+			const auto& meshes{ renderObjects[layers[l].renderObject].meshes };
+			for (std::size_t m{ 0 }; m < meshes.size(); ++m)
+			{
+				for (std::uint32_t r{ 0 }; r < m_regionCount; ++r)
+				{
+					commands[m_layers[l].firstCommand + m * m_regionCount + r] =
+					{
+						.indexCount{ meshes[m].indexCount },
+						.instanceCount{ 0 },
+						.firstIndex{ meshes[m].firstIndex },
+						.vertexOffset{ 0 },
+						.firstInstance{ layerConstants[l].instanceBase + r * layerConstants[l].cellsPerRegion },
+					};
+				}
+			}
+		}
+		vmaFlushAllocation(allocator, m_commandBuffer.alloc, 0, VK_WHOLE_SIZE);
+
+		// Holds the accepted sample of every cell while a layer is being generated
+		VkBufferCreateInfo gridBufferCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ maxCellCount * sizeof(glm::vec4) },
+			.usage{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT },
+		};
+		Buffer gridBuffer{};
+		vmaCreateBuffer(allocator, &gridBufferCI, &deviceAllocCI, &gridBuffer.buffer, &gridBuffer.alloc, nullptr);
+
+		// Shared with the clean up below, which keeps them alive until the generation pass has run
+		const auto densityMap{ std::make_shared<Texture>(settings.densityMapPath, uploader, samplers, device, allocator, VK_FORMAT_R8G8B8A8_UNORM) };
+		const auto heightMap{ std::make_shared<Texture>(settings.heightMapPath, uploader, samplers, device, allocator, VK_FORMAT_R8G8B8A8_UNORM) };
+
+		// Mips are recorded as a batch is submitted, so the maps go up in a batch of their own ahead of the one sampling them
+		uploader.flush();
+
+		VkDescriptorSetLayoutBinding bindings[5]
+		{
+			{ 0, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 1, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 2, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 3, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+			{ 4, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 1, VK_SHADER_STAGE_COMPUTE_BIT },
+		};
+		VkDescriptorSetLayoutCreateInfo setLayoutCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO },
+			.bindingCount{ 5 },
+			.pBindings{ bindings },
+		};
+		VkDescriptorSetLayout setLayout{};
+		vkCreateDescriptorSetLayout(device, &setLayoutCI, nullptr, &setLayout);
+
+		VkDescriptorPoolSize poolSizes[2]
+		{
+			{ VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 2 },
+			{ VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, 3 },
+		};
+		VkDescriptorPoolCreateInfo poolCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO },
+			.maxSets{ 1 },
+			.poolSizeCount{ 2 },
+			.pPoolSizes{ poolSizes },
+		};
+		VkDescriptorPool pool{};
+		vkCreateDescriptorPool(device, &poolCI, nullptr, &pool);
+
+		VkDescriptorSetAllocateInfo setAI
+		{
+			.sType{ VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO },
+			.descriptorPool{ pool },
+			.descriptorSetCount{ 1 },
+			.pSetLayouts{ &setLayout },
+		};
+		VkDescriptorSet set{};
+		vkAllocateDescriptorSets(device, &setAI, &set);
+
+		VkDescriptorImageInfo imageInfos[2]
+		{
+			{ densityMap->vkSampler(), densityMap->vkImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			{ heightMap->vkSampler(), heightMap->vkImageView(), VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+		};
+		VkDescriptorBufferInfo bufferInfos[3]
+		{
+			{ gridBuffer.buffer, 0, VK_WHOLE_SIZE },
+			{ m_instanceBuffer.buffer, 0, VK_WHOLE_SIZE },
+			{ m_commandBuffer.buffer, 0, VK_WHOLE_SIZE },
+		};
+		VkWriteDescriptorSet writes[5]{};
+		for (std::uint32_t i{ 0 }; i < 5; ++i)
+		{
+			writes[i] =
+			{
+				.sType{ VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET },
+				.dstSet{ set },
+				.dstBinding{ i },
+				.descriptorCount{ 1 },
+				.descriptorType{ bindings[i].descriptorType },
+				.pImageInfo{ i < 2 ? &imageInfos[i] : nullptr },
+				.pBufferInfo{ i < 2 ? nullptr : &bufferInfos[i - 2] },
+			};
+		}
+		vkUpdateDescriptorSets(device, 5, writes, 0, nullptr);
+
+		VkPipelineLayout pipelineLayout{ createPipelineLayout(device, 1, &setLayout, sizeof(ScatterPushConstants), VK_SHADER_STAGE_COMPUTE_BIT) };
+		VkPipeline pipeline{ createComputePipeline(device, "shaders/scatter.comp.spv", pipelineLayout) };
+
+		// Generation runs with the uploads, so the caller waits for the batch before anything reads the buffers
+		VkCommandBuffer commandBuffer{ uploader.graphicsCommands() };
+
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipeline);
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, pipelineLayout, 0, 1, &set, 0, nullptr);
+
+		VkMemoryBarrier computeBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+		};
+		VkMemoryBarrier clearBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT },
+		};
+
+		for (auto& constants : layerConstants)
+		{
+			// Wait for the previous layer to be done with the grid before clearing it
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+				0, 0, nullptr, 0, nullptr, 0, nullptr);
+			vkCmdFillBuffer(commandBuffer, gridBuffer.buffer, 0, constants.gridSize.x * constants.gridSize.y * sizeof(glm::vec4), 0);
+			vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+				0, 1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+			for (std::uint32_t phase{ 0 }; phase < scatterPhaseCount; ++phase)
+			{
+				constants.phase = phase;
+				vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ScatterPushConstants), &constants);
+
+				const glm::uvec2 phaseCells{ (constants.gridSize + 2u) / 3u };
+				vkCmdDispatch(commandBuffer, (phaseCells.x + 7) / 8, (phaseCells.y + 7) / 8, 1);
+
+				vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT,
+					0, 1, &computeBarrier, 0, nullptr, 0, nullptr);
+			}
+
+			constants.phase = scatterFinalizePhase;
+			vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(ScatterPushConstants), &constants);
+			vkCmdDispatch(commandBuffer, (constants.commandCount + 63) / 64, 1, 1);
+		}
+
+		VkMemoryBarrier drawBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_SHADER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT },
+		};
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT,
+			0, 1, &drawBarrier, 0, nullptr, 0, nullptr);
+
+		uploader.destroyAfterUpload(gridBuffer);
+		uploader.destroyAfterUpload([device, pipeline, pipelineLayout, pool, setLayout, densityMap, heightMap]
+		{
+			vkDestroyPipeline(device, pipeline, nullptr);
+			vkDestroyPipelineLayout(device, pipelineLayout, nullptr);
+			vkDestroyDescriptorPool(device, pool, nullptr);
+			vkDestroyDescriptorSetLayout(device, setLayout, nullptr);
+		});
+	}
+
+	Scatter::Scatter(Scatter&& s) noexcept
+	{
+		move(std::move(s));
+	}
+
+	Scatter& Scatter::operator=(Scatter&& s) noexcept
+	{
+		destroy();
+		move(std::move(s));
+		return *this;
+	}
+
+	Scatter::~Scatter()
+	{
+		destroy();
+	}
+
+	void Scatter::draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const std::vector<RenderObject>& renderObjects, bool opaque) const
+	{
+		for (const auto& layer : m_layers)
+		{
+			const auto& meshes{ renderObjects[layer.renderObject].meshes };
+			for (std::size_t m{ 0 }; m < meshes.size(); ++m)
+			{
+				if (meshes[m].draw && meshes[m].opaque == opaque)
+				{
+					PushConstants pushConstants{ .textureIndex{ meshes[m].textureIndex }, .instanceSource{ 1 } };
+					vkCmdPushConstants(commandBuffer, pipelineLayout, VK_SHADER_STAGE_ALL_GRAPHICS, 0, sizeof(PushConstants), &pushConstants);
+
+					const VkDeviceSize offset{ (layer.firstCommand + m * m_regionCount) * sizeof(VkDrawIndexedIndirectCommand) };
+
+					vkCmdDrawIndexedIndirect(commandBuffer, m_commandBuffer.buffer, offset, m_regionCount, sizeof(VkDrawIndexedIndirectCommand));
+				}
+			}
+		}
+	}
+
+	void Scatter::move(Scatter&& s)
+	{
+		m_layers = std::move(s.m_layers);
+		m_regionCount = s.m_regionCount;
+
+		m_instanceBuffer = s.m_instanceBuffer;
+		m_commandBuffer = s.m_commandBuffer;
+
+		m_allocator = s.m_allocator;
+		s.m_allocator = {};
+	}
+
+	void Scatter::destroy()
+	{
+		if (m_allocator != VmaAllocator{})
+		{
+			vmaDestroyBuffer(m_allocator, m_commandBuffer.buffer, m_commandBuffer.alloc);
+			vmaDestroyBuffer(m_allocator, m_instanceBuffer.buffer, m_instanceBuffer.alloc);
+		}
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,90 @@
+#pragma once
+
+#include "alloc.hpp"
+#include "mesh.hpp"
+#include "sampler_cache.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics
+{
+
+	// One kind of scattered object (trees, shrubs, rocks...)
+	struct ScatterLayer
+	{
+		int           renderObject{};
+		float         spacing{ 4.0f };      // Minimum distance between two instances of the layer
+		float         densityScale{ 1.0f }; // Multiplies the density map
+		float         minScale{ 1.0f };
+		float         maxScale{ 1.0f };
+		std::uint32_t seed{};
+	};
+
+	struct ScatterSettings
+	{
+		const char*   densityMapPath{};
+		const char*   heightMapPath{};
+		glm::vec2     areaMin{ -1250.0f };
+		glm::vec2     areaMax{ 1250.0f };
+		float         heightScale{ 0.0f };
+		std::uint32_t regionsPerAxis{ 8 };
+	};
+
+	// Places instances on the GPU with a Poisson-disk distribution driven by a density map.
+	// The instances never exist on the CPU; they are written to a device local buffer,
+	// grouped by region, and drawn with one multi-draw-indirect call per mesh.
+	// Generation is recorded into the uploader's open batch, and the buffers are ready once that batch has completed.
+	class Scatter
+	{
+	public:
+		Scatter() = default;
+		Scatter(const ScatterSettings& settings, const std::vector<ScatterLayer>& layers, const std::vector<RenderObject>& renderObjects,
+			UploadManager& uploader, SamplerCache& samplers, VkDevice device, VmaAllocator allocator);
+
+		Scatter(const Scatter&) = delete;
+		Scatter& operator=(const Scatter&) = delete;
+
+		Scatter(Scatter&& s) noexcept;
+		Scatter& operator=(Scatter&& s) noexcept;
+
+		~Scatter();
+
+		void draw(VkCommandBuffer commandBuffer, VkPipelineLayout pipelineLayout, const std::vector<RenderObject>& renderObjects, bool opaque) const;
+
+		bool empty() const
+		{
+			return m_layers.empty();
+		}
+
+		VkBuffer instanceBuffer() const
+		{
+			return m_instanceBuffer.buffer;
+		}
+
+	private:
+		struct GeneratedLayer
+		{
+			int           renderObject{};
+			std::uint32_t firstCommand{};
+		};
+
+		std::vector<GeneratedLayer> m_layers{};
+		std::uint32_t               m_regionCount{};
+
+		Buffer m_instanceBuffer{};
+		Buffer m_commandBuffer{};
+
+		// Not owned by the class
+		VmaAllocator m_allocator{};
+
+		void move(Scatter&& s);
+		void destroy();
+	};
+
+}
\ No newline at end of file
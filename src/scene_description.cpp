@@ -0,0 +1,103 @@
+#include "scene_description.hpp"
+
+#include "texture_cooker.hpp"
+
+#include <cstddef>
+#include <fstream>
+#include <istream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <utility>
+
+namespace Graphics
+{
+
+	bool parseUsage(const std::string& name, TextureUsage& usage)
+	{
+		const std::pair<const char*, TextureUsage> usages[]
+		{
+			{ "auto",   TextureUsage::Auto },
+			{ "color",  TextureUsage::Color },
+			{ "cutout", TextureUsage::AlphaCutout },
+			{ "normal", TextureUsage::Normal },
+		};
+		for (const auto& [usageName, value] : usages)
+		{
+			if (name == usageName)
+			{
+				usage = value;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool readSceneDescription(const std::string& path, SceneDescription& scene)
+	{
+		std::ifstream file{ path };
+		if (!file)
+		{
+			std::cerr << "failed to open scene description: " << path << '\n';
+			return false;
+		}
+
+		std::string line{};
+		for (std::size_t lineNumber{ 1 }; std::getline(file, line); ++lineNumber)
+		{
+			std::istringstream words{ line };
+			std::string kind{};
+			if (!(words >> kind) || kind[0] == '#')
+			{
+				continue;
+			}
+
+			bool valid{ false };
+			if (kind == "object" || kind == "skybox")
+			{
+				std::string model{};
+				valid = static_cast<bool>(words >> model);
+				if (kind == "skybox")
+				{
+					scene.skybox = static_cast<std::uint32_t>(scene.objects.size());
+				}
+				scene.objects.push_back(model);
+			}
+			else if (kind == "texture")
+			{
+				SceneDescription::Texture texture{};
+				std::string usage{};
+				valid = (words >> texture.path >> usage) && parseUsage(usage, texture.usage);
+				scene.textures.push_back(texture);
+			}
+			else if (kind == "cell_size")
+			{
+				valid = (words >> scene.cellSize) && scene.cellSize > 0.0f;
+			}
+			else if (kind == "instance")
+			{
+				SceneDescription::Instance instance{};
+				std::string mobility{};
+				valid = (words >> instance.object >> mobility >> instance.scale >> instance.position.x >> instance.position.y >> instance.position.z) &&
+					(mobility == "static" || mobility == "dynamic") && instance.object < scene.objects.size() && instance.scale > 0.0f;
+				instance.isStatic = mobility == "static";
+
+				// The rotation is optional
+				if (valid && !(words >> std::ws).eof())
+				{
+					valid = static_cast<bool>(words >> instance.rotation.x >> instance.rotation.y >> instance.rotation.z);
+				}
+				scene.instances.push_back(instance);
+			}
+
+			if (!valid)
+			{
+				std::cerr << path << ':' << lineNumber << ": can't read \"" << line << "\"\n";
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,50 @@
+#pragma once
+
+#include "texture_cooker.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Graphics
+{
+
+	// The authored form of a scene, a text file the scene cooker compiles into a scene pack and a placement file.
+	// The renderer only reads it when they are missing, so it should stay small; large placement sets belong
+	// in the placement file.
+	struct SceneDescription
+	{
+		struct Texture
+		{
+			std::string  path{};
+			TextureUsage usage{};
+		};
+
+		struct Instance
+		{
+			std::uint32_t object{};
+			bool          isStatic{};
+			float         scale{ 1.0f };
+			glm::vec3     position{};
+			glm::vec3     rotation{}; // Yaw, pitch and roll in degrees
+
+			glm::quat orientation() const
+			{
+				return glm::quat{ glm::radians(glm::vec3{ rotation.y, rotation.x, rotation.z }) };
+			}
+		};
+
+		std::vector<std::string> objects{};
+		std::uint32_t            skybox{ ~0u }; // Into objects
+		float                    cellSize{ 128.0f };
+		std::vector<Texture>     textures{};
+		std::vector<Instance>    instances{};
+	};
+
+	// Returns false, after saying why, if the file is missing or any line is malformed
+	bool readSceneDescription(const std::string& path, SceneDescription& scene);
+
+}
\ No newline at end of file
@@ -0,0 +1,302 @@
+#include "scene_pack.hpp"
+
+#include "mapped_file.hpp"
+#include "obj_loader.hpp"
+#include "texture_cooker.hpp"
+#include "vertex.hpp"
+
+#include "volk/volk.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Graphics
+{
+
+	constexpr char packIdentifier[8]{ 'F', 'O', 'R', 'E', 'S', 'T', 'P', 'K' };
+
+	constexpr std::size_t textureDataAlignment{ 16 };
+
+	std::size_t alignPack(std::size_t value, std::size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	PackString ScenePackContents::addString(std::string_view string)
+	{
+		const PackString packString{ static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(string.size()) };
+		strings += string;
+		return packString;
+	}
+
+	std::uint32_t ScenePackContents::addTexture(std::string_view path, const CookedImage& image)
+	{
+		PackTexture texture
+		{
+			.path{ addString(path) },
+			.format{ static_cast<std::uint32_t>(image.format) },
+			.firstLevel{ static_cast<std::uint32_t>(textureLevels.size()) },
+			.levelCount{ static_cast<std::uint32_t>(image.levels.size()) },
+			.averageColor{ image.averageColor.r, image.averageColor.g, image.averageColor.b, image.averageColor.a },
+			.contentHash{ image.contentHash },
+			.dataOffset{ alignPack(textureData.size(), textureDataAlignment) },
+		};
+
+		// Levels keep the offsets they have in the image, which are already aligned for their blocks
+		textureData.resize(texture.dataOffset);
+		textureData.insert(textureData.end(), image.data.begin(), image.data.end());
+		texture.dataSize = image.data.size();
+
+		for (const CookedLevel& level : image.levels)
+		{
+			textureLevels.push_back({ .width{ level.width }, .height{ level.height }, .offset{ level.offset }, .size{ level.size } });
+		}
+
+		textures.push_back(texture);
+		return static_cast<std::uint32_t>(textures.size() - 1);
+	}
+
+	bool writeScenePack(const std::string& path, const ScenePackContents& contents)
+	{
+		const std::span<const std::byte> sections[]
+		{
+			std::as_bytes(std::span{ contents.vertices }),
+			std::as_bytes(std::span{ contents.indices }),
+			std::as_bytes(std::span{ contents.objects }),
+			std::as_bytes(std::span{ contents.meshes }),
+			std::as_bytes(std::span{ contents.textures }),
+			std::as_bytes(std::span{ contents.textureLevels }),
+			std::span{ contents.textureData },
+			std::as_bytes(std::span{ contents.strings }),
+		};
+		static_assert(std::size(sections) == static_cast<std::size_t>(PackSection::Count));
+
+		PackHeader header{ .version{ scenePackVersion }, .sectionCount{ static_cast<std::uint32_t>(PackSection::Count) } };
+		std::memcpy(header.identifier, packIdentifier, sizeof(packIdentifier));
+
+		std::size_t offset{ sizeof(header) };
+		for (std::size_t i{ 0 }; i < std::size(sections); ++i)
+		{
+			offset = alignPack(offset, scenePackAlignment);
+			header.sections[i] = { .type{ static_cast<std::uint32_t>(i) }, .offset{ offset }, .size{ sections[i].size() } };
+			offset += sections[i].size();
+		}
+
+		std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+		if (!file)
+		{
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		std::size_t written{ sizeof(header) };
+		const std::vector<char> padding(scenePackAlignment);
+		for (std::size_t i{ 0 }; i < std::size(sections); ++i)
+		{
+			file.write(padding.data(), header.sections[i].offset - written);
+			file.write(reinterpret_cast<const char*>(sections[i].data()), sections[i].size());
+			written = header.sections[i].offset + sections[i].size();
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	ScenePack::ScenePack(const char* path)
+		: m_file{ path }
+	{
+		if (m_file.empty())
+		{
+			return;
+		}
+
+		PackHeader header{};
+		if (m_file.size() < sizeof(header))
+		{
+			std::cerr << "not a scene pack: " << path << '\n';
+			*this = ScenePack{};
+			return;
+		}
+		std::memcpy(&header, m_file.data(), sizeof(header));
+
+		if (std::memcmp(header.identifier, packIdentifier, sizeof(packIdentifier)) != 0 ||
+			header.sectionCount != static_cast<std::uint32_t>(PackSection::Count))
+		{
+			std::cerr << "not a scene pack: " << path << '\n';
+			*this = ScenePack{};
+			return;
+		}
+		if (header.version != scenePackVersion)
+		{
+			std::cerr << "scene pack " << path << " is version " << header.version << ", expected " << scenePackVersion
+				<< ". Run the scene cooker again\n";
+			*this = ScenePack{};
+			return;
+		}
+
+		for (const PackSectionEntry& entry : header.sections)
+		{
+			if (entry.type >= header.sectionCount || entry.offset % scenePackAlignment != 0 ||
+				entry.offset > m_file.size() || entry.size > m_file.size() - entry.offset)
+			{
+				std::cerr << "truncated scene pack: " << path << '\n';
+				*this = ScenePack{};
+				return;
+			}
+			m_sections[entry.type] = { m_file.data() + entry.offset, static_cast<std::size_t>(entry.size) };
+		}
+
+		if (!validate())
+		{
+			std::cerr << "inconsistent scene pack: " << path << '\n';
+			*this = ScenePack{};
+		}
+	}
+
+	// Checks every cross reference once here, so nothing after has to
+	bool ScenePack::validate() const
+	{
+		const auto fits{ [](std::uint64_t first, std::uint64_t count, std::size_t size)
+		{
+			return first <= size && count <= size - first;
+		} };
+
+		const std::span<const std::byte> textureData{ m_sections[static_cast<std::size_t>(PackSection::TextureData)] };
+		const std::span<const std::byte> strings{ m_sections[static_cast<std::size_t>(PackSection::Strings)] };
+		const std::span<const PackLevel> textureLevels{ section<PackLevel>(PackSection::TextureLevels) };
+
+		// Every record section has to hold whole records
+		constexpr std::size_t recordSizes[]
+		{
+			sizeof(Vertex), sizeof(std::uint32_t), sizeof(PackObject), sizeof(PackMesh), sizeof(PackTexture), sizeof(PackLevel),
+			1, 1,
+		};
+		static_assert(std::size(recordSizes) == static_cast<std::size_t>(PackSection::Count));
+		for (std::size_t i{ 0 }; i < std::size(recordSizes); ++i)
+		{
+			if (m_sections[i].size() % recordSizes[i] != 0)
+			{
+				return false;
+			}
+		}
+
+		for (const PackObject& object : objects())
+		{
+			if (!fits(object.firstMesh, object.meshCount, meshes().size()) ||
+				!fits(object.firstVertex, object.vertexCount, vertices().size()) ||
+				!fits(object.path.offset, object.path.length, strings.size()))
+			{
+				return false;
+			}
+		}
+
+		for (const PackMesh& mesh : meshes())
+		{
+			if (!fits(mesh.firstIndex, mesh.indexCount, indices().size()) ||
+				!fits(mesh.diffusePath.offset, mesh.diffusePath.length, strings.size()) ||
+				(mesh.texture != noPackTexture && mesh.texture >= textures().size()))
+			{
+				return false;
+			}
+		}
+		if (std::any_of(indices().begin(), indices().end(), [&](std::uint32_t index) { return index >= vertices().size(); }))
+		{
+			return false;
+		}
+
+		for (const PackTexture& texture : textures())
+		{
+			if (texture.levelCount == 0 || !fits(texture.firstLevel, texture.levelCount, textureLevels.size()) ||
+				!fits(texture.dataOffset, texture.dataSize, textureData.size()) ||
+				!fits(texture.path.offset, texture.path.length, strings.size()))
+			{
+				return false;
+			}
+
+			for (std::uint32_t i{ 0 }; i < texture.levelCount; ++i)
+			{
+				const PackLevel& level{ textureLevels[texture.firstLevel + i] };
+				if (!fits(level.offset, level.size, texture.dataSize) ||
+					level.size != levelSize(static_cast<VkFormat>(texture.format), level.width, level.height))
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+
+	std::string_view ScenePack::string(PackString string) const
+	{
+		const std::span<const std::byte> strings{ m_sections[static_cast<std::size_t>(PackSection::Strings)] };
+		return { reinterpret_cast<const char*>(strings.data()) + string.offset, string.length };
+	}
+
+	CookedImage ScenePack::texture(std::uint32_t index) const
+	{
+		const PackTexture& texture{ textures()[index] };
+		const std::span<const PackLevel> levels{ section<PackLevel>(PackSection::TextureLevels).subspan(texture.firstLevel, texture.levelCount) };
+		const std::byte* data{ m_sections[static_cast<std::size_t>(PackSection::TextureData)].data() + texture.dataOffset };
+
+		CookedImage image
+		{
+			.format{ static_cast<VkFormat>(texture.format) },
+			.data{ data, data + texture.dataSize },
+			.averageColor{ texture.averageColor[0], texture.averageColor[1], texture.averageColor[2], texture.averageColor[3] },
+			.contentHash{ texture.contentHash },
+		};
+		image.levels.reserve(levels.size());
+		for (const PackLevel& level : levels)
+		{
+			image.levels.push_back(
+			{
+				.width{ level.width },
+				.height{ level.height },
+				.offset{ static_cast<std::size_t>(level.offset) },
+				.size{ static_cast<std::size_t>(level.size) },
+			});
+		}
+
+		return image;
+	}
+
+	std::vector<ObjMesh> ScenePack::object(std::uint32_t index, std::vector<Vertex>& vertices) const
+	{
+		const PackObject& packObject{ objects()[index] };
+		const std::span<const Vertex> packVertices{ this->vertices().subspan(packObject.firstVertex, packObject.vertexCount) };
+
+		// Pack indices point into the pack's vertex section, so they only need moving to where the vertices land
+		const std::uint32_t rebase{ static_cast<std::uint32_t>(vertices.size()) - packObject.firstVertex };
+		vertices.insert(vertices.end(), packVertices.begin(), packVertices.end());
+
+		std::vector<ObjMesh> meshes{};
+		meshes.reserve(packObject.meshCount);
+		for (const PackMesh& packMesh : this->meshes().subspan(packObject.firstMesh, packObject.meshCount))
+		{
+			ObjMesh& mesh{ meshes.emplace_back(ObjMesh{
+				.material{ packMesh.material },
+				.diffusePath{ std::string{ string(packMesh.diffusePath) } },
+				}) };
+
+			const std::span<const std::uint32_t> packIndices{ indices().subspan(packMesh.firstIndex, packMesh.indexCount) };
+			mesh.indices.resize(packIndices.size());
+			std::transform(packIndices.begin(), packIndices.end(), mesh.indices.begin(), [=](std::uint32_t index)
+			{
+				return index + rebase;
+			});
+		}
+		return meshes;
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,185 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "obj_loader.hpp"
+#include "texture_cooker.hpp"
+#include "vertex.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+namespace Graphics
+{
+
+	// The models and textures of a scene, cooked offline by the scene cooker into one file. Each section is an array
+	// of fixed size records in the layout the runtime uses, so loading is mapping the file and copying ranges out of it.
+	// Little endian only, like every target the renderer has.
+
+	// Bump whenever a record below, or Vertex, changes layout or meaning
+	constexpr std::uint32_t scenePackVersion{ 3 };
+	// Sections start on a page, so a mapped section is suitably aligned for any record
+	constexpr std::size_t scenePackAlignment{ 4096 };
+
+	enum class PackSection : std::uint32_t
+	{
+		Vertices,      // Vertex
+		Indices,       // std::uint32_t, into the vertex section
+		Objects,       // PackObject
+		Meshes,        // PackMesh
+		Textures,      // PackTexture
+		TextureLevels, // PackLevel
+		TextureData,   // Bytes, each texture's levels at 16 byte aligned offsets
+		Strings,       // Characters, not terminated
+		Count,
+	};
+
+	struct PackSectionEntry
+	{
+		std::uint32_t type{};
+		std::uint32_t reserved{};
+		std::uint64_t offset{}; // From the start of the file
+		std::uint64_t size{};   // In bytes
+	};
+
+	struct PackHeader
+	{
+		char             identifier[8]{};
+		std::uint32_t    version{};
+		std::uint32_t    sectionCount{};
+		PackSectionEntry sections[static_cast<std::size_t>(PackSection::Count)]{};
+	};
+
+	struct PackString
+	{
+		std::uint32_t offset{}; // Into the string section
+		std::uint32_t length{};
+	};
+
+	struct PackObject
+	{
+		PackString    path{}; // Of the source model, for messages
+		std::uint32_t firstMesh{};
+		std::uint32_t meshCount{};
+		std::uint32_t firstVertex{};
+		std::uint32_t vertexCount{};
+	};
+
+	constexpr std::uint32_t noPackObject{ ~0u };
+
+	struct PackMesh
+	{
+		std::int32_t  material{};
+		std::uint32_t texture{}; // Into the texture section, or noPackTexture
+		std::uint32_t firstIndex{};
+		std::uint32_t indexCount{};
+		PackString    diffusePath{}; // As the model names it, relative to its directory
+	};
+
+	constexpr std::uint32_t noPackTexture{ ~0u };
+
+	struct PackTexture
+	{
+		PackString    path{}; // The path the runtime requests it by
+		std::uint32_t format{}; // VkFormat
+		std::uint32_t firstLevel{}; // Into the level section
+		std::uint32_t levelCount{};
+		std::uint32_t reserved{};
+		float         averageColor[4]{};
+		std::uint64_t contentHash{};
+		std::uint64_t dataOffset{}; // Into the texture data section
+		std::uint64_t dataSize{};
+	};
+
+	struct PackLevel
+	{
+		std::uint32_t width{};
+		std::uint32_t height{};
+		std::uint64_t offset{}; // From the texture's dataOffset
+		std::uint64_t size{};
+	};
+
+	static_assert(std::is_trivially_copyable_v<Vertex> && sizeof(Vertex) == 48);
+	static_assert(sizeof(PackHeader) == 16 + 24 * static_cast<std::size_t>(PackSection::Count));
+	static_assert(sizeof(PackMesh) == 24 && sizeof(PackTexture) == 64 && sizeof(PackLevel) == 24);
+
+	// What the cooker fills in, section by section
+	struct ScenePackContents
+	{
+		std::vector<Vertex>        vertices{};
+		std::vector<std::uint32_t> indices{};
+		std::vector<PackObject>    objects{};
+		std::vector<PackMesh>      meshes{};
+		std::vector<PackTexture>   textures{};
+		std::vector<PackLevel>     textureLevels{};
+		std::vector<std::byte>     textureData{};
+		std::string                strings{};
+
+		PackString addString(std::string_view string);
+		// Returns the index of the texture
+		std::uint32_t addTexture(std::string_view path, const CookedImage& image);
+	};
+
+	bool writeScenePack(const std::string& path, const ScenePackContents& contents);
+
+	// A pack mapped read only. The spans point into the mapping and live as long as the pack.
+	class ScenePack
+	{
+	public:
+		ScenePack() = default;
+		// Empty if the file is missing, from another version or inconsistent
+		explicit ScenePack(const char* path);
+
+		bool empty() const
+		{
+			return m_file.empty();
+		}
+
+		std::span<const Vertex> vertices() const
+		{
+			return section<Vertex>(PackSection::Vertices);
+		}
+		std::span<const std::uint32_t> indices() const
+		{
+			return section<std::uint32_t>(PackSection::Indices);
+		}
+		std::span<const PackObject> objects() const
+		{
+			return section<PackObject>(PackSection::Objects);
+		}
+		std::span<const PackMesh> meshes() const
+		{
+			return section<PackMesh>(PackSection::Meshes);
+		}
+		std::span<const PackTexture> textures() const
+		{
+			return section<PackTexture>(PackSection::Textures);
+		}
+		std::string_view string(PackString string) const;
+
+		// Copies the texture's levels out of the mapping, ready for the upload path. Safe to call from any thread.
+		CookedImage texture(std::uint32_t index) const;
+
+		// Appends the object's vertices to vertices and returns its meshes the way loadObj would, with the indices
+		// moved to where the vertices landed. Safe to call from any thread.
+		std::vector<ObjMesh> object(std::uint32_t index, std::vector<Vertex>& vertices) const;
+
+	private:
+		MappedFile                 m_file{};
+		std::span<const std::byte> m_sections[static_cast<std::size_t>(PackSection::Count)]{};
+
+		template<typename T>
+		std::span<const T> section(PackSection type) const
+		{
+			const std::span<const std::byte> bytes{ m_sections[static_cast<std::size_t>(type)] };
+			return { reinterpret_cast<const T*>(bytes.data()), bytes.size() / sizeof(T) };
+		}
+
+		bool validate() const;
+	};
+
+}
\ No newline at end of file
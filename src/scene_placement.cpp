@@ -0,0 +1,308 @@
+#include "scene_placement.hpp"
+
+#include "mapped_file.hpp"
+#include "mesh.hpp"
+#include "scene_pack.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <numeric>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	constexpr char placementIdentifier[8]{ 'F', 'O', 'R', 'E', 'S', 'T', 'P', 'L' };
+
+	constexpr float quantizedComponentRange{ 0.70710678f }; // The three smallest components of a unit quaternion are within this
+
+	std::size_t alignPlacement(std::size_t value)
+	{
+		return (value + scenePackAlignment - 1) / scenePackAlignment * scenePackAlignment;
+	}
+
+	std::uint32_t encodeRotation(glm::quat rotation)
+	{
+		rotation = glm::normalize(rotation);
+		float components[4]{ rotation.x, rotation.y, rotation.z, rotation.w };
+
+		std::uint32_t largest{ 0 };
+		for (std::uint32_t i{ 1 }; i < 4; ++i)
+		{
+			if (std::abs(components[i]) > std::abs(components[largest]))
+			{
+				largest = i;
+			}
+		}
+		// q and -q are the same rotation, so the dropped component can always be made positive
+		const float sign{ components[largest] < 0.0f ? -1.0f : 1.0f };
+
+		std::uint32_t encoded{ largest << 30 };
+		std::uint32_t shift{ 20 };
+		for (std::uint32_t i{ 0 }; i < 4; ++i)
+		{
+			if (i != largest)
+			{
+				const float normalized{ glm::clamp(components[i] * sign / quantizedComponentRange * 0.5f + 0.5f, 0.0f, 1.0f) };
+				encoded |= static_cast<std::uint32_t>(std::lround(normalized * 1023.0f)) << shift;
+				shift -= 10;
+			}
+		}
+		return encoded;
+	}
+
+	glm::quat decodeRotation(std::uint32_t encoded)
+	{
+		const auto component{ [encoded](std::uint32_t shift)
+		{
+			return (((encoded >> shift) & 1023u) * (2.0f / 1023.0f) - 1.0f) * quantizedComponentRange;
+		} };
+		const float a{ component(20) };
+		const float b{ component(10) };
+		const float c{ component(0) };
+		// Quantization keeps this close enough to unit length that it needs no normalizing
+		const float dropped{ std::sqrt(std::max(1.0f - a * a - b * b - c * c, 0.0f)) };
+
+		switch (encoded >> 30)
+		{
+		case 0:  return glm::quat{ c, dropped, a, b };
+		case 1:  return glm::quat{ c, a, dropped, b };
+		case 2:  return glm::quat{ c, a, b, dropped };
+		default: return glm::quat{ dropped, a, b, c };
+		}
+	}
+
+	std::uint16_t encodeScale(float scale)
+	{
+		const float normalized{ (std::log2(glm::clamp(scale, minPlacementScale, maxPlacementScale)) + placementScaleExponent) / (2.0f * placementScaleExponent) };
+		return static_cast<std::uint16_t>(std::lround(normalized * 65535.0f));
+	}
+
+	float decodeScale(std::uint16_t encoded)
+	{
+		return std::exp2(encoded * (2.0f * placementScaleExponent / 65535.0f) - placementScaleExponent);
+	}
+
+	glm::mat4 placementTransform(const glm::vec3& position, const glm::quat& rotation, float scale)
+	{
+		// translate * rotate * scale, built directly since this runs once per placement
+		const glm::mat3 basis{ glm::mat3_cast(rotation) * scale };
+		return { glm::vec4{ basis[0], 0.0f }, glm::vec4{ basis[1], 0.0f }, glm::vec4{ basis[2], 0.0f }, glm::vec4{ position, 1.0f } };
+	}
+
+	bool writePlacementFile(const std::string& path, const std::vector<std::string>& objects, std::uint32_t skyboxObject, float cellSize,
+		const std::vector<PlacementSource>& placements)
+	{
+		if (objects.size() > 0xFFFF)
+		{
+			std::cerr << "too many objects for a placement file: " << objects.size() << '\n';
+			return false;
+		}
+
+		const auto cellOf{ [cellSize](const glm::vec3& position)
+		{
+			return std::pair{ static_cast<std::int32_t>(std::floor(position.z / cellSize)), static_cast<std::int32_t>(std::floor(position.x / cellSize)) };
+		} };
+
+		// Row by row, so neighbouring cells tend to be near each other in the file too
+		std::vector<std::uint32_t> order(placements.size());
+		std::iota(order.begin(), order.end(), 0u);
+		std::stable_sort(order.begin(), order.end(), [&](std::uint32_t a, std::uint32_t b)
+		{
+			return cellOf(placements[a].position) < cellOf(placements[b].position);
+		});
+
+		std::vector<PlacementCell> cells{};
+		for (std::uint32_t i{ 0 }; i < order.size(); ++i)
+		{
+			const glm::vec3& position{ placements[order[i]].position };
+			const auto [z, x] { cellOf(position) };
+			if (cells.empty() || cells.back().x != x || cells.back().z != z)
+			{
+				cells.push_back({ .x{ x }, .z{ z }, .firstPlacement{ i },
+					.boundsMin{ position.x, position.y, position.z }, .boundsMax{ position.x, position.y, position.z } });
+			}
+
+			PlacementCell& cell{ cells.back() };
+			++cell.placementCount;
+			for (int axis{ 0 }; axis < 3; ++axis)
+			{
+				cell.boundsMin[axis] = std::min(cell.boundsMin[axis], position[axis]);
+				cell.boundsMax[axis] = std::max(cell.boundsMax[axis], position[axis]);
+			}
+		}
+
+		std::vector<Placement> records(order.size());
+		for (const PlacementCell& cell : cells)
+		{
+			for (std::uint32_t i{ cell.firstPlacement }; i < cell.firstPlacement + cell.placementCount; ++i)
+			{
+				const PlacementSource& source{ placements[order[i]] };
+
+				Placement& record{ records[i] };
+				for (int axis{ 0 }; axis < 3; ++axis)
+				{
+					const float extent{ cell.boundsMax[axis] - cell.boundsMin[axis] };
+					const float normalized{ extent > 0.0f ? (source.position[axis] - cell.boundsMin[axis]) / extent : 0.0f };
+					record.position[axis] = static_cast<std::uint16_t>(std::lround(glm::clamp(normalized, 0.0f, 1.0f) * 65535.0f));
+				}
+				record.object = static_cast<std::uint16_t>(source.object);
+				record.rotation = encodeRotation(source.rotation);
+				record.scale = encodeScale(source.scale);
+				record.flags = source.isStatic ? placementStatic : 0u;
+			}
+		}
+
+		std::string strings{};
+		std::vector<PlacementObject> objectRecords{};
+		for (const std::string& object : objects)
+		{
+			objectRecords.push_back({ .path{ static_cast<std::uint32_t>(strings.size()), static_cast<std::uint32_t>(object.size()) } });
+			strings += object;
+		}
+
+		PlacementFileHeader header
+		{
+			.version{ placementFileVersion },
+			.objectCount{ static_cast<std::uint32_t>(objectRecords.size()) },
+			.cellCount{ static_cast<std::uint32_t>(cells.size()) },
+			.placementCount{ static_cast<std::uint32_t>(records.size()) },
+			.skyboxObject{ skyboxObject },
+			.cellSize{ cellSize },
+		};
+		std::memcpy(header.identifier, placementIdentifier, sizeof(placementIdentifier));
+		header.objectsOffset = alignPlacement(sizeof(header));
+		header.cellsOffset = alignPlacement(header.objectsOffset + objectRecords.size() * sizeof(PlacementObject));
+		header.placementsOffset = alignPlacement(header.cellsOffset + cells.size() * sizeof(PlacementCell));
+		header.stringsOffset = alignPlacement(header.placementsOffset + records.size() * sizeof(Placement));
+		header.stringsSize = strings.size();
+
+		std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+		if (!file)
+		{
+			return false;
+		}
+
+		std::size_t written{ 0 };
+		const std::vector<char> padding(scenePackAlignment);
+		const auto writeAt{ [&](std::uint64_t offset, const void* data, std::size_t size)
+		{
+			file.write(padding.data(), offset - written);
+			file.write(static_cast<const char*>(data), size);
+			written = offset + size;
+		} };
+		writeAt(0, &header, sizeof(header));
+		writeAt(header.objectsOffset, objectRecords.data(), objectRecords.size() * sizeof(PlacementObject));
+		writeAt(header.cellsOffset, cells.data(), cells.size() * sizeof(PlacementCell));
+		writeAt(header.placementsOffset, records.data(), records.size() * sizeof(Placement));
+		writeAt(header.stringsOffset, strings.data(), strings.size());
+
+		return static_cast<bool>(file);
+	}
+
+	PlacementFile::PlacementFile(const char* path)
+		: m_file{ path }
+	{
+		if (m_file.empty())
+		{
+			return;
+		}
+
+		PlacementFileHeader header{};
+		if (m_file.size() < sizeof(header))
+		{
+			std::cerr << "not a placement file: " << path << '\n';
+			*this = PlacementFile{};
+			return;
+		}
+		std::memcpy(&header, m_file.data(), sizeof(header));
+
+		if (std::memcmp(header.identifier, placementIdentifier, sizeof(placementIdentifier)) != 0)
+		{
+			std::cerr << "not a placement file: " << path << '\n';
+			*this = PlacementFile{};
+			return;
+		}
+		if (header.version != placementFileVersion)
+		{
+			std::cerr << "placement file " << path << " is version " << header.version << ", expected " << placementFileVersion
+				<< ". Run the scene cooker again\n";
+			*this = PlacementFile{};
+			return;
+		}
+
+		const auto fits{ [&](std::uint64_t offset, std::uint64_t size)
+		{
+			return offset % scenePackAlignment == 0 && offset <= m_file.size() && size <= m_file.size() - offset;
+		} };
+		if (!fits(header.objectsOffset, std::uint64_t{ header.objectCount } * sizeof(PlacementObject)) ||
+			!fits(header.cellsOffset, std::uint64_t{ header.cellCount } * sizeof(PlacementCell)) ||
+			!fits(header.placementsOffset, std::uint64_t{ header.placementCount } * sizeof(Placement)) ||
+			!fits(header.stringsOffset, header.stringsSize))
+		{
+			std::cerr << "truncated placement file: " << path << '\n';
+			*this = PlacementFile{};
+			return;
+		}
+
+		m_objects = { reinterpret_cast<const PlacementObject*>(m_file.data() + header.objectsOffset), header.objectCount };
+		m_cells = { reinterpret_cast<const PlacementCell*>(m_file.data() + header.cellsOffset), header.cellCount };
+		m_placements = { reinterpret_cast<const Placement*>(m_file.data() + header.placementsOffset), header.placementCount };
+		m_strings = { reinterpret_cast<const char*>(m_file.data() + header.stringsOffset), static_cast<std::size_t>(header.stringsSize) };
+		m_skyboxObject = header.skyboxObject;
+		m_cellSize = header.cellSize;
+
+		// Cells have to tile the placements exactly, every object reference has to resolve
+		std::uint64_t nextPlacement{ 0 };
+		bool valid{ m_skyboxObject == noPlacementObject || m_skyboxObject < m_objects.size() };
+		for (const PlacementCell& cell : m_cells)
+		{
+			valid = valid && cell.firstPlacement == nextPlacement;
+			nextPlacement += cell.placementCount;
+		}
+		valid = valid && nextPlacement == m_placements.size();
+		for (const PlacementObject& object : m_objects)
+		{
+			valid = valid && object.path.offset <= m_strings.size() && object.path.length <= m_strings.size() - object.path.offset;
+		}
+		valid = valid && std::all_of(m_placements.begin(), m_placements.end(), [&](const Placement& placement)
+		{
+			return placement.object < m_objects.size();
+		});
+
+		if (!valid)
+		{
+			std::cerr << "inconsistent placement file: " << path << '\n';
+			*this = PlacementFile{};
+		}
+	}
+
+	void PlacementFile::decodeCell(std::uint32_t cellIndex, RenderObjectInstance* instances) const
+	{
+		const PlacementCell& cell{ m_cells[cellIndex] };
+		const glm::vec3 boundsMin{ cell.boundsMin[0], cell.boundsMin[1], cell.boundsMin[2] };
+		const glm::vec3 extent{ glm::vec3{ cell.boundsMax[0], cell.boundsMax[1], cell.boundsMax[2] } - boundsMin };
+
+		for (const Placement& placement : m_placements.subspan(cell.firstPlacement, cell.placementCount))
+		{
+			const glm::vec3 position{ boundsMin + extent * (glm::vec3{ placement.position[0], placement.position[1], placement.position[2] } / 65535.0f) };
+
+			RenderObjectInstance& instance{ *instances++ };
+			instance.renderObject = placement.object;
+			instance.transform = placementTransform(position, decodeRotation(placement.rotation), decodeScale(placement.scale));
+			instance.isStatic = (placement.flags & placementStatic) != 0;
+		}
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,148 @@
+#pragma once
+
+#include "mapped_file.hpp"
+#include "scene_pack.hpp"
+
+#include "glm/glm.hpp"
+#include "glm/gtc/quaternion.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct RenderObjectInstance;
+
+	// Where a scene's instances go, cooked by the scene cooker into a file that is mapped and decoded in one pass.
+	// Placements are grouped by the square cell of the XZ plane they fall in, and each is 16 bytes:
+	// its position quantized to its cell's bounds, its rotation as the smallest three quaternion components
+	// and its uniform scale on a log scale. Models are referred to by path, so the file doesn't depend on
+	// the order anything else loads them in.
+
+	// Bump whenever a record below changes layout or meaning
+	constexpr std::uint32_t placementFileVersion{ 1 };
+
+	struct PlacementFileHeader
+	{
+		char          identifier[8]{};
+		std::uint32_t version{};
+		std::uint32_t objectCount{};
+		std::uint32_t cellCount{};
+		std::uint32_t placementCount{};
+		std::uint32_t skyboxObject{}; // Or noPlacementObject
+		float         cellSize{};
+		// From the start of the file, each on a scenePackAlignment boundary
+		std::uint64_t objectsOffset{};
+		std::uint64_t cellsOffset{};
+		std::uint64_t placementsOffset{};
+		std::uint64_t stringsOffset{};
+		std::uint64_t stringsSize{};
+	};
+
+	constexpr std::uint32_t noPlacementObject{ ~0u };
+
+	struct PlacementObject
+	{
+		PackString path{}; // Of the model
+	};
+
+	struct PlacementCell
+	{
+		std::int32_t  x{}; // In cells
+		std::int32_t  z{};
+		std::uint32_t firstPlacement{};
+		std::uint32_t placementCount{};
+		float         boundsMin[3]{}; // Of the placement positions, which are quantized to them
+		float         boundsMax[3]{};
+	};
+
+	struct Placement
+	{
+		std::uint16_t position[3]{};
+		std::uint16_t object{};
+		std::uint32_t rotation{}; // Index of the dropped component in the top 2 bits, then 3 x 10 bits
+		std::uint16_t scale{};
+		std::uint16_t flags{};
+	};
+
+	constexpr std::uint32_t placementStatic{ 1u << 0 };
+
+	static_assert(sizeof(PlacementFileHeader) == 72 && sizeof(PlacementCell) == 40 && sizeof(Placement) == 16);
+
+	// Scales outside 2^-exponent .. 2^exponent are clamped
+	constexpr float placementScaleExponent{ 8.0f };
+	constexpr float minPlacementScale{ 1.0f / 256.0f };
+	constexpr float maxPlacementScale{ 256.0f };
+
+	glm::mat4 placementTransform(const glm::vec3& position, const glm::quat& rotation, float scale);
+
+	// What the cooker writes, before quantization and grouping
+	struct PlacementSource
+	{
+		std::uint32_t object{};
+		bool          isStatic{};
+		glm::vec3     position{};
+		glm::quat     rotation{ 1.0f, 0.0f, 0.0f, 0.0f };
+		float         scale{ 1.0f };
+	};
+
+	bool writePlacementFile(const std::string& path, const std::vector<std::string>& objects, std::uint32_t skyboxObject, float cellSize,
+		const std::vector<PlacementSource>& placements);
+
+	// A placement file mapped read only
+	class PlacementFile
+	{
+	public:
+		PlacementFile() = default;
+		// Empty if the file is missing, from another version or inconsistent
+		explicit PlacementFile(const char* path);
+
+		bool empty() const
+		{
+			return m_file.empty();
+		}
+
+		std::span<const PlacementObject> objects() const
+		{
+			return m_objects;
+		}
+		std::span<const PlacementCell> cells() const
+		{
+			return m_cells;
+		}
+		std::span<const Placement> placements() const
+		{
+			return m_placements;
+		}
+		std::string_view string(PackString string) const
+		{
+			return m_strings.substr(string.offset, string.length);
+		}
+		std::uint32_t skyboxObject() const
+		{
+			return m_skyboxObject;
+		}
+		float cellSize() const
+		{
+			return m_cellSize;
+		}
+
+		// Writes one instance per placement of the cell, with render object set to the placement's object index
+		void decodeCell(std::uint32_t cell, RenderObjectInstance* instances) const;
+
+	private:
+		MappedFile                       m_file{};
+		std::span<const PlacementObject> m_objects{};
+		std::span<const PlacementCell>   m_cells{};
+		std::span<const Placement>       m_placements{};
+		std::string_view                 m_strings{};
+		std::uint32_t                    m_skyboxObject{ noPlacementObject };
+		float                            m_cellSize{};
+	};
+
+}
\ No newline at end of file
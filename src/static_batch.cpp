@@ -0,0 +1,263 @@
+#include "static_batch.hpp"
+
+#include "alloc.hpp"
+#include "mesh.hpp"
+#include "meshlet.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct ChunkBuild
+	{
+		glm::vec3                  boundsMin{ std::numeric_limits<float>::max() };
+		glm::vec3                  boundsMax{ std::numeric_limits<float>::lowest() };
+		std::vector<std::uint32_t> indices{};
+	};
+
+	StaticBatchBuild buildStaticBatch(const StaticBatchSettings& settings, const std::vector<RenderObject>& renderObjects,
+		const std::vector<RenderObjectInstance>& instances, std::vector<Vertex>& vertices)
+	{
+		StaticBatchBuild batch{};
+
+		std::vector<std::uint32_t> references(renderObjects.size(), 0u);
+		for (const auto& instance : instances)
+		{
+			++references[instance.renderObject];
+		}
+
+		// Keyed on the grid cell in xyz and the material in w
+		std::unordered_map<glm::ivec4, ChunkBuild> builds{};
+
+		for (const auto& instance : instances)
+		{
+			if (!instance.isStatic)
+			{
+				continue;
+			}
+
+			const RenderObject& renderObject{ renderObjects[instance.renderObject] };
+			const glm::mat3 normalTransform{ glm::inverse(glm::transpose(glm::mat3{ instance.transform })) };
+
+			auto transformVertex = [&](Vertex vertex)
+			{
+				vertex.pos  = instance.transform * glm::vec4{ vertex.pos, 1.0f };
+				vertex.norm = glm::normalize(normalTransform * vertex.norm);
+				return vertex;
+			};
+
+			// Offset from the object's original vertices to the ones in world space
+			std::uint32_t vertexOffset{ 0 };
+			if (references[instance.renderObject] == 1)
+			{
+				for (std::uint32_t v{ renderObject.firstVertex }; v < renderObject.firstVertex + renderObject.vertexCount; ++v)
+				{
+					vertices[v] = transformVertex(vertices[v]);
+				}
+			}
+			else
+			{
+				vertexOffset = static_cast<std::uint32_t>(vertices.size()) - renderObject.firstVertex;
+				vertices.reserve(vertices.size() + renderObject.vertexCount);
+				for (std::uint32_t v{ renderObject.firstVertex }; v < renderObject.firstVertex + renderObject.vertexCount; ++v)
+				{
+					vertices.push_back(transformVertex(vertices[v]));
+				}
+			}
+
+			for (const auto& mesh : renderObject.meshes)
+			{
+				if (!mesh.draw)
+				{
+					continue;
+				}
+
+				const int material{ static_cast<int>(mesh.textureIndex * 2 + (mesh.opaque ? 1 : 0)) };
+
+				for (std::size_t t{ 0 }; t + 2 < mesh.indices.size(); t += 3)
+				{
+					const std::uint32_t triangle[3]
+					{
+						mesh.indices[t + 0] + vertexOffset,
+						mesh.indices[t + 1] + vertexOffset,
+						mesh.indices[t + 2] + vertexOffset,
+					};
+
+					const glm::vec3 centroid{ (vertices[triangle[0]].pos + vertices[triangle[1]].pos + vertices[triangle[2]].pos) / 3.0f };
+					ChunkBuild& build{ builds[glm::ivec4{ glm::ivec3{ glm::floor(centroid / settings.chunkSize) }, material }] };
+
+					for (std::uint32_t index : triangle)
+					{
+						build.boundsMin = glm::min(build.boundsMin, vertices[index].pos);
+						build.boundsMax = glm::max(build.boundsMax, vertices[index].pos);
+						build.indices.push_back(index);
+					}
+				}
+			}
+		}
+
+		if (builds.empty())
+		{
+			return batch;
+		}
+
+		// Chunks sharing a material are kept next to each other so their draws share push constants
+		std::vector<std::pair<glm::ivec4, ChunkBuild*>> sorted{};
+		sorted.reserve(builds.size());
+		for (auto& [key, build] : builds)
+		{
+			sorted.push_back({ key, &build });
+		}
+		std::sort(sorted.begin(), sorted.end(), [](const auto& a, const auto& b) { return a.first.w < b.first.w; });
+
+		std::vector<std::uint32_t>& indices{ batch.indices };
+		std::vector<StaticBatchCluster>& clusters{ batch.clusters };
+		for (const auto& [key, build] : sorted)
+		{
+			const bool opaque{ (key.w % 2) == 1 };
+			const std::uint32_t chunk{ static_cast<std::uint32_t>(batch.chunks.size()) };
+			const std::uint32_t firstIndex{ static_cast<std::uint32_t>(indices.size()) };
+			const std::uint32_t firstCluster{ static_cast<std::uint32_t>(clusters.size()) };
+
+			MeshletSettings clusterSettings{ settings.clusters };
+			clusterSettings.coneCulling = clusterSettings.coneCulling && opaque;
+
+			// Triangles come in the order of the vertex cache optimized meshes they were taken from
+			for (const auto& meshlet : buildMeshlets(build->indices, vertices, clusterSettings))
+			{
+				clusters.push_back({
+					.center{ meshlet.center },
+					.radius{ meshlet.radius },
+					.coneAxis{ meshlet.coneAxis },
+					.coneCos{ meshlet.coneCos },
+					.firstIndex{ firstIndex + meshlet.firstIndex },
+					.indexCount{ meshlet.indexCount },
+					.chunk{ chunk },
+					.chunkFirstCluster{ firstCluster },
+					});
+				batch.coneClusterCount += meshlet.coneCos > 0.0f ? 1 : 0;
+			}
+
+			batch.chunks.push_back({
+				.boundsMin{ build->boundsMin },
+				.boundsMax{ build->boundsMax },
+				.firstIndex{ firstIndex },
+				.indexCount{ static_cast<std::uint32_t>(build->indices.size()) },
+				.firstCluster{ firstCluster },
+				.clusterCount{ static_cast<std::uint32_t>(clusters.size()) - firstCluster },
+				.textureIndex{ static_cast<std::uint32_t>(key.w / 2) },
+				.opaque{ opaque },
+				});
+
+			indices.insert(indices.end(), build->indices.begin(), build->indices.end());
+			build->indices = {};
+		}
+
+		return batch;
+	}
+
+	StaticBatch::StaticBatch(StaticBatchBuild&& build, GeometryArena& geometry, UploadManager& uploader, VmaAllocator allocator)
+		: m_chunks{ std::move(build.chunks) },
+		  m_clusterCount{ static_cast<std::uint32_t>(build.clusters.size()) },
+		  m_coneClusterCount{ build.coneClusterCount },
+		  m_geometry{ &geometry },
+		  m_allocator{ allocator }
+	{
+		if (m_chunks.empty())
+		{
+			return;
+		}
+
+		m_indexRange = geometry.allocateIndices(build.indices);
+		for (auto& chunk : m_chunks)
+		{
+			chunk.firstIndex += m_indexRange.first;
+		}
+		for (auto& cluster : build.clusters)
+		{
+			cluster.firstIndex += m_indexRange.first;
+		}
+
+		const VkDeviceSize clusterBufferSize{ build.clusters.size() * sizeof(StaticBatchCluster) };
+		VkBufferCreateInfo clusterBufferCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ clusterBufferSize },
+			.usage{ VK_BUFFER_USAGE_STORAGE_BUFFER_BIT },
+		};
+		m_clusterBuffer = uploader.createBuffer(clusterBufferCI);
+
+		const BufferWrite write{ uploader.beginBufferWrite(m_clusterBuffer, 0, clusterBufferSize) };
+		std::memcpy(write.data, build.clusters.data(), clusterBufferSize);
+		uploader.endBufferWrite(write);
+	}
+
+	StaticBatch::StaticBatch(StaticBatch&& b) noexcept
+	{
+		move(std::move(b));
+	}
+
+	StaticBatch& StaticBatch::operator=(StaticBatch&& b) noexcept
+	{
+		destroy();
+		move(std::move(b));
+		return *this;
+	}
+
+	StaticBatch::~StaticBatch()
+	{
+		destroy();
+	}
+
+	void StaticBatch::printStatistics() const
+	{
+		std::uint32_t triangleCount{ 0 };
+		for (const auto& chunk : m_chunks)
+		{
+			triangleCount += chunk.indexCount / 3;
+		}
+
+		std::cout << "static batch: " << m_chunks.size() << " chunks, " << m_clusterCount << " clusters of "
+			<< (m_clusterCount > 0 ? static_cast<float>(triangleCount) / m_clusterCount : 0.0f) << " triangles on average, "
+			<< m_coneClusterCount << " of them with a normal cone\n";
+	}
+
+	void StaticBatch::move(StaticBatch&& b)
+	{
+		m_chunks = std::move(b.m_chunks);
+
+		m_indexRange = b.m_indexRange;
+
+		m_clusterBuffer = b.m_clusterBuffer;
+		m_clusterCount = b.m_clusterCount;
+		m_coneClusterCount = b.m_coneClusterCount;
+
+		m_geometry = b.m_geometry;
+		b.m_geometry = {};
+		m_allocator = b.m_allocator;
+	}
+
+	void StaticBatch::destroy()
+	{
+		if (m_geometry != nullptr)
+		{
+			m_geometry->free(m_indexRange);
+			vmaDestroyBuffer(m_allocator, m_clusterBuffer.buffer, m_clusterBuffer.alloc);
+		}
+	}
+
+}
\ No newline at end of file
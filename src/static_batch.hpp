@@ -0,0 +1,121 @@
+#pragma once
+
+#include "alloc.hpp"
+#include "geometry_arena.hpp"
+#include "mesh.hpp"
+#include "meshlet.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <cstdint>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct StaticBatchSettings
+	{
+		// Width of the grid cells triangles are batched by.
+		// Smaller chunks cull more precisely, larger chunks mean fewer draws.
+		float chunkSize{ 250.0f };
+		// Chunks are split into clusters that are culled one by one on the GPU. Cone culling stays off while the
+		// graphics pipeline rasterizes back faces, and cutout chunks never cull by cone, since foliage is seen from both sides.
+		MeshletSettings clusters{ .coneCulling{ false } };
+	};
+
+	// World space triangles of one material that fall into one grid cell
+	struct StaticBatchChunk
+	{
+		glm::vec3     boundsMin{};
+		glm::vec3     boundsMax{};
+		std::uint32_t firstIndex{};
+		std::uint32_t indexCount{};
+		std::uint32_t firstCluster{};
+		std::uint32_t clusterCount{};
+		std::uint32_t textureIndex{};
+		bool          opaque{ true };
+	};
+
+	// Must match Cluster in cluster_cull.comp
+	struct StaticBatchCluster
+	{
+		glm::vec3     center{};
+		float         radius{};
+		glm::vec3     coneAxis{};
+		float         coneCos{};
+		std::uint32_t firstIndex{};
+		std::uint32_t indexCount{};
+		std::uint32_t chunk{};
+		std::uint32_t chunkFirstCluster{};
+	};
+
+	// The CPU side of a static batch, built on any thread and uploaded by StaticBatch's constructor.
+	// First indices count from the start of indices.
+	struct StaticBatchBuild
+	{
+		std::vector<StaticBatchChunk>   chunks{};
+		std::vector<StaticBatchCluster> clusters{};
+		std::vector<std::uint32_t>      indices{};
+		std::uint32_t                   coneClusterCount{};
+	};
+
+	// Bakes every static instance into world space. Needs the meshes' CPU index lists and must run before
+	// the vertex buffer is created. Dynamic instances are only counted: a render object used by a single
+	// instance, and that one static, is transformed in place; otherwise its vertices are copied.
+	StaticBatchBuild buildStaticBatch(const StaticBatchSettings& settings, const std::vector<RenderObject>& renderObjects,
+		const std::vector<RenderObjectInstance>& instances, std::vector<Vertex>& vertices);
+
+	class StaticBatch
+	{
+	public:
+		StaticBatch() = default;
+
+		// Uploads the indices, and the cluster bounds through the uploader
+		StaticBatch(StaticBatchBuild&& build, GeometryArena& geometry, UploadManager& uploader, VmaAllocator allocator);
+
+		StaticBatch(const StaticBatch&) = delete;
+		StaticBatch& operator=(const StaticBatch&) = delete;
+
+		StaticBatch(StaticBatch&& b) noexcept;
+		StaticBatch& operator=(StaticBatch&& b) noexcept;
+
+		~StaticBatch();
+
+		void printStatistics() const;
+
+		const std::vector<StaticBatchChunk>& chunks() const
+		{
+			return m_chunks;
+		}
+
+		// The bounds of every chunk's clusters, in chunk order, as read by cluster_cull.comp
+		VkBuffer clusterBuffer() const
+		{
+			return m_clusterBuffer.buffer;
+		}
+		std::uint32_t clusterCount() const
+		{
+			return m_clusterCount;
+		}
+
+	private:
+		std::vector<StaticBatchChunk> m_chunks{};
+
+		GeometryRange m_indexRange{};
+
+		Buffer        m_clusterBuffer{};
+		std::uint32_t m_clusterCount{};
+		std::uint32_t m_coneClusterCount{};
+
+		// Not owned by the class
+		GeometryArena* m_geometry{};
+		VmaAllocator   m_allocator{};
+
+		void move(StaticBatch&& b);
+		void destroy();
+	};
+
+}
\ No newline at end of file
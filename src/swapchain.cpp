@@ -23,7 +23,7 @@ namespace Graphics
 			.imageColorSpace{ VK_COLOR_SPACE_SRGB_NONLINEAR_KHR  },
 			.imageExtent{ imageExtent },
 			.imageArrayLayers{ 1 },
-			.imageUsage{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT },
+			.imageUsage{ VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT }, // Frames can be captured
 			.imageSharingMode{ VK_SHARING_MODE_EXCLUSIVE },
 			.preTransform{ VK_SURFACE_TRANSFORM_IDENTITY_BIT_KHR },
 			.compositeAlpha{ VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR },
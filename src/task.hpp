@@ -0,0 +1,196 @@
+#pragma once
+
+#include <coroutine>
+#include <exception>
+#include <optional>
+#include <utility>
+
+namespace Graphics
+{
+
+	template<typename T>
+	class Task;
+
+	struct TaskPromiseBase
+	{
+		std::coroutine_handle<> continuation{};
+		std::exception_ptr      exception{};
+
+		std::suspend_always initial_suspend() noexcept
+		{
+			return {};
+		}
+
+		// Hands the thread straight to whoever awaited the task, without growing the stack
+		struct FinalAwaiter
+		{
+			bool await_ready() noexcept
+			{
+				return false;
+			}
+			template<typename Promise>
+			std::coroutine_handle<> await_suspend(std::coroutine_handle<Promise> handle) noexcept
+			{
+				const std::coroutine_handle<> continuation{ handle.promise().continuation };
+				return continuation ? continuation : std::noop_coroutine();
+			}
+			void await_resume() noexcept
+			{
+			}
+		};
+
+		FinalAwaiter final_suspend() noexcept
+		{
+			return {};
+		}
+
+		void unhandled_exception()
+		{
+			exception = std::current_exception();
+		}
+
+		void rethrow() const
+		{
+			if (exception)
+			{
+				std::rethrow_exception(exception);
+			}
+		}
+	};
+
+	template<typename T>
+	struct TaskPromise : TaskPromiseBase
+	{
+		std::optional<T> value{};
+
+		Task<T> get_return_object();
+
+		void return_value(T result)
+		{
+			value.emplace(std::move(result));
+		}
+
+		T result()
+		{
+			rethrow();
+			return std::move(*value);
+		}
+	};
+
+	template<>
+	struct TaskPromise<void> : TaskPromiseBase
+	{
+		Task<void> get_return_object();
+
+		void return_void()
+		{
+		}
+
+		void result()
+		{
+			rethrow();
+		}
+	};
+
+	// A coroutine that starts when it is awaited, or when AssetLoader::start is given it, and resumes its awaiter
+	// on whichever thread it finishes on. Where it runs in between is up to what it awaits.
+	template<typename T = void>
+	class Task
+	{
+	public:
+		using promise_type = TaskPromise<T>;
+
+		Task() = default;
+
+		explicit Task(std::coroutine_handle<promise_type> handle)
+			: m_handle{ handle }
+		{
+		}
+
+		Task(const Task&) = delete;
+		Task& operator=(const Task&) = delete;
+
+		Task(Task&& t) noexcept
+		{
+			move(std::move(t));
+		}
+		Task& operator=(Task&& t) noexcept
+		{
+			destroy();
+			move(std::move(t));
+			return *this;
+		}
+
+		~Task()
+		{
+			destroy();
+		}
+
+		bool done() const
+		{
+			return !m_handle || m_handle.done();
+		}
+
+		// Only valid once done(). Rethrows whatever escaped the coroutine.
+		T result()
+		{
+			return m_handle.promise().result();
+		}
+
+		std::coroutine_handle<> handle() const
+		{
+			return m_handle;
+		}
+
+		auto operator co_await() noexcept
+		{
+			struct Awaiter
+			{
+				std::coroutine_handle<promise_type> handle{};
+
+				bool await_ready() noexcept
+				{
+					return false;
+				}
+				std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiter) noexcept
+				{
+					handle.promise().continuation = awaiter;
+					return handle;
+				}
+				T await_resume()
+				{
+					return handle.promise().result();
+				}
+			};
+			return Awaiter{ m_handle };
+		}
+
+	private:
+		std::coroutine_handle<promise_type> m_handle{};
+
+		void move(Task&& t)
+		{
+			m_handle = std::exchange(t.m_handle, {});
+		}
+
+		void destroy()
+		{
+			if (m_handle)
+			{
+				m_handle.destroy();
+			}
+		}
+	};
+
+	template<typename T>
+	Task<T> TaskPromise<T>::get_return_object()
+	{
+		return Task<T>{ std::coroutine_handle<TaskPromise<T>>::from_promise(*this) };
+	}
+
+	inline Task<void> TaskPromise<void>::get_return_object()
+	{
+		return Task<void>{ std::coroutine_handle<TaskPromise<void>>::from_promise(*this) };
+	}
+
+}
\ No newline at end of file
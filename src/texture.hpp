@@ -1,17 +1,21 @@
 #pragma once
 
 #include "alloc.hpp"
+#include "texture_cooker.hpp"
+#include "upload.hpp"
 
 #include "volk/volk.h"
 #include "vma/vk_mem_alloc.h"
 
+#include <cstdint>
+
 namespace Graphics
 {
 
-	Image loadSkybox(const char** paths, VkDevice device, VmaAllocator allocator,
-		VkQueue queue, VkCommandBuffer commandBuffer, VkFence fence);
+	// Faces in +X, -X, +Y, -Y, +Z, -Z order, all cooked the same way
+	Image loadSkybox(const CookedImage (&faces)[6], UploadManager& uploader, VmaAllocator allocator);
 
-	VkImageView createSkyboxView(VkDevice device, VkImage image);
+	VkImageView createSkyboxView(VkDevice device, VkImage image, VkFormat format, std::uint32_t mipLevels);
 
 	VkSampler createSkyboxSampler(VkDevice device);
 
@@ -0,0 +1,126 @@
+#include "texture_cache.hpp"
+
+#include "mesh.hpp"
+#include "texture_cooker.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <utility>
+
+namespace Graphics
+{
+
+	TextureCache::TextureCache(UploadManager& uploader, VkDevice device, VmaAllocator allocator)
+		: m_samplers{ device },
+		  m_uploader{ &uploader },
+		  m_device{ device },
+		  m_allocator{ allocator }
+	{
+	}
+
+	TextureCache::Request TextureCache::request(const std::string& path)
+	{
+		++m_requests;
+
+		// Different spellings of the same file share one entry
+		std::error_code error{};
+		std::string canonical{ std::filesystem::weakly_canonical(path, error).generic_string() };
+		if (error)
+		{
+			canonical = path;
+		}
+
+		auto found{ m_handleByPath.find(canonical) };
+		if (found != m_handleByPath.end())
+		{
+			++m_sharedByPath;
+			return { .handle{ found->second }, .load{ false } };
+		}
+
+		if (m_handles.size() >= maxTextures)
+		{
+			std::cerr << "texture table is full, not loading: " << path << '\n';
+			return {};
+		}
+
+		const std::uint32_t handle{ static_cast<std::uint32_t>(m_handles.size()) };
+		m_handles.push_back({ .path{ canonical }, .source{ path }, .slot{ noTexture } });
+		m_handleByPath.emplace(canonical, handle);
+
+		return { .handle{ handle }, .load{ true } };
+	}
+
+	void TextureCache::add(std::uint32_t handle, const CookedImage& image, std::uint32_t firstLevel)
+	{
+		if (image.empty())
+		{
+			return;
+		}
+
+		// The hash covers the format too, so the same pixels cooked differently stay apart
+		std::uint32_t slot{};
+		auto found{ m_slotByContent.find(image.contentHash) };
+		if (found != m_slotByContent.end())
+		{
+			++m_sharedByContent;
+			slot = found->second;
+		}
+		else
+		{
+			slot = static_cast<std::uint32_t>(m_textures.size());
+			m_textures.emplace_back();
+			m_slots.emplace_back();
+
+			firstLevel = std::min(firstLevel, static_cast<std::uint32_t>(image.levels.size()) - 1);
+			m_textures[slot].emplace(image, *m_uploader, m_samplers, m_device, m_allocator, firstLevel);
+			m_slots[slot] = { .contentHash{ image.contentHash } };
+
+			Residency& residency{ m_slots[slot].residency };
+			residency.source = m_handles[handle].source;
+			residency.firstLevel = firstLevel;
+			for (const CookedLevel& level : image.levels)
+			{
+				residency.levelSizes.push_back(level.size);
+			}
+			m_slotByContent.emplace(image.contentHash, slot);
+		}
+
+		m_handles[handle].slot = slot;
+	}
+
+	std::uint32_t TextureCache::slot(std::uint32_t handle) const
+	{
+		return handle < m_handles.size() ? m_handles[handle].slot : noTexture;
+	}
+
+	Texture TextureCache::replace(std::uint32_t slot, Texture&& texture, std::uint32_t firstLevel)
+	{
+		Texture previous{ std::move(*m_textures[slot]) };
+		m_textures[slot] = std::move(texture);
+		m_slots[slot].residency.firstLevel = firstLevel;
+		return previous;
+	}
+
+	void TextureCache::printStatistics() const
+	{
+		std::size_t loaded{ 0 };
+		for (const auto& texture : m_textures)
+		{
+			loaded += texture.has_value();
+		}
+
+		std::cout << "textures: " << m_requests << " requested, " << loaded << " loaded, "
+			<< m_sharedByPath << " shared by path, " << m_sharedByContent << " shared by content, "
+			<< m_samplers.size() << " samplers\n";
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,133 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "sampler_cache.hpp"
+#include "texture_cooker.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Owns every material texture and decides which slot of the bindless texture table each one lives in.
+	// Textures are shared by canonical path before decoding and by content hash after it. Nothing evicts a
+	// texture, they all live as long as the cache, which goes with the scene once no frame is in flight.
+	//
+	// Meshes get a handle from request() while loading and swap it for slot() once add() has been called.
+	class TextureCache
+	{
+	public:
+		// Slot 1000 of the table holds the shadow map, and index 1001 means untextured
+		static constexpr std::uint32_t maxTextures{ 1000 };
+		static constexpr std::uint32_t noTexture{ 1001 };
+
+		struct Request
+		{
+			std::uint32_t handle{ noTexture };
+			bool          load{ false }; // The caller decodes the image and passes it to add()
+		};
+
+		TextureCache() = default;
+
+		// The uploader must outlive the cache
+		TextureCache(UploadManager& uploader, VkDevice device, VmaAllocator allocator);
+
+		TextureCache(const TextureCache&) = delete;
+		TextureCache& operator=(const TextureCache&) = delete;
+
+		TextureCache(TextureCache&&) noexcept = default;
+		TextureCache& operator=(TextureCache&&) noexcept = default;
+
+		// Handles never reach noTexture, and once maxTextures are live further paths get noTexture
+		Request request(const std::string& path);
+
+		// Uploads the levels of the image from firstLevel down, unless a texture with the same contents and format
+		// is already loaded
+		void add(std::uint32_t handle, const CookedImage& image, std::uint32_t firstLevel = 0);
+
+		// Slot in the bindless table, or noTexture if the image could not be loaded
+		std::uint32_t slot(std::uint32_t handle) const;
+
+		// The path the handle was requested with
+		const std::string& source(std::uint32_t handle) const
+		{
+			return m_handles[handle].source;
+		}
+
+		// Slots in use are the ones that hold a value
+		const std::vector<std::optional<Texture>>& textures() const
+		{
+			return m_textures;
+		}
+
+		const Texture& operator[](std::uint32_t slot) const
+		{
+			return *m_textures[slot];
+		}
+
+		// Which levels of a slot's image are resident, for streaming
+		struct Residency
+		{
+			std::string              source{};     // Path the image was loaded from
+			std::vector<std::size_t> levelSizes{}; // Bytes of every level of the full chain, largest first
+			std::uint32_t            firstLevel{}; // Largest resident level
+		};
+
+		const Residency& residency(std::uint32_t slot) const
+		{
+			return m_slots[slot].residency;
+		}
+
+		// Swaps in a texture holding the levels from firstLevel down and hands back the old one. The caller keeps
+		// it alive until no frame in flight samples it, and rewrites the slot's descriptor.
+		Texture replace(std::uint32_t slot, Texture&& texture, std::uint32_t firstLevel);
+
+		SamplerCache& samplers()
+		{
+			return m_samplers;
+		}
+
+		void printStatistics() const;
+
+	private:
+		struct Handle
+		{
+			std::string   path{}; // Canonical
+			std::string   source{};
+			std::uint32_t slot{ noTexture };
+		};
+
+		struct Slot
+		{
+			std::uint64_t contentHash{};
+			Residency     residency{};
+		};
+
+		SamplerCache                        m_samplers{};
+		std::vector<std::optional<Texture>> m_textures{};
+		std::vector<Slot>                   m_slots{};
+
+		std::vector<Handle>                              m_handles{};
+		std::unordered_map<std::string, std::uint32_t>   m_handleByPath{};
+		std::unordered_map<std::uint64_t, std::uint32_t> m_slotByContent{};
+
+		std::size_t m_requests{};
+		std::size_t m_sharedByPath{};
+		std::size_t m_sharedByContent{};
+
+		// Not owned by the class
+		UploadManager* m_uploader{};
+		VkDevice       m_device{};
+		VmaAllocator   m_allocator{};
+	};
+
+}
\ No newline at end of file
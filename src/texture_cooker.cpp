@@ -0,0 +1,851 @@
+#include "texture_cooker.hpp"
+
+#include "image.hpp"
+
+#include "volk/volk.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cfloat>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <iostream>
+#include <string>
+#include <system_error>
+#include <vector>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define FOREST_SSE2 1
+#endif
+
+namespace Graphics
+{
+
+	constexpr std::uint8_t ktx2Identifier[12]{ 0xAB, 'K', 'T', 'X', ' ', '2', '0', 0xBB, '\r', '\n', 0x1A, '\n' };
+	// Renamed whenever the meaning of the average color changes, so files cooked before are cooked again
+	constexpr char averageColorKey[]{ "FSlinearAverageColor" };
+
+	// Level data is aligned to the largest block size, which also satisfies bufferOffset rules when uploading
+	constexpr std::size_t levelAlignment{ 16 };
+
+	std::size_t alignUp(std::size_t value, std::size_t alignment)
+	{
+		return (value + alignment - 1) / alignment * alignment;
+	}
+
+	bool isBlockCompressed(VkFormat format)
+	{
+		return format >= VK_FORMAT_BC1_RGB_UNORM_BLOCK && format <= VK_FORMAT_BC7_SRGB_BLOCK;
+	}
+
+	std::size_t formatBlockSize(VkFormat format)
+	{
+		switch (format)
+		{
+		case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+		case VK_FORMAT_BC1_RGBA_UNORM_BLOCK:
+		case VK_FORMAT_BC1_RGBA_SRGB_BLOCK:
+		case VK_FORMAT_BC4_UNORM_BLOCK:
+		case VK_FORMAT_BC4_SNORM_BLOCK:
+			return 8;
+		default:
+			return isBlockCompressed(format) ? 16 : 4;
+		}
+	}
+
+	std::size_t levelSize(VkFormat format, std::uint32_t width, std::uint32_t height)
+	{
+		if (isBlockCompressed(format))
+		{
+			return static_cast<std::size_t>((width + 3) / 4) * ((height + 3) / 4) * formatBlockSize(format);
+		}
+		return static_cast<std::size_t>(width) * height * formatBlockSize(format);
+	}
+
+	VkFormat cookedFormat(TextureUsage usage, bool compress)
+	{
+		switch (usage)
+		{
+		case TextureUsage::AlphaCutout:
+			return compress ? VK_FORMAT_BC3_SRGB_BLOCK : VK_FORMAT_R8G8B8A8_SRGB;
+		case TextureUsage::Normal:
+			return compress ? VK_FORMAT_BC5_UNORM_BLOCK : VK_FORMAT_R8G8B8A8_UNORM;
+		default:
+			return compress ? VK_FORMAT_BC1_RGB_SRGB_BLOCK : VK_FORMAT_R8G8B8A8_SRGB;
+		}
+	}
+
+	std::uint8_t toUnorm8(float value)
+	{
+		return static_cast<std::uint8_t>(std::clamp(value, 0.0f, 1.0f) * 255.0f + 0.5f);
+	}
+
+	std::uint64_t hashLevels(const CookedImage& image)
+	{
+		// FNV-1a
+		std::uint64_t hash{ 14695981039346656037ull ^ static_cast<std::uint64_t>(image.format) };
+		for (const CookedLevel& level : image.levels)
+		{
+			const auto* bytes{ reinterpret_cast<const std::uint8_t*>(image.data.data() + level.offset) };
+			for (std::size_t i{ 0 }; i < level.size; ++i)
+			{
+				hash = (hash ^ bytes[i]) * 1099511628211ull;
+			}
+		}
+		return hash;
+	}
+
+	// ---- Mip generation, done on linear values ----
+
+	struct FloatImage
+	{
+		std::uint32_t          width{};
+		std::uint32_t          height{};
+		std::vector<glm::vec4> pixels{};
+
+		const glm::vec4& at(std::uint32_t x, std::uint32_t y) const
+		{
+			return pixels[static_cast<std::size_t>(std::min(y, height - 1)) * width + std::min(x, width - 1)];
+		}
+	};
+
+	FloatImage toFloatImage(const DecodedImage& image, TextureUsage usage)
+	{
+		FloatImage result{ static_cast<std::uint32_t>(image.width), static_cast<std::uint32_t>(image.height) };
+		result.pixels.resize(static_cast<std::size_t>(image.width) * image.height);
+
+		std::array<float, 256> srgbTable{};
+		for (int i{ 0 }; i < 256; ++i)
+		{
+			srgbTable[i] = decodeSrgb(i / 255.0f);
+		}
+
+		const std::uint8_t* data{ image.pixels.get() };
+		for (std::size_t i{ 0 }; i < result.pixels.size(); ++i)
+		{
+			const std::uint8_t* p{ data + i * 4 };
+			if (usage == TextureUsage::Normal)
+			{
+				result.pixels[i] = glm::vec4{ glm::vec3{ p[0], p[1], p[2] } / 127.5f - 1.0f, 1.0f };
+			}
+			else
+			{
+				result.pixels[i] = glm::vec4{ srgbTable[p[0]], srgbTable[p[1]], srgbTable[p[2]], p[3] / 255.0f };
+			}
+		}
+
+		return result;
+	}
+
+	FloatImage downsample(const FloatImage& source, TextureUsage usage)
+	{
+		FloatImage result{ std::max(source.width / 2, 1u), std::max(source.height / 2, 1u) };
+		result.pixels.resize(static_cast<std::size_t>(result.width) * result.height);
+
+		for (std::uint32_t y{ 0 }; y < result.height; ++y)
+		{
+			for (std::uint32_t x{ 0 }; x < result.width; ++x)
+			{
+				const glm::vec4 a{ source.at(x * 2, y * 2) };
+				const glm::vec4 b{ source.at(x * 2 + 1, y * 2) };
+				const glm::vec4 c{ source.at(x * 2, y * 2 + 1) };
+				const glm::vec4 d{ source.at(x * 2 + 1, y * 2 + 1) };
+
+				glm::vec4 pixel{};
+				if (usage == TextureUsage::Normal)
+				{
+					const glm::vec3 sum{ glm::vec3{ a } + glm::vec3{ b } + glm::vec3{ c } + glm::vec3{ d } };
+					pixel = glm::vec4{ glm::length(sum) > 0.0f ? glm::normalize(sum) : glm::vec3{ 0.0f, 0.0f, 1.0f }, 1.0f };
+				}
+				else
+				{
+					// Weighted by alpha so transparent texels don't bleed their color into the edges
+					const float alpha{ a.a + b.a + c.a + d.a };
+					const glm::vec3 color{ glm::vec3{ a } * a.a + glm::vec3{ b } * b.a + glm::vec3{ c } * c.a + glm::vec3{ d } * d.a };
+					pixel = alpha > 0.0f
+						? glm::vec4{ color / alpha, alpha * 0.25f }
+						: glm::vec4{ (glm::vec3{ a } + glm::vec3{ b } + glm::vec3{ c } + glm::vec3{ d }) * 0.25f, 0.0f };
+				}
+				result.pixels[static_cast<std::size_t>(y) * result.width + x] = pixel;
+			}
+		}
+
+		return result;
+	}
+
+	float alphaCoverage(const FloatImage& image, float cutoff, float scale)
+	{
+		std::size_t covered{ 0 };
+		for (const glm::vec4& pixel : image.pixels)
+		{
+			covered += pixel.a * scale > cutoff;
+		}
+		return static_cast<float>(covered) / image.pixels.size();
+	}
+
+	// Averaging thins out alpha tested foliage in the smaller mips. Scaling alpha so the same share of
+	// texels passes the test as in the top level keeps it from vanishing in the distance.
+	void preserveAlphaCoverage(FloatImage& image, float cutoff, float targetCoverage)
+	{
+		float low{ 0.0f };
+		float high{ 8.0f };
+		for (int i{ 0 }; i < 12; ++i)
+		{
+			const float middle{ (low + high) * 0.5f };
+			(alphaCoverage(image, cutoff, middle) < targetCoverage ? low : high) = middle;
+		}
+
+		const float scale{ (low + high) * 0.5f };
+		for (glm::vec4& pixel : image.pixels)
+		{
+			pixel.a = std::min(pixel.a * scale, 1.0f);
+		}
+	}
+
+	std::vector<std::uint8_t> toRgba8(const FloatImage& image, TextureUsage usage)
+	{
+		std::vector<std::uint8_t> result(image.pixels.size() * 4);
+		for (std::size_t i{ 0 }; i < image.pixels.size(); ++i)
+		{
+			const glm::vec4& p{ image.pixels[i] };
+			std::uint8_t* out{ result.data() + i * 4 };
+			if (usage == TextureUsage::Normal)
+			{
+				out[0] = toUnorm8(p.x * 0.5f + 0.5f);
+				out[1] = toUnorm8(p.y * 0.5f + 0.5f);
+				out[2] = toUnorm8(p.z * 0.5f + 0.5f);
+				out[3] = 255;
+			}
+			else
+			{
+				out[0] = toUnorm8(encodeSrgb(p.r));
+				out[1] = toUnorm8(encodeSrgb(p.g));
+				out[2] = toUnorm8(encodeSrgb(p.b));
+				out[3] = toUnorm8(p.a);
+			}
+		}
+		return result;
+	}
+
+	// ---- Block compression ----
+
+	// One 4x4 block, split into channels so four texels can be compared at once
+	struct BlockTexels
+	{
+		alignas(16) float r[16];
+		alignas(16) float g[16];
+		alignas(16) float b[16];
+		std::uint8_t      channels[4][16];
+	};
+
+	BlockTexels loadBlock(const std::uint8_t* rgba, std::uint32_t width, std::uint32_t height, std::uint32_t blockX, std::uint32_t blockY)
+	{
+		BlockTexels block{};
+		for (std::uint32_t i{ 0 }; i < 16; ++i)
+		{
+			// Edge blocks repeat the last row and column
+			const std::uint32_t x{ std::min(blockX * 4 + i % 4, width - 1) };
+			const std::uint32_t y{ std::min(blockY * 4 + i / 4, height - 1) };
+			const std::uint8_t* texel{ rgba + (static_cast<std::size_t>(y) * width + x) * 4 };
+
+			block.r[i] = texel[0];
+			block.g[i] = texel[1];
+			block.b[i] = texel[2];
+			for (int c{ 0 }; c < 4; ++c)
+			{
+				block.channels[c][i] = texel[c];
+			}
+		}
+		return block;
+	}
+
+	std::uint16_t packRgb565(const glm::vec3& color)
+	{
+		const int r{ std::clamp(static_cast<int>(color.r * (31.0f / 255.0f) + 0.5f), 0, 31) };
+		const int g{ std::clamp(static_cast<int>(color.g * (63.0f / 255.0f) + 0.5f), 0, 63) };
+		const int b{ std::clamp(static_cast<int>(color.b * (31.0f / 255.0f) + 0.5f), 0, 31) };
+		return static_cast<std::uint16_t>((r << 11) | (g << 5) | b);
+	}
+
+	glm::vec3 unpackRgb565(std::uint16_t packed)
+	{
+		const int r{ (packed >> 11) & 31 };
+		const int g{ (packed >> 5) & 63 };
+		const int b{ packed & 31 };
+		return glm::vec3{ (r << 3) | (r >> 2), (g << 2) | (g >> 4), (b << 3) | (b >> 2) };
+	}
+
+	// Finds the closest of the four palette entries for every texel and returns the summed squared error
+	float selectColorIndices(const BlockTexels& block, const glm::vec3 (&palette)[4], std::uint32_t& indices)
+	{
+		indices = 0;
+		float error{ 0.0f };
+
+#ifdef FOREST_SSE2
+		for (int i{ 0 }; i < 16; i += 4)
+		{
+			const __m128 r{ _mm_load_ps(block.r + i) };
+			const __m128 g{ _mm_load_ps(block.g + i) };
+			const __m128 b{ _mm_load_ps(block.b + i) };
+
+			__m128 best{ _mm_set1_ps(FLT_MAX) };
+			__m128i bestIndex{ _mm_setzero_si128() };
+			for (int p{ 0 }; p < 4; ++p)
+			{
+				const __m128 dr{ _mm_sub_ps(r, _mm_set1_ps(palette[p].r)) };
+				const __m128 dg{ _mm_sub_ps(g, _mm_set1_ps(palette[p].g)) };
+				const __m128 db{ _mm_sub_ps(b, _mm_set1_ps(palette[p].b)) };
+				const __m128 distance{ _mm_add_ps(_mm_add_ps(_mm_mul_ps(dr, dr), _mm_mul_ps(dg, dg)), _mm_mul_ps(db, db)) };
+
+				const __m128i closer{ _mm_castps_si128(_mm_cmplt_ps(distance, best)) };
+				best = _mm_min_ps(distance, best);
+				bestIndex = _mm_or_si128(_mm_andnot_si128(closer, bestIndex), _mm_and_si128(closer, _mm_set1_epi32(p)));
+			}
+
+			alignas(16) std::int32_t texelIndices[4];
+			alignas(16) float texelErrors[4];
+			_mm_store_si128(reinterpret_cast<__m128i*>(texelIndices), bestIndex);
+			_mm_store_ps(texelErrors, best);
+			for (int t{ 0 }; t < 4; ++t)
+			{
+				indices |= static_cast<std::uint32_t>(texelIndices[t]) << ((i + t) * 2);
+				error += texelErrors[t];
+			}
+		}
+#else
+		for (int i{ 0 }; i < 16; ++i)
+		{
+			float best{ FLT_MAX };
+			std::uint32_t bestIndex{ 0 };
+			for (std::uint32_t p{ 0 }; p < 4; ++p)
+			{
+				const glm::vec3 difference{ glm::vec3{ block.r[i], block.g[i], block.b[i] } - palette[p] };
+				const float distance{ glm::dot(difference, difference) };
+				if (distance < best)
+				{
+					best = distance;
+					bestIndex = p;
+				}
+			}
+			indices |= bestIndex << (i * 2);
+			error += best;
+		}
+#endif
+
+		return error;
+	}
+
+	struct ColorBlock
+	{
+		std::uint16_t color0{};
+		std::uint16_t color1{};
+		std::uint32_t indices{};
+		float         error{ FLT_MAX };
+	};
+
+	// Always uses the four color mode, which is also the only one BC3 knows
+	ColorBlock fitColorBlock(const BlockTexels& block, glm::vec3 endpoint0, glm::vec3 endpoint1)
+	{
+		ColorBlock result{ packRgb565(endpoint0), packRgb565(endpoint1) };
+		if (result.color0 < result.color1)
+		{
+			std::swap(result.color0, result.color1);
+		}
+
+		const glm::vec3 c0{ unpackRgb565(result.color0) };
+		const glm::vec3 c1{ unpackRgb565(result.color1) };
+		const glm::vec3 palette[4]{ c0, c1, (c0 * 2.0f + c1) / 3.0f, (c0 + c1 * 2.0f) / 3.0f };
+		result.error = selectColorIndices(block, palette, result.indices);
+
+		// Equal endpoints would switch BC1 into its three color mode, where index 3 means transparent
+		if (result.color0 == result.color1)
+		{
+			result.indices = 0;
+		}
+
+		return result;
+	}
+
+	void encodeColorBlock(const BlockTexels& block, std::uint8_t* out)
+	{
+		glm::vec3 mean{ 0.0f };
+		for (int i{ 0 }; i < 16; ++i)
+		{
+			mean += glm::vec3{ block.r[i], block.g[i], block.b[i] };
+		}
+		mean /= 16.0f;
+
+		glm::mat3 covariance{ 0.0f };
+		for (int i{ 0 }; i < 16; ++i)
+		{
+			const glm::vec3 d{ glm::vec3{ block.r[i], block.g[i], block.b[i] } - mean };
+			covariance += glm::outerProduct(d, d);
+		}
+
+		// Principal axis by power iteration
+		glm::vec3 axis{ 1.0f, 1.0f, 1.0f };
+		for (int i{ 0 }; i < 8; ++i)
+		{
+			const glm::vec3 next{ covariance * axis };
+			const float length{ glm::length(next) };
+			if (length < 1e-6f)
+			{
+				break;
+			}
+			axis = next / length;
+		}
+		axis = glm::normalize(axis);
+
+		float minProjection{ FLT_MAX };
+		float maxProjection{ -FLT_MAX };
+		for (int i{ 0 }; i < 16; ++i)
+		{
+			const float projection{ glm::dot(glm::vec3{ block.r[i], block.g[i], block.b[i] } - mean, axis) };
+			minProjection = std::min(minProjection, projection);
+			maxProjection = std::max(maxProjection, projection);
+		}
+
+		ColorBlock best{ fitColorBlock(block, mean + axis * maxProjection, mean + axis * minProjection) };
+
+		// One least squares refinement of the endpoints for the indices picked above
+		constexpr float weights[4]{ 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+		float alpha2{ 0.0f };
+		float beta2{ 0.0f };
+		float alphaBeta{ 0.0f };
+		glm::vec3 alphaX{ 0.0f };
+		glm::vec3 betaX{ 0.0f };
+		for (int i{ 0 }; i < 16; ++i)
+		{
+			const float w{ weights[(best.indices >> (i * 2)) & 3] };
+			const glm::vec3 texel{ block.r[i], block.g[i], block.b[i] };
+			alpha2 += w * w;
+			beta2 += (1.0f - w) * (1.0f - w);
+			alphaBeta += w * (1.0f - w);
+			alphaX += texel * w;
+			betaX += texel * (1.0f - w);
+		}
+
+		const float determinant{ alpha2 * beta2 - alphaBeta * alphaBeta };
+		if (std::abs(determinant) > 1e-6f)
+		{
+			const glm::vec3 endpoint0{ glm::clamp((alphaX * beta2 - betaX * alphaBeta) / determinant, 0.0f, 255.0f) };
+			const glm::vec3 endpoint1{ glm::clamp((betaX * alpha2 - alphaX * alphaBeta) / determinant, 0.0f, 255.0f) };
+
+			const ColorBlock refined{ fitColorBlock(block, endpoint0, endpoint1) };
+			if (refined.error < best.error)
+			{
+				best = refined;
+			}
+		}
+
+		std::memcpy(out + 0, &best.color0, 2);
+		std::memcpy(out + 2, &best.color1, 2);
+		std::memcpy(out + 4, &best.indices, 4);
+	}
+
+	// BC4 layout, also used for BC3 alpha and both BC5 channels
+	void encodeChannelBlock(const std::uint8_t (&values)[16], std::uint8_t* out)
+	{
+		const auto [minValue, maxValue] { std::minmax_element(std::begin(values), std::end(values)) };
+
+		out[0] = *maxValue;
+		out[1] = *minValue;
+
+		std::uint64_t indices{ 0 };
+		if (*maxValue != *minValue)
+		{
+			// Eight value mode: both endpoints, then six values evenly between them
+			float palette[8]{ static_cast<float>(*maxValue), static_cast<float>(*minValue) };
+			for (int i{ 1 }; i < 7; ++i)
+			{
+				palette[i + 1] = ((7 - i) * palette[0] + i * palette[1]) / 7.0f;
+			}
+
+			for (int i{ 0 }; i < 16; ++i)
+			{
+				std::uint64_t bestIndex{ 0 };
+				float best{ FLT_MAX };
+				for (std::uint64_t p{ 0 }; p < 8; ++p)
+				{
+					const float distance{ std::abs(values[i] - palette[p]) };
+					if (distance < best)
+					{
+						best = distance;
+						bestIndex = p;
+					}
+				}
+				indices |= bestIndex << (i * 3);
+			}
+		}
+
+		for (int i{ 0 }; i < 6; ++i)
+		{
+			out[2 + i] = static_cast<std::uint8_t>(indices >> (i * 8));
+		}
+	}
+
+	void compressLevel(VkFormat format, const std::uint8_t* rgba, std::uint32_t width, std::uint32_t height, std::uint8_t* out)
+	{
+		const std::uint32_t blocksX{ (width + 3) / 4 };
+		const std::uint32_t blocksY{ (height + 3) / 4 };
+
+		for (std::uint32_t by{ 0 }; by < blocksY; ++by)
+		{
+			for (std::uint32_t bx{ 0 }; bx < blocksX; ++bx)
+			{
+				const BlockTexels block{ loadBlock(rgba, width, height, bx, by) };
+				switch (format)
+				{
+				case VK_FORMAT_BC1_RGB_SRGB_BLOCK:
+				case VK_FORMAT_BC1_RGB_UNORM_BLOCK:
+					encodeColorBlock(block, out);
+					out += 8;
+					break;
+				case VK_FORMAT_BC3_SRGB_BLOCK:
+				case VK_FORMAT_BC3_UNORM_BLOCK:
+					encodeChannelBlock(block.channels[3], out);
+					encodeColorBlock(block, out + 8);
+					out += 16;
+					break;
+				case VK_FORMAT_BC5_UNORM_BLOCK:
+					encodeChannelBlock(block.channels[0], out);
+					encodeChannelBlock(block.channels[1], out + 8);
+					out += 16;
+					break;
+				default:
+					break;
+				}
+			}
+		}
+	}
+
+	CookedImage cookImage(const DecodedImage& image, const TextureCookSettings& settings)
+	{
+		CookedImage cooked{ .averageColor{ image.averageColor } };
+		if (!image.pixels || image.width <= 0 || image.height <= 0)
+		{
+			return cooked;
+		}
+
+		TextureUsage usage{ settings.usage };
+		if (usage == TextureUsage::Auto)
+		{
+			usage = TextureUsage::Color;
+			for (std::size_t i{ 0 }; i < static_cast<std::size_t>(image.width) * image.height; ++i)
+			{
+				if (image.pixels.get()[i * 4 + 3] != 255)
+				{
+					usage = TextureUsage::AlphaCutout;
+					break;
+				}
+			}
+		}
+		cooked.format = cookedFormat(usage, settings.compress);
+
+		FloatImage level{ toFloatImage(image, usage) };
+		const float coverage{ usage == TextureUsage::AlphaCutout ? alphaCoverage(level, settings.alphaCutoff, 1.0f) : 0.0f };
+
+		while (true)
+		{
+			const std::vector<std::uint8_t> rgba{ toRgba8(level, usage) };
+
+			const std::size_t offset{ alignUp(cooked.data.size(), levelAlignment) };
+			const std::size_t size{ levelSize(cooked.format, level.width, level.height) };
+			cooked.data.resize(offset + size);
+			cooked.levels.push_back({ .width{ level.width }, .height{ level.height }, .offset{ offset }, .size{ size } });
+
+			auto* out{ reinterpret_cast<std::uint8_t*>(cooked.data.data() + offset) };
+			if (isBlockCompressed(cooked.format))
+			{
+				compressLevel(cooked.format, rgba.data(), level.width, level.height, out);
+			}
+			else
+			{
+				std::memcpy(out, rgba.data(), size);
+			}
+
+			if (level.width == 1 && level.height == 1)
+			{
+				break;
+			}
+
+			level = downsample(level, usage);
+			if (usage == TextureUsage::AlphaCutout)
+			{
+				preserveAlphaCoverage(level, settings.alphaCutoff, coverage);
+			}
+		}
+
+		cooked.contentHash = hashLevels(cooked);
+		return cooked;
+	}
+
+	// ---- Container ----
+
+	struct KTX2Header
+	{
+		std::uint8_t  identifier[12]{};
+		std::uint32_t vkFormat{};
+		std::uint32_t typeSize{};
+		std::uint32_t pixelWidth{};
+		std::uint32_t pixelHeight{};
+		std::uint32_t pixelDepth{};
+		std::uint32_t layerCount{};
+		std::uint32_t faceCount{};
+		std::uint32_t levelCount{};
+		std::uint32_t supercompressionScheme{};
+		std::uint32_t dfdByteOffset{};
+		std::uint32_t dfdByteLength{};
+		std::uint32_t kvdByteOffset{};
+		std::uint32_t kvdByteLength{};
+		std::uint64_t sgdByteOffset{};
+		std::uint64_t sgdByteLength{};
+	};
+	static_assert(sizeof(KTX2Header) == 80);
+
+	struct KTX2Level
+	{
+		std::uint64_t byteOffset{};
+		std::uint64_t byteLength{};
+		std::uint64_t uncompressedByteLength{};
+	};
+
+	bool writeKTX2(const std::string& path, const CookedImage& image)
+	{
+		if (image.empty())
+		{
+			return false;
+		}
+
+		// One key/value pair: the key with its terminator, then the color
+		std::vector<std::uint8_t> keyValueData(sizeof(std::uint32_t) + sizeof(averageColorKey) + sizeof(glm::vec4));
+		const std::uint32_t keyValueLength{ static_cast<std::uint32_t>(sizeof(averageColorKey) + sizeof(glm::vec4)) };
+		std::memcpy(keyValueData.data(), &keyValueLength, sizeof(keyValueLength));
+		std::memcpy(keyValueData.data() + sizeof(keyValueLength), averageColorKey, sizeof(averageColorKey));
+		std::memcpy(keyValueData.data() + sizeof(keyValueLength) + sizeof(averageColorKey), &image.averageColor, sizeof(glm::vec4));
+		keyValueData.resize(alignUp(keyValueData.size(), 4));
+
+		const std::uint32_t levelCount{ static_cast<std::uint32_t>(image.levels.size()) };
+		const std::size_t keyValueOffset{ sizeof(KTX2Header) + sizeof(KTX2Level) * levelCount };
+
+		KTX2Header header
+		{
+			.vkFormat{ static_cast<std::uint32_t>(image.format) },
+			.typeSize{ 1 },
+			.pixelWidth{ image.levels[0].width },
+			.pixelHeight{ image.levels[0].height },
+			.pixelDepth{ 0 },
+			.layerCount{ 0 },
+			.faceCount{ 1 },
+			.levelCount{ levelCount },
+			.supercompressionScheme{ 0 },
+			.kvdByteOffset{ static_cast<std::uint32_t>(keyValueOffset) },
+			.kvdByteLength{ static_cast<std::uint32_t>(keyValueData.size()) },
+		};
+		std::memcpy(header.identifier, ktx2Identifier, sizeof(ktx2Identifier));
+
+		// KTX2 stores the smallest level first
+		std::vector<KTX2Level> levelIndex(levelCount);
+		std::size_t offset{ keyValueOffset + keyValueData.size() };
+		for (std::uint32_t i{ levelCount }; i-- > 0;)
+		{
+			offset = alignUp(offset, levelAlignment);
+			levelIndex[i] = { offset, image.levels[i].size, image.levels[i].size };
+			offset += image.levels[i].size;
+		}
+
+		std::ofstream file{ path, std::ios::binary | std::ios::trunc };
+		if (!file)
+		{
+			return false;
+		}
+
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		file.write(reinterpret_cast<const char*>(levelIndex.data()), sizeof(KTX2Level) * levelCount);
+		file.write(reinterpret_cast<const char*>(keyValueData.data()), keyValueData.size());
+
+		std::size_t written{ keyValueOffset + keyValueData.size() };
+		const char padding[levelAlignment]{};
+		for (std::uint32_t i{ levelCount }; i-- > 0;)
+		{
+			file.write(padding, levelIndex[i].byteOffset - written);
+			file.write(reinterpret_cast<const char*>(image.data.data() + image.levels[i].offset), image.levels[i].size);
+			written = levelIndex[i].byteOffset + image.levels[i].size;
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	CookedImage readKTX2(const std::string& path, std::uint32_t firstLevel)
+	{
+		std::ifstream file{ path, std::ios::binary | std::ios::ate };
+		if (!file)
+		{
+			return {};
+		}
+		const std::size_t fileSize{ static_cast<std::size_t>(file.tellg()) };
+		file.seekg(0);
+
+		KTX2Header header{};
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file)
+		{
+			return {};
+		}
+
+		if (std::memcmp(header.identifier, ktx2Identifier, sizeof(ktx2Identifier)) != 0 || header.levelCount == 0 ||
+			header.faceCount != 1 || header.supercompressionScheme != 0 ||
+			sizeof(header) + sizeof(KTX2Level) * header.levelCount > fileSize)
+		{
+			std::cerr << "not a usable KTX2 file: " << path << '\n';
+			return {};
+		}
+		if (firstLevel >= header.levelCount)
+		{
+			return {};
+		}
+
+		std::vector<KTX2Level> levelIndex(header.levelCount);
+		file.read(reinterpret_cast<char*>(levelIndex.data()), sizeof(KTX2Level) * header.levelCount);
+
+		CookedImage image{ .format{ static_cast<VkFormat>(header.vkFormat) } };
+
+		// The smallest levels come first in the file, so the wanted ones are a single range at its start
+		std::uint64_t begin{ fileSize };
+		std::uint64_t end{ 0 };
+		for (std::uint32_t i{ firstLevel }; i < header.levelCount; ++i)
+		{
+			const KTX2Level& level{ levelIndex[i] };
+			const std::uint32_t width{ std::max(header.pixelWidth >> i, 1u) };
+			const std::uint32_t height{ std::max(header.pixelHeight >> i, 1u) };
+			if (level.byteOffset + level.byteLength > fileSize || level.byteLength != levelSize(image.format, width, height))
+			{
+				std::cerr << "truncated KTX2 file: " << path << '\n';
+				return {};
+			}
+
+			begin = std::min(begin, level.byteOffset);
+			end = std::max(end, level.byteOffset + level.byteLength);
+		}
+
+		for (std::uint32_t i{ firstLevel }; i < header.levelCount; ++i)
+		{
+			image.levels.push_back(
+			{
+				.width{ std::max(header.pixelWidth >> i, 1u) },
+				.height{ std::max(header.pixelHeight >> i, 1u) },
+				.offset{ static_cast<std::size_t>(levelIndex[i].byteOffset - begin) },
+				.size{ static_cast<std::size_t>(levelIndex[i].byteLength) },
+			});
+		}
+
+		std::vector<std::uint8_t> keyValueData(std::min<std::size_t>(header.kvdByteLength,
+			fileSize - std::min<std::size_t>(header.kvdByteOffset, fileSize)));
+		file.seekg(header.kvdByteOffset);
+		file.read(reinterpret_cast<char*>(keyValueData.data()), keyValueData.size());
+
+		image.data.resize(static_cast<std::size_t>(end - begin));
+		file.seekg(begin);
+		file.read(reinterpret_cast<char*>(image.data.data()), image.data.size());
+		if (!file)
+		{
+			std::cerr << "failed to read KTX2 file: " << path << '\n';
+			return {};
+		}
+
+		// Look for the average color among the key/value pairs
+		bool hasAverageColor{ false };
+		std::size_t offset{ 0 };
+		while (offset + sizeof(std::uint32_t) <= keyValueData.size())
+		{
+			std::uint32_t length{};
+			std::memcpy(&length, keyValueData.data() + offset, sizeof(length));
+			const std::size_t pair{ offset + sizeof(length) };
+			if (pair + length > keyValueData.size())
+			{
+				break;
+			}
+
+			if (length == sizeof(averageColorKey) + sizeof(glm::vec4) &&
+				std::memcmp(keyValueData.data() + pair, averageColorKey, sizeof(averageColorKey)) == 0)
+			{
+				std::memcpy(&image.averageColor, keyValueData.data() + pair + sizeof(averageColorKey), sizeof(glm::vec4));
+				hasAverageColor = true;
+			}
+
+			offset = alignUp(pair + length, 4);
+		}
+		if (!hasAverageColor)
+		{
+			return {};
+		}
+
+		image.contentHash = hashLevels(image);
+		return image;
+	}
+
+	std::string cookedCachePath(const std::string& path, const std::string& cacheDirectory)
+	{
+		return (std::filesystem::path{ cacheDirectory } / (std::filesystem::path{ path }.relative_path().string() + ".ktx2")).string();
+	}
+
+	CookedImage loadCookedImage(const std::string& path, const TextureCookSettings& settings, const std::string& cacheDirectory)
+	{
+		const std::filesystem::path cachePath{ cookedCachePath(path, cacheDirectory) };
+
+		std::error_code error{};
+		const auto cacheTime{ std::filesystem::last_write_time(cachePath, error) };
+		if (!error)
+		{
+			// A missing source is fine, the cooked file is all that is needed
+			const auto sourceTime{ std::filesystem::last_write_time(path, error) };
+			if (error || cacheTime >= sourceTime)
+			{
+				CookedImage image{ readKTX2(cachePath.string()) };
+
+				const bool usable{ settings.usage == TextureUsage::Auto
+					? isBlockCompressed(image.format) == settings.compress
+					: image.format == cookedFormat(settings.usage, settings.compress) };
+				if (!image.empty() && usable)
+				{
+					return image;
+				}
+			}
+		}
+
+		const DecodedImage decoded{ decodeImage(path.c_str()) };
+		CookedImage image{ cookImage(decoded, settings) };
+		if (image.empty())
+		{
+			return image;
+		}
+
+		// Written under a temporary name, so an interrupted run never leaves a half written file behind
+		std::filesystem::create_directories(cachePath.parent_path(), error);
+		const std::filesystem::path temporaryPath{ cachePath.string() + ".tmp" };
+		if (writeKTX2(temporaryPath.string(), image))
+		{
+			std::filesystem::rename(temporaryPath, cachePath, error);
+		}
+		else
+		{
+			std::filesystem::remove(temporaryPath, error);
+			error = std::make_error_code(std::errc::io_error);
+		}
+		if (error)
+		{
+			std::cerr << "failed to write cooked texture: " << cachePath.string() << '\n';
+		}
+
+		return image;
+	}
+
+}
\ No newline at end of file
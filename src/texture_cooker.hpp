@@ -0,0 +1,79 @@
+#pragma once
+
+#include "image.hpp"
+
+#include "volk/volk.h"
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Picks the block format a texture is cooked to
+	enum class TextureUsage
+	{
+		Auto,        // Color, or AlphaCutout if any pixel is not fully opaque
+		Color,       // BC1, sRGB
+		AlphaCutout, // BC3, sRGB, mips keep the alpha test coverage of the top level
+		Normal,      // BC5, tangent space XY, mips are renormalized
+	};
+
+	struct CookedLevel
+	{
+		std::uint32_t width{};
+		std::uint32_t height{};
+		std::size_t   offset{}; // Into CookedImage::data
+		std::size_t   size{};
+	};
+
+	// A texture with its full mip chain, ready to be copied into an image as is
+	struct CookedImage
+	{
+		VkFormat                 format{ VK_FORMAT_UNDEFINED };
+		std::vector<CookedLevel> levels{}; // Largest first
+		std::vector<std::byte>   data{};
+		glm::vec4                averageColor{}; // Alpha weighted mean of the source's linear colors, sRGB encoded
+		std::uint64_t            contentHash{};  // Of the level data, for spotting duplicate files
+
+		bool empty() const
+		{
+			return levels.empty();
+		}
+	};
+
+	struct TextureCookSettings
+	{
+		TextureUsage usage{ TextureUsage::Auto };
+		bool         compress{ true };   // Falls back to RGBA8 mips when the device has no BC support
+		float        alphaCutoff{ 0.2f }; // Matches the discard in uber.frag
+	};
+
+	bool isBlockCompressed(VkFormat format);
+	// Bytes per 4x4 block, or per texel for uncompressed formats
+	std::size_t formatBlockSize(VkFormat format);
+	std::size_t levelSize(VkFormat format, std::uint32_t width, std::uint32_t height);
+
+	// Builds the mip chain on the CPU and block compresses every level
+	CookedImage cookImage(const DecodedImage& image, const TextureCookSettings& settings);
+
+	// The container follows the KTX2 layout, without the data format descriptor, which nothing here reads.
+	// The average color is stored as key/value data.
+	bool writeKTX2(const std::string& path, const CookedImage& image);
+	// Levels above firstLevel are skipped without being read, so the image starts at firstLevel.
+	// Empty if the file has no average color under the current key, as when it was cooked by an older version.
+	CookedImage readKTX2(const std::string& path, std::uint32_t firstLevel = 0);
+
+	// Where loadCookedImage keeps the cooked version of the image at path
+	std::string cookedCachePath(const std::string& path, const std::string& cacheDirectory = "cache");
+
+	// Returns the cooked version of the image at path from cacheDirectory, cooking it first if the
+	// cached file is missing, older than the source or of the wrong kind. Safe to call from any thread
+	// as long as two threads never load the same path at once.
+	CookedImage loadCookedImage(const std::string& path, const TextureCookSettings& settings,
+		const std::string& cacheDirectory = "cache");
+
+}
\ No newline at end of file
@@ -0,0 +1,383 @@
+#include "texture_packer.hpp"
+
+#include "alloc.hpp"
+#include "mesh.hpp"
+#include "sampler_cache.hpp"
+#include "texture_cooker.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Every other bit of a Morton code, packed together
+	std::uint32_t compactBits(std::uint64_t code)
+	{
+		code &= 0x5555555555555555ull;
+		code = (code | (code >> 1)) & 0x3333333333333333ull;
+		code = (code | (code >> 2)) & 0x0F0F0F0F0F0F0F0Full;
+		code = (code | (code >> 4)) & 0x00FF00FF00FF00FFull;
+		code = (code | (code >> 8)) & 0x0000FFFF0000FFFFull;
+		code = (code | (code >> 16)) & 0x00000000FFFFFFFFull;
+		return static_cast<std::uint32_t>(code);
+	}
+
+	TexturePacker::TexturePacker(const TexturePackingSettings& settings, SamplerCache& samplers, VkDevice device, VmaAllocator allocator)
+		: m_settings{ settings },
+		  m_device{ device },
+		  m_allocator{ allocator }
+	{
+		// The same sampler regular textures use, so a texture samples the same whether it was packed or not
+		VkSamplerCreateInfo samplerCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO },
+			.magFilter{ VK_FILTER_LINEAR },
+			.minFilter{ VK_FILTER_LINEAR },
+			.mipmapMode{ VK_SAMPLER_MIPMAP_MODE_LINEAR },
+			.addressModeU{ VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT },
+			.addressModeV{ VK_SAMPLER_ADDRESS_MODE_MIRRORED_REPEAT },
+			.minLod{ 0.0f },
+			.maxLod{ VK_LOD_CLAMP_NONE },
+		};
+		m_sampler = samplers.get(samplerCI);
+	}
+
+	TexturePacker::TexturePacker(TexturePacker&& t) noexcept
+	{
+		move(std::move(t));
+	}
+
+	TexturePacker& TexturePacker::operator=(TexturePacker&& t) noexcept
+	{
+		destroy();
+		move(std::move(t));
+		return *this;
+	}
+
+	TexturePacker::~TexturePacker()
+	{
+		destroy();
+	}
+
+	bool TexturePacker::packable(const CookedImage& image) const
+	{
+		return m_device && !image.empty() && std::max(image.levels[0].width, image.levels[0].height) <= m_settings.maxPackedSize;
+	}
+
+	void TexturePacker::add(std::uint32_t handle, CookedImage&& image, bool atlasable)
+	{
+		m_pending.push_back({ .handle{ handle }, .image{ std::move(image) }, .atlasable{ atlasable } });
+	}
+
+	std::vector<std::pair<std::uint32_t, CookedImage>> TexturePacker::pack(UploadManager& uploader)
+	{
+		// A layer of an array to be: an atlas, or a single pending texture
+		struct Layer
+		{
+			CookedImage                image{};
+			std::size_t                pending{ ~std::size_t{ 0 } }; // Set when the layer is a texture as is
+			std::vector<std::size_t>   textures{};                   // Into m_pending
+			std::vector<PackedTexture> regions{};
+		};
+		std::vector<Layer> layers{};
+		std::vector<bool> atlased(m_pending.size(), false);
+
+		auto atlasCandidate{ [this](const Pending& pending)
+		{
+			const CookedLevel& top{ pending.image.levels[0] };
+			const std::uint32_t block{ isBlockCompressed(pending.image.format) ? 4u : 1u };
+			return pending.atlasable && top.width == top.height && std::has_single_bit(top.width) &&
+				top.width >= block && top.width <= m_settings.maxAtlasEntrySize;
+		} };
+
+		std::map<VkFormat, std::vector<std::size_t>> atlasGroups{};
+		for (std::size_t i{ 0 }; i < m_pending.size(); ++i)
+		{
+			if (atlasCandidate(m_pending[i]))
+			{
+				atlasGroups[m_pending[i].image.format].push_back(i);
+			}
+		}
+
+		for (auto& [format, group] : atlasGroups)
+		{
+			std::stable_sort(group.begin(), group.end(),
+				[this](std::size_t a, std::size_t b) { return m_pending[a].image.levels[0].width > m_pending[b].image.levels[0].width; });
+
+			// Placed along a Morton curve in units of the smallest texture. Going from the largest texture down,
+			// every texture starts at a multiple of its own area, so it lands aligned to its own size.
+			const std::uint32_t unit{ m_pending[group.back()].image.levels[0].width };
+			const std::uint64_t capacity{ static_cast<std::uint64_t>(m_settings.maxAtlasSize / unit) * (m_settings.maxAtlasSize / unit) };
+
+			for (std::size_t begin{ 0 }; begin < group.size();)
+			{
+				std::vector<std::uint64_t> positions{};
+				std::uint64_t cursor{ 0 };
+				std::size_t end{ begin };
+				for (; end < group.size(); ++end)
+				{
+					const std::uint64_t cells{ static_cast<std::uint64_t>(m_pending[group[end]].image.levels[0].width / unit) *
+						(m_pending[group[end]].image.levels[0].width / unit) };
+					if (cursor + cells > capacity)
+					{
+						break;
+					}
+					positions.push_back(cursor);
+					cursor += cells;
+				}
+
+				// A texture alone in an atlas gains nothing, it can still share an array as is
+				if (end - begin < 2)
+				{
+					begin = end;
+					continue;
+				}
+
+				// The smallest square holding the used part of the curve
+				std::uint32_t side{ unit };
+				while (static_cast<std::uint64_t>(side / unit) * (side / unit) < cursor)
+				{
+					side *= 2;
+				}
+
+				// Levels stop before the smallest texture shrinks below a block, so every region stays block aligned
+				const std::uint32_t block{ isBlockCompressed(format) ? 4u : 1u };
+				const std::size_t blockBytes{ formatBlockSize(format) };
+				const std::uint32_t smallest{ m_pending[group[end - 1]].image.levels[0].width };
+				const std::uint32_t levelCount{ static_cast<std::uint32_t>(std::bit_width(smallest / block)) };
+
+				Layer layer{ .image{ .format{ format } } };
+				glm::dvec4 colorSum{ 0.0 };
+				for (std::uint32_t level{ 0 }; level < levelCount; ++level)
+				{
+					const std::uint32_t width{ side >> level };
+					layer.image.levels.push_back(
+					{
+						.width{ width },
+						.height{ width },
+						.offset{ layer.image.data.size() },
+						.size{ levelSize(format, width, width) },
+					});
+					layer.image.data.resize(layer.image.data.size() + layer.image.levels.back().size);
+				}
+
+				for (std::size_t i{ begin }; i < end; ++i)
+				{
+					const Pending& pending{ m_pending[group[i]] };
+					const std::uint32_t size{ pending.image.levels[0].width };
+					const std::uint32_t x{ compactBits(positions[i - begin]) * unit };
+					const std::uint32_t y{ compactBits(positions[i - begin] >> 1) * unit };
+
+					for (std::uint32_t level{ 0 }; level < levelCount; ++level)
+					{
+						const CookedLevel& source{ pending.image.levels[level] };
+						const CookedLevel& target{ layer.image.levels[level] };
+						const std::size_t rowBytes{ (size >> level) / block * blockBytes };
+						const std::size_t targetStride{ target.width / block * blockBytes };
+						for (std::uint32_t row{ 0 }; row < (size >> level) / block; ++row)
+						{
+							std::memcpy(layer.image.data.data() + target.offset + ((y >> level) / block + row) * targetStride + (x >> level) / block * blockBytes,
+								pending.image.data.data() + source.offset + row * rowBytes, rowBytes);
+						}
+					}
+
+					layer.textures.push_back(group[i]);
+					layer.regions.push_back(
+					{
+						.uvScale{ static_cast<float>(size) / side },
+						.uvOffset{ static_cast<float>(x) / side, static_cast<float>(y) / side },
+						.averageColor{ pending.image.averageColor },
+					});
+					const glm::vec4& color{ pending.image.averageColor };
+					colorSum += glm::dvec4{ decodeSrgb(color.r), decodeSrgb(color.g), decodeSrgb(color.b), color.a } * (static_cast<double>(size) * size);
+					atlased[group[i]] = true;
+				}
+				const glm::vec4 mean{ colorSum / (static_cast<double>(side) * side) };
+				layer.image.averageColor = glm::vec4{ encodeSrgb(mean.r), encodeSrgb(mean.g), encodeSrgb(mean.b), mean.a };
+
+				layers.push_back(std::move(layer));
+				++m_atlases;
+				begin = end;
+			}
+		}
+
+		for (std::size_t i{ 0 }; i < m_pending.size(); ++i)
+		{
+			if (!atlased[i])
+			{
+				layers.push_back({ .pending{ i }, .textures{ i }, .regions{ { .averageColor{ m_pending[i].image.averageColor } } } });
+			}
+		}
+
+		// Layers of one array need the same format, size and level count
+		std::map<std::tuple<VkFormat, std::uint32_t, std::uint32_t, std::size_t>, std::vector<std::size_t>> arrayGroups{};
+		for (std::size_t i{ 0 }; i < layers.size(); ++i)
+		{
+			const CookedImage& image{ layers[i].pending == ~std::size_t{ 0 } ? layers[i].image : m_pending[layers[i].pending].image };
+			arrayGroups[{ image.format, image.levels[0].width, image.levels[0].height, image.levels.size() }].push_back(i);
+		}
+
+		std::vector<std::pair<std::uint32_t, CookedImage>> unpacked{};
+		auto handBack{ [&](const Layer& layer)
+		{
+			for (std::size_t texture : layer.textures)
+			{
+				unpacked.emplace_back(m_pending[texture].handle, std::move(m_pending[texture].image));
+			}
+		} };
+
+		for (const auto& [key, group] : arrayGroups)
+		{
+			for (std::size_t begin{ 0 }; begin < group.size(); begin += m_settings.maxLayers)
+			{
+				const std::size_t end{ std::min<std::size_t>(begin + m_settings.maxLayers, group.size()) };
+
+				// A lone texture is better off in the texture table, where it can still stream
+				const bool alone{ end - begin == 1 && layers[group[begin]].pending != ~std::size_t{ 0 } };
+				if (alone || m_arrays.size() >= maxArrays)
+				{
+					for (std::size_t i{ begin }; i < end; ++i)
+					{
+						handBack(layers[group[i]]);
+					}
+					continue;
+				}
+
+				std::vector<CookedImage> images{};
+				images.reserve(end - begin);
+				for (std::size_t i{ begin }; i < end; ++i)
+				{
+					Layer& layer{ layers[group[i]] };
+					images.push_back(layer.pending == ~std::size_t{ 0 } ? std::move(layer.image) : std::move(m_pending[layer.pending].image));
+				}
+
+				const std::uint32_t array{ size() };
+				const std::uint32_t layerCount{ static_cast<std::uint32_t>(images.size()) };
+				TextureArray textureArray{ .image{ uploadCookedImage(images.data(), layerCount, uploader, m_allocator) } };
+
+				VkImageViewCreateInfo imageViewCI
+				{
+					.sType{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO },
+					.image{ textureArray.image.image },
+					.viewType{ VK_IMAGE_VIEW_TYPE_2D_ARRAY },
+					.format{ images[0].format },
+					.subresourceRange
+					{
+						.aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT },
+						.baseMipLevel{ 0 },
+						.levelCount{ static_cast<std::uint32_t>(images[0].levels.size()) },
+						.baseArrayLayer{ 0 },
+						.layerCount{ layerCount },
+					}
+				};
+				vkCreateImageView(m_device, &imageViewCI, nullptr, &textureArray.view);
+
+				for (std::size_t i{ begin }; i < end; ++i)
+				{
+					const Layer& layer{ layers[group[i]] };
+					for (std::size_t t{ 0 }; t < layer.textures.size(); ++t)
+					{
+						PackedTexture packed{ layer.regions[t] };
+						packed.textureIndex = firstIndex + array;
+						packed.layer = static_cast<std::uint32_t>(i - begin);
+						m_packed[m_pending[layer.textures[t]].handle] = packed;
+						textureArray.regions.push_back(packed);
+					}
+				}
+
+				m_layers += layerCount;
+				m_arrays.push_back(std::move(textureArray));
+			}
+		}
+
+		m_pending.clear();
+		return unpacked;
+	}
+
+	const PackedTexture* TexturePacker::find(std::uint32_t handle) const
+	{
+		const auto packed{ m_packed.find(handle) };
+		return packed == m_packed.end() ? nullptr : &packed->second;
+	}
+
+	glm::vec4 TexturePacker::averageColor(std::uint32_t textureIndex, std::uint32_t layer, const glm::vec2& uv) const
+	{
+		const PackedTexture* fallback{ nullptr };
+		for (const PackedTexture& region : m_arrays[textureIndex - firstIndex].regions)
+		{
+			if (region.layer != layer)
+			{
+				continue;
+			}
+			if (glm::all(glm::greaterThanEqual(uv, region.uvOffset)) && glm::all(glm::lessThanEqual(uv, region.uvOffset + region.uvScale)))
+			{
+				return region.averageColor;
+			}
+			fallback = &region;
+		}
+		return fallback ? fallback->averageColor : glm::vec4{ 0.0f };
+	}
+
+	void TexturePacker::printStatistics() const
+	{
+		std::cout << "texture packing: " << m_packed.size() << " textures in " << m_arrays.size() << " arrays, "
+			<< m_layers << " layers, " << m_atlases << " atlases\n";
+	}
+
+	void TexturePacker::move(TexturePacker&& t)
+	{
+		m_settings = t.m_settings;
+		m_pending = std::move(t.m_pending);
+		m_arrays = std::move(t.m_arrays);
+		m_packed = std::move(t.m_packed);
+
+		m_atlases = t.m_atlases;
+		m_layers = t.m_layers;
+
+		m_device = t.m_device;
+		m_allocator = t.m_allocator;
+		m_sampler = t.m_sampler;
+
+		t.m_arrays.clear();
+	}
+
+	void TexturePacker::destroy()
+	{
+		for (TextureArray& textureArray : m_arrays)
+		{
+			vkDestroyImageView(m_device, textureArray.view, nullptr);
+			vmaDestroyImage(m_allocator, textureArray.image.image, textureArray.image.alloc);
+		}
+		m_arrays.clear();
+	}
+
+	void applyPacking(const PackedTexture& packed, const RenderObject::Mesh& mesh, std::vector<Vertex>& vertices)
+	{
+		// Vertices are shared between the mesh's triangles, but never between meshes
+		std::vector<std::uint32_t> indices{ mesh.indices };
+		std::sort(indices.begin(), indices.end());
+		indices.erase(std::unique(indices.begin(), indices.end()), indices.end());
+
+		for (std::uint32_t index : indices)
+		{
+			vertices[index].tex = vertices[index].tex * packed.uvScale + packed.uvOffset;
+			vertices[index].layer = packed.layer;
+		}
+	}
+
+}
\ No newline at end of file
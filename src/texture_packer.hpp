@@ -0,0 +1,139 @@
+#pragma once
+
+#include "alloc.hpp"
+#include "mesh.hpp"
+#include "sampler_cache.hpp"
+#include "texture_cooker.hpp"
+#include "upload.hpp"
+#include "virtual_texture.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "glm/glm.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct TexturePackingSettings
+	{
+		std::uint32_t maxPackedSize{ 1024 };    // Larger textures keep a slot of their own, and keep streaming
+		std::uint32_t maxAtlasEntrySize{ 256 }; // Square power of two textures up to this size can share an atlas
+		std::uint32_t maxAtlasSize{ 2048 };
+		std::uint32_t maxLayers{ 256 };         // The smallest maxImageArrayLayers Vulkan allows
+	};
+
+	// Where a packed texture ended up. Meshes using it draw with textureIndex, take the layer from their
+	// vertices and have their UVs mapped into the texture's region of the layer.
+	struct PackedTexture
+	{
+		std::uint32_t textureIndex{};
+		std::uint32_t layer{};
+		glm::vec2     uvScale{ 1.0f };
+		glm::vec2     uvOffset{ 0.0f };
+		glm::vec4     averageColor{}; // Alpha weighted mean of the linear colors, sRGB encoded
+	};
+
+	// Packs small material textures into texture arrays, so meshes with different textures can share a draw:
+	// the push constant picks the array and the layer comes from the vertices. Textures of the same format
+	// and size become layers of one array. Smaller square ones go into atlases first, which are then stacked
+	// into arrays like any other texture; an atlased texture can't repeat, so only textures whose meshes keep
+	// their UVs inside the texture are atlased. Textures that find nothing to share with are handed back.
+	class TexturePacker
+	{
+	public:
+		static constexpr std::uint32_t maxArrays{ 64 };
+		// Texture index of the first array. Must match uber.frag.
+		static constexpr std::uint32_t firstIndex{ VirtualTextureCache::firstIndex + VirtualTextureCache::maxTextures };
+
+		TexturePacker() = default;
+
+		// The sampler cache must outlive the packer
+		TexturePacker(const TexturePackingSettings& settings, SamplerCache& samplers, VkDevice device, VmaAllocator allocator);
+
+		TexturePacker(const TexturePacker&) = delete;
+		TexturePacker& operator=(const TexturePacker&) = delete;
+
+		TexturePacker(TexturePacker&& t) noexcept;
+		TexturePacker& operator=(TexturePacker&& t) noexcept;
+
+		~TexturePacker();
+
+		bool packable(const CookedImage& image) const;
+
+		// Holds on to the image until pack(). atlasable says whether every mesh using the texture keeps its UVs
+		// inside [0, 1].
+		void add(std::uint32_t handle, CookedImage&& image, bool atlasable);
+
+		// Builds the atlases and arrays and queues their uploads. Returns the textures that had nothing to share
+		// an array with, to be loaded on their own.
+		std::vector<std::pair<std::uint32_t, CookedImage>> pack(UploadManager& uploader);
+
+		// Where the texture requested with handle ended up, or nullptr if it was not packed
+		const PackedTexture* find(std::uint32_t handle) const;
+
+		bool contains(std::uint32_t textureIndex) const
+		{
+			return textureIndex >= firstIndex && textureIndex - firstIndex < m_arrays.size();
+		}
+
+		// Alpha weighted mean color of the packed texture a vertex samples (sRGB encoded)
+		glm::vec4 averageColor(std::uint32_t textureIndex, std::uint32_t layer, const glm::vec2& uv) const;
+
+		std::uint32_t size() const
+		{
+			return static_cast<std::uint32_t>(m_arrays.size());
+		}
+		VkImageView arrayView(std::uint32_t array) const
+		{
+			return m_arrays[array].view;
+		}
+		VkSampler sampler() const
+		{
+			return m_sampler;
+		}
+
+		void printStatistics() const;
+
+	private:
+		struct Pending
+		{
+			std::uint32_t handle{};
+			CookedImage   image{};
+			bool          atlasable{};
+		};
+
+		struct TextureArray
+		{
+			Image                      image{};
+			VkImageView                view{};
+			std::vector<PackedTexture> regions{}; // Everything packed into the array, for averageColor()
+		};
+
+		TexturePackingSettings m_settings{};
+
+		std::vector<Pending>                             m_pending{};
+		std::vector<TextureArray>                        m_arrays{};
+		std::unordered_map<std::uint32_t, PackedTexture> m_packed{}; // By handle
+
+		std::size_t m_atlases{};
+		std::size_t m_layers{};
+
+		// Not owned by the class
+		VkDevice     m_device{};
+		VmaAllocator m_allocator{};
+		VkSampler    m_sampler{};
+
+		void move(TexturePacker&& t);
+		void destroy();
+	};
+
+	// Maps the UVs of the mesh's vertices into the region the texture was packed into and sets their layer
+	void applyPacking(const PackedTexture& packed, const RenderObject::Mesh& mesh, std::vector<Vertex>& vertices);
+
+}
\ No newline at end of file
@@ -0,0 +1,433 @@
+#include "texture_streamer.hpp"
+
+#include "descriptor.hpp"
+#include "mesh.hpp"
+#include "texture_cache.hpp"
+#include "texture_cooker.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Must match the feedback written in uber.frag: the finest level a fragment wanted, relative to the
+	// largest resident level, plus feedbackBias. Slots no fragment reported keep the cleared value.
+	constexpr std::uint32_t feedbackBias{ 16 };
+	constexpr std::uint32_t feedbackRange{ 32 };
+
+	// When a texture is swapped, the other frame in flight has already been recorded against the old one
+	constexpr std::uint32_t staleFeedbackFrames{ 1 };
+	// Must match the frames in flight the renderer keeps. A swapped out texture lives for this many updates.
+	constexpr std::uint32_t framesInFlight{ 2 };
+
+	TextureStreamer::TextureStreamer(const TextureStreamingSettings& settings, TextureCache& textures, UploadManager& uploader,
+		VkDevice device, VmaAllocator allocator, VkDescriptorSet descriptorSet)
+		: m_settings{ settings },
+		  m_reads{ std::make_unique<CompletionQueue<CookedImage>>() },
+		  m_pool{ std::make_unique<ThreadPool>(1) },
+		  m_textures{ &textures },
+		  m_uploader{ &uploader },
+		  m_device{ device },
+		  m_allocator{ allocator },
+		  m_descriptorSet{ descriptorSet }
+	{
+	}
+
+	TextureStreamer::TextureStreamer(TextureStreamer&& t) noexcept
+	{
+		move(std::move(t));
+	}
+
+	TextureStreamer& TextureStreamer::operator=(TextureStreamer&& t) noexcept
+	{
+		destroy();
+		move(std::move(t));
+		return *this;
+	}
+
+	TextureStreamer::~TextureStreamer()
+	{
+		destroy();
+	}
+
+	std::uint32_t TextureStreamer::baseLevel(const CookedImage& image, const std::string& source) const
+	{
+		// Without the cooked file there would be no way back to the dropped levels
+		std::error_code error{};
+		if (image.empty() || !std::filesystem::exists(cookedCachePath(source), error))
+		{
+			return 0;
+		}
+
+		std::uint32_t level{ 0 };
+		while (level + 1 < image.levels.size() &&
+			std::max(image.levels[level].width, image.levels[level].height) > m_settings.residentSize)
+		{
+			++level;
+		}
+		return level;
+	}
+
+	void TextureStreamer::update(const std::uint32_t* feedback)
+	{
+		if (!m_textures)
+		{
+			return;
+		}
+
+		++m_frame;
+
+		// Every frame in flight when these were swapped out has been waited for since
+		std::erase_if(m_retired, [this](const Retired& retired) { return m_frame - retired.frame >= framesInFlight; });
+
+		track();
+		readFeedback(feedback);
+		collectReads();
+		swapUploaded();
+		requestLevels();
+	}
+
+	VkDeviceSize TextureStreamer::residentBytes() const
+	{
+		VkDeviceSize bytes{ 0 };
+		if (!m_textures)
+		{
+			return bytes;
+		}
+
+		const auto& textures{ m_textures->textures() };
+		for (std::uint32_t slot{ 0 }; slot < textures.size(); ++slot)
+		{
+			if (textures[slot])
+			{
+				bytes += bytesFrom(slot, m_textures->residency(slot).firstLevel);
+			}
+		}
+		return bytes;
+	}
+
+	void TextureStreamer::printStatistics() const
+	{
+		std::cout << "texture streaming: " << residentBytes() / (1024 * 1024) << " MiB resident of "
+			<< m_settings.budget / (1024 * 1024) << " MiB budget, " << m_levelsStreamedIn << " levels streamed in, "
+			<< m_levelsDropped << " dropped\n";
+	}
+
+	void TextureStreamer::track()
+	{
+		const auto& textures{ m_textures->textures() };
+		m_streams.resize(textures.size());
+
+		for (std::uint32_t slot{ 0 }; slot < textures.size(); ++slot)
+		{
+			Stream& stream{ m_streams[slot] };
+			if (!textures[slot])
+			{
+				stream.tracked = false;
+				if (stream.staged)
+				{
+					m_uploader->wait(stream.stagedUpload);
+					stream.staged.reset();
+					stream.pendingLevel = noLevel;
+				}
+				continue;
+			}
+
+			// A slot reused while a read for its old texture is out waits for that read to come back
+			if (stream.tracked || stream.pendingLevel != noLevel)
+			{
+				continue;
+			}
+
+			const TextureCache::Residency& residency{ m_textures->residency(slot) };
+			stream = Stream
+			{
+				.tracked{ true },
+				.cachePath{ cookedCachePath(residency.source) },
+				.baseLevel{ residency.firstLevel },
+				.wantedLevel{ residency.firstLevel },
+			};
+			stream.streamable = residency.firstLevel > 0;
+		}
+	}
+
+	void TextureStreamer::readFeedback(const std::uint32_t* feedback)
+	{
+		const std::size_t slots{ std::min<std::size_t>(m_streams.size(), TextureCache::maxTextures) };
+		for (std::uint32_t slot{ 0 }; slot < slots; ++slot)
+		{
+			Stream& stream{ m_streams[slot] };
+			if (!stream.streamable)
+			{
+				continue;
+			}
+			if (stream.ignoreFeedback > 0)
+			{
+				--stream.ignoreFeedback;
+				continue;
+			}
+			if (feedback[slot] >= feedbackRange)
+			{
+				continue;
+			}
+
+			const int resident{ static_cast<int>(m_textures->residency(slot).firstLevel) };
+			const int wanted{ resident + static_cast<int>(feedback[slot]) - static_cast<int>(feedbackBias) };
+			stream.wantedLevel = static_cast<std::uint32_t>(std::clamp(wanted, 0, static_cast<int>(stream.baseLevel)));
+			stream.lastSeen = m_frame;
+		}
+	}
+
+	void TextureStreamer::collectReads()
+	{
+		std::vector<std::uint32_t> staged{};
+		while (auto result{ m_reads->tryPop() })
+		{
+			--m_pendingReads;
+
+			const std::uint32_t slot{ static_cast<std::uint32_t>(result->first) };
+			const CookedImage& image{ result->second };
+			Stream& stream{ m_streams[slot] };
+			if (!stream.tracked)
+			{
+				stream.pendingLevel = noLevel;
+				continue;
+			}
+			if (image.empty())
+			{
+				std::cerr << "failed to stream texture levels from: " << stream.cachePath << '\n';
+				stream.streamable = false;
+				stream.pendingLevel = noLevel;
+				continue;
+			}
+
+			stream.staged.emplace(image, *m_uploader, m_textures->samplers(), m_device, m_allocator);
+			staged.push_back(slot);
+		}
+
+		if (staged.empty())
+		{
+			return;
+		}
+
+		// Everything read this frame goes out in one batch
+		const std::uint64_t upload{ m_uploader->flush() };
+		for (std::uint32_t slot : staged)
+		{
+			m_streams[slot].stagedUpload = upload;
+		}
+	}
+
+	void TextureStreamer::swapUploaded()
+	{
+		std::vector<std::uint32_t> ready{};
+		for (std::uint32_t slot{ 0 }; slot < m_streams.size(); ++slot)
+		{
+			if (m_streams[slot].staged && m_uploader->isComplete(m_streams[slot].stagedUpload))
+			{
+				ready.push_back(slot);
+			}
+		}
+		if (ready.empty())
+		{
+			return;
+		}
+
+		// The texture table is update after bind, so the slots are rewritten while frames in flight still
+		// sample it. Those may see either texture, and the old one stays alive until they have finished.
+		for (std::uint32_t slot : ready)
+		{
+			Stream& stream{ m_streams[slot] };
+			const std::uint32_t previous{ m_textures->residency(slot).firstLevel };
+			if (stream.pendingLevel < previous)
+			{
+				m_levelsStreamedIn += previous - stream.pendingLevel;
+			}
+			else
+			{
+				m_levelsDropped += stream.pendingLevel - previous;
+			}
+
+			m_retired.push_back({ .texture{ m_textures->replace(slot, std::move(*stream.staged), stream.pendingLevel) }, .frame{ m_frame } });
+			stream.staged.reset();
+			stream.pendingLevel = noLevel;
+			stream.ignoreFeedback = staleFeedbackFrames;
+		}
+
+		writeTextureSamplers(m_device, m_descriptorSet, *m_textures, ready);
+	}
+
+	void TextureStreamer::requestLevels()
+	{
+		const auto& textures{ m_textures->textures() };
+		const std::uint32_t slots{ static_cast<std::uint32_t>(m_streams.size()) };
+
+		auto recentlySeen{ [this](const Stream& stream)
+		{
+			return stream.lastSeen != 0 && m_frame - stream.lastSeen < m_settings.evictAfterFrames;
+		} };
+
+		// Every texture starts from its always resident levels. The rest of the budget is handed out one
+		// level at a time, coarse levels before fine ones and recently seen textures first.
+		std::vector<std::uint32_t> planned(slots, noLevel);
+		std::vector<std::uint32_t> target(slots, noLevel);
+		std::vector<std::uint32_t> candidates{};
+		VkDeviceSize committed{ 0 };
+		for (std::uint32_t slot{ 0 }; slot < slots; ++slot)
+		{
+			if (!textures[slot])
+			{
+				continue;
+			}
+
+			const Stream& stream{ m_streams[slot] };
+			if (!stream.streamable)
+			{
+				committed += bytesFrom(slot, m_textures->residency(slot).firstLevel);
+				continue;
+			}
+
+			planned[slot] = stream.baseLevel;
+			target[slot] = recentlySeen(stream) ? stream.wantedLevel : stream.baseLevel;
+			committed += bytesFrom(slot, stream.baseLevel);
+			if (target[slot] < planned[slot])
+			{
+				candidates.push_back(slot);
+			}
+		}
+
+		std::sort(candidates.begin(), candidates.end(),
+			[this](std::uint32_t a, std::uint32_t b) { return m_streams[a].lastSeen > m_streams[b].lastSeen; });
+
+		for (bool granted{ true }; granted;)
+		{
+			granted = false;
+			for (std::uint32_t slot : candidates)
+			{
+				if (planned[slot] <= target[slot])
+				{
+					continue;
+				}
+
+				const VkDeviceSize cost{ m_textures->residency(slot).levelSizes[planned[slot] - 1] };
+				if (committed + cost <= m_settings.budget)
+				{
+					--planned[slot];
+					committed += cost;
+					granted = true;
+				}
+			}
+		}
+
+		// Dropping levels frees memory, so that goes first. Textures on screen keep finer levels than they
+		// currently want until the budget runs out, so turning the camera back and forth doesn't stream the
+		// same levels over and over.
+		const bool overBudget{ residentBytes() > m_settings.budget };
+		std::vector<std::uint32_t> changes{};
+		for (std::uint32_t slot{ 0 }; slot < slots; ++slot)
+		{
+			if (planned[slot] == noLevel || m_streams[slot].pendingLevel != noLevel)
+			{
+				continue;
+			}
+
+			const std::uint32_t resident{ m_textures->residency(slot).firstLevel };
+			if (planned[slot] > resident && (overBudget || !recentlySeen(m_streams[slot])))
+			{
+				changes.push_back(slot);
+			}
+		}
+
+		// Then finer levels, for the most recently seen textures first
+		for (std::uint32_t slot : candidates)
+		{
+			if (m_streams[slot].pendingLevel == noLevel && planned[slot] < m_textures->residency(slot).firstLevel)
+			{
+				changes.push_back(slot);
+			}
+		}
+
+		for (std::uint32_t slot : changes)
+		{
+			if (m_pendingReads >= m_settings.maxPendingReads)
+			{
+				break;
+			}
+
+			Stream& stream{ m_streams[slot] };
+			stream.pendingLevel = planned[slot];
+			++m_pendingReads;
+
+			m_pool->submit([reads = m_reads.get(), path = stream.cachePath, slot, level = planned[slot]]
+			{
+				reads->push(slot, readKTX2(path, level));
+			});
+		}
+	}
+
+	VkDeviceSize TextureStreamer::bytesFrom(std::uint32_t slot, std::uint32_t level) const
+	{
+		VkDeviceSize bytes{ 0 };
+		const std::vector<std::size_t>& levelSizes{ m_textures->residency(slot).levelSizes };
+		for (std::size_t i{ level }; i < levelSizes.size(); ++i)
+		{
+			bytes += levelSizes[i];
+		}
+		return bytes;
+	}
+
+	void TextureStreamer::move(TextureStreamer&& t)
+	{
+		m_settings = t.m_settings;
+		m_streams = std::move(t.m_streams);
+		m_retired = std::move(t.m_retired);
+		m_frame = t.m_frame;
+		m_pendingReads = t.m_pendingReads;
+
+		m_levelsStreamedIn = t.m_levelsStreamedIn;
+		m_levelsDropped = t.m_levelsDropped;
+
+		m_reads = std::move(t.m_reads);
+		m_pool = std::move(t.m_pool);
+
+		m_textures = t.m_textures;
+		m_uploader = t.m_uploader;
+		m_device = t.m_device;
+		m_allocator = t.m_allocator;
+		m_descriptorSet = t.m_descriptorSet;
+
+		t.m_textures = nullptr;
+	}
+
+	void TextureStreamer::destroy()
+	{
+		// Joins the worker before the queue it pushes into goes away
+		m_pool.reset();
+		m_reads.reset();
+
+		for (Stream& stream : m_streams)
+		{
+			if (stream.staged)
+			{
+				m_uploader->wait(stream.stagedUpload);
+			}
+		}
+		m_streams.clear();
+		m_retired.clear();
+	}
+
+}
\ No newline at end of file
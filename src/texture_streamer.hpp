@@ -0,0 +1,119 @@
+#pragma once
+
+#include "mesh.hpp"
+#include "texture_cache.hpp"
+#include "texture_cooker.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct TextureStreamingSettings
+	{
+		VkDeviceSize  budget{ 256ull * 1024 * 1024 }; // Bytes of texture levels allowed to be resident
+		std::uint32_t residentSize{ 64 };             // Levels no larger than this are always resident
+		std::uint32_t evictAfterFrames{ 300 };        // Textures unseen for this long drop back to their resident levels
+		std::uint32_t maxPendingReads{ 4 };
+	};
+
+	// Keeps only the levels of each texture that are actually sampled resident, within a memory budget.
+	// uber.frag reports, per texture slot, the finest level a sample of its fragments wanted. The streamer
+	// reads that back a couple of frames later, reads the missing levels from the cooked cache on a worker
+	// thread and swaps in a texture holding them. Levels nobody has asked for in a while are dropped again.
+	class TextureStreamer
+	{
+	public:
+		TextureStreamer() = default;
+
+		// The texture cache, uploader and descriptor set must outlive the streamer
+		TextureStreamer(const TextureStreamingSettings& settings, TextureCache& textures, UploadManager& uploader,
+			VkDevice device, VmaAllocator allocator, VkDescriptorSet descriptorSet);
+
+		TextureStreamer(const TextureStreamer&) = delete;
+		TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+		TextureStreamer(TextureStreamer&& t) noexcept;
+		TextureStreamer& operator=(TextureStreamer&& t) noexcept;
+
+		~TextureStreamer();
+
+		// The level a texture should first be uploaded from. Only textures whose cooked file can be read
+		// back later start below full resolution.
+		std::uint32_t baseLevel(const CookedImage& image, const std::string& source) const;
+
+		// Call once per frame with the feedback of a frame that has finished on the GPU, one entry per texture slot
+		void update(const std::uint32_t* feedback);
+
+		VkDeviceSize residentBytes() const;
+
+		void printStatistics() const;
+
+	private:
+		static constexpr std::uint32_t noLevel{ ~0u };
+
+		struct Stream
+		{
+			bool          tracked{ false };
+			bool          streamable{ false };
+			std::string   cachePath{};
+			std::uint32_t baseLevel{};
+			std::uint32_t wantedLevel{};
+			std::uint64_t lastSeen{};
+			std::uint32_t ignoreFeedback{}; // Frames still in flight that sampled an older version
+
+			std::uint32_t          pendingLevel{ noLevel }; // Being read or uploaded
+			std::optional<Texture> staged{};
+			std::uint64_t          stagedUpload{};
+		};
+
+		// A swapped out texture, kept until the frames in flight that may sample it have finished
+		struct Retired
+		{
+			Texture       texture;
+			std::uint64_t frame{};
+		};
+
+		TextureStreamingSettings m_settings{};
+		std::vector<Stream>      m_streams{};
+		std::vector<Retired>     m_retired{};
+		std::uint64_t            m_frame{};
+		std::uint32_t            m_pendingReads{};
+
+		std::size_t m_levelsStreamedIn{};
+		std::size_t m_levelsDropped{};
+
+		// Results outlive the pool, so its workers never push into a destroyed queue
+		std::unique_ptr<CompletionQueue<CookedImage>> m_reads{};
+		std::unique_ptr<ThreadPool>                   m_pool{};
+
+		// Not owned by the class
+		TextureCache*   m_textures{};
+		UploadManager*  m_uploader{};
+		VkDevice        m_device{};
+		VmaAllocator    m_allocator{};
+		VkDescriptorSet m_descriptorSet{};
+
+		void track();
+		void readFeedback(const std::uint32_t* feedback);
+		void collectReads();
+		void swapUploaded();
+		void requestLevels();
+
+		VkDeviceSize bytesFrom(std::uint32_t slot, std::uint32_t level) const;
+
+		void move(TextureStreamer&& t);
+		void destroy();
+	};
+
+}
\ No newline at end of file
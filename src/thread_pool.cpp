@@ -0,0 +1,72 @@
+#include "thread_pool.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+
+namespace Graphics
+{
+
+	ThreadPool::ThreadPool(std::size_t threadCount)
+	{
+		if (threadCount == 0)
+		{
+			threadCount = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+		}
+
+		m_workers.reserve(threadCount);
+		for (std::size_t i{ 0 }; i < threadCount; ++i)
+		{
+			m_workers.emplace_back([this] { work(); });
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard lock{ m_mutex };
+			m_stopping = true;
+		}
+		m_condition.notify_all();
+
+		for (auto& worker : m_workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::submit(std::function<void()> task)
+	{
+		{
+			std::lock_guard lock{ m_mutex };
+			m_tasks.push_back(std::move(task));
+		}
+		m_condition.notify_one();
+	}
+
+	void ThreadPool::work()
+	{
+		while (true)
+		{
+			std::function<void()> task{};
+			{
+				std::unique_lock lock{ m_mutex };
+				m_condition.wait(lock, [this] { return m_stopping || !m_tasks.empty(); });
+
+				if (m_tasks.empty())
+				{
+					return;
+				}
+
+				task = std::move(m_tasks.front());
+				m_tasks.pop_front();
+			}
+
+			task();
+		}
+	}
+
+}
\ No newline at end of file
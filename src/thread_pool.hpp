@@ -0,0 +1,204 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	class ThreadPool
+	{
+	public:
+		// Defaults to one worker per core, leaving one for the thread that submits
+		explicit ThreadPool(std::size_t threadCount = 0);
+
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		// Finishes every queued task before returning
+		~ThreadPool();
+
+		void submit(std::function<void()> task);
+
+	private:
+		std::vector<std::thread>          m_workers{};
+		std::deque<std::function<void()>> m_tasks{};
+		std::mutex                        m_mutex{};
+		std::condition_variable           m_condition{};
+		bool                              m_stopping{ false };
+
+		void work();
+	};
+
+	// Collects the results of tasks running on a pool and hands them out in the order they finish
+	template<typename T>
+	class CompletionQueue
+	{
+	public:
+		void push(std::size_t index, T value)
+		{
+			{
+				std::lock_guard lock{ m_mutex };
+				m_done.emplace_back(index, std::move(value));
+			}
+			m_condition.notify_one();
+		}
+
+		// Blocks until a result is available. Returns the index it was pushed with.
+		std::pair<std::size_t, T> pop()
+		{
+			std::unique_lock lock{ m_mutex };
+			m_condition.wait(lock, [this] { return !m_done.empty(); });
+
+			std::pair<std::size_t, T> result{ std::move(m_done.front()) };
+			m_done.pop_front();
+			return result;
+		}
+
+		// Returns nothing if no result is ready yet
+		std::optional<std::pair<std::size_t, T>> tryPop()
+		{
+			std::lock_guard lock{ m_mutex };
+			if (m_done.empty())
+			{
+				return std::nullopt;
+			}
+
+			std::pair<std::size_t, T> result{ std::move(m_done.front()) };
+			m_done.pop_front();
+			return result;
+		}
+
+	private:
+		std::deque<std::pair<std::size_t, T>> m_done{};
+		std::mutex                            m_mutex{};
+		std::condition_variable               m_condition{};
+	};
+
+	// Hands values from one thread to the next in order, holding up the producer while it is full. Keeps track of how
+	// full it gets and how long either side waited, which tells whether the producer or the consumer is the slow one.
+	template<typename T>
+	class BoundedQueue
+	{
+	public:
+		struct Statistics
+		{
+			std::size_t capacity{};
+			std::size_t pushes{};
+			std::size_t maxDepth{};
+			std::size_t depthSum{};        // The depth each push left, for the mean
+			double      pushWaitSeconds{}; // Producer waiting for room
+			double      popWaitSeconds{};  // Consumer waiting for a value
+		};
+
+		explicit BoundedQueue(std::size_t capacity)
+			: m_capacity{ capacity }
+		{
+		}
+
+		// Blocks while the queue is full. Returns false, dropping the value, once the queue is closed.
+		bool push(T value)
+		{
+			{
+				std::unique_lock lock{ m_mutex };
+				if (m_values.size() >= m_capacity && !m_closed)
+				{
+					const auto start{ std::chrono::steady_clock::now() };
+					m_notFull.wait(lock, [this] { return m_values.size() < m_capacity || m_closed; });
+					m_statistics.pushWaitSeconds += std::chrono::duration<double>{ std::chrono::steady_clock::now() - start }.count();
+				}
+				if (m_closed)
+				{
+					return false;
+				}
+
+				m_values.push_back(std::move(value));
+				++m_statistics.pushes;
+				m_statistics.maxDepth = std::max(m_statistics.maxDepth, m_values.size());
+				m_statistics.depthSum += m_values.size();
+			}
+			m_notEmpty.notify_one();
+			return true;
+		}
+
+		// Blocks until a value is available. Returns nothing once the queue is closed and empty.
+		std::optional<T> pop()
+		{
+			std::optional<T> value{};
+			{
+				std::unique_lock lock{ m_mutex };
+				if (m_values.empty() && !m_closed)
+				{
+					const auto start{ std::chrono::steady_clock::now() };
+					m_notEmpty.wait(lock, [this] { return !m_values.empty() || m_closed; });
+					m_statistics.popWaitSeconds += std::chrono::duration<double>{ std::chrono::steady_clock::now() - start }.count();
+				}
+				if (m_values.empty())
+				{
+					return std::nullopt;
+				}
+
+				value.emplace(std::move(m_values.front()));
+				m_values.pop_front();
+			}
+			m_notFull.notify_one();
+			return value;
+		}
+
+		// Returns nothing if no value is ready yet
+		std::optional<T> tryPop()
+		{
+			std::optional<T> value{};
+			{
+				std::lock_guard lock{ m_mutex };
+				if (m_values.empty())
+				{
+					return std::nullopt;
+				}
+
+				value.emplace(std::move(m_values.front()));
+				m_values.pop_front();
+			}
+			m_notFull.notify_one();
+			return value;
+		}
+
+		// Nothing more will be pushed. What is queued can still be popped.
+		void close()
+		{
+			{
+				std::lock_guard lock{ m_mutex };
+				m_closed = true;
+			}
+			m_notFull.notify_all();
+			m_notEmpty.notify_all();
+		}
+
+		Statistics statistics() const
+		{
+			std::lock_guard lock{ m_mutex };
+			Statistics statistics{ m_statistics };
+			statistics.capacity = m_capacity;
+			return statistics;
+		}
+
+	private:
+		std::deque<T>           m_values{};
+		std::size_t             m_capacity{};
+		bool                    m_closed{ false };
+		Statistics              m_statistics{};
+		mutable std::mutex      m_mutex{};
+		std::condition_variable m_notFull{};
+		std::condition_variable m_notEmpty{};
+	};
+
+}
\ No newline at end of file
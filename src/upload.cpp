@@ -0,0 +1,508 @@
+#include "upload.hpp"
+
+#include "alloc.hpp"
+#include "cmd_buffer.hpp"
+#include "mip_generator.hpp"
+#include "sync.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iostream>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	// Keeps every region suitably aligned for both buffer and image copies
+	constexpr VkDeviceSize stagingAlignment{ 16 };
+
+	UploadManager::UploadManager(VkDevice device, VmaAllocator allocator, std::uint32_t transferQueueFamily, VkQueue transferQueue,
+		std::uint32_t graphicsQueueFamily, VkQueue graphicsQueue, VkDeviceSize ringSize)
+		: m_ringSize{ ringSize },
+		  m_transferQueue{ transferQueue },
+		  m_graphicsQueue{ graphicsQueue },
+		  m_queueFamilies{ transferQueueFamily, graphicsQueueFamily },
+		  m_device{ device },
+		  m_allocator{ allocator }
+	{
+		VkBufferCreateInfo ringCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+			.size{ ringSize },
+			.usage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+		};
+		VmaAllocationCreateInfo ringAllocCI
+		{
+			.flags{ VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_HOST },
+			.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+		};
+		VmaAllocationInfo ringAllocInfo{};
+		vmaCreateBuffer(allocator, &ringCI, &ringAllocCI, &m_ring.buffer, &m_ring.alloc, &ringAllocInfo);
+		m_ringData = static_cast<std::uint8_t*>(ringAllocInfo.pMappedData);
+
+		VkSemaphoreTypeCreateInfo timelineCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO },
+			.semaphoreType{ VK_SEMAPHORE_TYPE_TIMELINE },
+			.initialValue{ 0 },
+		};
+		VkSemaphoreCreateInfo semaphoreCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO },
+			.pNext{ &timelineCI },
+		};
+		vkCreateSemaphore(device, &semaphoreCI, nullptr, &m_timeline);
+
+		m_transferCommandPool = createCommandPool(device, transferQueueFamily, true);
+		m_graphicsCommandPool = dedicatedTransfer() ? createCommandPool(device, graphicsQueueFamily, true) : m_transferCommandPool;
+	}
+
+	UploadManager::UploadManager(UploadManager&& u) noexcept
+	{
+		move(std::move(u));
+	}
+
+	UploadManager& UploadManager::operator=(UploadManager&& u) noexcept
+	{
+		destroy();
+		move(std::move(u));
+		return *this;
+	}
+
+	UploadManager::~UploadManager()
+	{
+		destroy();
+	}
+
+	StagingRegion UploadManager::allocateStaging(VkDeviceSize size)
+	{
+		if (!m_busy)
+		{
+			m_busy = true;
+			m_busyStart = std::chrono::steady_clock::now();
+		}
+		m_bytesUploaded += size;
+
+		size = (size + stagingAlignment - 1) / stagingAlignment * stagingAlignment;
+
+		// Anything that would hog the ring gets its own buffer, released with the batch
+		if (size > m_ringSize / 2)
+		{
+			VkBufferCreateInfo stagingBufferCI
+			{
+				.sType{ VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO },
+				.size{ size },
+				.usage{ VK_BUFFER_USAGE_TRANSFER_SRC_BIT },
+			};
+			VmaAllocationCreateInfo stagingAllocCI
+			{
+				.flags{ VMA_ALLOCATION_CREATE_MAPPED_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT },
+				.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_HOST },
+				.requiredFlags{ VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT },
+			};
+			Buffer stagingBuffer{};
+			VmaAllocationInfo stagingAllocInfo{};
+			vmaCreateBuffer(m_allocator, &stagingBufferCI, &stagingAllocCI, &stagingBuffer.buffer, &stagingBuffer.alloc, &stagingAllocInfo);
+
+			transferCommands();
+			m_open.garbage.push_back(stagingBuffer);
+
+			return { stagingBuffer.buffer, 0, stagingAllocInfo.pMappedData };
+		}
+
+		// Regions never wrap around the end of the ring
+		VkDeviceSize offset{ m_ringHead % m_ringSize };
+		if (offset + size > m_ringSize)
+		{
+			m_ringHead += m_ringSize - offset;
+			offset = 0;
+		}
+
+		while (m_ringHead + size - m_ringTail > m_ringSize)
+		{
+			if (m_inFlight.empty())
+			{
+				flush();
+			}
+			wait(m_inFlight.front().value);
+		}
+
+		m_ringHead += size;
+
+		transferCommands();
+
+		return { m_ring.buffer, offset, m_ringData + offset };
+	}
+
+	VkCommandBuffer UploadManager::transferCommands()
+	{
+		if (m_open.transferCommands == VK_NULL_HANDLE)
+		{
+			m_open.transferCommands = beginCommands(m_transferCommandPool, m_freeTransferCommands);
+		}
+
+		return m_open.transferCommands;
+	}
+
+	VkCommandBuffer UploadManager::graphicsCommands()
+	{
+		if (!dedicatedTransfer())
+		{
+			return transferCommands();
+		}
+
+		if (m_open.graphicsCommands == VK_NULL_HANDLE)
+		{
+			m_open.graphicsCommands = beginCommands(m_graphicsCommandPool, m_freeGraphicsCommands);
+		}
+
+		return m_open.graphicsCommands;
+	}
+
+	void UploadManager::uploadBuffer(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset)
+	{
+		const StagingRegion staging{ allocateStaging(size) };
+		std::memcpy(staging.data, data, size);
+
+		VkBufferCopy region
+		{
+			.srcOffset{ staging.offset },
+			.dstOffset{ offset },
+			.size{ size },
+		};
+		vkCmdCopyBuffer(transferCommands(), staging.buffer, buffer, 1, &region);
+	}
+
+	Buffer UploadManager::createBuffer(VkBufferCreateInfo bufferCI) const
+	{
+		bufferCI.usage |= VK_BUFFER_USAGE_TRANSFER_DST_BIT;
+		shareBuffer(bufferCI);
+
+		VmaAllocationCreateInfo allocCI
+		{
+			.flags{ VMA_ALLOCATION_CREATE_HOST_ACCESS_SEQUENTIAL_WRITE_BIT | VMA_ALLOCATION_CREATE_HOST_ACCESS_ALLOW_TRANSFER_INSTEAD_BIT | VMA_ALLOCATION_CREATE_MAPPED_BIT },
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+		};
+
+		Buffer buffer{};
+		vmaCreateBuffer(m_allocator, &bufferCI, &allocCI, &buffer.buffer, &buffer.alloc, nullptr);
+
+		return buffer;
+	}
+
+	BufferWrite UploadManager::beginBufferWrite(const Buffer& buffer, VkDeviceSize offset, VkDeviceSize size)
+	{
+		VkMemoryPropertyFlags memoryProperties{};
+		vmaGetAllocationMemoryProperties(m_allocator, buffer.alloc, &memoryProperties);
+
+		if (memoryProperties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+		{
+			VmaAllocationInfo allocInfo{};
+			vmaGetAllocationInfo(m_allocator, buffer.alloc, &allocInfo);
+
+			m_bytesWrittenDirectly += size;
+
+			return { static_cast<std::uint8_t*>(allocInfo.pMappedData) + offset, buffer.buffer, buffer.alloc, offset, size };
+		}
+
+		const StagingRegion staging{ allocateStaging(size) };
+		return { staging.data, buffer.buffer, buffer.alloc, offset, size, staging };
+	}
+
+	void UploadManager::endBufferWrite(const BufferWrite& write)
+	{
+		if (write.staging.buffer == VK_NULL_HANDLE)
+		{
+			vmaFlushAllocation(m_allocator, write.alloc, write.offset, write.size);
+			return;
+		}
+
+		VkBufferCopy region
+		{
+			.srcOffset{ write.staging.offset },
+			.dstOffset{ write.offset },
+			.size{ write.size },
+		};
+		vkCmdCopyBuffer(transferCommands(), write.staging.buffer, write.buffer, 1, &region);
+	}
+
+	void UploadManager::transferImageOwnership(VkImage image, VkImageLayout layout, const VkImageSubresourceRange& subresourceRange)
+	{
+		if (!dedicatedTransfer())
+		{
+			return;
+		}
+
+		VkImageMemoryBarrier releaseBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+			.dstAccessMask{ VK_ACCESS_NONE },
+			.oldLayout{ layout },
+			.newLayout{ layout },
+			.srcQueueFamilyIndex{ m_queueFamilies[0] },
+			.dstQueueFamilyIndex{ m_queueFamilies[1] },
+			.image{ image },
+			.subresourceRange{ subresourceRange },
+		};
+		vkCmdPipelineBarrier(transferCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &releaseBarrier);
+
+		VkImageMemoryBarrier acquireBarrier{ releaseBarrier };
+		acquireBarrier.srcAccessMask = VK_ACCESS_NONE;
+		acquireBarrier.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT | VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(graphicsCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &acquireBarrier);
+	}
+
+	void UploadManager::shareBuffer(VkBufferCreateInfo& bufferCI) const
+	{
+		if (dedicatedTransfer())
+		{
+			bufferCI.sharingMode = VK_SHARING_MODE_CONCURRENT;
+			bufferCI.queueFamilyIndexCount = 2;
+			bufferCI.pQueueFamilyIndices = m_queueFamilies;
+		}
+	}
+
+	void UploadManager::destroyAfterUpload(Buffer buffer)
+	{
+		transferCommands();
+		m_open.garbage.push_back(buffer);
+	}
+
+	void UploadManager::destroyAfterUpload(std::function<void()> destroy)
+	{
+		transferCommands();
+		m_open.deferred.push_back(std::move(destroy));
+	}
+
+	std::uint64_t UploadManager::flush()
+	{
+		if (m_open.transferCommands == VK_NULL_HANDLE && m_open.graphicsCommands == VK_NULL_HANDLE)
+		{
+			return m_submittedValue;
+		}
+
+		if (m_mipGenerator && m_mipGenerator->pending())
+		{
+			m_mipGenerator->record(graphicsCommands(), *this);
+		}
+
+		// Later submissions on the graphics queue read what this batch wrote. With a dedicated
+		// transfer queue the timeline semaphore carries that dependency instead.
+		if (!dedicatedTransfer())
+		{
+			VkMemoryBarrier uploadBarrier
+			{
+				.sType{ VK_STRUCTURE_TYPE_MEMORY_BARRIER },
+				.srcAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+				.dstAccessMask{ VK_ACCESS_MEMORY_READ_BIT },
+			};
+			vkCmdPipelineBarrier(transferCommands(), VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_ALL_COMMANDS_BIT,
+				0, 1, &uploadBarrier, 0, nullptr, 0, nullptr);
+		}
+
+		// Each submit waits for the one before it, which may still be running on the other queue. That keeps the
+		// timeline increasing, so a batch never reads as complete before all of its earlier ones are.
+		const std::uint64_t previousValue{ m_submittedValue };
+		std::uint64_t transferValue{ 0 };
+		if (m_open.transferCommands != VK_NULL_HANDLE)
+		{
+			vkEndCommandBuffer(m_open.transferCommands);
+			transferValue = ++m_submittedValue;
+			submit(m_transferQueue, m_open.transferCommands, previousValue, transferValue);
+		}
+		if (m_open.graphicsCommands != VK_NULL_HANDLE)
+		{
+			vkEndCommandBuffer(m_open.graphicsCommands);
+			++m_submittedValue;
+			submit(m_graphicsQueue, m_open.graphicsCommands, transferValue != 0 ? transferValue : previousValue, m_submittedValue);
+		}
+
+		m_open.value = m_submittedValue;
+		m_open.ringEnd = m_ringHead;
+		m_inFlight.push_back(std::move(m_open));
+		m_open = {};
+
+		return m_submittedValue;
+	}
+
+	bool UploadManager::isComplete(std::uint64_t value)
+	{
+		retire();
+		return m_inFlight.empty() || m_inFlight.front().value > value;
+	}
+
+	void UploadManager::wait(std::uint64_t value)
+	{
+		VkSemaphoreWaitInfo waitInfo
+		{
+			.sType{ VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO },
+			.semaphoreCount{ 1 },
+			.pSemaphores{ &m_timeline },
+			.pValues{ &value },
+		};
+		vkWaitSemaphores(m_device, &waitInfo, secondsToNanoseconds(600));
+
+		retire();
+	}
+
+	void UploadManager::waitIdle()
+	{
+		wait(flush());
+
+		if (m_busy)
+		{
+			m_busy = false;
+			m_busySeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - m_busyStart).count();
+		}
+	}
+
+	void UploadManager::printStatistics() const
+	{
+		const double megabytes{ m_bytesUploaded / (1024.0 * 1024.0) };
+		std::cout << "uploaded " << megabytes << " MB in " << m_busySeconds << " s ("
+			<< (m_busySeconds > 0.0 ? megabytes / m_busySeconds : 0.0) << " MB/s)"
+			<< (dedicatedTransfer() ? " on a dedicated transfer queue" : "")
+			<< ", wrote " << m_bytesWrittenDirectly / (1024.0 * 1024.0) << " MB directly into device memory\n";
+	}
+
+	VkCommandBuffer UploadManager::beginCommands(VkCommandPool commandPool, std::vector<VkCommandBuffer>& freeCommands)
+	{
+		VkCommandBuffer commandBuffer{};
+		if (freeCommands.empty())
+		{
+			commandBuffer = allocateCommandBuffer(m_device, commandPool);
+		}
+		else
+		{
+			commandBuffer = freeCommands.back();
+			freeCommands.pop_back();
+			vkResetCommandBuffer(commandBuffer, 0);
+		}
+
+		beginCommandBuffer(commandBuffer, true);
+
+		return commandBuffer;
+	}
+
+	void UploadManager::submit(VkQueue queue, VkCommandBuffer commandBuffer, std::uint64_t waitValue, std::uint64_t signalValue)
+	{
+		const VkPipelineStageFlags waitStage{ VK_PIPELINE_STAGE_ALL_COMMANDS_BIT };
+
+		VkTimelineSemaphoreSubmitInfo timelineInfo
+		{
+			.sType{ VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO },
+			.waitSemaphoreValueCount{ waitValue != 0 ? 1u : 0u },
+			.pWaitSemaphoreValues{ &waitValue },
+			.signalSemaphoreValueCount{ 1 },
+			.pSignalSemaphoreValues{ &signalValue },
+		};
+		VkSubmitInfo submitInfo
+		{
+			.sType{ VK_STRUCTURE_TYPE_SUBMIT_INFO },
+			.pNext{ &timelineInfo },
+			.waitSemaphoreCount{ waitValue != 0 ? 1u : 0u },
+			.pWaitSemaphores{ &m_timeline },
+			.pWaitDstStageMask{ &waitStage },
+			.commandBufferCount{ 1 },
+			.pCommandBuffers{ &commandBuffer },
+			.signalSemaphoreCount{ 1 },
+			.pSignalSemaphores{ &m_timeline },
+		};
+
+		vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+	}
+
+	void UploadManager::retire()
+	{
+		std::uint64_t completedValue{};
+		vkGetSemaphoreCounterValue(m_device, m_timeline, &completedValue);
+
+		while (!m_inFlight.empty() && m_inFlight.front().value <= completedValue)
+		{
+			Batch& batch{ m_inFlight.front() };
+
+			for (const auto& buffer : batch.garbage)
+			{
+				vmaDestroyBuffer(m_allocator, buffer.buffer, buffer.alloc);
+			}
+			for (const auto& destroy : batch.deferred)
+			{
+				destroy();
+			}
+			if (batch.transferCommands != VK_NULL_HANDLE)
+			{
+				m_freeTransferCommands.push_back(batch.transferCommands);
+			}
+			if (batch.graphicsCommands != VK_NULL_HANDLE)
+			{
+				m_freeGraphicsCommands.push_back(batch.graphicsCommands);
+			}
+			m_ringTail = batch.ringEnd;
+
+			m_inFlight.pop_front();
+		}
+	}
+
+	void UploadManager::move(UploadManager&& u)
+	{
+		m_ring = u.m_ring;
+		m_ringData = u.m_ringData;
+		m_ringSize = u.m_ringSize;
+		m_ringHead = u.m_ringHead;
+		m_ringTail = u.m_ringTail;
+
+		m_open = std::move(u.m_open);
+		m_inFlight = std::move(u.m_inFlight);
+		m_freeTransferCommands = std::move(u.m_freeTransferCommands);
+		m_freeGraphicsCommands = std::move(u.m_freeGraphicsCommands);
+
+		m_timeline = u.m_timeline;
+		m_submittedValue = u.m_submittedValue;
+
+		m_transferCommandPool = u.m_transferCommandPool;
+		m_graphicsCommandPool = u.m_graphicsCommandPool;
+		m_transferQueue = u.m_transferQueue;
+		m_graphicsQueue = u.m_graphicsQueue;
+		m_queueFamilies[0] = u.m_queueFamilies[0];
+		m_queueFamilies[1] = u.m_queueFamilies[1];
+
+		m_bytesUploaded = u.m_bytesUploaded;
+		m_bytesWrittenDirectly = u.m_bytesWrittenDirectly;
+		m_busySeconds = u.m_busySeconds;
+		m_busy = u.m_busy;
+		m_busyStart = u.m_busyStart;
+
+		m_device = u.m_device;
+		m_allocator = u.m_allocator;
+		m_mipGenerator = u.m_mipGenerator;
+		u.m_device = {};
+		u.m_allocator = {};
+	}
+
+	void UploadManager::destroy()
+	{
+		if (m_device != VkDevice{})
+		{
+			waitIdle();
+
+			vkDestroySemaphore(m_device, m_timeline, nullptr);
+			if (m_graphicsCommandPool != m_transferCommandPool)
+			{
+				vkDestroyCommandPool(m_device, m_graphicsCommandPool, nullptr);
+			}
+			vkDestroyCommandPool(m_device, m_transferCommandPool, nullptr);
+			vmaDestroyBuffer(m_allocator, m_ring.buffer, m_ring.alloc);
+		}
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,167 @@
+#pragma once
+
+#include "alloc.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <vector>
+
+namespace Graphics
+{
+
+	class MipGenerator;
+
+	// Staging memory that stays valid until the batch it was allocated in has completed
+	struct StagingRegion
+	{
+		VkBuffer     buffer{};
+		VkDeviceSize offset{};
+		void*        data{};
+	};
+
+	// Where the CPU writes data bound for a buffer: the buffer's own memory when it is host visible
+	// (resizable BAR, unified memory, software implementations), otherwise a staging region that is
+	// copied over when the write ends
+	struct BufferWrite
+	{
+		void*         data{};
+		VkBuffer      buffer{};
+		VmaAllocation alloc{};
+		VkDeviceSize  offset{};
+		VkDeviceSize  size{};
+		StagingRegion staging{}; // Empty for direct writes
+	};
+
+	// Records uploads into batches that are submitted together and tracked with a timeline semaphore,
+	// staging through a persistently mapped ring buffer. Copies run on a dedicated transfer queue when
+	// the device has one; work that needs the graphics queue (mip generation, layout changes after an
+	// ownership transfer) is recorded into graphicsCommands() and ordered after the batch's copies.
+	class UploadManager
+	{
+	public:
+		UploadManager() = default;
+
+		UploadManager(VkDevice device, VmaAllocator allocator, std::uint32_t transferQueueFamily, VkQueue transferQueue,
+			std::uint32_t graphicsQueueFamily, VkQueue graphicsQueue, VkDeviceSize ringSize = 64ull * 1024 * 1024);
+
+		UploadManager(const UploadManager&) = delete;
+		UploadManager& operator=(const UploadManager&) = delete;
+
+		UploadManager(UploadManager&& u) noexcept;
+		UploadManager& operator=(UploadManager&& u) noexcept;
+
+		~UploadManager();
+
+		// May submit the open batch to make room, so allocate before fetching the command buffers
+		StagingRegion allocateStaging(VkDeviceSize size);
+
+		VkCommandBuffer transferCommands();
+		VkCommandBuffer graphicsCommands();
+
+		void uploadBuffer(const void* data, VkDeviceSize size, VkBuffer buffer, VkDeviceSize offset);
+
+		// Creates a device local buffer that lands in host visible memory when the device has some,
+		// so writes to it can skip staging. Adds the transfer usage and sharing it needs.
+		Buffer createBuffer(VkBufferCreateInfo bufferCI) const;
+
+		// The range must be written through data before any other call into the uploader,
+		// and must not be in use by the GPU. Only buffers from createBuffer can be written directly.
+		BufferWrite beginBufferWrite(const Buffer& buffer, VkDeviceSize offset, VkDeviceSize size);
+		void endBufferWrite(const BufferWrite& write);
+
+		// Hands an image written by transferCommands() over to graphicsCommands(), keeping its layout.
+		// Does nothing when both run on the same queue.
+		void transferImageOwnership(VkImage image, VkImageLayout layout, const VkImageSubresourceRange& subresourceRange);
+
+		// Buffers written by uploads and read by the graphics queue are shared between both families,
+		// so they need no ownership transfers
+		void shareBuffer(VkBufferCreateInfo& bufferCI) const;
+
+		// Destroys the buffer once everything recorded so far has completed
+		void destroyAfterUpload(Buffer buffer);
+		void destroyAfterUpload(std::function<void()> destroy);
+
+		// Mips requested from the generator are recorded into each batch just before it is submitted.
+		// The generator must outlive the uploader.
+		void setMipGenerator(MipGenerator* mipGenerator)
+		{
+			m_mipGenerator = mipGenerator;
+		}
+		MipGenerator* mipGenerator() const
+		{
+			return m_mipGenerator;
+		}
+
+		// Submits the open batch and returns the timeline value that signals its completion
+		std::uint64_t flush();
+
+		bool isComplete(std::uint64_t value);
+		void wait(std::uint64_t value);
+		void waitIdle();
+
+		void printStatistics() const;
+
+		bool dedicatedTransfer() const
+		{
+			return m_queueFamilies[0] != m_queueFamilies[1];
+		}
+
+	private:
+		struct Batch
+		{
+			VkCommandBuffer     transferCommands{};
+			VkCommandBuffer     graphicsCommands{};
+			std::uint64_t       value{};
+			VkDeviceSize        ringEnd{};
+			std::vector<Buffer> garbage{};
+
+			std::vector<std::function<void()>> deferred{};
+		};
+
+		Buffer         m_ring{};
+		std::uint8_t*  m_ringData{};
+		VkDeviceSize   m_ringSize{};
+		VkDeviceSize   m_ringHead{}; // Total bytes ever allocated from the ring
+		VkDeviceSize   m_ringTail{}; // Total bytes ever released back to it
+
+		Batch             m_open{};
+		std::deque<Batch> m_inFlight{};
+
+		std::vector<VkCommandBuffer> m_freeTransferCommands{};
+		std::vector<VkCommandBuffer> m_freeGraphicsCommands{};
+
+		VkSemaphore   m_timeline{};
+		std::uint64_t m_submittedValue{};
+
+		VkCommandPool m_transferCommandPool{};
+		VkCommandPool m_graphicsCommandPool{};
+		VkQueue       m_transferQueue{};
+		VkQueue       m_graphicsQueue{};
+		std::uint32_t m_queueFamilies[2]{}; // Transfer, graphics
+
+		std::uint64_t                         m_bytesUploaded{};
+		std::uint64_t                         m_bytesWrittenDirectly{};
+		double                                m_busySeconds{};
+		bool                                  m_busy{};
+		std::chrono::steady_clock::time_point m_busyStart{};
+
+		// Not owned by the class
+		VkDevice      m_device{};
+		VmaAllocator  m_allocator{};
+		MipGenerator* m_mipGenerator{};
+
+		VkCommandBuffer beginCommands(VkCommandPool commandPool, std::vector<VkCommandBuffer>& freeCommands);
+		void submit(VkQueue queue, VkCommandBuffer commandBuffer, std::uint64_t waitValue, std::uint64_t signalValue);
+		void retire();
+
+		void move(UploadManager&& u);
+		void destroy();
+	};
+
+}
\ No newline at end of file
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "glm/glm.hpp"
+#define GLM_ENABLE_EXPERIMENTAL
+#include "glm/gtx/hash.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+
+namespace Graphics
+{
+
+	struct Vertex
+	{
+		glm::vec3     pos{};
+		glm::vec3     norm{};
+		glm::vec3     color{};
+		glm::vec2     tex{};
+		std::uint32_t layer{}; // Of the texture array the mesh's texture was packed into
+
+		bool operator==(const Vertex& v) const
+		{
+			return pos == v.pos && norm == v.norm && color == v.color && tex == v.tex && layer == v.layer;
+		}
+	};
+
+}
+
+template<>
+struct std::hash<Graphics::Vertex>
+{
+	size_t operator()(const Graphics::Vertex& v) const noexcept
+	{
+		size_t h1{ hash<glm::vec3>{}(v.pos) };
+		size_t h2{ hash<glm::vec3>{}(v.norm) };
+		size_t h3{ hash<glm::vec3>{}(v.color) };
+		size_t h4{ hash<glm::vec2>{}(v.tex) };
+		size_t h5{ hash<std::uint32_t>{}(v.layer) };
+
+		constexpr std::uint64_t multiplier{ 6364136223846793005 };
+		constexpr std::uint64_t increment{ 1442695040888963407 };
+
+		size_t finalHash{ h1 };
+		finalHash = finalHash ^ (h2 * multiplier + increment);
+		finalHash = finalHash ^ (h3 * multiplier + increment);
+		finalHash = finalHash ^ (h4 * multiplier + increment);
+		finalHash = finalHash ^ (h5 * multiplier + increment);
+
+		return finalHash;
+	}
+};
\ No newline at end of file
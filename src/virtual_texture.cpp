@@ -0,0 +1,799 @@
+#include "virtual_texture.hpp"
+
+#include "alloc.hpp"
+#include "image.hpp"
+#include "mesh.hpp"
+#include "sampler_cache.hpp"
+#include "texture_cache.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+#include "stb/stb_image.h"
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <system_error>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	constexpr char          pageFileIdentifier[4]{ 'V', 'T', 'E', 'X' };
+	constexpr std::uint32_t pageFileVersion{ 1 };
+
+	// Page keys and requests have 12 bits for each page coordinate, and the page table grows with the square of this
+	constexpr std::uint32_t maxPages{ 256 };
+
+	constexpr std::uint32_t paddedPageSize{ VirtualTextureCache::pageSize + 2 * VirtualTextureCache::pageBorder };
+	constexpr std::size_t   pageBytes{ static_cast<std::size_t>(paddedPageSize) * paddedPageSize * 4 };
+
+	// Followed by every page, RGBA8 sRGB, level by level from the largest and row by row within a level
+	struct PageFileHeader
+	{
+		char          identifier[4]{};
+		std::uint32_t version{};
+		std::uint32_t pageSize{};
+		std::uint32_t pageBorder{};
+		std::uint32_t pages{}; // Per side at level 0
+		std::uint32_t levels{};
+	};
+
+	// Must match the page requests uber.frag appends
+	std::uint32_t pageKey(std::uint32_t texture, std::uint32_t level, std::uint32_t x, std::uint32_t y)
+	{
+		return texture << 28 | level << 24 | y << 12 | x;
+	}
+
+	std::uint32_t keyTexture(std::uint32_t key)
+	{
+		return key >> 28;
+	}
+
+	std::uint32_t keyLevel(std::uint32_t key)
+	{
+		return (key >> 24) & 0xF;
+	}
+
+	std::uint32_t keyX(std::uint32_t key)
+	{
+		return key & 0xFFF;
+	}
+
+	std::uint32_t keyY(std::uint32_t key)
+	{
+		return (key >> 12) & 0xFFF;
+	}
+
+	// Bilinear, in the encoded space. Virtual textures are only ever stretched up to the next whole page count.
+	std::vector<std::uint8_t> resample(const DecodedImage& image, std::uint32_t size)
+	{
+		const std::uint8_t* source{ image.pixels.get() };
+		std::vector<std::uint8_t> result(static_cast<std::size_t>(size) * size * 4);
+		if (image.width == static_cast<int>(size) && image.height == static_cast<int>(size))
+		{
+			std::memcpy(result.data(), source, result.size());
+			return result;
+		}
+
+		for (std::uint32_t y{ 0 }; y < size; ++y)
+		{
+			const float sy{ std::clamp((y + 0.5f) * image.height / size - 0.5f, 0.0f, image.height - 1.0f) };
+			const int y0{ static_cast<int>(sy) };
+			const int y1{ std::min(y0 + 1, image.height - 1) };
+			const float fy{ sy - y0 };
+			for (std::uint32_t x{ 0 }; x < size; ++x)
+			{
+				const float sx{ std::clamp((x + 0.5f) * image.width / size - 0.5f, 0.0f, image.width - 1.0f) };
+				const int x0{ static_cast<int>(sx) };
+				const int x1{ std::min(x0 + 1, image.width - 1) };
+				const float fx{ sx - x0 };
+				for (int c{ 0 }; c < 4; ++c)
+				{
+					auto texel{ [&](int tx, int ty) { return static_cast<float>(source[(static_cast<std::size_t>(ty) * image.width + tx) * 4 + c]); } };
+					const float top{ texel(x0, y0) + (texel(x1, y0) - texel(x0, y0)) * fx };
+					const float bottom{ texel(x0, y1) + (texel(x1, y1) - texel(x0, y1)) * fx };
+					result[(static_cast<std::size_t>(y) * size + x) * 4 + c] = static_cast<std::uint8_t>(top + (bottom - top) * fy + 0.5f);
+				}
+			}
+		}
+		return result;
+	}
+
+	// Box filters color in linear space and alpha as is
+	std::vector<std::uint8_t> downsample(const std::vector<std::uint8_t>& level, std::uint32_t size)
+	{
+		static const std::array<float, 256> linear{ []
+		{
+			std::array<float, 256> table{};
+			for (std::size_t i{ 0 }; i < table.size(); ++i)
+			{
+				table[i] = decodeSrgb(static_cast<float>(i) / 255.0f);
+			}
+			return table;
+		}() };
+
+		const std::uint32_t half{ size / 2 };
+		std::vector<std::uint8_t> result(static_cast<std::size_t>(half) * half * 4);
+		for (std::uint32_t y{ 0 }; y < half; ++y)
+		{
+			for (std::uint32_t x{ 0 }; x < half; ++x)
+			{
+				const std::size_t texels[4]
+				{
+					(static_cast<std::size_t>(y * 2) * size + x * 2) * 4,
+					(static_cast<std::size_t>(y * 2) * size + x * 2 + 1) * 4,
+					(static_cast<std::size_t>(y * 2 + 1) * size + x * 2) * 4,
+					(static_cast<std::size_t>(y * 2 + 1) * size + x * 2 + 1) * 4,
+				};
+				std::uint8_t* out{ &result[(static_cast<std::size_t>(y) * half + x) * 4] };
+				for (int c{ 0 }; c < 3; ++c)
+				{
+					float sum{ 0.0f };
+					for (std::size_t texel : texels)
+					{
+						sum += linear[level[texel + c]];
+					}
+					out[c] = static_cast<std::uint8_t>(std::clamp(encodeSrgb(sum * 0.25f) * 255.0f + 0.5f, 0.0f, 255.0f));
+				}
+				out[3] = static_cast<std::uint8_t>((level[texels[0] + 3] + level[texels[1] + 3] + level[texels[2] + 3] + level[texels[3] + 3] + 2) / 4);
+			}
+		}
+		return result;
+	}
+
+	// The border repeats the texels across the page's edges, wrapping around the texture's own edges
+	void cutPage(const std::vector<std::uint8_t>& level, std::uint32_t size, std::uint32_t pageX, std::uint32_t pageY, std::uint8_t* page)
+	{
+		constexpr std::uint32_t pageSize{ VirtualTextureCache::pageSize };
+		constexpr std::uint32_t pageBorder{ VirtualTextureCache::pageBorder };
+		for (std::uint32_t y{ 0 }; y < paddedPageSize; ++y)
+		{
+			const std::uint32_t sourceY{ (pageY * pageSize + size + y - pageBorder) % size };
+			for (std::uint32_t x{ 0 }; x < paddedPageSize; ++x)
+			{
+				const std::uint32_t sourceX{ (pageX * pageSize + size + x - pageBorder) % size };
+				std::memcpy(page + (static_cast<std::size_t>(y) * paddedPageSize + x) * 4,
+					&level[(static_cast<std::size_t>(sourceY) * size + sourceX) * 4], 4);
+			}
+		}
+	}
+
+	std::vector<std::byte> readPage(const std::string& path, std::uint64_t page)
+	{
+		std::vector<std::byte> data(pageBytes);
+
+		std::ifstream file{ path, std::ios::binary };
+		file.seekg(static_cast<std::streamoff>(sizeof(PageFileHeader) + page * pageBytes));
+		file.read(reinterpret_cast<char*>(data.data()), static_cast<std::streamsize>(data.size()));
+		if (!file)
+		{
+			std::cerr << "failed to read virtual texture page from: " << path << '\n';
+			return {};
+		}
+		return data;
+	}
+
+	std::string virtualTextureCachePath(const std::string& path, const std::string& cacheDirectory)
+	{
+		return (std::filesystem::path{ cacheDirectory } / (std::filesystem::path{ path }.relative_path().string() + ".vt")).string();
+	}
+
+	bool cookVirtualTexture(const std::string& path, const std::string& outPath)
+	{
+		constexpr std::uint32_t pageSize{ VirtualTextureCache::pageSize };
+
+		const DecodedImage decoded{ decodeImage(path.c_str(), false) };
+		if (!decoded.pixels)
+		{
+			return false;
+		}
+
+		// Square and a power of two in pages, so every level halves the page count exactly and a page of any
+		// level covers the same region as four pages of the level below
+		const std::uint32_t pages{ std::bit_ceil((static_cast<std::uint32_t>(std::max(decoded.width, decoded.height)) + pageSize - 1) / pageSize) };
+		if (pages > maxPages)
+		{
+			std::cerr << "too large for a virtual texture: " << path << '\n';
+			return false;
+		}
+
+		PageFileHeader header
+		{
+			.version{ pageFileVersion },
+			.pageSize{ pageSize },
+			.pageBorder{ VirtualTextureCache::pageBorder },
+			.pages{ pages },
+			.levels{ static_cast<std::uint32_t>(std::bit_width(pages)) },
+		};
+		std::memcpy(header.identifier, pageFileIdentifier, sizeof(pageFileIdentifier));
+
+		std::ofstream file{ outPath, std::ios::binary | std::ios::trunc };
+		if (!file)
+		{
+			return false;
+		}
+		file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+		std::uint32_t size{ pages * pageSize };
+		std::vector<std::uint8_t> level{ resample(decoded, size) };
+		std::vector<std::uint8_t> page(pageBytes);
+		for (std::uint32_t i{ 0 }; i < header.levels; ++i)
+		{
+			const std::uint32_t levelPages{ pages >> i };
+			for (std::uint32_t y{ 0 }; y < levelPages; ++y)
+			{
+				for (std::uint32_t x{ 0 }; x < levelPages; ++x)
+				{
+					cutPage(level, size, x, y, page.data());
+					file.write(reinterpret_cast<const char*>(page.data()), static_cast<std::streamsize>(page.size()));
+				}
+			}
+
+			if (i + 1 < header.levels)
+			{
+				level = downsample(level, size);
+				size /= 2;
+			}
+		}
+
+		return static_cast<bool>(file);
+	}
+
+	VirtualTextureCache::VirtualTextureCache(const VirtualTextureSettings& settings, UploadManager& uploader, SamplerCache& samplers,
+		VkDevice device, VmaAllocator allocator)
+		: m_settings{ settings },
+		  m_physicalPages(cachePages * cachePages),
+		  m_reads{ std::make_unique<CompletionQueue<std::vector<std::byte>>>() },
+		  m_pool{ std::make_unique<ThreadPool>(1) },
+		  m_uploader{ &uploader },
+		  m_device{ device },
+		  m_allocator{ allocator }
+	{
+		VkImageCreateInfo imageCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO },
+			.imageType{ VK_IMAGE_TYPE_2D },
+			.format{ VK_FORMAT_R8G8B8A8_SRGB },
+			.extent{ .width{ cachePages * paddedPageSize }, .height{ cachePages * paddedPageSize }, .depth{ 1u } },
+			.mipLevels{ 1 },
+			.arrayLayers{ 1 },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.tiling{ VK_IMAGE_TILING_OPTIMAL },
+			.usage{ VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+		};
+		VmaAllocationCreateInfo allocCI
+		{
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+		};
+		vmaCreateImage(m_allocator, &imageCI, &allocCI, &m_pageCache.image, &m_pageCache.alloc, nullptr);
+
+		VkImageViewCreateInfo imageViewCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO },
+			.image{ m_pageCache.image },
+			.viewType{ VK_IMAGE_VIEW_TYPE_2D },
+			.format{ imageCI.format },
+			.subresourceRange{ .aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT }, .levelCount{ 1 }, .layerCount{ 1 } },
+		};
+		vkCreateImageView(m_device, &imageViewCI, nullptr, &m_pageCacheView);
+
+		// Pages carry their own borders, so filtering never reaches into a neighbouring page
+		VkSamplerCreateInfo samplerCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO },
+			.magFilter{ VK_FILTER_LINEAR },
+			.minFilter{ VK_FILTER_LINEAR },
+			.mipmapMode{ VK_SAMPLER_MIPMAP_MODE_NEAREST },
+			.addressModeU{ VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			.addressModeV{ VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			.addressModeW{ VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE },
+			.minLod{ 0.0f },
+			.maxLod{ 0.0f },
+		};
+		m_pageCacheSampler = samplers.get(samplerCI);
+
+		// Page tables are only read with texelFetch, but integer formats can't be filtered either way
+		samplerCI.magFilter = VK_FILTER_NEAREST;
+		samplerCI.minFilter = VK_FILTER_NEAREST;
+		samplerCI.maxLod = VK_LOD_CLAMP_NONE;
+		m_pageTableSampler = samplers.get(samplerCI);
+
+		// Every page is written before a page table points at it, the rest of the cache can stay undefined
+		VkImageMemoryBarrier imageBarrier
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+			.srcAccessMask{ VK_ACCESS_NONE },
+			.dstAccessMask{ VK_ACCESS_SHADER_READ_BIT },
+			.oldLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+			.newLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+			.image{ m_pageCache.image },
+			.subresourceRange{ imageViewCI.subresourceRange },
+		};
+		vkCmdPipelineBarrier(m_uploader->graphicsCommands(), VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, 1, &imageBarrier);
+	}
+
+	VirtualTextureCache::VirtualTextureCache(VirtualTextureCache&& v) noexcept
+	{
+		move(std::move(v));
+	}
+
+	VirtualTextureCache& VirtualTextureCache::operator=(VirtualTextureCache&& v) noexcept
+	{
+		destroy();
+		move(std::move(v));
+		return *this;
+	}
+
+	VirtualTextureCache::~VirtualTextureCache()
+	{
+		destroy();
+	}
+
+	std::uint32_t VirtualTextureCache::add(const std::string& path)
+	{
+		if (!m_uploader)
+		{
+			return TextureCache::noTexture;
+		}
+
+		if (const auto found{ m_indices.find(path) }; found != m_indices.end())
+		{
+			return firstIndex + found->second;
+		}
+
+		int width{};
+		int height{};
+		int channels{};
+		if (m_textures.size() >= maxTextures || !stbi_info(path.c_str(), &width, &height, &channels) ||
+			static_cast<std::uint32_t>(std::max(width, height)) < m_settings.minSize)
+		{
+			return TextureCache::noTexture;
+		}
+
+		const std::filesystem::path pagePath{ virtualTextureCachePath(path) };
+		std::error_code error{};
+		const auto cacheTime{ std::filesystem::last_write_time(pagePath, error) };
+		if (error || cacheTime < std::filesystem::last_write_time(path, error))
+		{
+			// Written under a temporary name, so an interrupted run never leaves a half written file behind
+			std::filesystem::create_directories(pagePath.parent_path(), error);
+			const std::filesystem::path temporaryPath{ pagePath.string() + ".tmp" };
+			if (!cookVirtualTexture(path, temporaryPath.string()))
+			{
+				std::filesystem::remove(temporaryPath, error);
+				std::cerr << "failed to cook virtual texture: " << path << '\n';
+				return TextureCache::noTexture;
+			}
+			std::filesystem::rename(temporaryPath, pagePath, error);
+		}
+
+		PageFileHeader header{};
+		std::ifstream file{ pagePath, std::ios::binary };
+		file.read(reinterpret_cast<char*>(&header), sizeof(header));
+		if (!file || std::memcmp(header.identifier, pageFileIdentifier, sizeof(pageFileIdentifier)) != 0 ||
+			header.version != pageFileVersion || header.pageSize != pageSize || header.pageBorder != pageBorder ||
+			header.pages == 0 || header.pages > maxPages || header.levels != static_cast<std::uint32_t>(std::bit_width(header.pages)))
+		{
+			std::cerr << "not a usable virtual texture page file: " << pagePath.string() << '\n';
+			return TextureCache::noTexture;
+		}
+
+		VirtualTexture texture
+		{
+			.path{ pagePath.string() },
+			.pages{ header.pages },
+			.levels{ header.levels },
+		};
+		std::uint32_t entries{ 0 };
+		for (std::uint32_t level{ 0 }; level < texture.levels; ++level)
+		{
+			texture.firstEntry.push_back(entries);
+			entries += (texture.pages >> level) * (texture.pages >> level);
+		}
+		texture.entries.resize(entries);
+
+		VkImageCreateInfo imageCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO },
+			.imageType{ VK_IMAGE_TYPE_2D },
+			.format{ VK_FORMAT_R8G8B8A8_UINT },
+			.extent{ .width{ texture.pages }, .height{ texture.pages }, .depth{ 1u } },
+			.mipLevels{ texture.levels },
+			.arrayLayers{ 1 },
+			.samples{ VK_SAMPLE_COUNT_1_BIT },
+			.tiling{ VK_IMAGE_TILING_OPTIMAL },
+			.usage{ VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT },
+			.initialLayout{ VK_IMAGE_LAYOUT_UNDEFINED },
+		};
+		VmaAllocationCreateInfo allocCI
+		{
+			.usage{ VMA_MEMORY_USAGE_AUTO_PREFER_DEVICE },
+			.requiredFlags{ VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT },
+		};
+		vmaCreateImage(m_allocator, &imageCI, &allocCI, &texture.pageTable.image, &texture.pageTable.alloc, nullptr);
+
+		VkImageViewCreateInfo imageViewCI
+		{
+			.sType{ VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO },
+			.image{ texture.pageTable.image },
+			.viewType{ VK_IMAGE_VIEW_TYPE_2D },
+			.format{ imageCI.format },
+			.subresourceRange{ .aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT }, .levelCount{ texture.levels }, .layerCount{ 1 } },
+		};
+		vkCreateImageView(m_device, &imageViewCI, nullptr, &texture.pageTableView);
+
+		const std::uint32_t index{ size() };
+		m_textures.push_back(std::move(texture));
+		m_indices.emplace(path, index);
+
+		// The coarsest level is a single page every other page can fall back to, so it is loaded right away and never evicted
+		const VirtualTexture& added{ m_textures.back() };
+		std::vector<std::pair<std::uint32_t, std::vector<std::byte>>> uploads{};
+		std::vector<std::byte> root{ readPage(added.path, added.firstEntry[added.levels - 1]) };
+		const std::uint32_t slot{ root.empty() ? noSlot : allocatePhysicalPage() };
+		if (slot != noSlot)
+		{
+			const std::uint32_t key{ pageKey(index, added.levels - 1, 0, 0) };
+			m_physicalPages[slot] = { .key{ key }, .pinned{ true } };
+			m_resident.emplace(key, slot);
+			uploads.emplace_back(slot, std::move(root));
+		}
+		m_textures.back().dirty = true;
+		uploadPages(uploads);
+
+		return firstIndex + index;
+	}
+
+	void VirtualTextureCache::update(const std::uint32_t* feedback)
+	{
+		if (!m_uploader || m_textures.empty())
+		{
+			return;
+		}
+
+		++m_frame;
+
+		std::vector<std::uint32_t> missing{};
+		readFeedback(feedback, missing);
+
+		// Pages that finished reading go into the cache, taking the place of the least recently used ones
+		std::vector<std::pair<std::uint32_t, std::vector<std::byte>>> uploads{};
+		while (uploads.size() < m_settings.maxUploadsPerFrame)
+		{
+			auto result{ m_reads->tryPop() };
+			if (!result)
+			{
+				break;
+			}
+
+			const std::uint32_t key{ static_cast<std::uint32_t>(result->first) };
+			m_pending.erase(key);
+
+			// When every page was sampled this frame the read is dropped, and asked for again if it is still wanted
+			const std::uint32_t slot{ result->second.empty() ? noSlot : allocatePhysicalPage() };
+			if (slot == noSlot)
+			{
+				continue;
+			}
+
+			m_physicalPages[slot] = { .key{ key }, .lastUsed{ m_frame } };
+			m_resident.emplace(key, slot);
+			m_textures[keyTexture(key)].dirty = true;
+			uploads.emplace_back(slot, std::move(result->second));
+			++m_pagesLoaded;
+		}
+		uploadPages(uploads);
+
+		// Coarse pages first, so a texture sharpens evenly instead of one corner at a time
+		std::sort(missing.begin(), missing.end(), [](std::uint32_t a, std::uint32_t b) { return keyLevel(a) > keyLevel(b); });
+		for (std::uint32_t key : missing)
+		{
+			if (m_pending.size() >= m_settings.maxPendingReads)
+			{
+				break;
+			}
+
+			const VirtualTexture& texture{ m_textures[keyTexture(key)] };
+			const std::uint32_t level{ keyLevel(key) };
+			const std::uint64_t page{ texture.firstEntry[level] + keyY(key) * (texture.pages >> level) + keyX(key) };
+
+			m_pending.insert(key);
+			m_pool->submit([reads = m_reads.get(), path = texture.path, key, page]
+			{
+				reads->push(key, readPage(path, page));
+			});
+		}
+	}
+
+	void VirtualTextureCache::printStatistics() const
+	{
+		std::cout << "virtual textures: " << m_textures.size() << " textures, " << m_resident.size() << " of "
+			<< m_physicalPages.size() << " pages resident, " << m_pagesLoaded << " pages loaded, " << m_pagesEvicted << " evicted\n";
+	}
+
+	void VirtualTextureCache::readFeedback(const std::uint32_t* feedback, std::vector<std::uint32_t>& missing)
+	{
+		const std::uint32_t count{ std::min(feedback[feedbackOffset], maxFeedbackRequests) };
+		const std::uint32_t* requests{ feedback + feedbackOffset + 1 };
+
+		std::unordered_set<std::uint32_t> seen{};
+		for (std::uint32_t i{ 0 }; i < count; ++i)
+		{
+			const std::uint32_t key{ requests[i] };
+			if (!seen.insert(key).second)
+			{
+				continue;
+			}
+
+			const std::uint32_t texture{ keyTexture(key) };
+			const std::uint32_t level{ keyLevel(key) };
+			if (texture >= m_textures.size() || level >= m_textures[texture].levels ||
+				keyX(key) >= m_textures[texture].pages >> level || keyY(key) >= m_textures[texture].pages >> level)
+			{
+				continue;
+			}
+
+			if (!m_resident.contains(key) && !m_pending.contains(key))
+			{
+				missing.push_back(key);
+			}
+			touch(key);
+		}
+	}
+
+	void VirtualTextureCache::touch(std::uint32_t key)
+	{
+		// Until a page is resident it is drawn with the pages above it, so those count as used too
+		const std::uint32_t texture{ keyTexture(key) };
+		std::uint32_t x{ keyX(key) };
+		std::uint32_t y{ keyY(key) };
+		for (std::uint32_t level{ keyLevel(key) }; level < m_textures[texture].levels; ++level, x /= 2, y /= 2)
+		{
+			if (const auto resident{ m_resident.find(pageKey(texture, level, x, y)) }; resident != m_resident.end())
+			{
+				m_physicalPages[resident->second].lastUsed = m_frame;
+			}
+		}
+	}
+
+	std::uint32_t VirtualTextureCache::allocatePhysicalPage()
+	{
+		std::uint32_t oldest{ noSlot };
+		for (std::uint32_t slot{ 0 }; slot < m_physicalPages.size(); ++slot)
+		{
+			const PhysicalPage& page{ m_physicalPages[slot] };
+			if (page.key == noSlot)
+			{
+				return slot;
+			}
+			if (!page.pinned && (oldest == noSlot || page.lastUsed < m_physicalPages[oldest].lastUsed))
+			{
+				oldest = slot;
+			}
+		}
+
+		// Evicting a page sampled this frame would only bring it straight back
+		if (oldest == noSlot || m_physicalPages[oldest].lastUsed >= m_frame)
+		{
+			return noSlot;
+		}
+
+		const std::uint32_t key{ m_physicalPages[oldest].key };
+		m_resident.erase(key);
+		m_textures[keyTexture(key)].dirty = true;
+		m_physicalPages[oldest] = {};
+		++m_pagesEvicted;
+		return oldest;
+	}
+
+	void VirtualTextureCache::uploadPages(const std::vector<std::pair<std::uint32_t, std::vector<std::byte>>>& pages)
+	{
+		std::vector<std::uint32_t> tables{};
+		VkDeviceSize stagingSize{ pages.size() * pageBytes };
+		for (std::uint32_t texture{ 0 }; texture < m_textures.size(); ++texture)
+		{
+			if (m_textures[texture].dirty)
+			{
+				rebuildPageTable(texture);
+				tables.push_back(texture);
+				stagingSize += m_textures[texture].entries.size() * sizeof(std::uint32_t);
+			}
+		}
+		if (stagingSize == 0)
+		{
+			return;
+		}
+
+		const StagingRegion staging{ m_uploader->allocateStaging(stagingSize) };
+		VkCommandBuffer commandBuffer{ m_uploader->graphicsCommands() };
+
+		// Frames already submitted may still sample the pages being replaced and the old page tables, and the
+		// ones recorded after this batch must see the new ones. Both run on the graphics queue, so barriers on
+		// either side of the copies order them.
+		std::vector<VkImageMemoryBarrier> barriers{};
+		if (!pages.empty())
+		{
+			barriers.push_back(
+			{
+				.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+				.srcAccessMask{ VK_ACCESS_SHADER_READ_BIT },
+				.dstAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+				.oldLayout{ VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL },
+				.newLayout{ VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+				.image{ m_pageCache.image },
+				.subresourceRange{ .aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT }, .levelCount{ 1 }, .layerCount{ 1 } },
+			});
+		}
+		for (std::uint32_t texture : tables)
+		{
+			barriers.push_back(
+			{
+				.sType{ VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER },
+				.srcAccessMask{ VK_ACCESS_SHADER_READ_BIT },
+				.dstAccessMask{ VK_ACCESS_TRANSFER_WRITE_BIT },
+				.oldLayout{ m_textures[texture].initialized ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_UNDEFINED },
+				.newLayout{ VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL },
+				.image{ m_textures[texture].pageTable.image },
+				.subresourceRange{ .aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT }, .levelCount{ m_textures[texture].levels }, .layerCount{ 1 } },
+			});
+		}
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT,
+			0, 0, nullptr, 0, nullptr, static_cast<std::uint32_t>(barriers.size()), barriers.data());
+
+		std::size_t offset{ 0 };
+		std::vector<VkBufferImageCopy> copies{};
+		for (const auto& [slot, data] : pages)
+		{
+			std::memcpy(static_cast<char*>(staging.data) + offset, data.data(), pageBytes);
+			copies.push_back(
+			{
+				.bufferOffset{ staging.offset + offset },
+				.imageSubresource{ .aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT }, .mipLevel{ 0 }, .baseArrayLayer{ 0 }, .layerCount{ 1 } },
+				.imageOffset{ static_cast<std::int32_t>(slot % cachePages * paddedPageSize), static_cast<std::int32_t>(slot / cachePages * paddedPageSize), 0 },
+				.imageExtent{ paddedPageSize, paddedPageSize, 1 },
+			});
+			offset += pageBytes;
+		}
+		if (!copies.empty())
+		{
+			vkCmdCopyBufferToImage(commandBuffer, staging.buffer, m_pageCache.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<std::uint32_t>(copies.size()), copies.data());
+		}
+
+		for (std::uint32_t texture : tables)
+		{
+			VirtualTexture& virtualTexture{ m_textures[texture] };
+			std::memcpy(static_cast<char*>(staging.data) + offset, virtualTexture.entries.data(), virtualTexture.entries.size() * sizeof(std::uint32_t));
+
+			copies.clear();
+			for (std::uint32_t level{ 0 }; level < virtualTexture.levels; ++level)
+			{
+				const std::uint32_t levelPages{ virtualTexture.pages >> level };
+				copies.push_back(
+				{
+					.bufferOffset{ staging.offset + offset + virtualTexture.firstEntry[level] * sizeof(std::uint32_t) },
+					.imageSubresource{ .aspectMask{ VK_IMAGE_ASPECT_COLOR_BIT }, .mipLevel{ level }, .baseArrayLayer{ 0 }, .layerCount{ 1 } },
+					.imageExtent{ levelPages, levelPages, 1 },
+				});
+			}
+			vkCmdCopyBufferToImage(commandBuffer, staging.buffer, virtualTexture.pageTable.image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				static_cast<std::uint32_t>(copies.size()), copies.data());
+
+			offset += virtualTexture.entries.size() * sizeof(std::uint32_t);
+			virtualTexture.initialized = true;
+			virtualTexture.dirty = false;
+		}
+
+		for (VkImageMemoryBarrier& barrier : barriers)
+		{
+			barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+			barrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+			barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+			barrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+		}
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT,
+			0, 0, nullptr, 0, nullptr, static_cast<std::uint32_t>(barriers.size()), barriers.data());
+
+		m_uploader->flush();
+	}
+
+	void VirtualTextureCache::rebuildPageTable(std::uint32_t texture)
+	{
+		VirtualTexture& virtualTexture{ m_textures[texture] };
+
+		// Coarsest level first, so a page that isn't resident can take the entry of the page above it
+		for (std::uint32_t level{ virtualTexture.levels }; level-- > 0;)
+		{
+			const std::uint32_t levelPages{ virtualTexture.pages >> level };
+			for (std::uint32_t y{ 0 }; y < levelPages; ++y)
+			{
+				for (std::uint32_t x{ 0 }; x < levelPages; ++x)
+				{
+					std::uint32_t& entry{ virtualTexture.entries[virtualTexture.firstEntry[level] + y * levelPages + x] };
+					if (const auto resident{ m_resident.find(pageKey(texture, level, x, y)) }; resident != m_resident.end())
+					{
+						entry = resident->second % cachePages | resident->second / cachePages << 8 | level << 16;
+					}
+					else if (level + 1 < virtualTexture.levels)
+					{
+						entry = virtualTexture.entries[virtualTexture.firstEntry[level + 1] + y / 2 * (levelPages / 2) + x / 2];
+					}
+					else
+					{
+						entry = 0;
+					}
+				}
+			}
+		}
+	}
+
+	void VirtualTextureCache::move(VirtualTextureCache&& v)
+	{
+		m_settings = v.m_settings;
+		m_textures = std::move(v.m_textures);
+		m_indices = std::move(v.m_indices);
+		m_physicalPages = std::move(v.m_physicalPages);
+		m_resident = std::move(v.m_resident);
+		m_pending = std::move(v.m_pending);
+		m_frame = v.m_frame;
+
+		m_pageCache = v.m_pageCache;
+		m_pageCacheView = v.m_pageCacheView;
+
+		m_pagesLoaded = v.m_pagesLoaded;
+		m_pagesEvicted = v.m_pagesEvicted;
+
+		m_reads = std::move(v.m_reads);
+		m_pool = std::move(v.m_pool);
+
+		m_uploader = v.m_uploader;
+		m_device = v.m_device;
+		m_allocator = v.m_allocator;
+		m_pageCacheSampler = v.m_pageCacheSampler;
+		m_pageTableSampler = v.m_pageTableSampler;
+
+		v.m_textures.clear();
+		v.m_pageCache = {};
+		v.m_pageCacheView = VK_NULL_HANDLE;
+		v.m_uploader = nullptr;
+	}
+
+	void VirtualTextureCache::destroy()
+	{
+		// Joins the worker before the queue it pushes into goes away
+		m_pool.reset();
+		m_reads.reset();
+
+		for (VirtualTexture& texture : m_textures)
+		{
+			vkDestroyImageView(m_device, texture.pageTableView, nullptr);
+			vmaDestroyImage(m_allocator, texture.pageTable.image, texture.pageTable.alloc);
+		}
+		m_textures.clear();
+
+		if (m_pageCache.image)
+		{
+			vkDestroyImageView(m_device, m_pageCacheView, nullptr);
+			vmaDestroyImage(m_allocator, m_pageCache.image, m_pageCache.alloc);
+			m_pageCache = {};
+		}
+	}
+
+}
\ No newline at end of file
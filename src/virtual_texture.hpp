@@ -0,0 +1,166 @@
+#pragma once
+
+#include "alloc.hpp"
+#include "sampler_cache.hpp"
+#include "texture_cache.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "VMA/vk_mem_alloc.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct VirtualTextureSettings
+	{
+		std::uint32_t minSize{ 4096 };           // Material textures at least this large on a side are made virtual
+		std::uint32_t maxPendingReads{ 32 };     // Pages being read from disk at once
+		std::uint32_t maxUploadsPerFrame{ 16 };
+	};
+
+	// Where the tiled page file of the image at path is kept
+	std::string virtualTextureCachePath(const std::string& path, const std::string& cacheDirectory = "cache");
+
+	// Writes the image at path as a tiled page file: its mip chain, resampled to a square power of two
+	// number of pages, cut into pages with a border of neighbouring texels on every side
+	bool cookVirtualTexture(const std::string& path, const std::string& outPath);
+
+	// Textures too large to keep resident as a whole. Each one is split into fixed size pages, of which only
+	// the ones fragments actually sample are kept in a physical page cache shared by all virtual textures.
+	// A page table per texture, with one texel per page and level, points every page at the finest
+	// resident page covering it. uber.frag samples through the page table and appends the pages it wanted
+	// to the frame's feedback buffer; the cache reads those back, loads the missing pages from disk on a
+	// worker thread and recycles the least recently used ones.
+	class VirtualTextureCache
+	{
+	public:
+		// Must match uber.frag
+		static constexpr std::uint32_t pageSize{ 128 };
+		static constexpr std::uint32_t pageBorder{ 4 };
+		static constexpr std::uint32_t cachePages{ 16 };    // Per side of the physical page cache
+		static constexpr std::uint32_t maxTextures{ 16 };
+		static constexpr std::uint32_t firstIndex{ TextureCache::noTexture + 1 }; // Texture index of the first virtual texture
+
+		// Page requests follow the per slot levels in the frame's feedback buffer: a count, then the requests
+		static constexpr std::uint32_t feedbackOffset{ TextureCache::maxTextures };
+		static constexpr std::uint32_t maxFeedbackRequests{ 8192 };
+
+		VirtualTextureCache() = default;
+
+		// The uploader and sampler cache must outlive the virtual texture cache
+		VirtualTextureCache(const VirtualTextureSettings& settings, UploadManager& uploader, SamplerCache& samplers,
+			VkDevice device, VmaAllocator allocator);
+
+		VirtualTextureCache(const VirtualTextureCache&) = delete;
+		VirtualTextureCache& operator=(const VirtualTextureCache&) = delete;
+
+		VirtualTextureCache(VirtualTextureCache&& v) noexcept;
+		VirtualTextureCache& operator=(VirtualTextureCache&& v) noexcept;
+
+		~VirtualTextureCache();
+
+		// Returns the texture index to draw the image at path with, or noTexture if it is too small to be made
+		// virtual or its pages could not be written. Cooks the page file on the calling thread if it is missing
+		// or older than the source.
+		std::uint32_t add(const std::string& path);
+
+		// Call once per frame with the feedback of a frame that has finished on the GPU
+		void update(const std::uint32_t* feedback);
+
+		std::uint32_t size() const
+		{
+			return static_cast<std::uint32_t>(m_textures.size());
+		}
+
+		VkImageView pageCacheView() const
+		{
+			return m_pageCacheView;
+		}
+		VkSampler pageCacheSampler() const
+		{
+			return m_pageCacheSampler;
+		}
+		VkImageView pageTableView(std::uint32_t texture) const
+		{
+			return m_textures[texture].pageTableView;
+		}
+		VkSampler pageTableSampler() const
+		{
+			return m_pageTableSampler;
+		}
+
+		void printStatistics() const;
+
+	private:
+		static constexpr std::uint32_t noSlot{ ~0u };
+
+		struct VirtualTexture
+		{
+			std::string                path{};   // Of the page file
+			std::uint32_t              pages{};  // Per side at level 0
+			std::uint32_t              levels{};
+			std::vector<std::uint32_t> firstEntry{}; // Per level, into entries and the page file
+
+			// CPU copy of every level of the page table: x and y of the physical page and its level
+			std::vector<std::uint32_t> entries{};
+			bool                       dirty{};
+
+			Image       pageTable{};
+			VkImageView pageTableView{};
+			bool        initialized{}; // The page table has been written once
+		};
+
+		struct PhysicalPage
+		{
+			std::uint32_t key{ noSlot };
+			std::uint64_t lastUsed{};
+			bool          pinned{}; // The single page of a texture's coarsest level never leaves
+		};
+
+		VirtualTextureSettings m_settings{};
+
+		std::vector<VirtualTexture>                      m_textures{};
+		std::unordered_map<std::string, std::uint32_t>   m_indices{}; // By source path
+		std::vector<PhysicalPage>                        m_physicalPages{};
+		std::unordered_map<std::uint32_t, std::uint32_t> m_resident{}; // Page key to physical page
+		std::unordered_set<std::uint32_t>                m_pending{};
+		std::uint64_t                                    m_frame{};
+
+		Image       m_pageCache{};
+		VkImageView m_pageCacheView{};
+
+		std::size_t m_pagesLoaded{};
+		std::size_t m_pagesEvicted{};
+
+		// Results outlive the pool, so its workers never push into a destroyed queue
+		std::unique_ptr<CompletionQueue<std::vector<std::byte>>> m_reads{};
+		std::unique_ptr<ThreadPool>                              m_pool{};
+
+		// Not owned by the class
+		UploadManager* m_uploader{};
+		VkDevice       m_device{};
+		VmaAllocator   m_allocator{};
+		VkSampler      m_pageCacheSampler{};
+		VkSampler      m_pageTableSampler{};
+
+		void readFeedback(const std::uint32_t* feedback, std::vector<std::uint32_t>& missing);
+		void touch(std::uint32_t key);
+		std::uint32_t allocatePhysicalPage();
+		void uploadPages(const std::vector<std::pair<std::uint32_t, std::vector<std::byte>>>& pages);
+		void rebuildPageTable(std::uint32_t texture);
+
+		void move(VirtualTextureCache&& v);
+		void destroy();
+	};
+
+}
\ No newline at end of file
@@ -0,0 +1,518 @@
+#include "world_streamer.hpp"
+
+#include "geometry_arena.hpp"
+#include "mesh.hpp"
+#include "scene_pack.hpp"
+#include "scene_placement.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "glm/glm.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <iterator>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	WorldStreamer::WorldStreamer(const WorldStreamingSettings& settings, const PlacementFile& placements, const ScenePack& pack,
+		std::span<const std::uint32_t> packObjects, std::vector<RenderObject>& renderObjects, GeometryArena& geometry, UploadManager& uploader)
+		: m_settings{ settings },
+		  m_packObjects{ packObjects.begin(), packObjects.end() },
+		  m_loads{ std::make_unique<CompletionQueue<TileLoad>>() },
+		  m_pool{ std::make_unique<ThreadPool>(1) },
+		  m_placements{ &placements },
+		  m_pack{ &pack },
+		  m_renderObjects{ &renderObjects },
+		  m_geometry{ &geometry },
+		  m_uploader{ &uploader }
+	{
+		m_tiles.resize(placements.cells().size());
+		m_loadedTiles.resize(m_tiles.size(), 0);
+		for (std::uint32_t cell{ 0 }; cell < m_tiles.size(); ++cell)
+		{
+			const PlacementCell& placementCell{ placements.cells()[cell] };
+			Tile& tile{ m_tiles[cell] };
+			for (const Placement& placement : placements.placements().subspan(placementCell.firstPlacement, placementCell.placementCount))
+			{
+				if ((placement.flags & placementStatic) == 0)
+				{
+					++tile.instanceCount;
+					tile.objects.push_back(placement.object);
+				}
+			}
+
+			std::sort(tile.objects.begin(), tile.objects.end());
+			tile.objects.erase(std::unique(tile.objects.begin(), tile.objects.end()), tile.objects.end());
+		}
+
+		// Nothing is in flight yet, so the indices of every streamed model can go right away
+		m_objects.resize(placements.objects().size());
+		for (std::uint32_t object{ 0 }; object < m_objects.size(); ++object)
+		{
+			RenderObject& renderObject{ renderObjects[object] };
+			StreamedObject& streamed{ m_objects[object] };
+			streamed.streamable = m_packObjects[object] != noPackObject && object != placements.skyboxObject() && renderObject.indexCount() > 0;
+			if (streamed.streamable)
+			{
+				streamed.bytes = renderObject.indexCount() * sizeof(std::uint32_t);
+				renderObject.releaseIndices();
+			}
+		}
+	}
+
+	WorldStreamer::WorldStreamer(WorldStreamer&& w) noexcept
+	{
+		move(std::move(w));
+	}
+
+	WorldStreamer& WorldStreamer::operator=(WorldStreamer&& w) noexcept
+	{
+		destroy();
+		move(std::move(w));
+		return *this;
+	}
+
+	WorldStreamer::~WorldStreamer()
+	{
+		destroy();
+	}
+
+	void WorldStreamer::update(const glm::vec3& cameraPosition)
+	{
+		if (!m_renderObjects)
+		{
+			return;
+		}
+
+		const Clock::time_point start{ Clock::now() };
+		++m_frame;
+
+		const float cellSize{ m_placements->cellSize() };
+		const glm::ivec2 cameraCell{ static_cast<int>(std::floor(cameraPosition.x / cellSize)), static_cast<int>(std::floor(cameraPosition.z / cellSize)) };
+
+		collectLoads();
+		evictTiles(cameraCell);
+		releaseObjects();
+		uploadObjects();
+		finishTiles();
+		requestTiles(cameraCell);
+
+		if (m_instancesChanged)
+		{
+			m_instances.clear();
+			for (std::uint32_t t{ 0 }; t < m_tiles.size(); ++t)
+			{
+				const Tile& tile{ m_tiles[t] };
+				m_loadedTiles[t] = tile.state == TileState::Loaded ? 1 : 0;
+				if (tile.state == TileState::Loaded)
+				{
+					m_instances.insert(m_instances.end(), tile.instances.begin(), tile.instances.end());
+				}
+			}
+			m_instancesChanged = false;
+		}
+
+		const float milliseconds{ std::chrono::duration<float, std::milli>{ Clock::now() - start }.count() };
+		if (milliseconds > m_settings.hitchMilliseconds)
+		{
+			std::cout << "world streaming hitch: update took " << milliseconds << " ms\n";
+			++m_hitches;
+		}
+	}
+
+	VkDeviceSize WorldStreamer::residentBytes() const
+	{
+		VkDeviceSize bytes{ 0 };
+		for (const Tile& tile : m_tiles)
+		{
+			if (tile.state == TileState::Loaded)
+			{
+				bytes += tile.instanceCount * sizeof(RenderObjectInstance);
+			}
+		}
+		for (std::uint32_t object{ 0 }; object < m_objects.size(); ++object)
+		{
+			if (m_objects[object].streamable && (*m_renderObjects)[object].indicesResident())
+			{
+				bytes += m_objects[object].bytes;
+			}
+		}
+		return bytes;
+	}
+
+	void WorldStreamer::printStatistics() const
+	{
+		if (!m_renderObjects)
+		{
+			return;
+		}
+
+		const auto loaded{ std::count_if(m_tiles.begin(), m_tiles.end(), [](const Tile& tile) { return tile.state == TileState::Loaded; }) };
+		std::cout << "world streaming: " << loaded << " of " << m_tiles.size() << " tiles loaded, "
+			<< residentBytes() / (1024 * 1024) << " MiB resident of " << m_settings.budget / (1024 * 1024) << " MiB budget, "
+			<< m_tilesStreamedIn << " tiles streamed in, " << m_tilesEvicted << " evicted, " << m_hitches << " hitches\n";
+	}
+
+	std::uint32_t WorldStreamer::distance(std::uint32_t tile, const glm::ivec2& cameraCell) const
+	{
+		const PlacementCell& cell{ m_placements->cells()[tile] };
+		return static_cast<std::uint32_t>(std::max(std::abs(cell.x - cameraCell.x), std::abs(cell.z - cameraCell.y)));
+	}
+
+	bool WorldStreamer::objectReady(std::uint32_t object) const
+	{
+		const StreamedObject& streamed{ m_objects[object] };
+		return !streamed.streamable || ((*m_renderObjects)[object].indicesResident() && m_uploader->isComplete(streamed.upload));
+	}
+
+	void WorldStreamer::collectLoads()
+	{
+		while (auto result{ m_loads->tryPop() })
+		{
+			--m_pendingLoads;
+
+			// Models are kept for whichever tile still wants them, even if the one that read them is gone
+			for (auto& [object, indices] : result->second.objects)
+			{
+				StreamedObject& streamed{ m_objects[object] };
+				streamed.reading = false;
+				if (streamed.references > 0 && !(*m_renderObjects)[object].indicesResident())
+				{
+					streamed.indices = std::move(indices);
+				}
+			}
+
+			Tile& tile{ m_tiles[result->first] };
+			if (tile.state == TileState::Loading && !tile.decoded)
+			{
+				tile.instances = std::move(result->second.instances);
+				tile.decoded = true;
+			}
+		}
+	}
+
+	void WorldStreamer::releaseObjects()
+	{
+		// The frame in flight during the update that dropped a model may still draw it, but it has finished by the next one
+		for (std::uint32_t object{ 0 }; object < m_objects.size(); ++object)
+		{
+			StreamedObject& streamed{ m_objects[object] };
+			RenderObject& renderObject{ (*m_renderObjects)[object] };
+			if (streamed.streamable && streamed.references == 0 && renderObject.indicesResident() && streamed.unusedSince < m_frame &&
+				m_uploader->isComplete(streamed.upload))
+			{
+				renderObject.releaseIndices();
+				m_arenaFull = false;
+			}
+		}
+	}
+
+	void WorldStreamer::uploadObjects()
+	{
+		VkDeviceSize uploaded{ 0 };
+		std::vector<std::uint32_t> staged{};
+		for (std::uint32_t object{ 0 }; object < m_objects.size() && uploaded < m_settings.uploadBytesPerFrame; ++object)
+		{
+			StreamedObject& streamed{ m_objects[object] };
+			if (streamed.indices.empty())
+			{
+				continue;
+			}
+
+			// Growing the arena would reallocate the index buffer under the frame in flight, so the model waits for evictions instead
+			RenderObject& renderObject{ (*m_renderObjects)[object] };
+			if (!m_geometry->fits(renderObject.indexCount()))
+			{
+				if (!m_arenaFull)
+				{
+					std::cerr << "world streaming: no room left in the geometry arena, waiting for tiles to be evicted\n";
+					m_arenaFull = true;
+				}
+				continue;
+			}
+
+			renderObject.restoreIndices(streamed.indices.data());
+			streamed.indices = {};
+			uploaded += streamed.bytes;
+			staged.push_back(object);
+		}
+
+		if (staged.empty())
+		{
+			return;
+		}
+
+		const std::uint64_t upload{ m_uploader->flush() };
+		for (std::uint32_t object : staged)
+		{
+			m_objects[object].upload = upload;
+		}
+	}
+
+	void WorldStreamer::finishTiles()
+	{
+		const Clock::time_point now{ Clock::now() };
+		for (std::uint32_t t{ 0 }; t < m_tiles.size(); ++t)
+		{
+			Tile& tile{ m_tiles[t] };
+			if (tile.state != TileState::Loading || !tile.decoded ||
+				!std::all_of(tile.objects.begin(), tile.objects.end(), [this](std::uint32_t object) { return objectReady(object); }))
+			{
+				continue;
+			}
+
+			tile.state = TileState::Loaded;
+			m_instancesChanged = true;
+			++m_tilesStreamedIn;
+
+			// The camera got close before the tile was there, so something near it popped in late
+			if (tile.needed)
+			{
+				const float milliseconds{ std::chrono::duration<float, std::milli>{ now - tile.neededSince }.count() };
+				if (milliseconds > m_settings.hitchMilliseconds)
+				{
+					const PlacementCell& cell{ m_placements->cells()[t] };
+					std::cout << "world streaming hitch: tile (" << cell.x << ", " << cell.z << ") arrived " << milliseconds
+						<< " ms after the camera reached it\n";
+					++m_hitches;
+				}
+			}
+		}
+	}
+
+	void WorldStreamer::evictTiles(const glm::ivec2& cameraCell)
+	{
+		for (std::uint32_t t{ 0 }; t < m_tiles.size(); ++t)
+		{
+			if (m_tiles[t].state != TileState::Unloaded && distance(t, cameraCell) > m_settings.unloadRadius)
+			{
+				unloadTile(t);
+			}
+		}
+
+		// Over budget, the furthest tiles outside the load radius go first. The ones inside it are never evicted,
+		// since they would only be requested again.
+		while (residentBytes() > m_settings.budget)
+		{
+			std::uint32_t furthest{ ~0u };
+			for (std::uint32_t t{ 0 }; t < m_tiles.size(); ++t)
+			{
+				if (m_tiles[t].state == TileState::Loaded && distance(t, cameraCell) > m_settings.loadRadius &&
+					(furthest == ~0u || distance(t, cameraCell) > distance(furthest, cameraCell)))
+				{
+					furthest = t;
+				}
+			}
+			if (furthest == ~0u)
+			{
+				break;
+			}
+			unloadTile(furthest);
+		}
+	}
+
+	void WorldStreamer::requestTiles(const glm::ivec2& cameraCell)
+	{
+		const Clock::time_point now{ Clock::now() };
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> wanted{};
+		for (std::uint32_t t{ 0 }; t < m_tiles.size(); ++t)
+		{
+			Tile& tile{ m_tiles[t] };
+			const std::uint32_t tileDistance{ distance(t, cameraCell) };
+
+			const bool needed{ tileDistance <= 1 && tile.state != TileState::Loaded && tile.instanceCount > 0 };
+			if (needed && !tile.needed)
+			{
+				tile.neededSince = now;
+			}
+			tile.needed = needed;
+
+			if (tile.state == TileState::Unloaded && tile.instanceCount > 0 && tileDistance <= m_settings.loadRadius)
+			{
+				wanted.push_back({ tileDistance, t });
+			}
+		}
+
+		// Nearest first. A tile that doesn't fit the budget holds back the ones behind it, so the rings fill from the inside.
+		std::sort(wanted.begin(), wanted.end());
+		VkDeviceSize committed{ committedBytes() };
+		for (const auto& [tileDistance, t] : wanted)
+		{
+			if (m_pendingLoads >= m_settings.maxPendingTiles)
+			{
+				break;
+			}
+
+			VkDeviceSize cost{ m_tiles[t].instanceCount * sizeof(RenderObjectInstance) };
+			for (std::uint32_t object : m_tiles[t].objects)
+			{
+				const StreamedObject& streamed{ m_objects[object] };
+				if (streamed.streamable && streamed.references == 0 && !(*m_renderObjects)[object].indicesResident())
+				{
+					cost += streamed.bytes;
+				}
+			}
+			if (committed + cost > m_settings.budget)
+			{
+				break;
+			}
+
+			committed += cost;
+			loadTile(t);
+		}
+	}
+
+	void WorldStreamer::loadTile(std::uint32_t t)
+	{
+		Tile& tile{ m_tiles[t] };
+		tile.state = TileState::Loading;
+		tile.decoded = false;
+
+		struct ObjectRead
+		{
+			std::uint32_t object{};
+			std::uint32_t packObject{};
+			std::uint32_t rebase{};
+		};
+		std::vector<ObjectRead> reads{};
+		for (std::uint32_t object : tile.objects)
+		{
+			StreamedObject& streamed{ m_objects[object] };
+			++streamed.references;
+
+			const RenderObject& renderObject{ (*m_renderObjects)[object] };
+			if (streamed.streamable && !renderObject.indicesResident() && streamed.indices.empty() && !streamed.reading)
+			{
+				streamed.reading = true;
+				const std::uint32_t packObject{ m_packObjects[object] };
+				reads.push_back({ object, packObject, renderObject.firstVertex - m_pack->objects()[packObject].firstVertex });
+			}
+		}
+
+		++m_pendingLoads;
+		m_pool->submit([loads = m_loads.get(), placements = m_placements, pack = m_pack, t, count = tile.instanceCount, reads = std::move(reads)]
+		{
+			TileLoad load{};
+
+			const PlacementCell& cell{ placements->cells()[t] };
+			std::vector<RenderObjectInstance> decoded(cell.placementCount);
+			placements->decodeCell(t, decoded.data());
+			load.instances.reserve(count);
+			std::copy_if(decoded.begin(), decoded.end(), std::back_inserter(load.instances),
+				[](const RenderObjectInstance& instance) { return !instance.isStatic; });
+
+			// Pack indices point into the pack's vertex section, the model's vertices are elsewhere in the vertex buffer
+			for (const ObjectRead& read : reads)
+			{
+				const PackObject& packObject{ pack->objects()[read.packObject] };
+				std::vector<std::uint32_t> indices{};
+				for (const PackMesh& packMesh : pack->meshes().subspan(packObject.firstMesh, packObject.meshCount))
+				{
+					for (std::uint32_t index : pack->indices().subspan(packMesh.firstIndex, packMesh.indexCount))
+					{
+						indices.push_back(index + read.rebase);
+					}
+				}
+				load.objects.emplace_back(read.object, std::move(indices));
+			}
+
+			loads->push(t, std::move(load));
+		});
+	}
+
+	void WorldStreamer::unloadTile(std::uint32_t t)
+	{
+		Tile& tile{ m_tiles[t] };
+		if (tile.state == TileState::Loaded)
+		{
+			m_instancesChanged = true;
+			++m_tilesEvicted;
+		}
+
+		tile.state = TileState::Unloaded;
+		tile.decoded = false;
+		tile.needed = false;
+		tile.instances = {};
+
+		for (std::uint32_t object : tile.objects)
+		{
+			StreamedObject& streamed{ m_objects[object] };
+			if (--streamed.references == 0)
+			{
+				streamed.indices = {};
+				streamed.unusedSince = m_frame;
+			}
+		}
+	}
+
+	VkDeviceSize WorldStreamer::committedBytes() const
+	{
+		VkDeviceSize bytes{ 0 };
+		for (const Tile& tile : m_tiles)
+		{
+			if (tile.state != TileState::Unloaded)
+			{
+				bytes += tile.instanceCount * sizeof(RenderObjectInstance);
+			}
+		}
+		for (std::uint32_t object{ 0 }; object < m_objects.size(); ++object)
+		{
+			const StreamedObject& streamed{ m_objects[object] };
+			if (streamed.streamable && (streamed.references > 0 || (*m_renderObjects)[object].indicesResident()))
+			{
+				bytes += streamed.bytes;
+			}
+		}
+		return bytes;
+	}
+
+	void WorldStreamer::move(WorldStreamer&& w)
+	{
+		m_settings = w.m_settings;
+		m_tiles = std::move(w.m_tiles);
+		m_objects = std::move(w.m_objects);
+		m_packObjects = std::move(w.m_packObjects);
+		m_frame = w.m_frame;
+		m_pendingLoads = w.m_pendingLoads;
+		m_instancesChanged = w.m_instancesChanged;
+		m_arenaFull = w.m_arenaFull;
+
+		m_instances = std::move(w.m_instances);
+		m_loadedTiles = std::move(w.m_loadedTiles);
+
+		m_tilesStreamedIn = w.m_tilesStreamedIn;
+		m_tilesEvicted = w.m_tilesEvicted;
+		m_hitches = w.m_hitches;
+
+		m_loads = std::move(w.m_loads);
+		m_pool = std::move(w.m_pool);
+
+		m_placements = w.m_placements;
+		m_pack = w.m_pack;
+		m_renderObjects = w.m_renderObjects;
+		m_geometry = w.m_geometry;
+		m_uploader = w.m_uploader;
+
+		w.m_renderObjects = nullptr;
+	}
+
+	void WorldStreamer::destroy()
+	{
+		// Joins the worker before the queue it pushes into goes away
+		m_pool.reset();
+		m_loads.reset();
+	}
+
+}
\ No newline at end of file
@@ -0,0 +1,159 @@
+#pragma once
+
+#include "geometry_arena.hpp"
+#include "mesh.hpp"
+#include "scene_pack.hpp"
+#include "scene_placement.hpp"
+#include "thread_pool.hpp"
+#include "upload.hpp"
+
+#include "volk/volk.h"
+#include "glm/glm.hpp"
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <span>
+#include <utility>
+#include <vector>
+
+namespace Graphics
+{
+
+	struct WorldStreamingSettings
+	{
+		std::uint32_t loadRadius{ 2 };                        // Tiles this many cells or fewer from the camera's are loaded, nearest first
+		std::uint32_t unloadRadius{ 4 };                      // Loaded tiles are kept until they are further away than this
+		VkDeviceSize  budget{ 128ull * 1024 * 1024 };         // Bytes of streamed indices and instances allowed to be resident
+		VkDeviceSize  uploadBytesPerFrame{ 4ull * 1024 * 1024 };
+		std::uint32_t maxPendingTiles{ 4 };
+		float         hitchMilliseconds{ 2.0f };              // Updates, and tiles arriving after the camera, slower than this are logged
+	};
+
+	// Streams the world in tiles, one per cell of the placement file. A tile is the cell's dynamic placements; the static
+	// ones are baked by the static batch at load, and the HLOD builds the proxy drawn while the tile isn't loaded. Tiles in rings around the camera are decoded on a worker thread, together
+	// with the indices of the scene pack models they use that aren't resident, and uploaded a few per frame. Tiles beyond the
+	// unload radius are dropped, as are tiles between the two radii while over budget, and a model's indices are freed once
+	// no tile uses it.
+	class WorldStreamer
+	{
+	public:
+		WorldStreamer() = default;
+
+		// Render object i draws placement object i. packObjects maps each placement object to its object in the pack, or to
+		// noPackObject; models not in the pack, and the skybox, stay resident. The others have their indices freed here.
+		// Everything passed in must outlive the streamer.
+		WorldStreamer(const WorldStreamingSettings& settings, const PlacementFile& placements, const ScenePack& pack,
+			std::span<const std::uint32_t> packObjects, std::vector<RenderObject>& renderObjects, GeometryArena& geometry, UploadManager& uploader);
+
+		WorldStreamer(const WorldStreamer&) = delete;
+		WorldStreamer& operator=(const WorldStreamer&) = delete;
+
+		WorldStreamer(WorldStreamer&& w) noexcept;
+		WorldStreamer& operator=(WorldStreamer&& w) noexcept;
+
+		~WorldStreamer();
+
+		// Call once per frame, after waiting for the frame about to be recorded
+		void update(const glm::vec3& cameraPosition);
+
+		// The instances of every loaded tile, all dynamic
+		const std::vector<RenderObjectInstance>& instances() const
+		{
+			return m_instances;
+		}
+		// One flag per tile, set while its instances are among instances()
+		const std::vector<std::uint8_t>& loadedTiles() const
+		{
+			return m_loadedTiles;
+		}
+
+		VkDeviceSize residentBytes() const;
+
+		void printStatistics() const;
+
+	private:
+		using Clock = std::chrono::steady_clock;
+
+		enum class TileState
+		{
+			Unloaded,
+			Loading,
+			Loaded,
+		};
+
+		struct Tile
+		{
+			TileState                         state{ TileState::Unloaded };
+			std::vector<std::uint32_t>        objects{}; // Used by its dynamic placements
+			std::uint32_t                     instanceCount{};
+			std::vector<RenderObjectInstance> instances{};
+			bool                              decoded{ false };
+			bool                              needed{ false }; // The camera is within a cell of it
+			Clock::time_point                 neededSince{};
+		};
+
+		struct StreamedObject
+		{
+			bool                       streamable{ false };
+			std::uint32_t              references{}; // Tiles loading or loaded that use it
+			bool                       reading{ false };
+			std::vector<std::uint32_t> indices{};    // Read, waiting to be uploaded
+			std::uint64_t              upload{};
+			std::uint64_t              unusedSince{};
+			VkDeviceSize               bytes{};
+		};
+
+		struct TileLoad
+		{
+			std::vector<RenderObjectInstance>                                 instances{};
+			std::vector<std::pair<std::uint32_t, std::vector<std::uint32_t>>> objects{};
+		};
+
+		WorldStreamingSettings      m_settings{};
+		std::vector<Tile>           m_tiles{};
+		std::vector<StreamedObject> m_objects{};
+		std::vector<std::uint32_t>  m_packObjects{};
+		std::uint64_t               m_frame{};
+		std::uint32_t               m_pendingLoads{};
+		bool                        m_instancesChanged{ false };
+		bool                        m_arenaFull{ false };
+
+		std::vector<RenderObjectInstance> m_instances{};
+		std::vector<std::uint8_t>         m_loadedTiles{};
+
+		std::size_t m_tilesStreamedIn{};
+		std::size_t m_tilesEvicted{};
+		std::size_t m_hitches{};
+
+		// Results outlive the pool, so its worker never pushes into a destroyed queue
+		std::unique_ptr<CompletionQueue<TileLoad>> m_loads{};
+		std::unique_ptr<ThreadPool>                m_pool{};
+
+		// Not owned by the class
+		const PlacementFile*       m_placements{};
+		const ScenePack*           m_pack{};
+		std::vector<RenderObject>* m_renderObjects{};
+		GeometryArena*             m_geometry{};
+		UploadManager*             m_uploader{};
+
+		std::uint32_t distance(std::uint32_t tile, const glm::ivec2& cameraCell) const;
+		bool objectReady(std::uint32_t object) const;
+
+		void collectLoads();
+		void releaseObjects();
+		void uploadObjects();
+		void finishTiles();
+		void evictTiles(const glm::ivec2& cameraCell);
+		void requestTiles(const glm::ivec2& cameraCell);
+
+		void loadTile(std::uint32_t tile);
+		void unloadTile(std::uint32_t tile);
+		VkDeviceSize committedBytes() const;
+
+		void move(WorldStreamer&& w);
+		void destroy();
+	};
+
+}
\ No newline at end of file